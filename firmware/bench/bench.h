@@ -0,0 +1,89 @@
+/**
+ * Kaldor IIoT - Host Benchmark Helpers
+ *
+ * Minimal timing harness for the host-side benchmarks in this directory.
+ * Each result is printed as one JSON object per line so runs can be
+ * collected and compared by scripts.
+ *
+ * Every result also carries ref_ns, the time of a fixed reference loop
+ * measured right after it. Shared CI runners change speed from minute to
+ * minute (frequency scaling, noisy neighbours); bench_check compares
+ * ns_per_op / ref_ns so that drift cancels out.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <chrono>
+#include <stdio.h>
+#include <stdint.h>
+
+// Keeps the optimiser from discarding a computed value.
+template <typename T>
+inline void benchKeep(const T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+/**
+ * Nanoseconds for a fixed mix of integer, float and memory work (best of
+ * five ~50 µs runs). Only meaningful relative to another call on the same
+ * build.
+ */
+inline double benchReference() {
+    static uint32_t table[256];
+    double best = 0;
+    for (int run = 0; run < 5; run++) {
+        uint32_t x = 12345;
+        float acc = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < 20000; i++) {
+            x = x * 1664525u + 1013904223u;
+            table[x >> 24] += x;
+            acc = acc * 0.999f + (float)(x & 0xFFFF);
+        }
+        double ns = std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - start).count();
+        benchKeep(acc);
+        if (run == 0 || ns < best) best = ns;
+    }
+    return best;
+}
+
+/** Print one result line (for benchmarks that do their own timing). */
+inline void benchReport(const char* name, uint32_t iterations, double nsPerOp) {
+    printf("{\"bench\":\"%s\",\"iterations\":%u,\"ns_per_op\":%.2f,\"ref_ns\":%.0f}\n",
+           name, (unsigned)iterations, nsPerOp, benchReference());
+}
+
+/**
+ * Run `fn(i)` for `iterations` iterations after a short warm-up and print
+ * the cost per iteration: ns_per_op from the fastest of up to 100 equal
+ * chunks, which drops chunks that lost the CPU to another process, and
+ * mean_ns over the whole run. Returns ns_per_op.
+ */
+template <typename Fn>
+double benchRun(const char* name, uint32_t iterations, Fn fn) {
+    for (uint32_t i = 0; i < iterations / 10; i++) fn(i);
+
+    uint32_t chunks = iterations < 100 ? iterations : 100;
+    uint32_t perChunk = iterations / chunks;
+    double total = 0;
+    double best = 0;
+    uint32_t i = 0;
+    for (uint32_t c = 0; c < chunks; c++) {
+        uint32_t end = c + 1 == chunks ? iterations : i + perChunk;
+        uint32_t count = end - i;
+        auto start = std::chrono::steady_clock::now();
+        for (; i < end; i++) fn(i);
+        double ns = std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - start).count();
+        total += ns;
+        if (c == 0 || ns / count < best) best = ns / count;
+    }
+
+    printf("{\"bench\":\"%s\",\"iterations\":%u,\"ns_per_op\":%.2f,\"mean_ns\":%.2f,\"ref_ns\":%.0f}\n",
+           name, (unsigned)iterations, best, total / iterations, benchReference());
+    return best;
+}
+
+#endif // BENCH_H
@@ -0,0 +1,129 @@
+/**
+ * Kaldor IIoT - Benchmark regression check
+ *
+ * Compares benchmark results (JSON lines as printed by benchRun()) with the
+ * stored baselines and fails if any benchmark got slower than allowed.
+ * Results that carry ref_ns (see bench.h) are compared as ns_per_op /
+ * ref_ns, so a runner that is slower overall does not count as a
+ * regression. When a benchmark appears more than once (repeated runs),
+ * the fastest result is used on both sides, which keeps scheduler noise
+ * out.
+ *
+ *   bench_check baseline.jsonl results.jsonl [tolerance]
+ *   bench_check --best results.jsonl > baseline.jsonl
+ *
+ * tolerance is the allowed slowdown as a fraction (default 0.5). Prints
+ * one JSON line per benchmark; exits 1 on a regression, 2 on bad input.
+ * --best prints the fastest result per benchmark in the baseline format.
+ */
+
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <string.h>
+
+struct Result {
+    double ns;
+    double refNs;       // 0 if the line had no reference time
+
+    /** What gets compared: relative to the reference when there is one. */
+    double score() const { return refNs > 0 ? ns / refNs : ns; }
+};
+
+typedef std::map<std::string, Result> Results;
+
+/** The string value of "key" in a one-line JSON object, or "" if absent. */
+static std::string stringField(const char* line, const char* key) {
+    std::string needle = std::string("\"") + key + "\":\"";
+    const char* at = strstr(line, needle.c_str());
+    if (!at) return "";
+    at += needle.size();
+    const char* end = strchr(at, '"');
+    return end ? std::string(at, end - at) : "";
+}
+
+static bool numberField(const char* line, const char* key, double& value) {
+    std::string needle = std::string("\"") + key + "\":";
+    const char* at = strstr(line, needle.c_str());
+    if (!at) return false;
+    char* end;
+    value = strtod(at + needle.size(), &end);
+    return end != at + needle.size();
+}
+
+/** Best ns_per_op per benchmark; lines without one are ignored. */
+static bool load(const char* path, Results& out) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "bench_check: cannot open %s\n", path);
+        return false;
+    }
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) {
+        std::string name = stringField(line, "bench");
+        Result r;
+        if (name.empty() || !numberField(line, "ns_per_op", r.ns)) continue;
+        if (!numberField(line, "ref_ns", r.refNs)) r.refNs = 0;
+        Results::iterator it = out.find(name);
+        if (it == out.end() || r.score() < it->second.score()) out[name] = r;
+    }
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc == 3 && strcmp(argv[1], "--best") == 0) {
+        Results best;
+        if (!load(argv[2], best)) return 2;
+        for (Results::const_iterator it = best.begin(); it != best.end(); ++it) {
+            printf("{\"bench\":\"%s\",\"ns_per_op\":%.2f,\"ref_ns\":%.0f}\n",
+                   it->first.c_str(), it->second.ns, it->second.refNs);
+        }
+        return 0;
+    }
+    if (argc < 3 || argc > 4) {
+        fprintf(stderr, "usage: %s baseline.jsonl results.jsonl [tolerance]\n"
+                        "       %s --best results.jsonl\n", argv[0], argv[0]);
+        return 2;
+    }
+    double tolerance = argc == 4 ? strtod(argv[3], nullptr) : 0.5;
+
+    Results baseline, current;
+    if (!load(argv[1], baseline) || !load(argv[2], current)) return 2;
+
+    int regressions = 0;
+    for (Results::const_iterator it = current.begin(); it != current.end(); ++it) {
+        Results::const_iterator base = baseline.find(it->first);
+        if (base == baseline.end()) {
+            printf("{\"bench\":\"%s\",\"ns_per_op\":%.2f,\"status\":\"new\"}\n",
+                   it->first.c_str(), it->second.ns);
+            continue;
+        }
+        const Result& now = it->second;
+        const Result& then = base->second;
+        double change;
+        if (now.refNs > 0 && then.refNs > 0) {
+            change = now.score() / then.score() - 1.0;
+        } else {
+            change = then.ns > 0 ? now.ns / then.ns - 1.0 : 0.0;
+        }
+        const char* status = "ok";
+        if (change > tolerance) {
+            status = "regression";
+            regressions++;
+        } else if (change < -tolerance) {
+            status = "improved";
+        }
+        printf("{\"bench\":\"%s\",\"baseline_ns\":%.2f,\"ns_per_op\":%.2f,\"change_pct\":%.1f,\"status\":\"%s\"}\n",
+               it->first.c_str(), then.ns, now.ns, change * 100.0, status);
+    }
+    for (Results::const_iterator it = baseline.begin(); it != baseline.end(); ++it) {
+        if (current.find(it->first) == current.end()) {
+            printf("{\"bench\":\"%s\",\"status\":\"missing\"}\n", it->first.c_str());
+        }
+    }
+
+    fprintf(stderr, "bench_check: %d regression(s) beyond +%.0f%%\n", regressions, tolerance * 100.0);
+    return regressions ? 1 : 0;
+}
@@ -0,0 +1,59 @@
+/**
+ * Kaldor IIoT - MQTT session benchmark
+ *
+ * Cost per raw-sample message through MqttSession: queueing, encoding,
+ * writing and (QoS 1) settling the PUBACK, against the in-process broker
+ * in hal_sim.h. The broker parses every packet, so the session results
+ * include its share; mqtt_codec/encode_publish is the encoder alone.
+ */
+
+#include <string.h>
+#include "bench.h"
+#include "hal_sim.h"
+#include "mqtt_session.h"
+
+static const uint32_t ITERATIONS = 200000;
+static const char* TOPIC = "kaldor/loom/LOOM-001/bbw/raw";
+static const char* PAYLOAD =
+    "{\"timestamp\":1234567890,\"seq\":42,\"bbw\":125.43,\"bbw_min\":123.10,"
+    "\"bbw_max\":127.80,\"quality\":100}";
+
+alignas(4) static uint8_t controlQueue[MQTT_QUEUE_CONTROL_BYTES];
+alignas(4) static uint8_t liveQueue[MQTT_QUEUE_LIVE_BYTES];
+alignas(4) static uint8_t bulkQueue[MQTT_QUEUE_BULK_BYTES];
+
+static void benchSession(const char* name, uint8_t qos) {
+    SimClock clock;
+    SimBrokerStream broker(clock);
+    MqttSession session(broker, clock);
+    session.setQueue(MqttPriority::Control, controlQueue, sizeof(controlQueue));
+    session.setQueue(MqttPriority::Live, liveQueue, sizeof(liveQueue));
+    session.setQueue(MqttPriority::Bulk, bulkQueue, sizeof(bulkQueue));
+    session.setWindow(MQTT_INFLIGHT_WINDOW);
+    session.connect("sim", 1883, "bench", nullptr, nullptr);
+    session.loop();
+
+    benchRun(name, ITERATIONS, [&](uint32_t i) {
+        (void)i;
+        session.publish(TOPIC, PAYLOAD, false, qos, MqttPriority::Live);
+        session.loop();
+    });
+    benchKeep(broker.publishes());
+    if (session.stats().rejected) {
+        fprintf(stderr, "%s: %u messages rejected\n", name, (unsigned)session.stats().rejected);
+    }
+}
+
+int main() {
+    benchSession("mqtt_session/publish_loop_qos0", 0);
+    benchSession("mqtt_session/publish_loop_qos1", 1);
+
+    static uint8_t packet[256];
+    size_t payloadLength = strlen(PAYLOAD);
+    benchRun("mqtt_codec/encode_publish", ITERATIONS * 10, [&](uint32_t i) {
+        benchKeep(mqttEncodePublish(packet, TOPIC, (const uint8_t*)PAYLOAD, payloadLength, 1,
+                                    false, (uint16_t)(i | 1)));
+    });
+
+    return 0;
+}
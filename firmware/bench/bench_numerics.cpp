@@ -0,0 +1,52 @@
+/**
+ * Kaldor IIoT - Acquisition arithmetic benchmark
+ *
+ * The per-sample arithmetic from the echo time to the rolling statistics
+ * (echo to mm, calibration, rolling mean and standard deviation) in float,
+ * as the firmware does it, and the same code in double. On the host both
+ * run in hardware, so the gap here is small; on the ESP32 every double
+ * operation is a call into the software float library. The on-device cost
+ * per sample is in the sensor_read and stats stage timings.
+ */
+
+#include "bench.h"
+#include "echo_capture.h"
+#include "rolling_window.h"
+
+static const uint32_t ITERATIONS = 1000000;
+
+template <typename T>
+struct AcquisitionPath {
+    RollingWindow<T, 100> window;
+    T mmPerUs = (T)speedOfSound(24.5f) / 2;
+    T offset = (T)1.5f;
+    T scale = (T)1.02f;
+
+    T step(uint32_t echoUs) {
+        T mm = ((T)echoUs * mmPerUs + offset) * scale;
+        window.push(mm);
+        return window.stddev();
+    }
+};
+
+template <typename T>
+static void benchPath(const char* name) {
+    AcquisitionPath<T> path;
+    benchRun(name, ITERATIONS, [&](uint32_t i) {
+        T stddev = path.step(600 + (i * 2654435761u >> 24));
+        benchKeep(stddev);
+    });
+}
+
+int main() {
+    benchPath<float>("numerics/sample_float");
+    benchPath<double>("numerics/sample_double");
+
+    // Once per temperature reading (1 Hz)
+    benchRun("numerics/speed_of_sound", ITERATIONS, [&](uint32_t i) {
+        float c = speedOfSound((float)(i & 127) * 0.5f - 20.0f);
+        benchKeep(c);
+    });
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+/**
+ * Kaldor IIoT - OTA image benchmark
+ *
+ * Decoding a 256 KiB firmware from a packed and from a delta image into a
+ * FirmwarePort that discards the bytes, fed in OTA_CHUNK_BYTES pieces as
+ * the OTA task does. On the board the flash writes dominate (some 100 µs
+ * per KiB); decoding should stay well below that.
+ */
+
+#include <string.h>
+#include <vector>
+#include "bench.h"
+#include "ota_image.h"
+
+static const size_t FIRMWARE_SIZE = 256 * 1024;
+
+/** Keeps nothing; base reads come from the running image. */
+class NullFirmware : public FirmwarePort {
+public:
+    explicit NullFirmware(const std::vector<uint8_t>& running) : sum(0), image(running) {}
+    bool readRunning(uint32_t offset, uint8_t* data, size_t length) override {
+        if (offset + length > image.size()) return false;
+        memcpy(data, image.data() + offset, length);
+        return true;
+    }
+    bool begin(uint32_t) override { return true; }
+    bool write(const uint8_t* data, size_t length) override {
+        sum += data[0] + length;
+        return true;
+    }
+    bool finish() override { return true; }
+    void abort() override {}
+
+    uint32_t sum;
+
+private:
+    const std::vector<uint8_t>& image;
+};
+
+/** Instruction-like bytes with strings and padding, as in test_ota_image. */
+static std::vector<uint8_t> fakeFirmware(size_t size, uint32_t seed) {
+    static const uint8_t opcodes[][3] = {
+        {0x36, 0x41, 0x00}, {0x1d, 0xf0, 0x00}, {0x0c, 0x02, 0x00},
+        {0x81, 0x00, 0x00}, {0xe0, 0x08, 0x00}, {0x22, 0xa0, 0x00}
+    };
+    std::vector<uint8_t> image;
+    uint32_t state = seed;
+    while (image.size() < size) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        if (state % 50 == 0) {
+            static const char text[] = "sensor read failed";
+            image.insert(image.end(), text, text + sizeof(text));
+        } else if (state % 97 == 0) {
+            image.insert(image.end(), 16 + (state >> 8) % 48, 0xFF);
+        } else {
+            const uint8_t* op = opcodes[(state >> 8) % 6];
+            image.insert(image.end(), op, op + 3);
+            image.back() = (uint8_t)(state >> 16) & 0x0F;
+        }
+    }
+    image.resize(size);
+    return image;
+}
+
+static void benchDecode(const char* name, const std::vector<uint8_t>& packed,
+                        const std::vector<uint8_t>& running) {
+    static uint8_t window[OTA_WINDOW_BYTES];
+    NullFirmware firmware(running);
+    OtaImageDecoder decoder(firmware, window, sizeof(window));
+    benchRun(name, 50, [&](uint32_t) {
+        decoder.begin((uint32_t)packed.size());
+        for (size_t at = 0; at < packed.size(); at += OTA_CHUNK_BYTES) {
+            size_t n = packed.size() - at < OTA_CHUNK_BYTES ? packed.size() - at : OTA_CHUNK_BYTES;
+            decoder.feed(packed.data() + at, n);
+        }
+        benchKeep(decoder.finish());
+    });
+    benchKeep(firmware.sum);
+}
+
+int main() {
+    std::vector<uint8_t> running = fakeFirmware(FIRMWARE_SIZE, 1);
+    std::vector<uint8_t> next = running;
+    for (size_t i = 100000; i < 101000; i++) next[i] ^= 0x5A;
+
+    std::vector<uint8_t> packed = otaImagePack(next.data(), next.size());
+    std::vector<uint8_t> delta = otaImagePack(next.data(), next.size(), running.data(),
+                                              running.size());
+    benchDecode("ota_image/decode_packed_256k", packed, running);
+    benchDecode("ota_image/decode_delta_256k", delta, running);
+    return 0;
+}
@@ -0,0 +1,342 @@
+/**
+ * Kaldor IIoT - Per-stage pipeline benchmark
+ *
+ * Cost per call of each stage a sample passes through, on the production
+ * code with the simulated ports from hal_sim.h:
+ *
+ *   sensors/read            SensorManager::read(): echo poll, calibration,
+ *                           rolling statistics and quality (100-sample window)
+ *   sensors/get_aggregated  the 1 Hz aggregate
+ *   rollup/add_sample       Rollups::add(), closed buckets included
+ *   payload/raw_sample      raw JSON into the static payload buffer
+ *   payload/backlog_batch   one 20-record backlog batch
+ *   payload/rollup          one 1 min rollup bucket
+ *   payload/processed_json  publishTelemetry()'s ArduinoJson document, when
+ *                           ArduinoJson is on the include path; the run
+ *                           fails if it does not fit the payload buffer
+ *   payload/system_diagnostics_json  publishSystemDiagnostics()'s, likewise
+ *   publisher/publish_live  SamplePublisher::publish() while connected
+ *   data_buffer/add_*       DataBuffer::add() in the RAM tier and spilling
+ *                           to the flash journal (MAX_BUFFER_SIZE hot tier)
+ *   data_buffer/save_to_file_1000  persisting a full RAM tier
+ *   data_buffer/read_backlog_20
+ *   timing/stage_record     one StageTimers start/stop pair, the cost of
+ *                           instrumenting a stage
+ *
+ * Needs the sources: see bench/run.sh.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "config.h"
+#include "hal_sim.h"
+#include "sensors.h"
+#include "data_buffer.h"
+#include "sample_publisher.h"
+#include "rollup.h"
+#include "runtime_config_defaults.h"
+#include "vibration_analyzer.h"
+#include "stage_timing.h"
+#include "analog_frontend.h"
+
+#if __has_include(<ArduinoJson.h>)
+#include <ArduinoJson.h>
+#define BENCH_ARDUINOJSON 1
+#else
+#define BENCH_ARDUINOJSON 0
+#endif
+
+void halLog(const char*, ...) {}
+
+static const uint32_t PERIOD_US = 10000;
+
+#if BENCH_ARDUINOJSON
+// The documents of publishTelemetry() and publishSystemDiagnostics() in
+// src/main.cpp, field for field. Counters get large placeholder values, so
+// the sizes are close to the worst case. Returns 0, as the firmware sends
+// nothing, when a document does not fit the payload buffer whole.
+static uint32_t placeholder(uint32_t& value) {
+    value = value * 7 + 3;
+    return value;
+}
+
+static size_t serialized(JsonDocument& doc, char* out, size_t size) {
+    if (doc.overflowed() || measureJson(doc) >= size) return 0;
+    return serializeJson(doc, out, size);
+}
+
+static size_t writeProcessed(char* out, size_t size, const SensorData& data,
+                             const VibrationFeatures& features, const AnalogSummary& analog) {
+    StaticJsonDocument<3072> doc;
+    uint32_t value = 123456;
+    doc["timestamp"] = data.timestamp;
+    doc["device_id"] = "BBW-a1b2c3d4";
+    doc["loom_id"] = "loom-001";
+
+    JsonObject measurements = doc.createNestedObject("measurements");
+    measurements["bbw_avg"] = data.bbw;
+    measurements["bbw_min"] = data.bbw_min;
+    measurements["bbw_max"] = data.bbw_max;
+    measurements["bbw_stddev"] = data.bbw_stddev;
+    measurements["temperature"] = data.temperature;
+    measurements["vibration"] = data.vibration;
+    measurements["motor_current"] = data.motor_current;
+    measurements["warp_tension"] = data.warp_tension;
+
+    static const char* const axisNames[VIBRATION_AXES] = {"x", "y", "z"};
+    JsonObject vibration = doc.createNestedObject("vibration");
+    vibration["timestamp"] = features.timestamp;
+    vibration["rms"] = features.rms;
+    for (size_t a = 0; a < VIBRATION_AXES; a++) {
+        JsonObject axis = vibration.createNestedObject(axisNames[a]);
+        axis["rms"] = features.axis[a].rms;
+        axis["peak"] = features.axis[a].peak;
+        axis["crest"] = features.axis[a].crest;
+        axis["kurtosis"] = features.axis[a].kurtosis;
+    }
+    JsonArray bands = vibration.createNestedArray("band_energy");
+    for (uint8_t b = 0; b < features.bandCount; b++) {
+        bands.add(features.bandEnergy[b]);
+    }
+
+    static const char* const channelNames[ANALOG_CHANNELS] = {
+        "motor_current", "warp_tension"
+    };
+    JsonObject inputs = doc.createNestedObject("analog");
+    inputs["interval_ms"] = analog.intervalMs;
+    inputs["overruns"] = analog.overruns;
+    for (size_t c = 0; c < ANALOG_CHANNELS; c++) {
+        const AnalogChannelSummary& s = analog.channel[c];
+        JsonObject channel = inputs.createNestedObject(channelNames[c]);
+        channel["mean"] = s.mean;
+        channel["min"] = s.minimum;
+        channel["max"] = s.maximum;
+        channel["stddev"] = s.stddev;
+        channel["output_hz"] = s.outputHz;
+        channel["samples"] = s.samples;
+        channel["cpu_us"] = s.cpuUs;
+    }
+
+    static const char* const systemFields[] = {
+        "uptime", "free_heap", "largest_free_block", "min_free_heap", "wifi_rssi",
+        "buffer_size", "buffer_flash", "journal_errors", "backlog_depth",
+        "backlog_drain_rate", "echo_timeouts", "echo_late", "bbw_outliers", "ring_dropped",
+        "ring_high_water", "change_alerts_dropped", "rollups_pending", "rollups_dropped",
+        "sample_interval_ms", "report_sent", "report_suppressed", "vibration_dropped",
+        "accel_fifo_overruns", "accel_read_errors",
+    };
+    JsonObject system = doc.createNestedObject("system");
+    for (const char* field : systemFields) {
+        system[field] = placeholder(value);
+    }
+
+    return serialized(doc, out, size);
+}
+
+static size_t writeSystemDiagnostics(char* out, size_t size) {
+    StaticJsonDocument<2048> doc;
+    uint32_t value = 654321;
+    doc["timestamp"] = placeholder(value);
+    doc["device_id"] = "BBW-a1b2c3d4";
+
+    static const char* const connectionFields[] = {
+        "wifi_joins", "wifi_join_failures", "wifi_losses", "broker_connects",
+        "broker_failures", "join_ms", "connect_ms", "outage_ms", "max_outage_ms",
+        "tls_handshakes", "tls_resumed",
+    };
+    JsonObject net = doc.createNestedObject("connection");
+    for (const char* field : connectionFields) {
+        net[field] = placeholder(value);
+    }
+    net["tls_resumable"] = true;
+
+    static const char* const mqttFields[] = {
+        "queued", "rejected", "sent", "acked", "retransmits", "ack_timeouts", "connects",
+        "disconnects", "in_flight",
+    };
+    JsonObject mqtt = doc.createNestedObject("mqtt");
+    for (const char* field : mqttFields) {
+        mqtt[field] = placeholder(value);
+    }
+    JsonArray queueBytes = mqtt.createNestedArray("queue_bytes");
+    for (uint8_t p = 0; p < (uint8_t)MqttPriority::Count; p++) {
+        queueBytes.add(placeholder(value));
+    }
+
+    static const char* const extraTimings[] = {"sample_jitter", "mqtt_queue", "mqtt_ack"};
+    JsonObject timing = doc.createNestedObject("timing");
+    for (uint8_t s = 0; s < (uint8_t)Stage::Count + 3; s++) {
+        const char* name = s < (uint8_t)Stage::Count ? stageName((Stage)s)
+                                                     : extraTimings[s - (uint8_t)Stage::Count];
+        JsonArray values = timing.createNestedArray(name);
+        for (int k = 0; k < 4; k++) {
+            values.add(placeholder(value));
+        }
+    }
+    doc["missed_deadlines"] = placeholder(value);
+    doc["sample_overruns"] = placeholder(value);
+    doc["payload_overflows"] = placeholder(value);
+
+    return serialized(doc, out, size);
+}
+#endif
+
+int main() {
+    SimClock clock;
+    SimUltrasonic ultrasonic(clock, [](uint32_t ms) {
+        return 120.0f + 0.4f * sinf(6.2831853f * 8.0f * (float)ms / 1000.0f);
+    });
+    SimTemperature thermometer(24.5f);
+    ultrasonic.setAirTemperature(24.5f);
+    SimAccel accel(clock, 0.2f, 25.0f);
+    SensorManager sensors(clock, ultrasonic, thermometer, accel);
+    sensors.begin();
+
+    // Acquisition stages
+    SensorData last;
+    benchRun("sensors/read", 200000, [&](uint32_t) {
+        clock.advance(PERIOD_US);
+        last = sensors.read();
+        benchKeep(last);
+    });
+    benchRun("sensors/get_aggregated", 200000, [&](uint32_t) {
+        SensorData aggregate = sensors.getAggregated();
+        benchKeep(aggregate);
+    });
+    Rollups rollups;
+    RollupBucket closed;
+    closed.clear((uint8_t)RollupLevel::Minute, 0);
+    benchRun("rollup/add_sample", 200000, [&](uint32_t i) {
+        last.timestamp = i * 10;
+        rollups.add(last, [&](const RollupBucket& b) { closed = b; });
+        benchKeep(closed);
+    });
+
+    // Payload serialisation
+    static char buffer[MQTT_MAX_PACKET_SIZE - MQTT_TOPIC_SIZE];
+    PayloadWriter payload(buffer, sizeof(buffer));
+    benchRun("payload/raw_sample", 200000, [&](uint32_t i) {
+        last.timestamp = i * 10;
+        writeRawSample(payload, last, "BBW-a1b2c3d4");
+        benchKeep(buffer);
+    });
+
+    SensorData records[BACKFILL_BATCH_SIZE];
+    uint32_t seqs[BACKFILL_BATCH_SIZE];
+    for (uint32_t i = 0; i < BACKFILL_BATCH_SIZE; i++) {
+        records[i] = last;
+        records[i].timestamp += i * 10;
+        seqs[i] = 1000 + i;
+    }
+    benchRun("payload/backlog_batch", 50000, [&](uint32_t) {
+        writeBacklogBatch(payload, "BBW-a1b2c3d4", "loom-001", records, seqs, BACKFILL_BATCH_SIZE);
+        benchKeep(buffer);
+    });
+    benchRun("payload/rollup", 200000, [&](uint32_t) {
+        writeRollup(payload, closed, "BBW-a1b2c3d4", "loom-001");
+        benchKeep(buffer);
+    });
+
+#if BENCH_ARDUINOJSON
+    VibrationFeatures features = {};
+    features.timestamp = 4000000000u;
+    features.rms = 0.14f;
+    features.bandCount = VIBRATION_MAX_BANDS;
+    for (size_t a = 0; a < VIBRATION_AXES; a++) {
+        features.axis[a] = {0.1f, 0.3f, 3.0f, 2.9f};
+    }
+    for (uint8_t b = 0; b < VIBRATION_MAX_BANDS; b++) {
+        features.bandEnergy[b] = 0.00041f;
+    }
+    AnalogSummary analog = {};
+    analog.intervalMs = 1000;
+    for (size_t c = 0; c < ANALOG_CHANNELS; c++) {
+        analog.channel[c] = {378.41f, 301.17f, 455.03f, 41.73f, 378.4f, 100, 10000, 100, 610};
+    }
+    last.motor_current = 12.13f;
+    last.warp_tension = 378.41f;
+
+    // The firmware drops a document that does not fit: fail the run
+    size_t processedSize = writeProcessed(buffer, sizeof(buffer), last, features, analog);
+    size_t diagnosticsSize = writeSystemDiagnostics(buffer, sizeof(buffer));
+    if (processedSize == 0 || diagnosticsSize == 0) {
+        fprintf(stderr, "bbw/processed or diagnostics/system does not fit %zu bytes\n",
+                sizeof(buffer));
+        return 1;
+    }
+    benchRun("payload/processed_json", 50000, [&](uint32_t) {
+        size_t n = writeProcessed(buffer, sizeof(buffer), last, features, analog);
+        benchKeep(n);
+    });
+    benchRun("payload/system_diagnostics_json", 50000, [&](uint32_t) {
+        size_t n = writeSystemDiagnostics(buffer, sizeof(buffer));
+        benchKeep(n);
+    });
+#else
+    printf("{\"bench\":\"payload/processed_json\",\"skipped\":\"ArduinoJson not on the include path\"}\n");
+    printf("{\"bench\":\"payload/system_diagnostics_json\",\"skipped\":\"ArduinoJson not on the include path\"}\n");
+#endif
+
+    // Publish path against a connected broker stand-in
+    SimBroker broker;
+    DataBuffer buffered;
+    buffered.begin(MAX_BUFFER_SIZE, 0);
+    buffered.clear();
+    Backfill backfill(BACKFILL_INTERVAL_MS, BACKFILL_ACK_TIMEOUT_MS, BACKFILL_WINDOW);
+    ReportFilter filter(REPORT_DEADBAND_MM, REPORT_DEADBAND_PCT, REPORT_MAX_SILENCE_MS);
+    RuntimeConfig config = defaultRuntimeConfig(100);
+    MqttTopics topics;
+    topics.build("loom-001");
+    SamplePublisher publisher(broker, clock, buffered, backfill, filter, config, topics, payload);
+    publisher.begin("BBW-a1b2c3d4", "loom-001", deviceIdHash("BBW-a1b2c3d4"));
+    benchRun("publisher/publish_live", 200000, [&](uint32_t i) {
+        last.timestamp = i * 10;
+        publisher.publish(last);
+    });
+
+    // Instrumentation overhead per timed stage
+    StageTimers timers(clock);
+    benchRun("timing/stage_record", 1000000, [&](uint32_t) {
+        uint32_t started = timers.start();
+        timers.stop(Stage::Publish, started);
+    });
+
+    // Offline buffering: RAM tier, then spilling to the flash journal
+    DataBuffer& store = buffered;
+    store.clear();
+    benchRun("data_buffer/add_ram", MAX_BUFFER_SIZE * 10 / 11, [&](uint32_t i) {
+        last.timestamp = i * 10;
+        store.add(last);
+    });
+    benchRun("data_buffer/add_spill_to_flash", 20000, [&](uint32_t i) {
+        last.timestamp = i * 10;
+        store.add(last);
+    });
+    benchRun("data_buffer/read_backlog_20", 20000, [&](uint32_t i) {
+        uint32_t from = store.oldestSequence() + (i % 1000);
+        size_t n = store.readBacklog(from, records, seqs, BACKFILL_BATCH_SIZE);
+        benchKeep(n);
+    });
+
+    // Persisting a full RAM tier; refilling it is not timed
+    const uint32_t saves = 20;
+    double saveNs = 0;
+    for (uint32_t i = 0; i < saves; i++) {
+        for (uint32_t k = 0; k < MAX_BUFFER_SIZE; k++) {
+            last.timestamp = (i * MAX_BUFFER_SIZE + k) * 10;
+            store.add(last);
+        }
+        auto start = std::chrono::steady_clock::now();
+        bool ok = store.saveToFile();
+        saveNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        benchKeep(ok);
+    }
+    char name[48];
+    snprintf(name, sizeof(name), "data_buffer/save_to_file_%u", (unsigned)MAX_BUFFER_SIZE);
+    benchReport(name, saves, saveNs / saves);
+    store.clear();
+
+    return 0;
+}
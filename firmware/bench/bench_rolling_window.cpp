@@ -0,0 +1,80 @@
+/**
+ * Kaldor IIoT - Rolling statistics benchmark
+ *
+ * Compares the per-sample cost of the former full-window rescan
+ * (updateStatistics() + calculateQuality()) with RollingWindow.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "rolling_window.h"
+
+static const int WINDOW = 100;
+static const uint32_t ITERATIONS = 1000000;
+static float samples[4096];
+
+// Former SensorManager implementation, kept here as the baseline.
+struct RescanStats {
+    float readings[WINDOW] = {};
+    int index = 0;
+    int count = 0;
+    float avg = 0, stddev = 0, minimum = 0, maximum = 0;
+    int invalid = 0;
+
+    void push(float value) {
+        readings[index] = value;
+        index = (index + 1) % WINDOW;
+        if (count < WINDOW) count++;
+
+        float sum = 0, sumSq = 0;
+        minimum = 9999;
+        maximum = -9999;
+        int valid = 0;
+        for (int i = 0; i < count; i++) {
+            float v = readings[i];
+            if (v > 0) {
+                sum += v;
+                sumSq += v * v;
+                minimum = v < minimum ? v : minimum;
+                maximum = v > maximum ? v : maximum;
+                valid++;
+            }
+        }
+        if (valid > 0) {
+            avg = sum / valid;
+            float var = sumSq / valid - avg * avg;
+            stddev = sqrtf(var > 0 ? var : 0);
+        }
+
+        invalid = 0;
+        for (int i = 0; i < count; i++) {
+            if (readings[i] < 0) invalid++;
+        }
+    }
+};
+
+int main() {
+    srand(1);
+    for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); i++) {
+        samples[i] = (rand() % 50) ? 120.0f + (rand() % 1000) / 100.0f : -1.0f;
+    }
+
+    RescanStats rescan;
+    benchRun("rolling_window/rescan_baseline", ITERATIONS, [&](uint32_t i) {
+        rescan.push(samples[i & 4095]);
+        benchKeep(rescan.stddev);
+    });
+
+    RollingWindow<float, WINDOW> window;
+    benchRun("rolling_window/push_and_query", ITERATIONS, [&](uint32_t i) {
+        float v = samples[i & 4095];
+        window.push(v, v > 0);
+        float stddev = window.stddev() + window.minimum() + window.maximum();
+        size_t invalid = window.invalidCount();
+        benchKeep(stddev);
+        benchKeep(invalid);
+    });
+
+    return 0;
+}
@@ -0,0 +1,78 @@
+/**
+ * Kaldor IIoT - Flash journal benchmark
+ *
+ * Per-sample persistence cost of the former DataBuffer::saveToFile()
+ * (rewrite the whole 100-entry buffer every 10 samples) against
+ * SampleJournal appends, on a file-backed store. Also reports the worst
+ * single-call latency, which is what stalls the acquisition loop.
+ */
+
+#include <stdlib.h>
+#include <vector>
+#include "bench.h"
+#include "sample_journal.h"
+
+static const uint32_t SAMPLES = 20000;
+
+static SensorData sample(uint32_t i) {
+    SensorData d = {};
+    d.bbw = 120.0f + (float)(i % 50) * 0.1f;
+    d.quality = 95;
+    d.timestamp = i * 10;
+    return d;
+}
+
+static void printMax(const char* name, double maxNs) {
+    printf("{\"bench\":\"%s\",\"max_ns\":%.0f}\n", name, maxNs);
+}
+
+int main() {
+    char dir[] = "/tmp/kaldor-bench-XXXXXX";
+    if (!mkdtemp(dir)) return 1;
+    char legacyPath[64], prefix[64];
+    snprintf(legacyPath, sizeof(legacyPath), "%s/buffer.dat", dir);
+    snprintf(prefix, sizeof(prefix), "%s/journal-", dir);
+
+    // Former behaviour: vector with erase-from-front, full rewrite every 10
+    std::vector<SensorData> buffer;
+    double legacyMax = 0;
+    benchRun("sample_journal/legacy_full_rewrite", SAMPLES, [&](uint32_t i) {
+        auto start = std::chrono::steady_clock::now();
+        if (buffer.size() >= 100) buffer.erase(buffer.begin());
+        buffer.push_back(sample(i));
+        if (buffer.size() % 10 == 0) {
+            FILE* f = fopen(legacyPath, "w");
+            size_t maxSize = 100, count = buffer.size();
+            fwrite(&maxSize, sizeof(maxSize), 1, f);
+            fwrite(&count, sizeof(count), 1, f);
+            for (const auto& d : buffer) fwrite(&d, sizeof(d), 1, f);
+            fflush(f);
+            fsync(fileno(f));
+            fclose(f);
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        if (ns > legacyMax) legacyMax = ns;
+    });
+    printMax("sample_journal/legacy_full_rewrite_worst", legacyMax);
+
+    FileJournalStore store(prefix);
+    SampleJournal journal(store, 4, 1000, 10);
+    journal.begin();
+    double journalMax = 0;
+    benchRun("sample_journal/append", SAMPLES, [&](uint32_t i) {
+        auto start = std::chrono::steady_clock::now();
+        journal.append(sample(i));
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        if (ns > journalMax) journalMax = ns;
+    });
+    printMax("sample_journal/append_worst", journalMax);
+
+    benchRun("sample_journal/replay_4000", 5, [&](uint32_t) {
+        size_t n = journal.replay([](uint32_t, const SensorData& d) { benchKeep(d); });
+        benchKeep(n);
+    });
+
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    return system(cmd);
+}
@@ -0,0 +1,74 @@
+/**
+ * Kaldor IIoT - Sample buffer benchmark
+ *
+ * Insert cost once the buffer is full: the former DataBuffer
+ * (std::vector with erase-from-front, O(n) per sample) against SampleRing
+ * (O(1) evict), at the old 100-entry size, MAX_BUFFER_SIZE and a PSRAM-
+ * sized warm tier. Also times a bulk read of one backfill batch.
+ */
+
+#include <stdio.h>
+#include <vector>
+#include "bench.h"
+#include "sample_ring.h"
+
+static SensorData sample(uint32_t i) {
+    SensorData d = {};
+    d.bbw = 120.0f + (float)(i % 50) * 0.1f;
+    d.quality = 95;
+    d.timestamp = i * 10;
+    return d;
+}
+
+static void benchVector(size_t capacity, uint32_t iterations) {
+    std::vector<SensorData> buffer;
+    buffer.reserve(capacity);
+    for (size_t i = 0; i < capacity; i++) buffer.push_back(sample((uint32_t)i));
+
+    char name[64];
+    snprintf(name, sizeof(name), "sample_ring/vector_erase_front_%zu", capacity);
+    benchRun(name, iterations, [&](uint32_t i) {
+        if (buffer.size() >= capacity) buffer.erase(buffer.begin());
+        buffer.push_back(sample(i));
+        benchKeep(buffer.front());
+    });
+}
+
+static void benchRing(size_t capacity, uint32_t iterations) {
+    std::vector<SequencedSample> storage(capacity);
+    SampleRing ring;
+    ring.attach(storage.data(), capacity);
+    SequencedSample evicted;
+    for (size_t i = 0; i < capacity; i++) ring.push({(uint32_t)i, sample((uint32_t)i)}, evicted);
+
+    char name[64];
+    snprintf(name, sizeof(name), "sample_ring/ring_evict_%zu", capacity);
+    benchRun(name, iterations, [&](uint32_t i) {
+        ring.push({i, sample(i)}, evicted);
+        benchKeep(evicted);
+    });
+
+    snprintf(name, sizeof(name), "sample_ring/ring_read_batch20_%zu", capacity);
+    benchRun(name, iterations / 10, [&](uint32_t i) {
+        size_t offset = (i * 37) % (capacity > 20 ? capacity - 20 : 1);
+        float sum = 0;
+        size_t got = 0, n;
+        const SequencedSample* run;
+        while (got < 20 && (n = ring.view(offset + got, run)) > 0) {
+            if (n > 20 - got) n = 20 - got;
+            for (size_t k = 0; k < n; k++) sum += run[k].data.bbw;
+            got += n;
+        }
+        benchKeep(sum);
+    });
+}
+
+int main() {
+    const size_t sizes[] = {100, 1000, 60000};
+    for (size_t capacity : sizes) {
+        uint32_t iterations = capacity >= 60000 ? 20000 : 200000;
+        benchVector(capacity, iterations);
+        benchRing(capacity, iterations);
+    }
+    return 0;
+}
@@ -0,0 +1,53 @@
+/**
+ * Kaldor IIoT - SPSC ring benchmark
+ *
+ * Measures the uncontended push+pop cost and the cross-thread hand-off
+ * throughput of SpscRing with a SensorData-sized payload.
+ */
+
+#include <thread>
+#include "bench.h"
+#include "spsc_ring.h"
+
+// Same layout as SensorData in sensors.h (which needs Arduino headers)
+struct Sample {
+    float bbw, bbw_min, bbw_max, bbw_stddev, temperature, vibration;
+    uint8_t quality;
+    unsigned long timestamp;
+};
+
+static const uint32_t ITERATIONS = 2000000;
+
+int main() {
+    static SpscRing<Sample, 256> ring;
+    Sample in = {}, out = {};
+
+    benchRun("spsc_ring/push_pop_same_thread", ITERATIONS, [&](uint32_t i) {
+        in.timestamp = i;
+        ring.push(in);
+        ring.pop(out);
+        benchKeep(out);
+    });
+
+    // One producer thread, consumer on the main thread
+    static SpscRing<Sample, 256> shared;
+    auto begin = std::chrono::steady_clock::now();
+    std::thread producer([&]() {
+        Sample s = {};
+        for (uint32_t i = 0; i < ITERATIONS; i++) {
+            s.timestamp = i;
+            while (!shared.push(s)) std::this_thread::yield();
+        }
+    });
+    Sample r;
+    for (uint32_t received = 0; received < ITERATIONS;) {
+        if (shared.pop(r)) received++;
+        else std::this_thread::yield();
+    }
+    producer.join();
+    double ns = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - begin).count();
+    benchReport("spsc_ring/cross_thread_handoff", ITERATIONS, ns / ITERATIONS);
+
+    return 0;
+}
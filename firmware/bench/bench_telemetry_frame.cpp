@@ -0,0 +1,77 @@
+/**
+ * Kaldor IIoT - Raw telemetry encoding benchmark
+ *
+ * Compares one JSON document per sample (the format readSensors() used to
+ * publish, reproduced with snprintf) against batched binary frames: bytes
+ * on the wire, publishes per second and encode cost per sample.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "telemetry_frame.h"
+
+static const uint32_t SAMPLES = 100000;   // 1000 s at 100 Hz
+static const size_t FRAME_CAPACITY = 1024 - 64;
+static const int FRAME_MAX_SAMPLES = 100;
+
+static float bbwAt(uint32_t i) {
+    return 125.0f + (float)((i * 7919u) % 200) / 100.0f;
+}
+
+int main() {
+    // JSON baseline
+    char json[256];
+    size_t jsonBytes = 0;
+    benchRun("telemetry_frame/json_per_sample", SAMPLES, [&](uint32_t i) {
+        int n = snprintf(json, sizeof(json),
+                         "{\"timestamp\":%u,\"device_id\":\"BBW-a1b2c3d4\",\"bbw\":%.2f,\"quality\":%u}",
+                         (unsigned)(i * 10), (double)bbwAt(i), 95u);
+        jsonBytes += (size_t)n;
+    });
+    jsonBytes /= SAMPLES + SAMPLES / 10;  // benchRun includes a warm-up pass
+
+    // Binary frames
+    uint8_t buf[FRAME_CAPACITY];
+    TelemetryFrameEncoder enc(buf, sizeof(buf));
+    uint32_t hash = deviceIdHash("BBW-a1b2c3d4");
+    size_t frameBytes = 0;
+    uint32_t frames = 0;
+    uint16_t seq = 0;
+    auto flush = [&]() {
+        frameBytes += enc.size();
+        frames++;
+        seq++;
+        enc.clear();
+    };
+    benchRun("telemetry_frame/binary_frame_add", SAMPLES, [&](uint32_t i) {
+        uint32_t ts = i * 10;
+        if (enc.empty()) enc.begin(hash, ts, seq);
+        if (!enc.add(ts, bbwAt(i), 95)) {
+            flush();
+            enc.begin(hash, ts, seq);
+            enc.add(ts, bbwAt(i), 95);
+        }
+        if (enc.count() >= FRAME_MAX_SAMPLES) flush();
+    });
+    if (!enc.empty()) flush();
+
+    uint32_t encoded = SAMPLES + SAMPLES / 10;
+    double binaryPerSample = (double)frameBytes / encoded;
+    printf("{\"bench\":\"telemetry_frame/bytes_per_sample\",\"json\":%u,\"binary\":%.2f,\"ratio\":%.1f}\n",
+           (unsigned)jsonBytes, binaryPerSample, jsonBytes / binaryPerSample);
+    printf("{\"bench\":\"telemetry_frame/publishes_per_second\",\"json\":100,\"binary\":%.2f}\n",
+           100.0 * frames / encoded);
+
+    // Decode cost
+    TelemetryFrameDecoder dec;
+    enc.begin(hash, 0, 0);
+    for (int i = 0; i < FRAME_MAX_SAMPLES; i++) enc.add(i * 10, bbwAt(i), 95);
+    benchRun("telemetry_frame/decode_frame_100", 100000, [&](uint32_t) {
+        FrameSample s;
+        dec.begin(enc.data(), enc.size());
+        while (dec.next(s)) benchKeep(s);
+    });
+
+    return 0;
+}
@@ -0,0 +1,69 @@
+/**
+ * Kaldor IIoT - Vibration analysis benchmark
+ *
+ * Cost of the portable real FFT at the block sizes the analyzer can use,
+ * a direct DFT for scale, and one full three-axis VibrationAnalyzer block
+ * (statistics, window, three FFTs, band sums).
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "bench.h"
+#include "real_fft.h"
+#include "vibration_analyzer.h"
+
+template <size_t N>
+static void benchFft(uint32_t iterations) {
+    static RealFft<N> fft;
+    static float input[N], data[N];
+    for (size_t i = 0; i < N; i++) input[i] = sinf(0.05f * (float)i) + 0.1f * (float)(i % 7);
+
+    char name[64];
+    snprintf(name, sizeof(name), "vibration/real_fft_%zu", N);
+    benchRun(name, iterations, [&](uint32_t) {
+        memcpy(data, input, sizeof(data));
+        fft.forward(data);
+        benchKeep(data[3]);
+    });
+}
+
+static void benchDirectDft(uint32_t iterations) {
+    const size_t n = 1024;
+    static float input[n], re[n / 2 + 1];
+    for (size_t i = 0; i < n; i++) input[i] = sinf(0.05f * (float)i);
+
+    benchRun("vibration/direct_dft_1024", iterations, [&](uint32_t) {
+        for (size_t k = 0; k <= n / 2; k++) {
+            float sum = 0;
+            for (size_t i = 0; i < n; i++) {
+                sum += input[i] * cosf(6.28318530718f * (float)((k * i) % n) / (float)n);
+            }
+            re[k] = sum;
+        }
+        benchKeep(re[5]);
+    });
+}
+
+int main() {
+    benchFft<256>(20000);
+    benchFft<512>(10000);
+    benchFft<1024>(5000);
+    benchFft<2048>(2000);
+    benchDirectDft(3);
+
+    static const float edges[] = {1, 10, 50, 150, 400};
+    static VibrationAnalyzer<1024> analyzer(800.0f, edges, 5);
+    static int16_t block[1024 * 3];
+    for (size_t i = 0; i < 1024; i++) {
+        block[i * 3] = (int16_t)(100.0f * sinf(0.7854f * (float)i));
+        block[i * 3 + 1] = (int16_t)(i % 13);
+        block[i * 3 + 2] = 250;
+    }
+    VibrationFeatures features;
+    benchRun("vibration/analyze_block_1024x3", 2000, [&](uint32_t) {
+        analyzer.analyze(block, 0.004f, features);
+        benchKeep(features.rms);
+    });
+    return 0;
+}
@@ -0,0 +1,83 @@
+#!/usr/bin/env bash
+#
+# Kaldor IIoT - Build and run the host benchmarks, then check them against
+# the stored baselines.
+#
+#   bench/run.sh            run, compare with bench/baseline.jsonl
+#   bench/run.sh --update   run and store the results as the new baseline
+#
+# Environment:
+#   BENCH_REPEAT     runs per benchmark, the fastest counts (default 3)
+#   BENCH_TOLERANCE  allowed slowdown before failing (default 0.5)
+#   BENCH_RETRIES    extra rounds of runs before a slowdown counts as a
+#                    regression (default 2)
+#   BENCH_OUT        where builds and results go (default .pio/bench)
+#   CXX, BENCH_CXXFLAGS
+#
+# Baselines are machine-specific: refresh them with --update on the machine
+# that runs the check (e.g. the CI runner) after an intended change.
+
+set -euo pipefail
+cd "$(dirname "$0")/.."
+
+CXX=${CXX:-g++}
+REPEAT=${BENCH_REPEAT:-3}
+RETRIES=${BENCH_RETRIES:-2}
+TOLERANCE=${BENCH_TOLERANCE:-0.5}
+OUT=${BENCH_OUT:-.pio/bench}
+BASELINE=bench/baseline.jsonl
+CXXFLAGS="-std=gnu++17 -O2 -Iinclude -DMQTT_MAX_PACKET_SIZE=2048 ${BENCH_CXXFLAGS:-}"
+
+# ArduinoJson for payload/processed_json, if PlatformIO fetched it
+if [ -d .pio/libdeps/native/ArduinoJson/src ]; then
+    CXXFLAGS="$CXXFLAGS -I.pio/libdeps/native/ArduinoJson/src"
+fi
+
+mkdir -p "$OUT"
+RESULTS="$OUT/results.jsonl"
+: > "$RESULTS"
+
+BENCHES=()
+for src in bench/bench_*.cpp; do
+    name=$(basename "$src" .cpp)
+    [ "$name" = bench_check ] && continue
+
+    extra=""
+    if [ "$name" = bench_pipeline ]; then
+        extra="src/sensors.cpp src/data_buffer.cpp src/sample_publisher.cpp"
+        extra="$extra -DJOURNAL_PATH_PREFIX=\"$OUT/journal-\""
+    fi
+    # shellcheck disable=SC2086
+    $CXX $CXXFLAGS "$src" $extra -o "$OUT/$name" -lpthread
+    BENCHES+=("$name")
+done
+$CXX -std=gnu++17 -O2 bench/bench_check.cpp -o "$OUT/bench_check"
+
+run_all() {
+    for name in "${BENCHES[@]}"; do
+        for _ in $(seq "$REPEAT"); do
+            "$OUT/$name" | tee -a "$RESULTS"
+        done
+    done
+    rm -f "$OUT"/journal-*
+}
+
+run_all
+
+if [ "${1:-}" = "--update" ]; then
+    "$OUT/bench_check" --best "$RESULTS" > "$BASELINE"
+    echo "Baseline updated: $(wc -l < "$BASELINE") benchmarks in $BASELINE"
+    exit 0
+fi
+
+# A slow phase on a shared runner can hit a whole benchmark binary; only
+# a slowdown that survives more runs counts
+for attempt in $(seq 0 "$RETRIES"); do
+    if "$OUT/bench_check" "$BASELINE" "$RESULTS" "$TOLERANCE" > "$OUT/check.jsonl"; then
+        cat "$OUT/check.jsonl"
+        exit 0
+    fi
+    [ "$attempt" -lt "$RETRIES" ] && run_all > /dev/null
+done
+cat "$OUT/check.jsonl"
+exit 1
@@ -0,0 +1,122 @@
+/**
+ * Kaldor IIoT - Adaptive Sample Interval
+ *
+ * Chooses the acquisition period from how much is going on:
+ *
+ *   Active  BBW spread or vibration above the "active" thresholds:
+ *           sample at the fast interval
+ *   Normal  the configured base interval
+ *   Idle    both below the "idle" thresholds for holdMs: slow interval
+ *
+ * Activity switches to Active at once; stepping down (Active -> Normal ->
+ * Idle) needs holdMs of calm each time, so a loom that is only briefly
+ * quiet keeps its rate. The gap between the two threshold pairs is the
+ * hysteresis.
+ *
+ * Header-only and free of Arduino dependencies.
+ */
+
+#ifndef ADAPTIVE_RATE_H
+#define ADAPTIVE_RATE_H
+
+#include <stdint.h>
+
+struct AdaptiveRateConfig {
+    uint32_t fastIntervalMs;
+    uint32_t idleIntervalMs;
+    float activeStddev;         // BBW standard deviation (mm)
+    float idleStddev;
+    float activeVibration;      // Vibration RMS (g)
+    float idleVibration;
+    uint32_t holdMs;
+};
+
+enum class RateState : uint8_t { Idle, Normal, Active };
+
+class AdaptiveRate {
+private:
+    AdaptiveRateConfig cfg;
+    uint32_t baseMs;
+    bool adaptive;
+
+    RateState current;
+    uint32_t calmSinceMs;
+    bool started;
+    uint32_t changeCount;
+
+    void enter(RateState next, uint32_t nowMs) {
+        if (next != current) {
+            current = next;
+            changeCount++;
+        }
+        calmSinceMs = nowMs;
+    }
+
+public:
+    AdaptiveRate(const AdaptiveRateConfig& config, uint32_t baseIntervalMs, bool enabled)
+        : cfg(config), baseMs(baseIntervalMs), adaptive(enabled),
+          current(RateState::Normal), calmSinceMs(0), started(false),
+          changeCount(0) {}
+
+    /** Base interval from a configured rate (Hz), clamped to fast..1 s. */
+    void setRate(uint32_t hz) {
+        uint32_t ms = hz > 0 ? 1000 / hz : 1000;
+        if (ms < cfg.fastIntervalMs) ms = cfg.fastIntervalMs;
+        if (ms > 1000) ms = 1000;
+        baseMs = ms;
+    }
+
+    void setAdaptive(bool enabled) {
+        adaptive = enabled;
+        current = RateState::Normal;
+        started = false;
+    }
+
+    /** Feed the latest statistics; returns the interval to sleep. */
+    uint32_t update(float bbwStddev, float vibration, uint32_t nowMs) {
+        if (!adaptive) return baseMs;
+        if (!started) {
+            started = true;
+            calmSinceMs = nowMs;
+        }
+
+        bool active = bbwStddev > cfg.activeStddev || vibration > cfg.activeVibration;
+        bool quiet = bbwStddev < cfg.idleStddev && vibration < cfg.idleVibration;
+
+        // calmSinceMs is the last time the current state was justified
+        if (active) {
+            enter(RateState::Active, nowMs);
+        } else if (current == RateState::Active) {
+            if (nowMs - calmSinceMs >= cfg.holdMs) enter(RateState::Normal, nowMs);
+        } else if (current == RateState::Normal) {
+            if (!quiet) {
+                calmSinceMs = nowMs;
+            } else if (nowMs - calmSinceMs >= cfg.holdMs) {
+                enter(RateState::Idle, nowMs);
+            }
+        } else if (!quiet) {
+            enter(RateState::Normal, nowMs);
+        }
+
+        return interval();
+    }
+
+    uint32_t interval() const {
+        if (!adaptive) return baseMs;
+        switch (current) {
+            case RateState::Active:
+                return cfg.fastIntervalMs < baseMs ? cfg.fastIntervalMs : baseMs;
+            case RateState::Idle:
+                return cfg.idleIntervalMs > baseMs ? cfg.idleIntervalMs : baseMs;
+            default:
+                return baseMs;
+        }
+    }
+
+    RateState state() const { return current; }
+    uint32_t baseInterval() const { return baseMs; }
+    bool isAdaptive() const { return adaptive; }
+    uint32_t changes() const { return changeCount; }
+};
+
+#endif // ADAPTIVE_RATE_H
@@ -0,0 +1,192 @@
+/**
+ * Kaldor IIoT - Analog Front End
+ *
+ * Takes the continuously converted analog inputs from an AnalogPort one
+ * DMA frame at a time, splits the interleaved conversions per input and
+ * runs each input through its own DecimationChain (include/decimator.h)
+ * down to its output rate. Outputs are scaled to engineering units (counts
+ * to volts at the pin, then A, N, ...) and gathered into per-channel
+ * statistics, handed out every ANALOG_SUMMARY_MS together with the CPU
+ * time each channel's filtering took.
+ *
+ * Used by one task (the analog task on the board): poll() waits in the
+ * port for the next frame.
+ *
+ * Header-only and free of Arduino dependencies.
+ */
+
+#ifndef ANALOG_FRONTEND_H
+#define ANALOG_FRONTEND_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+#include "config.h"
+#include "decimator.h"
+#include "hal.h"
+
+#define ANALOG_CHANNELS 2
+
+struct AnalogChannelSummary {
+    float mean;             // Engineering units
+    float minimum;
+    float maximum;
+    float stddev;
+    float latest;
+    uint32_t outputHz;
+    uint32_t samples;       // Conversions filtered in the interval
+    uint32_t outputs;       // Decimated outputs in the interval
+    uint32_t cpuUs;         // Filtering time in the interval
+};
+
+struct AnalogSummary {
+    AnalogChannelSummary channel[ANALOG_CHANNELS];
+    uint32_t intervalMs;
+    uint32_t overruns;      // DMA frames lost since begin()
+    uint32_t timestamp;     // End of the interval (ms)
+};
+
+class AnalogFrontEnd {
+private:
+    struct Accumulator {
+        float shift;        // First output of the interval; keeps the sums small
+        float sum;
+        float sumSquares;
+        float minimum;
+        float maximum;
+        uint32_t samples;
+        uint32_t outputs;
+        uint32_t cycles;
+    };
+
+    AnalogPort& port;
+    HalClock& clock;
+    DecimationChain<ANALOG_CIC_ORDER> chains[ANALOG_CHANNELS];
+    uint32_t outputHz[ANALOG_CHANNELS];     // 0: channel not configured
+    float unitsPerCount[ANALOG_CHANNELS];
+    float offset[ANALOG_CHANNELS];
+    float last[ANALOG_CHANNELS];
+    Accumulator acc[ANALOG_CHANNELS];
+
+    AnalogConversion frame[ANALOG_FRAME_CONVERSIONS];
+    int16_t input[ANALOG_FRAME_CONVERSIONS];
+    float output[ANALOG_FRAME_CONVERSIONS];
+
+    uint32_t overrunCount;
+    uint32_t intervalStartMs;
+    bool running;
+
+    void clearInterval(uint32_t nowMs) {
+        for (uint8_t c = 0; c < ANALOG_CHANNELS; c++) acc[c] = Accumulator();
+        intervalStartMs = nowMs;
+    }
+
+    void filter(uint8_t c, size_t count) {
+        uint32_t started = clock.cycles();
+        size_t n = chains[c].process(input, count, output);
+        Accumulator& a = acc[c];
+        for (size_t i = 0; i < n; i++) {
+            float v = output[i] * unitsPerCount[c] + offset[c];
+            if (a.outputs == 0) {
+                a.shift = v;
+                a.minimum = a.maximum = v;
+            }
+            float d = v - a.shift;
+            a.sum += d;
+            a.sumSquares += d * d;
+            if (v < a.minimum) a.minimum = v;
+            if (v > a.maximum) a.maximum = v;
+            a.outputs++;
+            last[c] = v;
+        }
+        a.samples += (uint32_t)count;
+        a.cycles += clock.cycles() - started;
+    }
+
+public:
+    AnalogFrontEnd(AnalogPort& analog, HalClock& halClock)
+        : port(analog), clock(halClock), overrunCount(0), intervalStartMs(0), running(false) {
+        for (uint8_t c = 0; c < ANALOG_CHANNELS; c++) {
+            outputHz[c] = 0;
+            unitsPerCount[c] = 0.0f;
+            offset[c] = 0.0f;
+            last[c] = 0.0f;
+        }
+        clearInterval(0);
+    }
+
+    /**
+     * Output rate and units of an input, before begin(): value =
+     * volts at the pin * unitsPerVolt + offsetUnits. False if the rate does
+     * not fit the decimation limits (see config.h).
+     */
+    bool configure(uint8_t channel, uint32_t rateHz, float unitsPerVolt, float offsetUnits) {
+        if (channel >= ANALOG_CHANNELS ||
+            !chains[channel].configure(ANALOG_SAMPLE_RATE_HZ, rateHz, ANALOG_FIR_DECIMATION,
+                                       ANALOG_FIR_TAPS, ANALOG_BITS)) {
+            return false;
+        }
+        outputHz[channel] = rateHz;
+        unitsPerCount[channel] =
+            ANALOG_FULL_SCALE_V / (float)((1u << ANALOG_BITS) - 1) * unitsPerVolt;
+        offset[channel] = offsetUnits;
+        return true;
+    }
+
+    bool begin() {
+        running = port.begin(ANALOG_SAMPLE_RATE_HZ);
+        clearInterval(clock.millis());
+        return running;
+    }
+
+    /** Read and filter the next DMA frame, waiting up to timeoutMs. Returns conversions. */
+    size_t poll(uint32_t timeoutMs) {
+        if (!running) return 0;
+        if (port.overrun()) overrunCount++;
+        size_t n = port.read(frame, ANALOG_FRAME_CONVERSIONS, timeoutMs);
+        for (uint8_t c = 0; c < ANALOG_CHANNELS; c++) {
+            if (!outputHz[c]) continue;
+            size_t count = 0;
+            for (size_t i = 0; i < n; i++) {
+                if (frame[i].channel == c) input[count++] = (int16_t)frame[i].value;
+            }
+            if (count) filter(c, count);
+        }
+        return n;
+    }
+
+    /** Statistics of the interval just ended, once every ANALOG_SUMMARY_MS. */
+    bool takeSummary(AnalogSummary& out) {
+        uint32_t now = clock.millis();
+        if (!running || now - intervalStartMs < ANALOG_SUMMARY_MS) return false;
+        uint32_t perUs = clock.cyclesPerMicrosecond();
+        for (uint8_t c = 0; c < ANALOG_CHANNELS; c++) {
+            const Accumulator& a = acc[c];
+            AnalogChannelSummary& s = out.channel[c];
+            float mean = a.outputs ? a.sum / (float)a.outputs : 0.0f;
+            float variance = a.outputs ? a.sumSquares / (float)a.outputs - mean * mean : 0.0f;
+            s.mean = a.outputs ? a.shift + mean : 0.0f;
+            s.minimum = a.minimum;
+            s.maximum = a.maximum;
+            s.stddev = variance > 0.0f ? sqrtf(variance) : 0.0f;
+            s.latest = last[c];
+            s.outputHz = outputHz[c];
+            s.samples = a.samples;
+            s.outputs = a.outputs;
+            s.cpuUs = a.cycles / (perUs ? perUs : 1);
+        }
+        out.intervalMs = now - intervalStartMs;
+        out.overruns = overrunCount;
+        out.timestamp = now;
+        clearInterval(now);
+        return true;
+    }
+
+    /** Newest decimated value of a channel, in its units. */
+    float latest(uint8_t channel) const { return channel < ANALOG_CHANNELS ? last[channel] : 0.0f; }
+
+    bool isRunning() const { return running; }
+    uint32_t overruns() const { return overrunCount; }
+};
+
+#endif // ANALOG_FRONTEND_H
@@ -0,0 +1,126 @@
+/**
+ * Kaldor IIoT - Store-and-Forward Backfill
+ *
+ * Decides when to send the next batch of buffered records after a
+ * reconnect and tracks what the backend has acknowledged. Records are
+ * addressed by their journal sequence number: batches are sent from the
+ * cursor, the backend acknowledges the highest sequence it has stored, and
+ * only acknowledged records are trimmed. If no acknowledgement arrives in
+ * time, the cursor rewinds and the unacknowledged records are re-sent
+ * (at-least-once; the backend de-duplicates by sequence number).
+ *
+ * Header-only and free of Arduino dependencies; the caller supplies the
+ * clock and does the actual reading and publishing.
+ */
+
+#ifndef BACKFILL_H
+#define BACKFILL_H
+
+#include <stdint.h>
+
+class Backfill {
+private:
+    uint32_t batchIntervalMs;
+    uint32_t ackTimeoutMs;
+    uint32_t maxUnacked;        // Records sent but not yet acknowledged
+
+    uint32_t cursor;            // Next sequence to send
+    uint32_t acked;             // Everything before this is acknowledged
+    uint32_t lastBatchMs;
+    uint32_t lastProgressMs;    // Last ack (or first send after an ack)
+    bool active;
+    bool started;
+
+    uint32_t ackedTotal;
+    uint32_t rateAckedMark;
+    uint32_t rateMarkMs;
+    uint32_t resendCount;
+
+    static bool seqAfter(uint32_t a, uint32_t b) { return (int32_t)(a - b) > 0; }
+
+public:
+    Backfill(uint32_t intervalMs, uint32_t timeoutMs, uint32_t window)
+        : batchIntervalMs(intervalMs), ackTimeoutMs(timeoutMs), maxUnacked(window),
+          cursor(0), acked(0), lastBatchMs(0), lastProgressMs(0), active(false),
+          started(false),
+          ackedTotal(0), rateAckedMark(0), rateMarkMs(0), resendCount(0) {}
+
+    /** Start draining from the oldest buffered record (call on connect). */
+    void start(uint32_t oldestSeq, uint32_t nowMs) {
+        if (!started || seqAfter(oldestSeq, acked)) {
+            acked = oldestSeq;
+        }
+        started = true;
+        cursor = acked;     // Anything unacknowledged is sent again
+        lastProgressMs = nowMs;
+        lastBatchMs = nowMs - batchIntervalMs;
+        active = true;
+    }
+
+    /** Connection lost: stop sending, keep the acknowledged position. */
+    void stop() { active = false; }
+
+    /**
+     * True if a batch may be sent now. Rate-limited to one batch per
+     * interval and to maxUnacked records outstanding.
+     */
+    bool due(uint32_t nextSeq, uint32_t nowMs) {
+        if (!active) return false;
+
+        // Unacknowledged for too long: go back and resend
+        if (cursor != acked && nowMs - lastProgressMs >= ackTimeoutMs) {
+            cursor = acked;
+            lastProgressMs = nowMs;
+            resendCount++;
+        }
+
+        if (!seqAfter(nextSeq, cursor)) return false;                  // Nothing to send
+        if (cursor - acked >= maxUnacked) return false;                // Window full
+        return nowMs - lastBatchMs >= batchIntervalMs;
+    }
+
+    uint32_t nextToSend() const { return cursor; }
+
+    /** A batch ending at lastSeq was published. */
+    void sent(uint32_t lastSeq, uint32_t nowMs) {
+        if (cursor == acked) lastProgressMs = nowMs;
+        cursor = lastSeq + 1;
+        lastBatchMs = nowMs;
+    }
+
+    /**
+     * Backend confirmed everything up to and including seq. Returns true
+     * if this moved the acknowledged position (caller should trim).
+     */
+    bool acknowledge(uint32_t seq, uint32_t nowMs) {
+        uint32_t next = seq + 1;
+        if (!seqAfter(next, acked) || seqAfter(next, cursor)) {
+            return false;   // Stale, duplicate, or for records never sent
+        }
+        ackedTotal += next - acked;
+        acked = next;
+        lastProgressMs = nowMs;
+        return true;
+    }
+
+    /** Records still waiting to be acknowledged. */
+    uint32_t depth(uint32_t oldestSeq, uint32_t nextSeq) const {
+        uint32_t from = (started && seqAfter(acked, oldestSeq)) ? acked : oldestSeq;
+        return seqAfter(nextSeq, from) ? nextSeq - from : 0;
+    }
+
+    /** Acknowledged records per second since the previous call. */
+    float drainRate(uint32_t nowMs) {
+        uint32_t elapsed = nowMs - rateMarkMs;
+        float rate = elapsed ? (float)(ackedTotal - rateAckedMark) * 1000.0f / (float)elapsed : 0.0f;
+        rateAckedMark = ackedTotal;
+        rateMarkMs = nowMs;
+        return rate;
+    }
+
+    uint32_t acknowledgedTotal() const { return ackedTotal; }
+    uint32_t resends() const { return resendCount; }
+    bool isActive() const { return active; }
+};
+
+#endif // BACKFILL_H
@@ -0,0 +1,253 @@
+/**
+ * Kaldor IIoT - Streaming Change Detection
+ *
+ * Watches every BBW sample for changes that a 1 s average would smooth
+ * away or report late. Three detectors share one baseline, all O(1) per
+ * sample:
+ *
+ *   Rate   |dx/dt| above maxRate (mm/s): spikes and jumps, same sample
+ *   Shift  two-sided CUSUM on the standardised deviation from the
+ *          baseline: steps and drifts, a few samples after onset
+ *   Ewma   EWMA of the samples leaves baseline +- limit * sigma_ewma:
+ *          small sustained offsets
+ *
+ * The baseline (mean, variance) is an exponentially weighted estimate
+ * that ignores samples more than 3 sigma away, so a spike or a step does
+ * not drag it along. When the CUSUM fires, the baseline jumps to the mean
+ * of the samples since the CUSUM last left zero (the estimated new level)
+ * so the detector settles instead of alarming for as long as the new
+ * level lasts. CUSUM and EWMA inputs are clipped to 4 sigma so a single
+ * outlier alone cannot trip them. Each detector has its own hold-off
+ * after it fires.
+ *
+ * Invalid samples are skipped; the first valid one after a gap is not
+ * used for the rate. The first warmupSamples only build the baseline.
+ *
+ * Header-only and free of Arduino dependencies.
+ */
+
+#ifndef CHANGE_DETECTOR_H
+#define CHANGE_DETECTOR_H
+
+#include <stdint.h>
+#include <math.h>
+
+struct ChangeDetectorConfig {
+    float baselineAlpha;        // Baseline EWMA weight per sample
+    float ewmaLambda;           // EWMA chart weight per sample
+    float ewmaLimit;            // EWMA control limit (sigma of the EWMA)
+    float cusumK;               // CUSUM allowance (sigma)
+    float cusumH;               // CUSUM decision threshold (sigma)
+    float maxRate;              // mm/s
+    float sigmaFloor;           // mm; keeps a quiet signal from alarming on quantisation
+    uint32_t warmupSamples;
+    uint32_t holdoffMs;         // Per detector, after it fires
+};
+
+enum class ChangeKind : uint8_t { None, Rate, Shift, Ewma };
+
+/** Detector state at the moment an alarm fired. */
+struct ChangeEvent {
+    uint32_t timestamp;
+    ChangeKind kind;
+    int8_t direction;           // +1 up, -1 down
+    float value;                // Sample that fired (mm)
+    float baseline;             // Baseline mean before the alarm (mm)
+    float sigma;                // Baseline standard deviation (mm)
+    float ewma;                 // EWMA chart value (mm)
+    float cusumHigh;            // Upper / lower CUSUM sums (sigma)
+    float cusumLow;
+    float rate;                 // mm/s against the previous sample
+    uint32_t samples;           // Valid samples seen so far
+};
+
+class ChangeDetector {
+private:
+    static constexpr float OUTLIER_SIGMA = 3.0f;   // Baseline ignores samples beyond this
+    static constexpr float CUSUM_CLIP = 4.0f;      // CUSUM/EWMA input limit (sigma)
+
+    ChangeDetectorConfig cfg;
+    float ewmaSigmaFactor;      // sqrt(lambda / (2 - lambda))
+
+    uint32_t sampleCount;
+    float mean;
+    float variance;
+    float ewma;
+    float cusumHigh;
+    float cusumLow;
+    float runHighSum;           // Samples since the upper CUSUM left zero
+    uint32_t runHighCount;
+    float runLowSum;
+    uint32_t runLowCount;
+
+    bool hasPrevious;
+    float previous;
+    uint32_t previousMs;
+
+    uint32_t lastFired[4];
+    bool armed[4];
+    uint32_t firedCount[4];
+
+    bool fire(ChangeKind kind, uint32_t nowMs) {
+        uint8_t k = (uint8_t)kind;
+        if (armed[k] && nowMs - lastFired[k] < cfg.holdoffMs) return false;
+        armed[k] = true;
+        lastFired[k] = nowMs;
+        firedCount[k]++;
+        return true;
+    }
+
+public:
+    explicit ChangeDetector(const ChangeDetectorConfig& config) : cfg(config) {
+        ewmaSigmaFactor = sqrtf(cfg.ewmaLambda / (2.0f - cfg.ewmaLambda));
+        reset();
+        for (uint32_t& n : firedCount) n = 0;
+    }
+
+    /** Forget the baseline, e.g. after the sensor was recalibrated. */
+    void reset() {
+        sampleCount = 0;
+        mean = variance = ewma = 0;
+        cusumHigh = cusumLow = 0;
+        runHighSum = runLowSum = 0;
+        runHighCount = runLowCount = 0;
+        hasPrevious = false;
+        previous = 0;
+        previousMs = 0;
+        for (int k = 0; k < 4; k++) {
+            lastFired[k] = 0;
+            armed[k] = false;
+        }
+    }
+
+    /**
+     * Feed one sample. Returns the detector that fired (at most one per
+     * sample, Rate before Shift before Ewma) and fills event, or
+     * ChangeKind::None.
+     */
+    ChangeKind update(float x, bool valid, uint32_t nowMs, ChangeEvent& event) {
+        if (!valid) {
+            hasPrevious = false;
+            return ChangeKind::None;
+        }
+
+        float rate = 0;
+        if (hasPrevious && nowMs != previousMs) {
+            rate = (x - previous) * 1000.0f / (float)(nowMs - previousMs);
+        }
+        bool rateValid = hasPrevious && nowMs != previousMs;
+        hasPrevious = true;
+        previous = x;
+        previousMs = nowMs;
+        sampleCount++;
+
+        // Warm-up: plain running mean and variance
+        if (sampleCount <= cfg.warmupSamples) {
+            float delta = x - mean;
+            mean += delta / (float)sampleCount;
+            variance += (delta * (x - mean) - variance) / (float)sampleCount;
+            ewma = mean;
+            return ChangeKind::None;
+        }
+
+        float sigma = sqrtf(variance);
+        if (sigma < cfg.sigmaFloor) sigma = cfg.sigmaFloor;
+        float u = (x - mean) / sigma;
+        float clipped = u > CUSUM_CLIP ? CUSUM_CLIP : (u < -CUSUM_CLIP ? -CUSUM_CLIP : u);
+
+        ewma += cfg.ewmaLambda * (mean + clipped * sigma - ewma);
+
+        cusumHigh += clipped - cfg.cusumK;
+        if (cusumHigh <= 0) {
+            cusumHigh = 0;
+            runHighSum = 0;
+            runHighCount = 0;
+        } else {
+            runHighSum += x;
+            runHighCount++;
+        }
+        cusumLow += -clipped - cfg.cusumK;
+        if (cusumLow <= 0) {
+            cusumLow = 0;
+            runLowSum = 0;
+            runLowCount = 0;
+        } else {
+            runLowSum += x;
+            runLowCount++;
+        }
+
+        event.timestamp = nowMs;
+        event.kind = ChangeKind::None;
+        event.value = x;
+        event.baseline = mean;
+        event.sigma = sigma;
+        event.ewma = ewma;
+        event.cusumHigh = cusumHigh;
+        event.cusumLow = cusumLow;
+        event.rate = rate;
+        event.samples = sampleCount;
+
+        ChangeKind fired = ChangeKind::None;
+        if (rateValid && fabsf(rate) > cfg.maxRate) {
+            if (fire(ChangeKind::Rate, nowMs)) {
+                fired = ChangeKind::Rate;
+                event.direction = rate > 0 ? 1 : -1;
+            }
+        }
+
+        // CUSUM: move the baseline to the new level whether or not the
+        // alarm is held off
+        if (cusumHigh > cfg.cusumH || cusumLow > cfg.cusumH) {
+            bool up = cusumHigh > cfg.cusumH;
+            float level = up ? runHighSum / (float)runHighCount : runLowSum / (float)runLowCount;
+            if (fired == ChangeKind::None && fire(ChangeKind::Shift, nowMs)) {
+                fired = ChangeKind::Shift;
+                event.direction = up ? 1 : -1;
+            }
+            mean = level;
+            ewma = level;
+            cusumHigh = cusumLow = 0;
+            runHighSum = runLowSum = 0;
+            runHighCount = runLowCount = 0;
+            event.kind = fired;
+            return fired;
+        }
+
+        float limit = cfg.ewmaLimit * sigma * ewmaSigmaFactor;
+        if (fired == ChangeKind::None && fabsf(ewma - mean) > limit) {
+            if (fire(ChangeKind::Ewma, nowMs)) {
+                fired = ChangeKind::Ewma;
+                event.direction = ewma > mean ? 1 : -1;
+            }
+        }
+
+        // Baseline follows in-control samples only
+        if (fabsf(u) < OUTLIER_SIGMA) {
+            float delta = x - mean;
+            mean += cfg.baselineAlpha * delta;
+            variance += cfg.baselineAlpha * (delta * delta - variance);
+        }
+
+        event.kind = fired;
+        return fired;
+    }
+
+    float baseline() const { return mean; }
+    float sigma() const { return sqrtf(variance); }
+    float ewmaValue() const { return ewma; }
+    float cusumUpper() const { return cusumHigh; }
+    float cusumLower() const { return cusumLow; }
+    bool ready() const { return sampleCount > cfg.warmupSamples; }
+    uint32_t alarms(ChangeKind kind) const { return firedCount[(uint8_t)kind]; }
+
+    static const char* name(ChangeKind kind) {
+        switch (kind) {
+            case ChangeKind::Rate: return "rate";
+            case ChangeKind::Shift: return "shift";
+            case ChangeKind::Ewma: return "ewma";
+            default: return "none";
+        }
+    }
+};
+
+#endif // CHANGE_DETECTOR_H
@@ -20,6 +20,100 @@
 #define MQTT_USER "kaldor_device"
 #define MQTT_PASSWORD "your_mqtt_password_here"
 
+// MQTT session (include/mqtt_session.h). QoS 1 messages stay queued until
+// the broker's PUBACK and are resent after a reconnect; QoS 0 ones are
+// gone once written. Queues are per priority: control, live, bulk.
+#define MQTT_QOS_RAW 1                  // Raw samples or frames
+#define MQTT_QOS_TELEMETRY 1
+#define MQTT_QOS_ALERTS 1
+#define MQTT_QOS_BACKLOG 1
+#define MQTT_QOS_ROLLUP 1
+#define MQTT_QOS_MEMORY 1
+#define MQTT_QOS_TRACE 1
+#define MQTT_INFLIGHT_WINDOW 16         // Unacknowledged QoS 1 messages (1..MQTT_MAX_INFLIGHT)
+#define MQTT_MAX_INFLIGHT 32
+#define MQTT_ACK_TIMEOUT_MS 10000       // No PUBACK (or CONNACK, PINGRESP): reconnect
+#define MQTT_CONNECT_TIMEOUT_MS 15000   // TCP connect and TLS handshake
+#define MQTT_KEEPALIVE_S 60
+#define MQTT_QUEUE_CONTROL_BYTES 4096   // Status, alerts, diagnostics
+#define MQTT_QUEUE_LIVE_BYTES 12288     // Raw samples and processed telemetry
+#define MQTT_QUEUE_BULK_BYTES 6144      // Backlog batches
+#define MQTT_CONTROL_PACKET_BYTES 512   // CONNECT, SUBSCRIBE, PUBACK, PINGREQ
+#define MQTT_RX_PACKET_SIZE 1024        // Largest incoming message (config, OTA)
+#define MQTT_WRITE_BUDGET 4096          // Bytes written per loop() pass
+#define MQTT_WRITE_CHUNK 1024           // TLS write staging buffer on the board
+
+// Connection management (include/connection_manager.h). WiFi and the
+// broker are (re)connected without blocking the network task. Failed
+// attempts back off exponentially with full jitter, so the looms in a
+// shed do not all retry in step after an access point or broker restart.
+#define WIFI_JOIN_TIMEOUT_MS 15000
+#define RECONNECT_BACKOFF_MIN_MS 1000   // First retry within 0..this
+#define RECONNECT_BACKOFF_MAX_MS 60000
+
+// Raw telemetry format
+// 0 = one JSON document per sample on kaldor/loom/{id}/bbw/raw
+// 1 = batched binary frames (include/telemetry_frame.h) on .../bbw/raw/frame
+#ifndef RAW_BINARY_FRAMES
+#define RAW_BINARY_FRAMES 0
+#endif
+#define RAW_FRAME_MAX_SAMPLES 100   // Samples per frame
+#define RAW_FRAME_MAX_AGE_MS 1000   // Publish a partial frame after this
+
+// Rollups (include/rollup.h): 1 s, 1 min and 1 h buckets of the samples on
+// bbw/rollup/1s, 1m and 1h. What each loom publishes can be changed at
+// runtime on the config topic ("publish"): raw samples on or off, and the
+// rollup levels as a bit mask (1 = 1 s, 2 = 1 min, 4 = 1 h).
+#define PUBLISH_RAW 1
+#define ROLLUP_PUBLISH_LEVELS 0x7
+#define ROLLUP_PENDING 32           // 1 min and 1 h buckets held while offline
+
+// Memory diagnostics (include/memory_metrics.h): heap and task stack snapshots
+// on diagnostics/memory, held in a ring while MQTT is down.
+#define MEMORY_SNAPSHOT_MS 60000
+#define MEMORY_HISTORY 60           // An hour of snapshots
+
+// Sensor traces (include/sensor_trace.h): the raw inputs of SensorManager
+// (echo edges, DHT readings, accelerometer samples) recorded on request on
+// the trace topic, for replay on the host (include/trace_replay.h).
+// Chunks go out on trace/data as they fill, or to flash for a later upload.
+#define TRACE_CHUNK_BYTES 512
+#define TRACE_RING_CHUNKS 8         // Per lane, waiting for the network task
+#define TRACE_FLUSH_MS 1000         // Close a chunk after this, full or not
+#define TRACE_MAX_SECONDS 3600
+#define TRACE_FLASH_BYTES 524288    // A capture to flash stops here (about 2 min)
+#define TRACE_PATH_PREFIX "/spiffs/trace-"
+
+// Streaming change detection on every BBW sample (include/change_detector.h)
+#define DETECTOR_BASELINE_ALPHA 0.01f   // Baseline time constant ~100 samples
+#define DETECTOR_EWMA_LAMBDA 0.1f
+#define DETECTOR_EWMA_LIMIT 4.5f        // Sigma of the EWMA
+#define DETECTOR_CUSUM_K 1.0f           // Tuned for shifts of ~2 sigma
+#define DETECTOR_CUSUM_H 8.0f           // A 3 sigma step fires after ~4 samples
+#define DETECTOR_MAX_RATE_MM_S 500.0f   // 5 mm between two 100 Hz samples
+#define DETECTOR_SIGMA_FLOOR_MM 0.05f
+#define DETECTOR_WARMUP_SAMPLES 100
+#define DETECTOR_HOLDOFF_MS 1000        // Per detector
+
+// Report-by-exception for raw samples: publish a sample only if it moved
+// more than max(absolute, percent) from the last published one, or after
+// REPORT_MAX_SILENCE_MS without a report. Both deadbands 0 = every sample.
+// Can be changed at runtime on the config topic ("report").
+#define REPORT_DEADBAND_MM 0.0f
+#define REPORT_DEADBAND_PCT 0.0f
+#define REPORT_MAX_SILENCE_MS 5000
+
+// Adaptive acquisition rate ("sampling_rate" / "adaptive_rate" on the
+// config topic). Faster while BBW or vibration is busy, slower when idle.
+#define ADAPTIVE_SAMPLE_RATE 0
+#define SAMPLE_INTERVAL_FAST_MS 10          // 100 Hz, the ultrasonic limit
+#define SAMPLE_INTERVAL_IDLE_MS 100         // 10 Hz
+#define ADAPTIVE_ACTIVE_STDDEV_MM 1.0f
+#define ADAPTIVE_IDLE_STDDEV_MM 0.2f
+#define ADAPTIVE_ACTIVE_VIBRATION_G 0.05f
+#define ADAPTIVE_IDLE_VIBRATION_G 0.01f
+#define ADAPTIVE_HOLD_MS 30000              // Calm time before slowing down
+
 // Pin Definitions
 #define I2C_SDA 21
 #define I2C_SCL 22
@@ -27,27 +121,98 @@
 // Ultrasonic sensor pins
 #define ULTRASONIC_TRIG 25
 #define ULTRASONIC_ECHO 26
+#define ULTRASONIC_TIMEOUT_US 30000   // Give up on an echo after 30 ms
+#define ULTRASONIC_DEADLINE_US 10000  // Echo expected within one sample period
+
+// ADXL345 INT1 (FIFO watermark interrupt)
+#define ACCEL_INT_PIN 32
 
 // DHT Temperature sensor
 #define DHT_PIN 27
 #define DHT_TYPE DHT22
 
-// Analog inputs
-#define ANALOG_SENSOR_1 34
-#define ANALOG_SENSOR_2 35
+// Analog inputs: both converted continuously by the ADC into DMA frames and
+// decimated on the device (include/analog_frontend.h). For each output rate,
+// ANALOG_SAMPLE_RATE_HZ / rate must be a whole multiple of
+// ANALOG_FIR_DECIMATION, and the CIC's share of it at most 80 (order 3,
+// 12 bits): 31.25 Hz and up at 10 kHz.
+#define ANALOG_SENSOR_1 34                  // Loom motor current (ADC1 channel 6)
+#define ANALOG_SENSOR_2 35                  // Warp tension (ADC1 channel 7)
+#define ANALOG_SAMPLE_RATE_HZ 10000         // Per input; the ESP32 DMA needs 20 kHz in total
+#define ANALOG_FRAME_CONVERSIONS 256        // Per DMA frame, both inputs (12.8 ms)
+#define ANALOG_BITS 12
+#define ANALOG_FULL_SCALE_V 3.1f            // At 11 dB attenuation
+#define ANALOG_CIC_ORDER 3
+#define ANALOG_FIR_DECIMATION 4
+#define ANALOG_FIR_TAPS 63
+#define ANALOG_CURRENT_OUTPUT_HZ 100
+#define ANALOG_CURRENT_SCALE 10.0f          // A per volt at the pin
+#define ANALOG_CURRENT_OFFSET 0.0f          // A
+#define ANALOG_TENSION_OUTPUT_HZ 50
+#define ANALOG_TENSION_SCALE 250.0f         // N per volt at the pin
+#define ANALOG_TENSION_OFFSET 0.0f          // N
+#define ANALOG_SUMMARY_MS 1000              // Statistics per processed telemetry message
+
+// Vibration analysis: the ADXL345 runs at a high output data rate into its
+// FIFO and is analysed in blocks (include/vibration_analyzer.h)
+#define VIBRATION_SAMPLE_RATE_HZ 800        // 100..3200, power-of-two steps
+#define VIBRATION_BLOCK_SIZE 1024           // Samples per FFT (1.28 s, 0.78 Hz bins)
+#define ACCEL_FIFO_WATERMARK 16             // Interrupt when this many are queued (1..31)
+#define VIBRATION_BAND_EDGES_HZ {1, 10, 50, 150, 400}   // Up to 9 edges
+
+// Measurement thresholds (defaults; see include/runtime_config.h)
+#define BBW_MIN_THRESHOLD 50.0f   // mm
+#define BBW_MAX_THRESHOLD 200.0f  // mm
+#define TEMP_MAX_THRESHOLD 80.0f  // Celsius
+#define VIB_MAX_THRESHOLD 5.0f    // g
 
-// Measurement thresholds
-#define BBW_MIN_THRESHOLD 50.0   // mm
-#define BBW_MAX_THRESHOLD 200.0  // mm
-#define TEMP_MAX_THRESHOLD 80.0  // Celsius
-#define VIB_MAX_THRESHOLD 5.0    // g
+// Sensor calibration (defaults; see include/runtime_config.h)
+#define BBW_CALIBRATION_OFFSET 0.0f
+#define BBW_CALIBRATION_SCALE 1.0f
 
-// Sensor calibration
-#define BBW_CALIBRATION_OFFSET 0.0
-#define BBW_CALIBRATION_SCALE 1.0
+// Outlier (Hampel) filter on BBW readings, ahead of the statistics.
+// Window is compile-time; threshold and floor are defaults (see
+// include/runtime_config.h).
+#define OUTLIER_WINDOW 15                // Samples (150 ms at 100 Hz)
+#define OUTLIER_THRESHOLD 3.0f           // Sigmas (1.4826 * MAD); 0 = off
+#define OUTLIER_MIN_SIGMA_MM 0.3f        // Floor for the sigma estimate
+
+// Rolling statistics windows (samples)
+#define BBW_WINDOW_SIZE 100      // 1 s at 100 Hz
+#define SLOW_WINDOW_SIZE 60      // 1 min of 1 Hz temperature/vibration
 
 // Data retention
-#define MAX_BUFFER_SIZE 1000
+#define MAX_BUFFER_SIZE 1000           // Hot tier, internal RAM (10 s at 100 Hz)
+#define PSRAM_BUFFER_SIZE 40000        // Warm tier, PSRAM (6.7 min, 48 B each: ~1.9 MB)
+#define PSRAM_RESERVE_BYTES 1048576    // Left free for allocations that spill to PSRAM
 #define BUFFER_FLUSH_SIZE 100
 
+// Flash journal (append-only segments on SPIFFS)
+#ifndef JOURNAL_PATH_PREFIX               // The native build puts it under /tmp
+#define JOURNAL_PATH_PREFIX "/spiffs/journal-"
+#endif
+#define JOURNAL_SEGMENTS 4              // Oldest segment is erased on rotation
+#define JOURNAL_SEGMENT_RECORDS 1000    // 40 KB per segment
+#define JOURNAL_STAGING_RECORDS 10      // Records per flash write
+
+// Backfill of buffered data after reconnect (kaldor/loom/{id}/bbw/backlog)
+#define BACKFILL_BATCH_SIZE 20          // Records per publish
+#define BACKFILL_INTERVAL_MS 50         // At most one batch per interval
+#define BACKFILL_ACK_TIMEOUT_MS 10000   // Resend if not acknowledged by then
+#define BACKFILL_WINDOW 200             // Max records sent but unacknowledged
+
+// Firmware updates over HTTP (include/ota_update.h) in a background task.
+// A dropped download resumes with a Range request; packed images
+// (include/ota_image.h) are compressed and/or a delta against the
+// running firmware.
+#define OTA_WINDOW_BYTES 4096           // Back-reference window of packed images
+#define OTA_CHUNK_BYTES 1024            // Read per pass
+#define OTA_CONNECT_TIMEOUT_MS 10000
+#define OTA_IDLE_TIMEOUT_MS 15000       // No data for this long: reconnect and resume
+#define OTA_MAX_RETRIES 8               // Failed attempts in a row before giving up
+#define OTA_RETRY_MIN_MS 1000
+#define OTA_RETRY_MAX_MS 30000
+#define OTA_PROGRESS_INTERVAL_MS 2000   // Status messages while an update runs
+#define OTA_RESTART_GRACE_MS 5000       // Wait for the final status before rebooting
+
 #endif // CONFIG_H
@@ -0,0 +1,79 @@
+/**
+ * Kaldor IIoT - Double-Buffered Configuration Snapshot
+ *
+ * Publishes a configuration struct from one writer task (the network task,
+ * on a config message) to reader tasks (the acquisition task) without
+ * locks. The writer fills the inactive copy and then switches the active
+ * index, so readers normally never see a copy being written. Each copy
+ * also carries a sequence count (odd while being written); a reader that
+ * was unlucky enough to straddle two updates notices and copies again.
+ *
+ * Readers poll generation() - one atomic load - and only copy the struct
+ * when it changed, so the per-sample cost is a single load.
+ *
+ * T must be trivially copyable. Header-only and free of Arduino
+ * dependencies.
+ */
+
+#ifndef CONFIG_SNAPSHOT_H
+#define CONFIG_SNAPSHOT_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+template <typename T>
+class ConfigSnapshot {
+    static_assert(std::is_trivially_copyable<T>::value, "ConfigSnapshot needs a trivially copyable type");
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> seq;      // Odd while the writer is in it
+        T value;
+    };
+
+    Slot slots[2];
+    std::atomic<uint8_t> active;
+    std::atomic<uint32_t> generationCount;
+
+public:
+    explicit ConfigSnapshot(const T& initial) : active(0), generationCount(0) {
+        for (Slot& slot : slots) {
+            slot.seq.store(0, std::memory_order_relaxed);
+            memcpy(&slot.value, &initial, sizeof(T));
+        }
+    }
+
+    /** Writer only. Makes value the current configuration. */
+    void publish(const T& value) {
+        uint8_t next = active.load(std::memory_order_relaxed) ^ 1;
+        Slot& slot = slots[next];
+
+        uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+        slot.seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(&slot.value, &value, sizeof(T));
+        slot.seq.store(seq + 2, std::memory_order_release);
+
+        active.store(next, std::memory_order_release);
+        generationCount.fetch_add(1, std::memory_order_release);
+    }
+
+    /** Any task. Copies the current configuration into out. */
+    void read(T& out) const {
+        for (;;) {
+            const Slot& slot = slots[active.load(std::memory_order_acquire)];
+            uint32_t before = slot.seq.load(std::memory_order_acquire);
+            if (before & 1) continue;       // Overtaken by two updates; retry
+            memcpy(&out, &slot.value, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) == before) return;
+        }
+    }
+
+    /** Changes on every publish(); compare to skip unchanged reads. */
+    uint32_t generation() const { return generationCount.load(std::memory_order_acquire); }
+};
+
+#endif // CONFIG_SNAPSHOT_H
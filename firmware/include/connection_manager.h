@@ -0,0 +1,246 @@
+/**
+ * Kaldor IIoT - Connection Manager
+ *
+ * Brings up the network link and the broker session and keeps them up,
+ * without ever waiting: loop() looks at where things stand, starts the
+ * next step and returns.
+ *
+ *   Joining     link.join() issued, waiting for up() (join timeout)
+ *   Connecting  MqttSession opening the stream and waiting for the
+ *               CONNACK (the session's own timeouts apply)
+ *   Online      session established; a lost link or session goes back
+ *               to Waiting
+ *   Waiting     backoff before the next attempt at whichever layer is down
+ *
+ * Every wait is drawn from Backoff: exponential in the number of failures
+ * in a row, with full jitter, so devices that lost the same access point
+ * spread their retries out instead of arriving together. Join, connect and
+ * outage durations go into ConnectionStats for the telemetry.
+ *
+ * Header-only and free of Arduino dependencies.
+ */
+
+#ifndef CONNECTION_MANAGER_H
+#define CONNECTION_MANAGER_H
+
+#include <stdint.h>
+#include "config.h"
+#include "hal.h"
+#include "mqtt_session.h"
+
+/**
+ * Retry delays: attempt n (failures in a row) waits a uniform random time
+ * in [0, min(maxMs, minMs * 2^n)]. Seed it per device.
+ */
+class Backoff {
+private:
+    uint32_t minMs;
+    uint32_t maxMs;
+    uint32_t failures;
+    uint32_t state;         // xorshift32
+
+    uint32_t draw() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+public:
+    Backoff(uint32_t minimumMs, uint32_t maximumMs, uint32_t seed)
+        : minMs(minimumMs), maxMs(maximumMs), failures(0), state(seed ? seed : 0x9E3779B9u) {}
+
+    /** Upper bound of the next delay. */
+    uint32_t ceiling() const {
+        uint32_t limit = minMs;
+        for (uint32_t i = 0; i < failures && limit < maxMs; i++) limit *= 2;
+        return limit < maxMs ? limit : maxMs;
+    }
+
+    /** Delay before the next attempt; each call counts one more failure. */
+    uint32_t next() {
+        uint32_t delay = (uint32_t)((uint64_t)draw() * ((uint64_t)ceiling() + 1) >> 32);
+        failures++;
+        return delay;
+    }
+
+    void reset() { failures = 0; }
+    void seed(uint32_t value) { state = value ? value : 0x9E3779B9u; }
+    uint32_t attempts() const { return failures; }
+};
+
+struct ConnectionStats {
+    uint32_t joins;             // Link joins completed
+    uint32_t joinFailures;      // Joins that timed out
+    uint32_t linkLosses;        // Link lost while the session was up
+    uint32_t connects;          // Broker sessions established
+    uint32_t connectFailures;   // Broker attempts that failed or timed out
+    uint32_t lastJoinMs;        // join() to link up
+    uint32_t lastConnectMs;     // connect() to CONNACK: TCP, TLS and MQTT
+    uint32_t lastOutageMs;      // Session lost to session back, backoff included
+    uint32_t maxOutageMs;
+    uint32_t backoffMs;         // Last delay drawn
+};
+
+class ConnectionManager {
+public:
+    enum class State : uint8_t { Waiting, Joining, Connecting, Online };
+
+private:
+    LinkPort& link;
+    MqttSession& session;
+    HalClock& clock;
+    Backoff backoff;
+    uint32_t joinTimeoutMs;
+
+    const char* host;
+    uint16_t port;
+    const char* clientId;
+    const char* user;
+    const char* password;
+
+    State state;
+    uint32_t stateSinceMs;
+    uint32_t retryAtMs;
+    uint32_t lostAtMs;
+    bool lost;                  // Outage in progress (was online before)
+    bool started;
+
+    ConnectionStats counters;
+
+    void enter(State next, uint32_t now) {
+        state = next;
+        stateSinceMs = now;
+    }
+
+    void wait(uint32_t now) {
+        counters.backoffMs = backoff.next();
+        retryAtMs = now + counters.backoffMs;
+        enter(State::Waiting, now);
+    }
+
+    void startJoin(uint32_t now) {
+        link.join();
+        enter(State::Joining, now);
+    }
+
+    void startConnect(uint32_t now) {
+        enter(State::Connecting, now);
+        if (!session.connect(host, port, clientId, user, password)) {
+            counters.connectFailures++;
+            wait(now);
+        }
+    }
+
+    void goOffline(uint32_t now) {
+        lost = true;
+        lostAtMs = now;
+        backoff.reset();        // Fresh outage: the first retry is soon, but jittered
+        wait(now);
+    }
+
+public:
+    ConnectionManager(LinkPort& netLink, MqttSession& mqttSession, HalClock& halClock)
+        : link(netLink), session(mqttSession), clock(halClock),
+          backoff(RECONNECT_BACKOFF_MIN_MS, RECONNECT_BACKOFF_MAX_MS, 0),
+          joinTimeoutMs(WIFI_JOIN_TIMEOUT_MS), host(nullptr), port(0), clientId(nullptr),
+          user(nullptr), password(nullptr), state(State::Waiting), stateSinceMs(0),
+          retryAtMs(0), lostAtMs(0), lost(false), started(false), counters() {}
+
+    /** Strings are not copied. Credentials may be null. */
+    void setBroker(const char* brokerHost, uint16_t brokerPort, const char* id,
+                   const char* username, const char* secret) {
+        host = brokerHost;
+        port = brokerPort;
+        clientId = id;
+        user = username;
+        password = secret;
+    }
+
+    void setJoinTimeout(uint32_t ms) { joinTimeoutMs = ms; }
+
+    /**
+     * First attempt right away. `seed` must differ between devices (e.g.
+     * the MAC or a hardware random number) for the jitter to spread them.
+     */
+    void begin(uint32_t seed) {
+        backoff.seed(seed);
+        started = true;
+        retryAtMs = clock.millis();
+        enter(State::Waiting, retryAtMs);
+    }
+
+    /** Advance the state machine. Never waits; call on every network pass. */
+    void loop() {
+        if (!started) return;
+        uint32_t now = clock.millis();
+
+        switch (state) {
+        case State::Waiting:
+            if ((int32_t)(now - retryAtMs) < 0) break;
+            if (link.up()) {
+                startConnect(now);
+            } else {
+                startJoin(now);
+            }
+            break;
+
+        case State::Joining:
+            if (link.up()) {
+                counters.joins++;
+                counters.lastJoinMs = now - stateSinceMs;
+                startConnect(now);
+            } else if (now - stateSinceMs > joinTimeoutMs) {
+                link.leave();
+                counters.joinFailures++;
+                wait(now);
+            }
+            break;
+
+        case State::Connecting:
+            if (!link.up()) {
+                session.disconnect();
+                counters.connectFailures++;
+                wait(now);
+            } else if (session.connected()) {
+                counters.connects++;
+                counters.lastConnectMs = now - stateSinceMs;
+                if (lost) {
+                    counters.lastOutageMs = now - lostAtMs;
+                    if (counters.lastOutageMs > counters.maxOutageMs) {
+                        counters.maxOutageMs = counters.lastOutageMs;
+                    }
+                    lost = false;
+                }
+                backoff.reset();
+                enter(State::Online, now);
+            } else if (session.status() == MqttSession::State::Disconnected) {
+                counters.connectFailures++;
+                wait(now);
+            }
+            break;
+
+        case State::Online:
+            if (!link.up()) {
+                counters.linkLosses++;
+                session.disconnect();
+                goOffline(now);
+            } else if (!session.connected()) {
+                goOffline(now);
+            }
+            break;
+        }
+    }
+
+    State status() const { return state; }
+    bool online() const { return state == State::Online; }
+    const ConnectionStats& stats() const { return counters; }
+
+    /** Milliseconds until the next attempt while Waiting, else 0. */
+    uint32_t retryInMs() const {
+        int32_t left = (int32_t)(retryAtMs - clock.millis());
+        return state == State::Waiting && left > 0 ? (uint32_t)left : 0;
+    }
+};
+
+#endif // CONNECTION_MANAGER_H
@@ -1,30 +1,47 @@
 /**
  * Kaldor IIoT - Data Buffer for Offline Resilience
+ *
+ * Unsent samples are kept in a TieredSampleStore: a ring in internal RAM,
+ * a larger ring in PSRAM when the board has it, and the flash journal for
+ * whatever overflows both. Runs unchanged in the native build.
  */
 
 #ifndef DATA_BUFFER_H
 #define DATA_BUFFER_H
 
-#include <Arduino.h>
-#include "sensors.h"
-#include <vector>
+#include "config.h"
+#include "sensor_data.h"
+#include "journal_store.h"
+#include "sample_journal.h"
+#include "tiered_store.h"
 
 class DataBuffer {
 private:
-    std::vector<SensorData> buffer;
-    size_t maxSize;
-    String bufferFile;
+    FileJournalStore fileStore;
+    SampleJournal journal;
+    TieredSampleStore store;
+    SequencedSample* hotStorage;
+    SequencedSample* warmStorage;
 
 public:
     DataBuffer();
-    void begin(size_t size);
+    void begin(size_t hotSize, size_t warmSize);
     void add(const SensorData& data);
     bool isFull();
     size_t size();
-    SensorData get(int index);
     void clear();
     bool saveToFile();
     bool loadFromFile();
+
+    // Store-and-forward access by sequence number
+    uint32_t nextSequence() const { return store.nextSequence(); }
+    uint32_t oldestSequence() const { return store.oldestSequence(); }
+    size_t readBacklog(uint32_t fromSeq, SensorData* out, uint32_t* seqs, size_t max);
+    void acknowledge(uint32_t seq);
+
+    size_t ramSize() const { return store.hotSize() + store.warmSize(); }
+    size_t flashSize() const { return store.coldSize(); }
+    uint32_t journalWriteErrors() const { return journal.writeErrors(); }
 };
 
 #endif // DATA_BUFFER_H
@@ -0,0 +1,236 @@
+/**
+ * Kaldor IIoT - Decimation Filters
+ *
+ * Brings a multi-kHz ADC stream down to a few tens of Hz in blocks:
+ *
+ *   counts --CIC, order N, /R--> fs/R --FIR, /M--> fs/(R*M)
+ *
+ * The CIC (cascaded integrator-comb) stage does most of the rate change
+ * with integer adds only: N integrators at the input rate, N combs at the
+ * output rate. Its passband droops (sinc^N) and its first alias bands are
+ * only as deep as its nulls, so a short linear-phase FIR after it
+ * compensates the droop, cuts everything above the output Nyquist
+ * frequency and decimates by M.
+ *
+ * The integrators wrap modulo 2^32. The result is still exact as long as
+ * the CIC's gain R^N times the input range fits in 31 bits, which
+ * configure() checks (R <= 80 for order 3 and 12-bit input).
+ *
+ * Single precision throughout, like the acquisition path. The FIR taps are
+ * designed once in configure().
+ *
+ * Header-only and free of Arduino dependencies.
+ */
+
+#ifndef DECIMATOR_H
+#define DECIMATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+
+#define DECIMATOR_MAX_TAPS 64
+#define DECIMATOR_BLOCK 32              // CIC outputs per FIR pass
+
+template <uint8_t ORDER>
+class CicDecimator {
+private:
+    uint32_t integrator[ORDER];
+    uint32_t previous[ORDER];           // Comb delay line, one per stage
+    uint32_t ratio;
+    uint32_t phase;
+    float gain;                         // 1 / R^N: unity gain at DC
+
+public:
+    CicDecimator() : ratio(1), phase(0), gain(1.0f) { reset(); }
+
+    /** Decimate by r. False if R^N times the input range overflows. */
+    bool configure(uint32_t r, uint8_t inputBits) {
+        if (r == 0) return false;
+        uint64_t growth = 1;
+        for (uint8_t i = 0; i < ORDER; i++) growth *= r;
+        if ((growth << inputBits) > (1ull << 31)) return false;
+        ratio = r;
+        gain = 1.0f / (float)growth;
+        reset();
+        return true;
+    }
+
+    void reset() {
+        for (uint8_t i = 0; i < ORDER; i++) integrator[i] = previous[i] = 0;
+        phase = 0;
+    }
+
+    /** n inputs; writes one output per ratio() inputs and returns how many. */
+    size_t process(const int16_t* in, size_t n, float* out) {
+        size_t produced = 0;
+        for (size_t i = 0; i < n; i++) {
+            uint32_t v = (uint32_t)(int32_t)in[i];
+            for (uint8_t k = 0; k < ORDER; k++) {
+                integrator[k] += v;
+                v = integrator[k];
+            }
+            if (++phase < ratio) continue;
+            phase = 0;
+            for (uint8_t k = 0; k < ORDER; k++) {
+                uint32_t x = v;
+                v = x - previous[k];
+                previous[k] = x;
+            }
+            out[produced++] = (float)(int32_t)v * gain;
+        }
+        return produced;
+    }
+
+    uint32_t decimation() const { return ratio; }
+
+    /** Magnitude response at f (cycles per output sample), 1 at DC. */
+    float response(float f) const {
+        const float pi = 3.14159265f;
+        if (f <= 0.0f) return 1.0f;
+        float droop = sinf(pi * f) / ((float)ratio * sinf(pi * f / (float)ratio));
+        float h = 1.0f;
+        for (uint8_t k = 0; k < ORDER; k++) h *= droop;
+        return fabsf(h);
+    }
+};
+
+class FirDecimator {
+private:
+    float taps[DECIMATOR_MAX_TAPS];
+    float history[2 * DECIMATOR_MAX_TAPS];  // Each input stored twice: no wrap in the dot product
+    uint16_t count;
+    uint16_t newest;
+    uint8_t ratio;
+    uint8_t phase;
+
+public:
+    FirDecimator() : count(1), newest(0), ratio(1), phase(0) {
+        taps[0] = 1.0f;
+        reset();
+    }
+
+    /** tapCount coefficients, decimating by r. */
+    bool configure(const float* coefficients, size_t tapCount, uint8_t r) {
+        if (tapCount == 0 || tapCount > DECIMATOR_MAX_TAPS || r == 0) return false;
+        for (size_t i = 0; i < tapCount; i++) taps[i] = coefficients[i];
+        count = (uint16_t)tapCount;
+        ratio = r;
+        reset();
+        return true;
+    }
+
+    void reset() {
+        for (size_t i = 0; i < 2 * DECIMATOR_MAX_TAPS; i++) history[i] = 0.0f;
+        newest = 0;
+        phase = 0;
+    }
+
+    /** n inputs; writes one output per ratio inputs and returns how many. */
+    size_t process(const float* in, size_t n, float* out) {
+        size_t produced = 0;
+        for (size_t i = 0; i < n; i++) {
+            newest = newest ? newest - 1 : count - 1;
+            history[newest] = history[newest + count] = in[i];
+            if (++phase < ratio) continue;
+            phase = 0;
+            // taps[j] weighs the input j samples back
+            const float* x = history + newest;
+            float acc = 0.0f;
+            for (uint16_t j = 0; j < count; j++) acc += taps[j] * x[j];
+            out[produced++] = acc;
+        }
+        return produced;
+    }
+
+    uint16_t tapCount() const { return count; }
+    uint8_t decimation() const { return ratio; }
+};
+
+/**
+ * Low-pass taps for the FIR after a CIC: cutoff at the FIR's output
+ * Nyquist frequency, passband shaped by the inverse of the CIC droop,
+ * Blackman window, unity gain at DC. Frequencies are in cycles per FIR
+ * input sample.
+ */
+template <uint8_t ORDER>
+inline void decimatorCompensator(const CicDecimator<ORDER>& cic, uint8_t firRatio,
+                                 float* taps, size_t tapCount) {
+    const float pi = 3.14159265f;
+    const size_t STEPS = 64;            // Integration points across the passband
+    const float cutoff = 0.5f / (float)firRatio;
+    const float step = cutoff / (float)STEPS;
+
+    float desired[STEPS];
+    for (size_t s = 0; s < STEPS; s++) {
+        float h = cic.response(((float)s + 0.5f) * step);
+        desired[s] = h > 0.25f ? 1.0f / h : 4.0f;
+    }
+
+    // Inverse transform of the desired response, then windowed
+    float centre = 0.5f * (float)(tapCount - 1);
+    float sum = 0.0f;
+    for (size_t k = 0; k < tapCount; k++) {
+        float t = (float)k - centre;
+        float acc = 0.0f;
+        for (size_t s = 0; s < STEPS; s++) {
+            acc += desired[s] * cosf(2.0f * pi * ((float)s + 0.5f) * step * t);
+        }
+        float w = 1.0f;
+        if (tapCount > 1) {
+            float x = (float)k / (float)(tapCount - 1);
+            w = 0.42f - 0.5f * cosf(2.0f * pi * x) + 0.08f * cosf(4.0f * pi * x);
+        }
+        taps[k] = 2.0f * step * acc * w;
+        sum += taps[k];
+    }
+    for (size_t k = 0; k < tapCount; k++) taps[k] /= sum;
+}
+
+/** CIC then compensating FIR: one input channel down to one output rate. */
+template <uint8_t ORDER>
+class DecimationChain {
+private:
+    CicDecimator<ORDER> cic;
+    FirDecimator fir;
+    float stage[DECIMATOR_BLOCK];
+
+public:
+    /**
+     * inputHz / outputHz must be a whole multiple of firRatio, and the
+     * CIC's share of it within its overflow limit for inputBits.
+     */
+    bool configure(uint32_t inputHz, uint32_t outputHz, uint8_t firRatio, size_t tapCount,
+                   uint8_t inputBits) {
+        if (outputHz == 0 || firRatio == 0 || inputHz % outputHz) return false;
+        uint32_t total = inputHz / outputHz;
+        if (total % firRatio || !cic.configure(total / firRatio, inputBits)) return false;
+        if (tapCount == 0 || tapCount > DECIMATOR_MAX_TAPS) return false;
+        float taps[DECIMATOR_MAX_TAPS];
+        decimatorCompensator(cic, firRatio, taps, tapCount);
+        return fir.configure(taps, tapCount, firRatio);
+    }
+
+    void reset() {
+        cic.reset();
+        fir.reset();
+    }
+
+    /** n inputs; out needs room for n / decimation() + 1. Returns outputs written. */
+    size_t process(const int16_t* in, size_t n, float* out) {
+        const size_t chunk = DECIMATOR_BLOCK * cic.decimation();
+        size_t produced = 0;
+        for (size_t at = 0; at < n; at += chunk) {
+            size_t m = n - at < chunk ? n - at : chunk;
+            size_t k = cic.process(in + at, m, stage);
+            produced += fir.process(stage, k, out + produced);
+        }
+        return produced;
+    }
+
+    uint32_t decimation() const { return cic.decimation() * fir.decimation(); }
+    uint32_t cicDecimation() const { return cic.decimation(); }
+    uint16_t tapCount() const { return fir.tapCount(); }
+};
+
+#endif // DECIMATOR_H
@@ -0,0 +1,161 @@
+/**
+ * Kaldor IIoT - Non-blocking Ultrasonic Echo Capture
+ *
+ * Trigger/capture state machine for the HC-SR04. The echo pin's edges are
+ * timestamped from a GPIO interrupt (onEdge()) and the result is collected
+ * on a later loop pass (poll()), so acquisition never busy-waits the way
+ * pulseIn() did.
+ *
+ * Header-only and free of Arduino dependencies: on the host, tests feed
+ * edge timestamps directly.
+ */
+
+#ifndef ECHO_CAPTURE_H
+#define ECHO_CAPTURE_H
+
+#include <stdint.h>
+#include <math.h>
+
+/**
+ * Speed of sound in dry air in mm/µs: 331.3 m/s at 0 °C, growing with the
+ * square root of the absolute temperature (0.3433 at 20 °C, +0.17 %/°C).
+ * Humidity adds less than 0.4 % and is left out. Clamped to the DHT22's
+ * -40..80 °C; NaN gives the 20 °C value.
+ */
+inline float speedOfSound(float celsius) {
+    if (isnan(celsius)) celsius = 20.0f;
+    if (celsius < -40.0f) celsius = -40.0f;
+    if (celsius > 80.0f) celsius = 80.0f;
+    return 0.3313f * sqrtf(1.0f + celsius / 273.15f);
+}
+
+enum class EchoStatus : uint8_t {
+    Idle,       // No measurement in flight
+    Pending,    // Triggered, echo not complete yet
+    Ready,      // Distance available
+    Timeout     // No (complete) echo within the timeout
+};
+
+class EchoCapture {
+private:
+    enum State : uint8_t { IDLE, ARMED, ECHOING, DONE };
+
+    // Written from the ISR, read from the loop. Each field is a single
+    // aligned word; the ISR publishes timestamps before the state change.
+    volatile uint8_t state;
+    volatile uint32_t riseUs;
+    volatile uint32_t fallUs;
+
+    uint32_t triggerUs;
+    uint32_t timeoutUs;
+    uint32_t deadlineUs;
+    float mmPerUs;          // Round-trip: half the speed of sound
+    bool flaggedLate;
+    bool echoed;            // Last collected measurement had both edges
+
+    uint32_t completedCount;
+    uint32_t timeoutCount;
+    uint32_t lateCount;
+
+public:
+    /**
+     * @param timeout  Echo timeout in µs (HC-SR04 max range ~25 ms)
+     * @param deadline Sample period in µs; results still outstanding
+     *                 after this are counted as late
+     */
+    explicit EchoCapture(uint32_t timeout = 30000, uint32_t deadline = 10000)
+        : state(IDLE), riseUs(0), fallUs(0), triggerUs(0),
+          timeoutUs(timeout), deadlineUs(deadline), mmPerUs(0.343f / 2.0f),
+          flaggedLate(false), echoed(false), completedCount(0), timeoutCount(0), lateCount(0) {}
+
+    /** Speed of sound in mm/µs (0.343 at 20 °C; see speedOfSound()). */
+    void setSpeedOfSound(float mmPerMicrosecond) { mmPerUs = mmPerMicrosecond / 2.0f; }
+    void setDeadline(uint32_t deadline) { deadlineUs = deadline; }
+
+    bool busy() const { return state == ARMED || state == ECHOING; }
+
+    /** Triggered and not yet collected by poll(), echo complete or not. */
+    bool inFlight() const { return state != IDLE; }
+
+    /** Arm the capture; call just before sending the trigger pulse. */
+    void trigger(uint32_t nowUs) {
+        triggerUs = nowUs;
+        flaggedLate = false;
+        echoed = false;
+        state = ARMED;
+    }
+
+    /** Echo pin edge, called from the GPIO interrupt. */
+    void onEdge(bool high, uint32_t timestampUs) {
+        if (high) {
+            if (state == ARMED) {
+                riseUs = timestampUs;
+                state = ECHOING;
+            }
+        } else if (state == ECHOING) {
+            fallUs = timestampUs;
+            state = DONE;
+        }
+    }
+
+    /**
+     * Collect the result of the last trigger without blocking.
+     * On Ready, distanceMm holds the measured distance.
+     */
+    EchoStatus poll(uint32_t nowUs, float& distanceMm) {
+        uint8_t s = state;
+
+        if (s == IDLE) {
+            return EchoStatus::Idle;
+        }
+
+        if (s == DONE) {
+            uint32_t echoUs = fallUs - riseUs;
+            state = IDLE;
+            echoed = true;
+            if (echoUs > timeoutUs) {
+                timeoutCount++;
+                return EchoStatus::Timeout;
+            }
+            if (!flaggedLate && fallUs - triggerUs > deadlineUs) {
+                lateCount++;
+            }
+            completedCount++;
+            distanceMm = echoUs * mmPerUs;
+            return EchoStatus::Ready;
+        }
+
+        uint32_t elapsed = nowUs - triggerUs;
+        if (elapsed > timeoutUs) {
+            state = IDLE;
+            timeoutCount++;
+            return EchoStatus::Timeout;
+        }
+        if (!flaggedLate && elapsed > deadlineUs) {
+            flaggedLate = true;
+            lateCount++;
+        }
+        return EchoStatus::Pending;
+    }
+
+    /** Trigger time (µs) of the measurement in flight or last collected. */
+    uint32_t triggerTime() const { return triggerUs; }
+
+    /**
+     * Edges of the last collected measurement relative to its trigger:
+     * rising edge after the trigger and echo width, in µs. False if it
+     * timed out without a complete echo.
+     */
+    bool lastEcho(uint32_t& riseAfterUs, uint32_t& widthUs) const {
+        if (!echoed) return false;
+        riseAfterUs = riseUs - triggerUs;
+        widthUs = fallUs - riseUs;
+        return true;
+    }
+
+    uint32_t completed() const { return completedCount; }
+    uint32_t timeouts() const { return timeoutCount; }
+    uint32_t lateSamples() const { return lateCount; }
+};
+
+#endif // ECHO_CAPTURE_H
@@ -0,0 +1,219 @@
+/**
+ * Kaldor IIoT - Hardware Abstraction Layer
+ *
+ * The interfaces between the firmware pipeline and the board. SensorManager,
+ * DataBuffer and SamplePublisher only talk to these, so the same code runs
+ * on the ESP32 (src/hal_esp32.cpp) and on Linux against simulated hardware
+ * (include/hal_sim.h, `pio run -e native`).
+ *
+ *   HalClock        millis/micros, delays and the cycle counter
+ *   UltrasonicPort  HC-SR04 trigger; echo edges go to an EchoCapture
+ *   TemperaturePort DHT22
+ *   AccelPort       ADXL345 FIFO over I2C with its watermark interrupt
+ *   AnalogPort      continuous ADC conversion into DMA frames
+ *   LinkPort        network link (WiFi station on the board), joined without waiting
+ *   NetStream       non-blocking byte stream to the broker (TLS on the board)
+ *   MqttTransport   publishing (MqttSession over a NetStream, mqtt_session.h)
+ *   FirmwarePort    the update slot being written and the running image
+ *   MemoryPort      heap regions and task stack high-water marks
+ *
+ * Flash storage is already abstracted by JournalStore (journal_store.h),
+ * whose stdio implementation works on both.
+ *
+ * Free of Arduino dependencies; each platform defines halLog().
+ */
+
+#ifndef HAL_H
+#define HAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+class EchoCapture;
+
+class HalClock {
+public:
+    virtual ~HalClock() {}
+    virtual uint32_t millis() = 0;
+    virtual uint32_t micros() = 0;
+    virtual void delay(uint32_t ms) = 0;
+
+    /** Cycle counter for short intervals; micros() where there is none. */
+    virtual uint32_t cycles() { return micros(); }
+    virtual uint32_t cyclesPerMicrosecond() { return 1; }
+};
+
+class UltrasonicPort {
+public:
+    virtual ~UltrasonicPort() {}
+
+    /** Set up the pins; echo edges are reported to capture from now on. */
+    virtual bool begin(EchoCapture& capture) = 0;
+
+    /** Send a trigger pulse. The capture must already be armed. */
+    virtual void trigger() = 0;
+};
+
+class TemperaturePort {
+public:
+    virtual ~TemperaturePort() {}
+    virtual bool begin() = 0;
+
+    /** Degrees Celsius, or NAN if the sensor did not answer. */
+    virtual float readCelsius() = 0;
+};
+
+class AccelPort {
+public:
+    virtual ~AccelPort() {}
+
+    /** Stream-mode FIFO at rateHz, interrupt at watermark entries. */
+    virtual bool begin(uint32_t rateHz, uint8_t watermark) = 0;
+
+    /** Block the calling task until the watermark interrupt or timeout. */
+    virtual bool waitForWatermark(uint32_t timeoutMs) = 0;
+
+    /** Samples queued in the FIFO. */
+    virtual uint8_t fifoEntries() = 0;
+
+    /** True (once) if the FIFO overflowed since the last call. */
+    virtual bool overrun() = 0;
+
+    /** Pop one x, y, z sample (raw counts). */
+    virtual bool readSample(int16_t* xyz) = 0;
+
+    virtual bool selfTest() = 0;
+};
+
+/** One conversion: which input (index into the port's pins) and raw counts. */
+struct AnalogConversion {
+    uint8_t channel;
+    uint16_t value;
+};
+
+class AnalogPort {
+public:
+    virtual ~AnalogPort() {}
+
+    /** Convert every input continuously at rateHz each. */
+    virtual bool begin(uint32_t rateHz) = 0;
+
+    /**
+     * Conversions from the next DMA frame, at most max. Blocks the calling
+     * task for up to timeoutMs until a frame is complete; 0 if none was.
+     */
+    virtual size_t read(AnalogConversion* out, size_t max, uint32_t timeoutMs) = 0;
+
+    /** True (once) if conversions were lost since the last call. */
+    virtual bool overrun() = 0;
+};
+
+class LinkPort {
+public:
+    virtual ~LinkPort() {}
+
+    /** Start joining the network; up() reports when it is done. */
+    virtual void join() = 0;
+    virtual bool up() = 0;
+
+    /** Abandon a join in progress, or leave the network. */
+    virtual void leave() = 0;
+};
+
+class NetStream {
+public:
+    virtual ~NetStream() {}
+
+    /**
+     * Open the connection (TCP, or TLS on the board). True if it is open
+     * or still being set up; in that case poll connecting() until it
+     * returns false, then check connected().
+     */
+    virtual bool connect(const char* host, uint16_t port) = 0;
+
+    /** Connection still being set up; also moves it along where it has to. */
+    virtual bool connecting() { return false; }
+    virtual bool connected() = 0;
+
+    /** Bytes accepted without waiting; 0 while the send buffer is full. */
+    virtual size_t write(const uint8_t* data, size_t length) = 0;
+
+    /** Bytes available without waiting, at most length. */
+    virtual size_t read(uint8_t* data, size_t length) = 0;
+
+    virtual void stop() = 0;
+};
+
+class FirmwarePort {
+public:
+    virtual ~FirmwarePort() {}
+
+    /** Bytes of the running firmware; false past its partition. */
+    virtual bool readRunning(uint32_t offset, uint8_t* data, size_t length) = 0;
+
+    /** Start writing the update slot with an image of this size. */
+    virtual bool begin(uint32_t size) = 0;
+    virtual bool write(const uint8_t* data, size_t length) = 0;
+
+    /** Check the image and boot it next time. False keeps the running one. */
+    virtual bool finish() = 0;
+
+    /** Give up on the image being written. */
+    virtual void abort() = 0;
+};
+
+/** One heap region; all zero if the board has none (PSRAM). */
+struct HeapRegion {
+    uint32_t total;             // Bytes
+    uint32_t free;
+    uint32_t largestFree;       // Largest block that can be allocated
+    uint32_t minimumFree;       // Lowest free since boot
+    uint32_t allocatedBlocks;   // Live allocations
+    uint32_t freeBlocks;        // Free blocks; many small ones = fragmented
+};
+
+enum class HeapKind : uint8_t {
+    Internal,
+    Psram
+};
+
+class MemoryPort {
+public:
+    virtual ~MemoryPort() {}
+    virtual void heap(HeapKind kind, HeapRegion& out) = 0;
+
+    /** Bytes of a task's stack never used so far; task is the RTOS handle. */
+    virtual uint32_t stackUnused(void* task) = 0;
+};
+
+/** Outbound queues, sent in this order. */
+enum class MqttPriority : uint8_t {
+    Control,    // Status, alerts, diagnostics
+    Live,       // Raw samples and processed telemetry
+    Bulk,       // Backlog batches
+    Count
+};
+
+class MqttTransport {
+public:
+    virtual ~MqttTransport() {}
+    virtual bool connected() = 0;
+
+    /**
+     * Queue one message. False if it was not accepted (offline, or its
+     * queue is full); the caller keeps the data.
+     */
+    virtual bool publish(const char* topic, const uint8_t* payload, size_t length, bool retained,
+                         uint8_t qos, MqttPriority priority) = 0;
+
+    bool publish(const char* topic, const char* payload, bool retained, uint8_t qos,
+                 MqttPriority priority) {
+        return publish(topic, (const uint8_t*)payload, strlen(payload), retained, qos, priority);
+    }
+};
+
+/** printf-style diagnostics: Serial on the board, stdout on the host. */
+void halLog(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+#endif // HAL_H
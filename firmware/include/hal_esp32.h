@@ -0,0 +1,246 @@
+/**
+ * Kaldor IIoT - ESP32 HAL Ports
+ *
+ * The board implementations of the hal.h interfaces: Arduino timing, the
+ * HC-SR04 on GPIO interrupts, the DHT22, the ADXL345 FIFO over Wire, the
+ * analog inputs over DMA, the WiFi station, the TLS connection to the
+ * broker, the plain TCP stream for firmware downloads, the OTA app
+ * partitions and the heap and task stack statistics.
+ */
+
+#ifndef HAL_ESP32_H
+#define HAL_ESP32_H
+
+#include <Arduino.h>
+#include <Adafruit_ADXL345_U.h>
+#include <DHT.h>
+#include <WiFi.h>
+#include "driver/adc.h"
+#include "esp_heap_caps.h"
+#include "esp_ota_ops.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/x509_crt.h"
+#include "config.h"
+#include "hal.h"
+
+class EspClock : public HalClock {
+public:
+    uint32_t millis() override { return ::millis(); }
+    uint32_t micros() override { return ::micros(); }
+    void delay(uint32_t ms) override { ::delay(ms); }
+    uint32_t cycles() override { return ESP.getCycleCount(); }
+    uint32_t cyclesPerMicrosecond() override {
+        if (!cpuMhz) cpuMhz = ESP.getCpuFreqMHz();
+        return cpuMhz;
+    }
+
+private:
+    uint32_t cpuMhz = 0;
+};
+
+class Hcsr04Ultrasonic : public UltrasonicPort {
+private:
+    uint8_t trigPin;
+    uint8_t echoPin;
+
+public:
+    Hcsr04Ultrasonic(uint8_t trig, uint8_t echo) : trigPin(trig), echoPin(echo) {}
+    bool begin(EchoCapture& capture) override;
+    void trigger() override;
+};
+
+class DhtTemperature : public TemperaturePort {
+private:
+    DHT dht;
+
+public:
+    DhtTemperature(uint8_t pin, uint8_t type) : dht(pin, type) {}
+    bool begin() override;
+    float readCelsius() override { return dht.readTemperature(); }
+};
+
+/**
+ * The ADXL345 in stream mode. Reading DATAX0..DATAZ1 pops one FIFO entry,
+ * so entries can't come out in one contiguous read. Instead, fifoEntries()
+ * fetches all queued entries in a single I2C command: a repeated start
+ * between entries, one stop at the end. readSample() then hands them out.
+ */
+class Adxl345Fifo : public AccelPort {
+private:
+    static const uint8_t FIFO_DEPTH = 32;
+
+    Adafruit_ADXL345_Unified accel;
+    uint8_t intPin;
+    int16_t fetched[FIFO_DEPTH][3];
+    uint8_t fetchedCount;
+    uint8_t fetchedNext;
+
+    bool readEntries(uint8_t count);
+
+public:
+    explicit Adxl345Fifo(uint8_t interruptPin)
+        : accel(12345), intPin(interruptPin), fetchedCount(0), fetchedNext(0) {}
+    bool begin(uint32_t rateHz, uint8_t watermark) override;
+    bool waitForWatermark(uint32_t timeoutMs) override;
+    uint8_t fifoEntries() override;
+    bool overrun() override;
+    bool readSample(int16_t* xyz) override;
+    bool selfTest() override;
+};
+
+/**
+ * Both analog inputs in the ADC's continuous (DMA) mode: ADC1 alternates
+ * between the pins at 2 x rateHz and the driver collects the results in
+ * frames of ANALOG_FRAME_CONVERSIONS. ADC1 only; ADC2 is taken by WiFi.
+ */
+class EspAnalogDma : public AnalogPort {
+private:
+    uint8_t pins[2];
+    uint8_t channels[2];        // ADC1 channel of each pin
+    uint8_t buffer[ANALOG_FRAME_CONVERSIONS * SOC_ADC_DIGI_RESULT_BYTES];
+    bool overflowed;
+
+public:
+    EspAnalogDma(uint8_t firstPin, uint8_t secondPin)
+        : pins{firstPin, secondPin}, channels{0, 0}, overflowed(false) {}
+    bool begin(uint32_t rateHz) override;
+    size_t read(AnalogConversion* out, size_t max, uint32_t timeoutMs) override;
+    bool overrun() override;
+};
+
+/**
+ * WiFi station joined without waiting. The driver's own auto-reconnect is
+ * off so that ConnectionManager decides when to retry. After the first
+ * join the access point's BSSID and channel are kept, so a rejoin skips
+ * the scan; a join that times out forgets them.
+ */
+class EspWifiLink : public LinkPort {
+private:
+    const char* ssid;
+    const char* password;
+    uint8_t bssid[6];
+    int32_t channel;
+    bool known;
+
+public:
+    EspWifiLink(const char* networkSsid, const char* networkPassword)
+        : ssid(networkSsid), password(networkPassword), channel(0), known(false) {}
+
+    /** Station mode; call once before the first join(). */
+    void begin(const char* hostname);
+
+    void join() override;
+    bool up() override;
+    void leave() override;
+};
+
+/**
+ * TLS connection to the broker over mbedTLS on a non-blocking socket:
+ * connecting() advances the TCP connect and then the handshake a step at a
+ * time, and reads and writes return what the socket takes right now. Writes
+ * go through a MQTT_WRITE_CHUNK staging buffer, since mbedTLS must be called
+ * again with the same data until a record is out.
+ *
+ * The session of the last handshake (ticket or session ID) is kept and
+ * offered on the next connect, so a reconnect can skip the certificate
+ * exchange if the broker agrees. esp-tls would only offer it with
+ * CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS, which the Arduino framework's SDK
+ * build lacks; hence mbedTLS directly. Resolving the broker's name still
+ * blocks while the DNS cache has no entry for it.
+ */
+class EspNetStream : public NetStream {
+private:
+    enum class State : uint8_t { Closed, Connecting, Handshaking, Open };
+
+    mbedtls_net_context net;
+    mbedtls_ssl_context ssl;
+    mbedtls_ssl_config sslConfig;
+    mbedtls_x509_crt caChain;
+    mbedtls_ssl_session session;    // Of the last handshake, if haveSession
+    bool haveSession;
+    const char* caCert;
+    const char* host;
+    State state;
+    uint32_t handshakes;
+    uint32_t resumed;
+    uint8_t staging[MQTT_WRITE_CHUNK];
+    size_t stagedLength;
+    size_t stagedSent;
+
+    bool startHandshake();
+    void keepSession();
+    bool flush();
+
+public:
+    EspNetStream();
+
+    /** Broker CA certificate (PEM), kept by pointer. */
+    void setCACert(const char* pem) { caCert = pem; }
+
+    bool connect(const char* brokerHost, uint16_t brokerPort) override;
+    bool connecting() override;
+    bool connected() override { return state == State::Open; }
+    size_t write(const uint8_t* data, size_t length) override;
+    size_t read(uint8_t* data, size_t length) override;
+    void stop() override;
+
+    /** Completed handshakes, those that resumed a session, and whether one is held. */
+    uint32_t handshakeCount() const { return handshakes; }
+    uint32_t resumedCount() const { return resumed; }
+    bool canResume() const { return haveSession; }
+};
+
+/**
+ * Plain TCP for firmware downloads, over WiFiClient. connect() blocks for
+ * the name lookup and the TCP handshake (up to OTA_CONNECT_TIMEOUT_MS),
+ * which only the OTA task ever waits for; reads return what has arrived.
+ */
+class EspTcpStream : public NetStream {
+private:
+    WiFiClient client;
+
+public:
+    bool connect(const char* host, uint16_t port) override;
+    bool connected() override { return client.connected(); }
+    size_t write(const uint8_t* data, size_t length) override;
+    size_t read(uint8_t* data, size_t length) override;
+    void stop() override { client.stop(); }
+};
+
+/**
+ * The next OTA app partition, written with esp_ota_* in sequential-write
+ * mode: each flash sector is erased just before it is written rather than
+ * the whole partition up front, so no single erase holds the flash (and
+ * stalls the other core) for long. finish() runs the ESP-IDF image check,
+ * including the signature under secure boot, and boots the partition next.
+ */
+class EspFirmwareSlot : public FirmwarePort {
+private:
+    const esp_partition_t* running;
+    const esp_partition_t* target;
+    esp_ota_handle_t handle;
+    bool writing;
+
+public:
+    EspFirmwareSlot() : running(nullptr), target(nullptr), handle(0), writing(false) {}
+
+    bool readRunning(uint32_t offset, uint8_t* data, size_t length) override;
+    bool begin(uint32_t size) override;
+    bool write(const uint8_t* data, size_t length) override;
+    bool finish() override;
+    void abort() override;
+};
+
+/**
+ * heap_caps_get_info() per region: internal 8-bit capable RAM, and PSRAM
+ * when the module has it. It walks the heap under its lock, so call it
+ * every few seconds at most. Stacks are in bytes (ESP-IDF FreeRTOS).
+ */
+class EspMemory : public MemoryPort {
+public:
+    void heap(HeapKind kind, HeapRegion& out) override;
+    uint32_t stackUnused(void* task) override;
+};
+
+#endif // HAL_ESP32_H
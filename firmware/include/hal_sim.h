@@ -0,0 +1,744 @@
+/**
+ * Kaldor IIoT - Simulated HAL Ports
+ *
+ * Host implementations of the hal.h interfaces for the native build and
+ * tests. Time is virtual: SimClock only moves when the driver advances it,
+ * so runs are repeatable and can go faster than real time.
+ *
+ *   SimUltrasonic  echo edges for a distance profile (mm over time) at a
+ *                  given air temperature
+ *   SimTemperature fixed reading, or NAN to simulate a dead sensor
+ *   SimAccel       32-entry FIFO filled at the output data rate with a
+ *                  sine vibration on top of 1 g, overruns like the ADXL345
+ *   SimAnalog      continuous ADC: a signal per input, converted at the
+ *                  sample rate and read in frames, losing what is not read
+ *   SimBroker      MqttTransport that counts publishes and hands each one
+ *                  to an optional hook; can be disconnected at will
+ *   SimLink        LinkPort that comes up a set time after join(), and
+ *                  can be taken away
+ *   SimBrokerStream
+ *                  NetStream with an MQTT broker on the other end, for
+ *                  MqttSession: a connect that takes a while, CONNACK,
+ *                  SUBACK, PINGRESP and (optionally delayed) PUBACKs,
+ *                  partial writes and connection loss
+ *   SimFirmware    FirmwarePort over vectors: a running image to read and
+ *                  the slot an update is written to
+ *   SimHttpServer  NetStream with an HTTP/1.1 file server on the other end,
+ *                  for OtaUpdate: Range requests (or not), error statuses,
+ *                  small reads and connections cut partway through
+ *   SimMemory      MemoryPort with heap regions and stack high-water marks
+ *                  the test sets
+ *
+ * Header-only; needs only the C++ standard library.
+ */
+
+#ifndef HAL_SIM_H
+#define HAL_SIM_H
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include "config.h"
+#include "hal.h"
+#include "echo_capture.h"
+#include "mqtt_codec.h"
+
+class SimClock : public HalClock {
+private:
+    std::atomic<uint64_t> nowUs;
+
+public:
+    SimClock() : nowUs(0) {}
+    uint32_t millis() override { return (uint32_t)(nowUs.load() / 1000); }
+    uint32_t micros() override { return (uint32_t)nowUs.load(); }
+    void delay(uint32_t ms) override { advance((uint64_t)ms * 1000); }
+
+    void advance(uint64_t us) { nowUs.fetch_add(us); }
+    uint64_t elapsedUs() const { return nowUs.load(); }
+};
+
+class SimUltrasonic : public UltrasonicPort {
+public:
+    /** Distance in mm at a given time (ms); <= 0 means no echo. */
+    typedef std::function<float(uint32_t)> Profile;
+
+private:
+    static const uint32_t BURST_US = 450;          // Trigger to echo start
+
+    HalClock& clock;
+    Profile profile;
+    EchoCapture* capture;
+    float mmPerUs;
+
+public:
+    SimUltrasonic(HalClock& clk, Profile distance)
+        : clock(clk), profile(distance), capture(nullptr), mmPerUs(speedOfSound(20.0f)) {}
+
+    /** Air the echo travels through; match SimTemperature for exact readings. */
+    void setAirTemperature(float celsius) { mmPerUs = speedOfSound(celsius); }
+
+    bool begin(EchoCapture& echo) override {
+        capture = &echo;
+        return true;
+    }
+
+    void trigger() override {
+        if (!capture) return;
+        float mm = profile(clock.millis());
+        if (mm <= 0) return;        // Echo never comes; the capture times out
+        uint32_t rise = clock.micros() + BURST_US;
+        capture->onEdge(true, rise);
+        capture->onEdge(false, rise + (uint32_t)(2.0f * mm / mmPerUs + 0.5f));
+    }
+};
+
+class SimTemperature : public TemperaturePort {
+private:
+    float celsius;
+
+public:
+    explicit SimTemperature(float value) : celsius(value) {}
+    bool begin() override { return true; }
+    float readCelsius() override { return celsius; }
+    void set(float value) { celsius = value; }
+};
+
+class SimAccel : public AccelPort {
+private:
+    static const uint32_t FIFO_SIZE = 32;
+    static const int16_t ONE_G = 256;              // Counts at 4 mg/LSB (approx.)
+
+    HalClock& clock;
+    float amplitudeCounts;
+    float frequencyHz;
+    uint32_t rateHz;
+    uint8_t watermarkLevel;
+
+    uint64_t produced;          // Samples generated since begin()
+    uint64_t consumed;          // Samples read (or overwritten)
+    uint32_t startUs;
+    bool overflowed;
+    bool ready;
+
+    void catchUp() {
+        uint64_t due = (uint64_t)(uint32_t)(clock.micros() - startUs) * rateHz / 1000000;
+        if (due > produced) produced = due;
+        if (produced - consumed > FIFO_SIZE) {
+            consumed = produced - FIFO_SIZE;       // Stream mode keeps the newest
+            overflowed = true;
+        }
+    }
+
+public:
+    SimAccel(HalClock& clk, float amplitudeG, float vibrationHz)
+        : clock(clk), amplitudeCounts(amplitudeG * (float)ONE_G), frequencyHz(vibrationHz),
+          rateHz(0), watermarkLevel(0), produced(0), consumed(0), startUs(0),
+          overflowed(false), ready(false) {}
+
+    bool begin(uint32_t rate, uint8_t watermark) override {
+        rateHz = rate;
+        watermarkLevel = watermark;
+        startUs = clock.micros();
+        produced = consumed = 0;
+        ready = true;
+        return true;
+    }
+
+    /** No interrupt on the host: reports whether the watermark is reached. */
+    bool waitForWatermark(uint32_t timeoutMs) override {
+        (void)timeoutMs;
+        return fifoEntries() >= watermarkLevel;
+    }
+
+    uint8_t fifoEntries() override {
+        if (!ready) return 0;
+        catchUp();
+        return (uint8_t)(produced - consumed);
+    }
+
+    bool overrun() override {
+        catchUp();
+        bool was = overflowed;
+        overflowed = false;
+        return was;
+    }
+
+    bool readSample(int16_t* xyz) override {
+        if (fifoEntries() == 0) return false;
+        float t = (float)consumed / (float)rateHz;
+        float v = amplitudeCounts * sinf(6.2831853f * frequencyHz * t);
+        xyz[0] = (int16_t)lrintf(v);
+        xyz[1] = (int16_t)lrintf(0.5f * v);
+        xyz[2] = (int16_t)(ONE_G + lrintf(0.25f * v));
+        consumed++;
+        return true;
+    }
+
+    bool selfTest() override { return ready; }
+};
+
+/**
+ * Continuously converting ADC: each input follows a signal in counts over
+ * time (s). read() hands out what is due by the clock, at most one frame
+ * and without waiting (no DMA interrupt on the host). Conversions not read
+ * within ANALOG_FRAME_CONVERSIONS * 4 are lost, like a full DMA pool.
+ */
+class SimAnalog : public AnalogPort {
+public:
+    typedef std::function<float(double)> Signal;
+
+private:
+    static const uint32_t POOL = ANALOG_FRAME_CONVERSIONS * 4;
+
+    HalClock& clock;
+    std::vector<Signal> inputs;
+    uint32_t rateHz;
+    uint64_t produced;          // Conversions per input read since begin()
+    uint32_t startUs;
+    bool overflowed;
+    bool ready;
+
+public:
+    SimAnalog(HalClock& clk, std::vector<Signal> signals)
+        : clock(clk), inputs(signals), rateHz(0), produced(0), startUs(0),
+          overflowed(false), ready(false) {}
+
+    bool begin(uint32_t rate) override {
+        rateHz = rate;
+        startUs = clock.micros();
+        produced = 0;
+        ready = true;
+        return true;
+    }
+
+    size_t read(AnalogConversion* out, size_t max, uint32_t timeoutMs) override {
+        (void)timeoutMs;
+        if (!ready || inputs.empty()) return 0;
+        uint64_t due = (uint64_t)(uint32_t)(clock.micros() - startUs) * rateHz / 1000000;
+        uint64_t pending = due - produced;
+        if (pending * inputs.size() > POOL) {
+            produced = due - POOL / inputs.size();
+            pending = due - produced;
+            overflowed = true;
+        }
+        size_t frames = (size_t)pending;
+        if (frames > max / inputs.size()) frames = max / inputs.size();
+        size_t n = 0;
+        for (size_t i = 0; i < frames; i++, produced++) {
+            double t = (double)produced / rateHz;
+            for (size_t c = 0; c < inputs.size(); c++) {
+                long v = lrint(inputs[c](t));
+                out[n].channel = (uint8_t)c;
+                out[n].value = (uint16_t)(v < 0 ? 0 : v > 4095 ? 4095 : v);
+                n++;
+            }
+        }
+        return n;
+    }
+
+    bool overrun() override {
+        bool was = overflowed;
+        overflowed = false;
+        return was;
+    }
+};
+
+class SimBroker : public MqttTransport {
+public:
+    typedef std::function<void(const char* topic, const uint8_t* payload, size_t length)> Hook;
+
+private:
+    bool online;
+    Hook hook;
+    uint32_t publishCount;
+    uint64_t byteCount;
+
+public:
+    SimBroker() : online(true), publishCount(0), byteCount(0) {}
+
+    void setConnected(bool connected) { online = connected; }
+    void onPublish(Hook fn) { hook = fn; }
+
+    bool connected() override { return online; }
+
+    bool publish(const char* topic, const uint8_t* payload, size_t length, bool retained,
+                 uint8_t qos, MqttPriority priority) override {
+        (void)retained;
+        (void)qos;
+        (void)priority;
+        if (!online) return false;
+        publishCount++;
+        byteCount += length;
+        if (hook) hook(topic, payload, length);
+        return true;
+    }
+    using MqttTransport::publish;
+
+    uint32_t publishes() const { return publishCount; }
+    uint64_t bytes() const { return byteCount; }
+};
+
+class SimLink : public LinkPort {
+private:
+    HalClock& clock;
+    bool available;
+    bool joining;
+    bool joined;
+    uint32_t joinDelayMs;
+    uint32_t joinStartMs;
+    uint32_t joinCount;
+
+public:
+    explicit SimLink(HalClock& clk)
+        : clock(clk), available(true), joining(false), joined(false), joinDelayMs(0),
+          joinStartMs(0), joinCount(0) {}
+
+    /** Unavailable: joins never complete and the link drops. */
+    void setAvailable(bool reachable) {
+        available = reachable;
+        if (!reachable) joined = false;
+    }
+
+    void setJoinDelay(uint32_t ms) { joinDelayMs = ms; }
+
+    void join() override {
+        joined = false;
+        joining = true;
+        joinStartMs = clock.millis();
+        joinCount++;
+    }
+
+    bool up() override {
+        if (joining && available && clock.millis() - joinStartMs >= joinDelayMs) {
+            joining = false;
+            joined = true;
+        }
+        return joined;
+    }
+
+    void leave() override {
+        joining = false;
+        joined = false;
+    }
+
+    uint32_t joins() const { return joinCount; }     // join() calls
+};
+
+class SimBrokerStream : public NetStream {
+public:
+    typedef std::function<void(const char* topic, const uint8_t* payload, size_t length)> Hook;
+
+private:
+    struct PendingAck {
+        uint16_t packetId;
+        uint32_t dueMs;
+    };
+
+    HalClock& clock;
+    bool online;
+    bool open;
+    size_t writeLimit;
+    uint32_t ackDelayMs;
+    uint32_t connectDelayMs;
+    uint32_t connectStartMs;
+    bool opening;
+    bool acking;
+    Hook hook;
+
+    std::vector<uint8_t> rx;
+    MqttPacketReader reader;
+    std::deque<uint8_t> outbound;
+    std::deque<PendingAck> acks;
+    std::vector<std::string> subscriptions;
+
+    uint32_t connectCount;
+    uint32_t publishCount;
+    uint32_t duplicateCount;
+    uint32_t pingCount;
+    uint32_t pubackCount;
+    uint64_t byteCount;
+
+    void send(const uint8_t* data, size_t length) {
+        outbound.insert(outbound.end(), data, data + length);
+    }
+
+    void releaseAcks() {
+        uint32_t now = clock.millis();
+        while (!acks.empty() && (int32_t)(now - acks.front().dueMs) >= 0) {
+            uint8_t ack[4];
+            send(ack, mqttEncodePuback(ack, acks.front().packetId));
+            acks.pop_front();
+        }
+    }
+
+    void handle() {
+        uint8_t* body = reader.body();
+        switch (reader.type()) {
+        case MqttPacket::Connect: {
+            const uint8_t connack[4] = {(uint8_t)MqttPacket::Connack << 4, 2, 0, 0};
+            send(connack, sizeof(connack));
+            connectCount++;
+            break;
+        }
+        case MqttPacket::Publish: {
+            const char* topic;
+            const uint8_t* payload;
+            size_t length;
+            uint16_t id;
+            uint8_t flags = reader.flags();
+            if (!mqttParsePublish(body, reader.length(), flags, topic, payload, length, id)) break;
+            publishCount++;
+            byteCount += length;
+            if (flags & MQTT_FLAG_DUP) duplicateCount++;
+            if (hook) hook(topic, payload, length);
+            if (id && acking) acks.push_back({id, clock.millis() + ackDelayMs});
+            break;
+        }
+        case MqttPacket::Subscribe: {
+            size_t filterLength = ((size_t)body[2] << 8) | body[3];
+            subscriptions.push_back(std::string((const char*)body + 4, filterLength));
+            const uint8_t suback[5] = {(uint8_t)MqttPacket::Suback << 4, 3, body[0], body[1], 0};
+            send(suback, sizeof(suback));
+            break;
+        }
+        case MqttPacket::Puback:
+            pubackCount++;
+            break;
+        case MqttPacket::Pingreq: {
+            uint8_t resp[2];
+            send(resp, mqttEncodeEmpty(resp, MqttPacket::Pingresp));
+            pingCount++;
+            break;
+        }
+        case MqttPacket::Disconnect:
+            stop();
+            break;
+        default:
+            break;
+        }
+    }
+
+public:
+    explicit SimBrokerStream(HalClock& clk, size_t maxPacket = 65536)
+        : clock(clk), online(true), open(false), writeLimit(0), ackDelayMs(0), connectDelayMs(0),
+          connectStartMs(0), opening(false), acking(true),
+          rx(maxPacket), reader(rx.data(), rx.size()), connectCount(0), publishCount(0),
+          duplicateCount(0), pingCount(0), pubackCount(0), byteCount(0) {}
+
+    /** Offline: connects fail and an open connection is cut. */
+    void setOnline(bool reachable) {
+        online = reachable;
+        if (!reachable) stop();
+    }
+
+    /** Bytes taken per write() call, 0 = all; models a full send buffer. */
+    void setWriteLimit(size_t bytes) { writeLimit = bytes; }
+
+    /** PUBACK this long after the PUBLISH arrived. */
+    void setAckDelay(uint32_t ms) { ackDelayMs = ms; }
+
+    /** connect() takes this long (TCP and TLS handshake). */
+    void setConnectDelay(uint32_t ms) { connectDelayMs = ms; }
+
+    /** Stop acknowledging (a broker that has hung). */
+    void setAcking(bool enabled) { acking = enabled; }
+
+    void onPublish(Hook fn) { hook = fn; }
+
+    /** Message to the device, if it subscribed to exactly this topic. */
+    void deliver(const char* topic, const char* payload, uint8_t qos = 0, uint16_t packetId = 1) {
+        if (!open) return;
+        bool subscribed = false;
+        for (const std::string& s : subscriptions) subscribed = subscribed || s == topic;
+        if (!subscribed) return;
+        size_t length = strlen(payload);
+        std::vector<uint8_t> packet(mqttPublishSize(strlen(topic), length, qos));
+        mqttEncodePublish(packet.data(), topic, (const uint8_t*)payload, length, qos, false,
+                          packetId);
+        send(packet.data(), packet.size());
+    }
+
+    bool connect(const char* host, uint16_t port) override {
+        (void)host;
+        (void)port;
+        stop();
+        if (!online) return false;
+        opening = true;
+        connectStartMs = clock.millis();
+        connecting();
+        return true;
+    }
+
+    bool connecting() override {
+        if (opening && clock.millis() - connectStartMs >= connectDelayMs) {
+            opening = false;
+            open = true;
+        }
+        return opening;
+    }
+
+    bool connected() override { return open; }
+
+    size_t write(const uint8_t* data, size_t length) override {
+        if (!open) return 0;
+        if (writeLimit && length > writeLimit) length = writeLimit;
+        size_t used = 0;
+        while (used < length && open) {
+            bool complete;
+            used += reader.feed(data + used, length - used, complete);
+            if (complete) handle();
+        }
+        return length;
+    }
+
+    size_t read(uint8_t* data, size_t length) override {
+        if (!open) return 0;
+        releaseAcks();
+        size_t n = 0;
+        while (n < length && !outbound.empty()) {
+            data[n++] = outbound.front();
+            outbound.pop_front();
+        }
+        return n;
+    }
+
+    void stop() override {
+        open = false;
+        opening = false;
+        reader.reset();
+        outbound.clear();
+        acks.clear();
+        subscriptions.clear();
+    }
+
+    uint32_t connects() const { return connectCount; }
+    uint32_t publishes() const { return publishCount; }
+    uint32_t duplicates() const { return duplicateCount; }
+    uint32_t pings() const { return pingCount; }
+    uint32_t pubacks() const { return pubackCount; }     // From the device
+    uint64_t bytes() const { return byteCount; }
+};
+
+class SimFirmware : public FirmwarePort {
+private:
+    std::vector<uint8_t> running;
+    std::vector<uint8_t> slot;
+    uint32_t expected;
+    bool writing;
+    bool installed;
+    uint32_t beginCount;
+    uint32_t abortCount;
+
+public:
+    explicit SimFirmware(const std::vector<uint8_t>& image = std::vector<uint8_t>())
+        : running(image), expected(0), writing(false), installed(false), beginCount(0),
+          abortCount(0) {}
+
+    bool readRunning(uint32_t offset, uint8_t* data, size_t length) override {
+        if (offset > running.size() || length > running.size() - offset) return false;
+        memcpy(data, running.data() + offset, length);
+        return true;
+    }
+
+    bool begin(uint32_t size) override {
+        slot.clear();
+        expected = size;
+        writing = true;
+        installed = false;
+        beginCount++;
+        return true;
+    }
+
+    bool write(const uint8_t* data, size_t length) override {
+        if (!writing || length > expected - slot.size()) return false;
+        slot.insert(slot.end(), data, data + length);
+        return true;
+    }
+
+    bool finish() override {
+        writing = false;
+        installed = slot.size() == expected;
+        return installed;
+    }
+
+    void abort() override {
+        writing = false;
+        slot.clear();
+        abortCount++;
+    }
+
+    const std::vector<uint8_t>& written() const { return slot; }
+    bool isInstalled() const { return installed; }
+    uint32_t begins() const { return beginCount; }
+    uint32_t aborts() const { return abortCount; }
+};
+
+class SimHttpServer : public NetStream {
+private:
+    struct File {
+        std::string path;
+        std::vector<uint8_t> body;
+    };
+
+    bool online;
+    bool open;
+    bool ranges;
+    bool responded;             // This connection's reply is queued
+    int forcedStatus;
+    size_t readLimit;
+    uint32_t dropAfter;
+    std::vector<File> files;
+    std::string request;
+    std::deque<uint8_t> outbound;
+
+    uint32_t requestCount;
+    uint32_t rangeCount;
+    uint32_t lastRangeStart;
+    uint64_t bodyCount;
+
+    void respond() {
+        size_t lineEnd = request.find("\r\n");
+        size_t pathStart = request.find(' ') + 1;
+        std::string path = request.substr(pathStart, request.find(' ', pathStart) - pathStart);
+        uint32_t from = 0;
+        bool ranged = false;
+        size_t range = request.find("\r\nRange: bytes=");
+        if (range != std::string::npos && range >= lineEnd) {
+            from = (uint32_t)strtoul(request.c_str() + range + 15, nullptr, 10);
+            ranged = ranges;
+            rangeCount++;
+            lastRangeStart = from;
+        }
+        request.clear();
+        requestCount++;
+        responded = true;
+
+        const File* file = nullptr;
+        for (const File& f : files) {
+            if (f.path == path) file = &f;
+        }
+        char head[192];
+        if (forcedStatus || !file || (ranged && from >= file->body.size())) {
+            int status = forcedStatus ? forcedStatus : file ? 416 : 404;
+            snprintf(head, sizeof(head), "HTTP/1.1 %d Error\r\nContent-Length: 0\r\n\r\n", status);
+            outbound.insert(outbound.end(), head, head + strlen(head));
+            return;
+        }
+        size_t size = file->body.size();
+        if (!ranged) from = 0;
+        if (ranged) {
+            snprintf(head, sizeof(head),
+                     "HTTP/1.1 206 Partial Content\r\nContent-Length: %u\r\n"
+                     "Content-Range: bytes %u-%u/%u\r\nConnection: close\r\n\r\n",
+                     (unsigned)(size - from), (unsigned)from, (unsigned)(size - 1), (unsigned)size);
+        } else {
+            snprintf(head, sizeof(head),
+                     "HTTP/1.1 200 OK\r\nContent-Length: %u\r\nAccept-Ranges: %s\r\n"
+                     "Connection: close\r\n\r\n",
+                     (unsigned)size, ranges ? "bytes" : "none");
+        }
+        outbound.insert(outbound.end(), head, head + strlen(head));
+        size_t end = size;
+        if (dropAfter && end - from > dropAfter) end = from + dropAfter;
+        outbound.insert(outbound.end(), file->body.begin() + from, file->body.begin() + end);
+        bodyCount += end - from;
+    }
+
+public:
+    SimHttpServer()
+        : online(true), open(false), ranges(true), responded(false), forcedStatus(0), readLimit(0),
+          dropAfter(0), requestCount(0), rangeCount(0), lastRangeStart(0), bodyCount(0) {}
+
+    void serve(const char* path, const std::vector<uint8_t>& body) {
+        files.push_back({path, body});
+    }
+
+    /** Offline: connects fail and an open connection is cut. */
+    void setOnline(bool reachable) {
+        online = reachable;
+        if (!reachable) stop();
+    }
+
+    /** Without range support a Range header is ignored (full 200 reply). */
+    void setRanges(bool supported) { ranges = supported; }
+
+    /** Answer every request with this status and no body; 0 = normal. */
+    void setStatus(int status) { forcedStatus = status; }
+
+    /** Bytes returned per read() call, 0 = all available. */
+    void setReadLimit(size_t bytes) { readLimit = bytes; }
+
+    /** Close each connection after this many body bytes, 0 = never. */
+    void setDropAfter(uint32_t bytes) { dropAfter = bytes; }
+
+    bool connect(const char* host, uint16_t port) override {
+        (void)host;
+        (void)port;
+        stop();
+        open = online;
+        return open;
+    }
+
+    bool connected() override { return open; }
+
+    size_t write(const uint8_t* data, size_t length) override {
+        if (!open) return 0;
+        request.append((const char*)data, length);
+        if (request.find("\r\n\r\n") != std::string::npos) respond();
+        return length;
+    }
+
+    /** Everything queued for this connection, then it is closed. */
+    size_t read(uint8_t* data, size_t length) override {
+        if (!open) return 0;
+        if (readLimit && length > readLimit) length = readLimit;
+        size_t n = 0;
+        while (n < length && !outbound.empty()) {
+            data[n++] = outbound.front();
+            outbound.pop_front();
+        }
+        if (responded && outbound.empty() && n == 0) open = false;
+        return n;
+    }
+
+    void stop() override {
+        open = false;
+        request.clear();
+        responded = false;
+        outbound.clear();
+    }
+
+    uint32_t requests() const { return requestCount; }
+    uint32_t rangeRequests() const { return rangeCount; }
+    uint32_t lastRange() const { return lastRangeStart; }
+    uint64_t bodyBytes() const { return bodyCount; }    // Body bytes queued to the device
+};
+
+class SimMemory : public MemoryPort {
+public:
+    HeapRegion internal;
+    HeapRegion psram;
+    std::vector<std::pair<void*, uint32_t>> stacks;     // Task handle, unused bytes
+
+    SimMemory() : internal(), psram() {}
+
+    void heap(HeapKind kind, HeapRegion& out) override {
+        out = kind == HeapKind::Psram ? psram : internal;
+    }
+
+    uint32_t stackUnused(void* task) override {
+        for (const auto& s : stacks) {
+            if (s.first == task) return s.second;
+        }
+        return 0;
+    }
+};
+
+#endif // HAL_SIM_H
@@ -0,0 +1,258 @@
+/**
+ * Kaldor IIoT - Sliding Median and Hampel Filter
+ *
+ * Spikes and multipath echoes from the ultrasonic sensor are replaced by
+ * the median of the recent samples before they reach the statistics:
+ *
+ *   SlidingMedian  the last N samples in an order-statistic treap (a
+ *                  binary search tree with subtree sizes), so inserting,
+ *                  evicting and selecting the k-th smallest are O(log N).
+ *                  The median is one select, the MAD (median absolute
+ *                  deviation) a binary search over two sorted runs, O(log^2 N).
+ *   HampelFilter   rejects a sample more than threshold * 1.4826 * MAD
+ *                  from the median of the previous N samples and outputs
+ *                  that median instead
+ *
+ * The window always takes the raw sample, rejected or not, so a real
+ * step passes once it fills more than half the window; isolated outliers
+ * never do. Nodes live in fixed arrays indexed by window slot: no heap.
+ *
+ * Header-only and free of Arduino dependencies.
+ */
+
+#ifndef HAMPEL_FILTER_H
+#define HAMPEL_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+
+template <size_t N>
+class SlidingMedian {
+    static_assert(N >= 3 && N < 255, "SlidingMedian window must be 3..254 samples");
+
+private:
+    static const uint8_t NIL = 0xFF;
+
+    float values[N];
+    uint8_t left[N];
+    uint8_t right[N];
+    uint8_t count[N];           // Subtree size
+    uint32_t priority[N];       // Heap order of the treap
+    uint8_t root;
+    size_t nextSlot;            // Oldest sample once the window is full
+    size_t filled;
+    uint32_t seed;
+
+    uint32_t nextPriority() {
+        // xorshift32: deterministic, so runs are reproducible
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    }
+
+    uint8_t sizeOf(uint8_t n) const { return n == NIL ? 0 : count[n]; }
+    void update(uint8_t n) { count[n] = (uint8_t)(1 + sizeOf(left[n]) + sizeOf(right[n])); }
+
+    // Tree order: by value, equal values by slot
+    bool before(uint8_t a, uint8_t b) const {
+        return values[a] < values[b] || (values[a] == values[b] && a < b);
+    }
+
+    // Nodes ordered before `key` go to a, the rest to b
+    void split(uint8_t t, uint8_t key, uint8_t& a, uint8_t& b) {
+        if (t == NIL) {
+            a = b = NIL;
+            return;
+        }
+        if (before(t, key)) {
+            split(right[t], key, right[t], b);
+            a = t;
+        } else {
+            split(left[t], key, a, left[t]);
+            b = t;
+        }
+        update(t);
+    }
+
+    uint8_t merge(uint8_t a, uint8_t b) {
+        if (a == NIL) return b;
+        if (b == NIL) return a;
+        if (priority[a] > priority[b]) {
+            right[a] = merge(right[a], b);
+            update(a);
+            return a;
+        }
+        left[b] = merge(a, left[b]);
+        update(b);
+        return b;
+    }
+
+    void insert(uint8_t n) {
+        left[n] = right[n] = NIL;
+        count[n] = 1;
+        priority[n] = nextPriority();
+        uint8_t a, b;
+        split(root, n, a, b);
+        root = merge(merge(a, n), b);
+    }
+
+    uint8_t erase(uint8_t t, uint8_t n) {
+        if (t == n) return merge(left[t], right[t]);
+        if (before(n, t)) {
+            left[t] = erase(left[t], n);
+        } else {
+            right[t] = erase(right[t], n);
+        }
+        update(t);
+        return t;
+    }
+
+    /** Number of samples <= value. */
+    size_t rankAtMost(float value) const {
+        size_t rank = 0;
+        uint8_t t = root;
+        while (t != NIL) {
+            if (values[t] <= value) {
+                rank += sizeOf(left[t]) + 1;
+                t = right[t];
+            } else {
+                t = left[t];
+            }
+        }
+        return rank;
+    }
+
+    /**
+     * k-th smallest (0-based) |x - m| over the window. With p samples <= m,
+     * the deviations below m ascend as m - select(p-1-i) and those above as
+     * select(p+j) - m; take k+1 from the two runs like merging them.
+     */
+    float kthDeviation(size_t k, float m, size_t p) const {
+        size_t above = filled - p;
+        size_t lo = k + 1 > above ? k + 1 - above : 0;
+        size_t hi = k + 1 < p ? k + 1 : p;
+        while (lo < hi) {
+            size_t i = (lo + hi) / 2;       // i from below, k+1-i from above
+            if (m - select(p - 1 - i) < select(p + k - i) - m) {
+                lo = i + 1;
+            } else {
+                hi = i;
+            }
+        }
+        size_t j = k + 1 - lo;
+        float lastBelow = lo > 0 ? m - select(p - lo) : 0.0f;
+        float lastAbove = j > 0 ? select(p + j - 1) - m : 0.0f;
+        return lastBelow > lastAbove ? lastBelow : lastAbove;
+    }
+
+public:
+    SlidingMedian() { reset(); }
+
+    void reset() {
+        root = NIL;
+        nextSlot = 0;
+        filled = 0;
+        seed = 0x9E3779B9u;
+    }
+
+    /** Add a sample, evicting the oldest once the window is full. */
+    void push(float value) {
+        uint8_t slot = (uint8_t)nextSlot;
+        if (filled == N) {
+            root = erase(root, slot);
+        } else {
+            filled++;
+        }
+        values[slot] = value;
+        insert(slot);
+        nextSlot = (nextSlot + 1) % N;
+    }
+
+    size_t size() const { return filled; }
+    size_t capacity() const { return N; }
+
+    /** k-th smallest sample, 0-based; k < size(). */
+    float select(size_t k) const {
+        uint8_t t = root;
+        for (;;) {
+            size_t below = sizeOf(left[t]);
+            if (k < below) {
+                t = left[t];
+            } else if (k == below) {
+                return values[t];
+            } else {
+                k -= below + 1;
+                t = right[t];
+            }
+        }
+    }
+
+    float median() const {
+        if (filled == 0) return 0;
+        if (filled % 2) return select(filled / 2);
+        return 0.5f * (select(filled / 2 - 1) + select(filled / 2));
+    }
+
+    /** Median absolute deviation from m (normally median()). */
+    float mad(float m) const {
+        if (filled == 0) return 0;
+        size_t p = rankAtMost(m);
+        if (filled % 2) return kthDeviation(filled / 2, m, p);
+        return 0.5f * (kthDeviation(filled / 2 - 1, m, p) + kthDeviation(filled / 2, m, p));
+    }
+};
+
+template <size_t N>
+class HampelFilter {
+private:
+    SlidingMedian<N> window;
+    float threshold;            // In sigmas; 0 passes everything through
+    float minSigma;             // Floor for 1.4826 * MAD, same unit as the samples
+    uint32_t rejectedCount;
+
+public:
+    // MAD to standard deviation for normally distributed samples
+    static constexpr float MAD_TO_SIGMA = 1.4826f;
+
+    HampelFilter(float threshold, float minSigma)
+        : threshold(threshold), minSigma(minSigma), rejectedCount(0) {}
+
+    void configure(float newThreshold, float newMinSigma) {
+        threshold = newThreshold;
+        minSigma = newMinSigma;
+    }
+
+    /** Forget the window, e.g. after a calibration change. */
+    void reset() { window.reset(); }
+
+    /**
+     * Filtered value of one valid sample: the window median if the sample
+     * is an outlier, otherwise the sample. Nothing is rejected until the
+     * window is half full.
+     */
+    float apply(float value, bool& rejected) {
+        rejected = false;
+        float out = value;
+        if (threshold > 0 && window.size() > N / 2) {
+            // Within threshold * minSigma of the median is never an outlier,
+            // which spares the MAD for nearly every sample
+            float m = window.median();
+            float deviation = fabsf(value - m);
+            if (deviation > threshold * minSigma &&
+                deviation > threshold * MAD_TO_SIGMA * window.mad(m)) {
+                rejected = true;
+                rejectedCount++;
+                out = m;
+            }
+        }
+        window.push(value);
+        return out;
+    }
+
+    uint32_t rejected() const { return rejectedCount; }
+    const SlidingMedian<N>& samples() const { return window; }
+};
+
+#endif // HAMPEL_FILTER_H
@@ -0,0 +1,111 @@
+/**
+ * Kaldor IIoT - Journal Segment Storage
+ *
+ * Storage backend for SampleJournal: a fixed set of numbered, append-only
+ * segment files. FileJournalStore uses C stdio, which works both on the
+ * host and on the ESP32, where SPIFFS is mounted into the VFS at /spiffs.
+ */
+
+#ifndef JOURNAL_STORE_H
+#define JOURNAL_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+class JournalStore {
+public:
+    virtual ~JournalStore() {}
+
+    /** Bytes currently stored in a segment (0 if it doesn't exist). */
+    virtual size_t size(uint8_t segment) = 0;
+
+    /** Read up to length bytes from offset; returns bytes read. */
+    virtual size_t read(uint8_t segment, size_t offset, uint8_t* data, size_t length) = 0;
+
+    /** Append to the end of a segment and make it durable. */
+    virtual bool append(uint8_t segment, const uint8_t* data, size_t length) = 0;
+
+    /** Delete a segment. Erasing a missing segment succeeds. */
+    virtual bool erase(uint8_t segment) = 0;
+};
+
+class FileJournalStore : public JournalStore {
+private:
+    char prefix[64];
+    FILE* active;           // Kept open for appends to one segment
+    int activeSegment;
+
+    void path(uint8_t segment, char* out, size_t outSize) const {
+        snprintf(out, outSize, "%s%u.jnl", prefix, (unsigned)segment);
+    }
+
+    void closeActive() {
+        if (active) {
+            fclose(active);
+            active = nullptr;
+        }
+        activeSegment = -1;
+    }
+
+public:
+    /** @param pathPrefix e.g. "/spiffs/journal-" -> /spiffs/journal-0.jnl */
+    explicit FileJournalStore(const char* pathPrefix) : active(nullptr), activeSegment(-1) {
+        snprintf(prefix, sizeof(prefix), "%s", pathPrefix);
+    }
+
+    ~FileJournalStore() override { closeActive(); }
+
+    size_t size(uint8_t segment) override {
+        char name[80];
+        path(segment, name, sizeof(name));
+        FILE* f = fopen(name, "rb");
+        if (!f) return 0;
+        fseek(f, 0, SEEK_END);
+        long end = ftell(f);
+        fclose(f);
+        return end > 0 ? (size_t)end : 0;
+    }
+
+    size_t read(uint8_t segment, size_t offset, uint8_t* data, size_t length) override {
+        char name[80];
+        path(segment, name, sizeof(name));
+        FILE* f = fopen(name, "rb");
+        if (!f) return 0;
+        size_t got = 0;
+        if (fseek(f, (long)offset, SEEK_SET) == 0) {
+            got = fread(data, 1, length, f);
+        }
+        fclose(f);
+        return got;
+    }
+
+    bool append(uint8_t segment, const uint8_t* data, size_t length) override {
+        if (activeSegment != segment) {
+            closeActive();
+            char name[80];
+            path(segment, name, sizeof(name));
+            active = fopen(name, "ab");
+            if (!active) return false;
+            activeSegment = segment;
+        }
+        if (fwrite(data, 1, length, active) != length) {
+            closeActive();
+            return false;
+        }
+        fflush(active);
+        fsync(fileno(active));
+        return true;
+    }
+
+    bool erase(uint8_t segment) override {
+        if (activeSegment == segment) closeActive();
+        char name[80];
+        path(segment, name, sizeof(name));
+        remove(name);
+        return true;
+    }
+};
+
+#endif // JOURNAL_STORE_H
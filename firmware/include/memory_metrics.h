@@ -0,0 +1,250 @@
+/**
+ * Kaldor IIoT - Memory Metrics
+ *
+ * Heap and stack usage over weeks of uptime, without a debugger: every
+ * MEMORY_SNAPSHOT_MS the network task records the internal heap (free,
+ * largest free block, minimum since boot, live and free block counts),
+ * PSRAM when there is any, and the unused stack of each registered task
+ * into a ring of MEMORY_HISTORY snapshots. Each snapshot is published
+ * once on kaldor/loom/{id}/diagnostics/memory; those taken while MQTT was
+ * down go out oldest first when it is back, as long as the ring holds
+ * them.
+ *
+ * Leaks show as a falling free heap (free_trend_bph, least squares over
+ * the ring) and a creeping block count; fragmentation as a largest free
+ * block falling behind the free total (1 - largest / free).
+ *
+ * Single-threaded: everything here belongs to the network task.
+ *
+ * Header-only and free of Arduino dependencies.
+ */
+
+#ifndef MEMORY_METRICS_H
+#define MEMORY_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+#include "hal.h"
+#include "payload_writer.h"
+
+#define MEMORY_MAX_TASKS 8
+
+struct MemorySnapshot {
+    uint32_t seq;
+    uint32_t uptime;                        // s
+    uint32_t internalFree;                  // Bytes
+    uint32_t internalLargest;
+    uint32_t internalMinimum;
+    uint32_t psramFree;
+    uint32_t psramLargest;
+    uint32_t psramMinimum;
+    uint16_t allocatedBlocks;               // Internal heap, saturating
+    uint16_t freeBlocks;
+    uint16_t stackUnused[MEMORY_MAX_TASKS]; // Bytes, in addTask() order
+};
+
+/** 1 - largest free block / free bytes: 0 = one contiguous free block. */
+inline float heapFragmentation(uint32_t free, uint32_t largest) {
+    if (free == 0 || largest >= free) return 0.0f;
+    return 1.0f - (float)largest / (float)free;
+}
+
+class MemoryMetrics {
+private:
+    struct Task {
+        const char* name;
+        void* handle;
+        uint32_t stackBytes;
+    };
+
+    MemoryPort& memory;
+    HalClock& clock;
+    uint32_t interval;
+
+    Task tasks[MEMORY_MAX_TASKS];
+    uint8_t taskCount;
+
+    MemorySnapshot ring[MEMORY_HISTORY];
+    size_t head;                // Oldest
+    size_t length;
+    uint32_t nextSeq;
+    uint32_t unsentSeq;         // Oldest snapshot not yet published
+    uint32_t lostCount;         // Overwritten before they were published
+    uint32_t lastTaken;
+    uint32_t internalTotal;
+    uint32_t psramTotal;
+
+    static uint16_t saturate(uint32_t value) {
+        return value > 0xFFFF ? (uint16_t)0xFFFF : (uint16_t)value;
+    }
+
+public:
+    MemoryMetrics(MemoryPort& port, HalClock& halClock, uint32_t intervalMs = MEMORY_SNAPSHOT_MS)
+        : memory(port), clock(halClock), interval(intervalMs), taskCount(0), head(0), length(0),
+          nextSeq(0), unsentSeq(0), lostCount(0), lastTaken(0), internalTotal(0),
+          psramTotal(0) {}
+
+    /**
+     * Watch a task's stack. The name must outlive the metrics. False once
+     * MEMORY_MAX_TASKS are registered.
+     */
+    bool addTask(const char* name, void* handle, uint32_t stackBytes) {
+        if (taskCount == MEMORY_MAX_TASKS) return false;
+        tasks[taskCount].name = name;
+        tasks[taskCount].handle = handle;
+        tasks[taskCount].stackBytes = stackBytes;
+        taskCount++;
+        return true;
+    }
+
+    /** Take a snapshot if one is due (the first straight away). */
+    bool poll() {
+        if (nextSeq != 0 && clock.millis() - lastTaken < interval) return false;
+        take();
+        return true;
+    }
+
+    /** Take a snapshot now; the next one is due an interval later. */
+    const MemorySnapshot& take() {
+        lastTaken = clock.millis();
+        HeapRegion internal;
+        HeapRegion psram;
+        memory.heap(HeapKind::Internal, internal);
+        memory.heap(HeapKind::Psram, psram);
+        internalTotal = internal.total;
+        psramTotal = psram.total;
+
+        if (length == MEMORY_HISTORY) {
+            if (ring[head].seq >= unsentSeq) {
+                unsentSeq = ring[head].seq + 1;
+                lostCount++;
+            }
+            head = (head + 1) % MEMORY_HISTORY;
+            length--;
+        }
+        MemorySnapshot& s = ring[(head + length) % MEMORY_HISTORY];
+        length++;
+
+        s.seq = nextSeq++;
+        s.uptime = lastTaken / 1000;
+        s.internalFree = internal.free;
+        s.internalLargest = internal.largestFree;
+        s.internalMinimum = internal.minimumFree;
+        s.psramFree = psram.free;
+        s.psramLargest = psram.largestFree;
+        s.psramMinimum = psram.minimumFree;
+        s.allocatedBlocks = saturate(internal.allocatedBlocks);
+        s.freeBlocks = saturate(internal.freeBlocks);
+        for (uint8_t t = 0; t < MEMORY_MAX_TASKS; t++) {
+            s.stackUnused[t] = t < taskCount ? saturate(memory.stackUnused(tasks[t].handle)) : 0;
+        }
+        return s;
+    }
+
+    /** Oldest snapshot not yet published, or nullptr. */
+    const MemorySnapshot* unsent() const {
+        if (length == 0) return nullptr;
+        const MemorySnapshot& newest = at(length - 1);
+        if (unsentSeq > newest.seq) return nullptr;
+        return &at(length - 1 - (newest.seq - unsentSeq));
+    }
+
+    void markSent() {
+        const MemorySnapshot* s = unsent();
+        if (s) unsentSeq = s->seq + 1;
+    }
+
+    /** Oldest first. */
+    const MemorySnapshot& at(size_t i) const { return ring[(head + i) % MEMORY_HISTORY]; }
+    const MemorySnapshot* latest() const { return length ? &at(length - 1) : nullptr; }
+    size_t size() const { return length; }
+    uint32_t lost() const { return lostCount; }
+
+    /**
+     * Least-squares slope of the internal free heap over the ring, in bytes
+     * per hour; negative while memory is being lost. 0 with fewer than
+     * three snapshots.
+     */
+    float freeTrend() const {
+        if (length < 3) return 0.0f;
+        float n = (float)length;
+        float meanT = 0.0f;
+        float meanFree = 0.0f;
+        for (size_t i = 0; i < length; i++) {
+            meanT += (float)(at(i).uptime - at(0).uptime);
+            meanFree += (float)at(i).internalFree;
+        }
+        meanT /= n;
+        meanFree /= n;
+        float sxy = 0.0f;
+        float sxx = 0.0f;
+        for (size_t i = 0; i < length; i++) {
+            float dt = (float)(at(i).uptime - at(0).uptime) - meanT;
+            sxy += dt * ((float)at(i).internalFree - meanFree);
+            sxx += dt * dt;
+        }
+        return sxx > 0.0f ? sxy / sxx * 3600.0f : 0.0f;
+    }
+
+    /** Least unused stack across the watched tasks, in bytes. */
+    uint32_t lowestStackUnused(const MemorySnapshot& s) const {
+        uint32_t lowest = UINT32_MAX;
+        for (uint8_t t = 0; t < taskCount; t++) {
+            if (s.stackUnused[t] < lowest) lowest = s.stackUnused[t];
+        }
+        return taskCount ? lowest : 0;
+    }
+
+    uint8_t taskCountWatched() const { return taskCount; }
+    const char* taskName(uint8_t t) const { return tasks[t].name; }
+    uint32_t taskStack(uint8_t t) const { return tasks[t].stackBytes; }
+    uint32_t internalSize() const { return internalTotal; }
+    uint32_t psramSize() const { return psramTotal; }
+};
+
+/**
+ * One snapshot for the diagnostics/memory topic. The psram object is left
+ * out on modules without PSRAM; stacks are {task: [size, unused]} in
+ * bytes. Returns false if it did not fit.
+ */
+inline bool writeMemorySnapshot(PayloadWriter& out, const MemoryMetrics& metrics,
+                                const MemorySnapshot& s, const char* deviceId) {
+    out.reset();
+    out.beginObject()
+       .add("device_id", deviceId)
+       .add("seq", s.seq)
+       .add("uptime", s.uptime)
+       .beginObject("heap")
+       .add("total", metrics.internalSize())
+       .add("free", s.internalFree)
+       .add("largest_free_block", s.internalLargest)
+       .add("min_free", s.internalMinimum)
+       .add("allocated_blocks", (uint32_t)s.allocatedBlocks)
+       .add("free_blocks", (uint32_t)s.freeBlocks)
+       .add("fragmentation", heapFragmentation(s.internalFree, s.internalLargest), 3)
+       .endObject();
+    if (metrics.psramSize()) {
+        out.beginObject("psram")
+           .add("total", metrics.psramSize())
+           .add("free", s.psramFree)
+           .add("largest_free_block", s.psramLargest)
+           .add("min_free", s.psramMinimum)
+           .add("fragmentation", heapFragmentation(s.psramFree, s.psramLargest), 3)
+           .endObject();
+    }
+    out.beginObject("stacks");
+    for (uint8_t t = 0; t < metrics.taskCountWatched(); t++) {
+        out.beginArray(metrics.taskName(t))
+           .value(metrics.taskStack(t))
+           .value((uint32_t)s.stackUnused[t])
+           .endArray();
+    }
+    out.endObject()
+       .add("free_trend_bph", metrics.freeTrend(), 1)
+       .add("lost", metrics.lost())
+       .endObject();
+    return out.ok();
+}
+
+#endif // MEMORY_METRICS_H
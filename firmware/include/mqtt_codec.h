@@ -0,0 +1,261 @@
+/**
+ * Kaldor IIoT - MQTT 3.1.1 Packet Encoding
+ *
+ * The packets the device sends (CONNECT, PUBLISH, PUBACK, SUBSCRIBE,
+ * PINGREQ, DISCONNECT) are written into caller-owned buffers, and
+ * MqttPacketReader reassembles incoming packets from a byte stream that
+ * arrives in arbitrary pieces. No heap, no blocking.
+ *
+ * Header-only and free of Arduino dependencies.
+ */
+
+#ifndef MQTT_CODEC_H
+#define MQTT_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+enum class MqttPacket : uint8_t {
+    Connect = 1,
+    Connack = 2,
+    Publish = 3,
+    Puback = 4,
+    Subscribe = 8,
+    Suback = 9,
+    Pingreq = 12,
+    Pingresp = 13,
+    Disconnect = 14
+};
+
+// PUBLISH fixed-header flags
+static const uint8_t MQTT_FLAG_RETAIN = 0x01;
+static const uint8_t MQTT_FLAG_QOS1 = 0x02;
+static const uint8_t MQTT_FLAG_DUP = 0x08;
+
+/** Bytes the remaining-length field takes (1..4). */
+inline size_t mqttLengthBytes(size_t remaining) {
+    return remaining < 128 ? 1 : remaining < 16384 ? 2 : remaining < 2097152 ? 3 : 4;
+}
+
+/** Fixed header: type, flags and the variable-length remaining length. */
+inline size_t mqttWriteHeader(uint8_t* out, MqttPacket type, uint8_t flags, size_t remaining) {
+    size_t n = 0;
+    out[n++] = (uint8_t)(((uint8_t)type << 4) | (flags & 0x0F));
+    do {
+        uint8_t digit = remaining % 128;
+        remaining /= 128;
+        out[n++] = remaining ? (uint8_t)(digit | 0x80) : digit;
+    } while (remaining);
+    return n;
+}
+
+inline size_t mqttWriteString(uint8_t* out, const char* s, size_t length) {
+    out[0] = (uint8_t)(length >> 8);
+    out[1] = (uint8_t)length;
+    memcpy(out + 2, s, length);
+    return length + 2;
+}
+
+/** Size of a PUBLISH packet. */
+inline size_t mqttPublishSize(size_t topicLength, size_t payloadLength, uint8_t qos) {
+    size_t remaining = 2 + topicLength + (qos ? 2 : 0) + payloadLength;
+    return 1 + mqttLengthBytes(remaining) + remaining;
+}
+
+/** PUBLISH into out, which must hold mqttPublishSize() bytes. */
+inline size_t mqttEncodePublish(uint8_t* out, const char* topic, const uint8_t* payload,
+                                size_t length, uint8_t qos, bool retained, uint16_t packetId) {
+    size_t topicLength = strlen(topic);
+    size_t remaining = 2 + topicLength + (qos ? 2 : 0) + length;
+    uint8_t flags = (uint8_t)((qos ? MQTT_FLAG_QOS1 : 0) | (retained ? MQTT_FLAG_RETAIN : 0));
+    size_t n = mqttWriteHeader(out, MqttPacket::Publish, flags, remaining);
+    n += mqttWriteString(out + n, topic, topicLength);
+    if (qos) {
+        out[n++] = (uint8_t)(packetId >> 8);
+        out[n++] = (uint8_t)packetId;
+    }
+    memcpy(out + n, payload, length);
+    return n + length;
+}
+
+/** CONNECT with MQTT 3.1.1; user and password may be null. 0 if it does not fit. */
+inline size_t mqttEncodeConnect(uint8_t* out, size_t capacity, const char* clientId,
+                                const char* user, const char* password,
+                                uint16_t keepAliveS, bool cleanSession) {
+    size_t idLength = strlen(clientId);
+    size_t userLength = user ? strlen(user) : 0;
+    size_t passwordLength = password ? strlen(password) : 0;
+    size_t remaining = 10 + 2 + idLength + (user ? 2 + userLength : 0) +
+                       (password ? 2 + passwordLength : 0);
+    if (1 + mqttLengthBytes(remaining) + remaining > capacity) return 0;
+
+    uint8_t flags = (uint8_t)((user ? 0x80 : 0) | (password ? 0x40 : 0) | (cleanSession ? 0x02 : 0));
+    size_t n = mqttWriteHeader(out, MqttPacket::Connect, 0, remaining);
+    n += mqttWriteString(out + n, "MQTT", 4);
+    out[n++] = 4;                           // Protocol level 3.1.1
+    out[n++] = flags;
+    out[n++] = (uint8_t)(keepAliveS >> 8);
+    out[n++] = (uint8_t)keepAliveS;
+    n += mqttWriteString(out + n, clientId, idLength);
+    if (user) n += mqttWriteString(out + n, user, userLength);
+    if (password) n += mqttWriteString(out + n, password, passwordLength);
+    return n;
+}
+
+/** SUBSCRIBE to one topic filter. 0 if it does not fit. */
+inline size_t mqttEncodeSubscribe(uint8_t* out, size_t capacity, uint16_t packetId,
+                                  const char* filter, uint8_t qos) {
+    size_t filterLength = strlen(filter);
+    size_t remaining = 2 + 2 + filterLength + 1;
+    if (1 + mqttLengthBytes(remaining) + remaining > capacity) return 0;
+
+    size_t n = mqttWriteHeader(out, MqttPacket::Subscribe, 0x02, remaining);
+    out[n++] = (uint8_t)(packetId >> 8);
+    out[n++] = (uint8_t)packetId;
+    n += mqttWriteString(out + n, filter, filterLength);
+    out[n++] = qos;
+    return n;
+}
+
+/** PUBACK, 4 bytes. */
+inline size_t mqttEncodePuback(uint8_t* out, uint16_t packetId) {
+    out[0] = (uint8_t)MqttPacket::Puback << 4;
+    out[1] = 2;
+    out[2] = (uint8_t)(packetId >> 8);
+    out[3] = (uint8_t)packetId;
+    return 4;
+}
+
+/** Packets without a body (PINGREQ, PINGRESP, DISCONNECT), 2 bytes. */
+inline size_t mqttEncodeEmpty(uint8_t* out, MqttPacket type) {
+    out[0] = (uint8_t)((uint8_t)type << 4);
+    out[1] = 0;
+    return 2;
+}
+
+/**
+ * Reassembles packets from stream bytes. Bodies larger than the buffer
+ * are skipped and counted; the stream stays in sync.
+ */
+class MqttPacketReader {
+private:
+    enum State : uint8_t { HEADER, LENGTH, BODY };
+
+    uint8_t* buffer;
+    size_t capacity;
+    State state;
+    uint8_t header;
+    uint32_t remaining;     // Body length
+    uint32_t multiplier;
+    uint32_t received;      // Body bytes so far
+    uint32_t oversizedCount;
+    bool malformed;
+
+public:
+    MqttPacketReader(uint8_t* storage, size_t size)
+        : buffer(storage), capacity(size), oversizedCount(0) {
+        reset();
+    }
+
+    void reset() {
+        state = HEADER;
+        header = 0;
+        remaining = 0;
+        multiplier = 1;
+        received = 0;
+        malformed = false;
+    }
+
+    /**
+     * Consume bytes up to the end of the next complete packet. Returns the
+     * bytes used; complete is set when a packet is ready in body().
+     */
+    size_t feed(const uint8_t* data, size_t length, bool& complete) {
+        complete = false;
+        size_t used = 0;
+        while (used < length && !complete) {
+            uint8_t b = data[used++];
+            switch (state) {
+            case HEADER:
+                header = b;
+                remaining = 0;
+                multiplier = 1;
+                received = 0;
+                state = LENGTH;
+                break;
+            case LENGTH:
+                remaining += (uint32_t)(b & 0x7F) * multiplier;
+                if (multiplier > 128 * 128 * 128) {
+                    malformed = true;           // Over four length bytes
+                    state = HEADER;
+                } else if (b & 0x80) {
+                    multiplier *= 128;
+                } else if (remaining == 0) {
+                    state = HEADER;
+                    complete = true;
+                } else {
+                    state = BODY;
+                }
+                break;
+            case BODY: {
+                // Copy as much of the body as is here in one go
+                size_t take = remaining - received;
+                if (take > length - used + 1) take = length - used + 1;
+                if (received + take <= capacity) {
+                    memcpy(buffer + received, data + used - 1, take);
+                }
+                received += (uint32_t)take;
+                used += take - 1;
+                if (received == remaining) {
+                    state = HEADER;
+                    if (remaining > capacity) {
+                        oversizedCount++;
+                    } else {
+                        complete = true;
+                    }
+                }
+                break;
+            }
+            }
+        }
+        return used;
+    }
+
+    MqttPacket type() const { return (MqttPacket)(header >> 4); }
+    uint8_t flags() const { return header & 0x0F; }
+    uint8_t* body() { return buffer; }
+    size_t length() const { return remaining; }
+
+    /** True once a length field ran past four bytes; the stream is lost. */
+    bool failed() const { return malformed; }
+    uint32_t oversized() const { return oversizedCount; }
+};
+
+/** Packet id in the first two bytes of a PUBACK or SUBACK body. */
+inline uint16_t mqttPacketId(const uint8_t* body) {
+    return (uint16_t)((body[0] << 8) | body[1]);
+}
+
+/**
+ * Split an incoming PUBLISH body. The topic is moved to the front of the
+ * body and NUL-terminated in place. False if the body is malformed.
+ */
+inline bool mqttParsePublish(uint8_t* body, size_t length, uint8_t flags, const char*& topic,
+                             const uint8_t*& payload, size_t& payloadLength, uint16_t& packetId) {
+    if (length < 2) return false;
+    size_t topicLength = ((size_t)body[0] << 8) | body[1];
+    uint8_t qos = (flags >> 1) & 0x03;
+    size_t header = 2 + topicLength + (qos ? 2 : 0);
+    if (header > length) return false;
+
+    packetId = qos ? mqttPacketId(body + 2 + topicLength) : 0;
+    payload = body + header;
+    payloadLength = length - header;
+    memmove(body, body + 2, topicLength);
+    body[topicLength] = '\0';               // Old topic bytes, already moved
+    topic = (const char*)body;
+    return true;
+}
+
+#endif // MQTT_CODEC_H
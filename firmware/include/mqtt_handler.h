@@ -5,10 +5,10 @@
 #ifndef MQTT_HANDLER_H
 #define MQTT_HANDLER_H
 
-#include <Arduino.h>
-#include <PubSubClient.h>
+#include <stddef.h>
+#include <stdint.h>
 
-// Forward declaration
-void mqttCallback(char* topic, byte* payload, unsigned int length);
+// Incoming messages, from MqttSession::loop() on the network task
+void mqttCallback(const char* topic, const uint8_t* payload, size_t length);
 
 #endif // MQTT_HANDLER_H
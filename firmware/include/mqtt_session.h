@@ -0,0 +1,616 @@
+/**
+ * Kaldor IIoT - Pipelined MQTT Session
+ *
+ * MQTT 3.1.1 client over a non-blocking NetStream. publish() only copies
+ * the encoded packet into a bounded per-priority queue; loop() writes as
+ * much as the stream takes without waiting, reads whatever has arrived and
+ * keeps the connection alive. Nothing in here blocks the network task.
+ *
+ *   Queues     one byte ring per MqttPriority (control, live, bulk), sent
+ *              in that order; a full queue refuses the message
+ *   QoS 1      up to `window` messages in flight at once; each stays in
+ *              its queue until the broker's PUBACK. After a reconnect the
+ *              unacknowledged ones go out again with the DUP flag
+ *   Connecting the stream may take many loop() passes to open (a TLS
+ *              handshake on the board); the session polls it and gives up
+ *              after the connect timeout
+ *   Timeouts   no CONNACK, PUBACK or PINGRESP within the ack timeout
+ *              drops the connection
+ *
+ * Counters and latency histograms (enqueue -> written, written -> PUBACK)
+ * go into the telemetry. Single-threaded: everything belongs to the
+ * network task.
+ *
+ * Header-only and free of Arduino dependencies.
+ */
+
+#ifndef MQTT_SESSION_H
+#define MQTT_SESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "config.h"
+#include "hal.h"
+#include "mqtt_codec.h"
+#include "stage_timing.h"
+
+struct MqttStats {
+    uint32_t queued;        // Messages accepted by publish()
+    uint32_t rejected;      // Refused because their queue was full
+    uint32_t sent;          // Written to the stream, retransmits included
+    uint32_t acked;         // PUBACKs for our QoS 1 messages
+    uint32_t retransmits;   // QoS 1 messages sent again after a reconnect
+    uint32_t ackTimeouts;   // Connections dropped for a missing response
+    uint32_t connects;      // Sessions established (CONNACK accepted)
+    uint32_t disconnects;   // Established sessions lost or dropped
+    uint32_t received;      // Incoming PUBLISH messages
+    uint64_t bytesOut;
+};
+
+class MqttSession : public MqttTransport {
+public:
+    typedef void (*Callback)(const char* topic, const uint8_t* payload, size_t length);
+
+    enum class State : uint8_t {
+        Disconnected,
+        Opening,        // Stream being opened (TCP, TLS handshake)
+        Connecting,     // CONNECT sent, waiting for the CONNACK
+        Connected
+    };
+
+private:
+    // Queue record: this header, then the encoded PUBLISH, padded to 4
+    struct Record {
+        uint16_t length;        // Packet bytes; WRAP marks unused space up to the end
+        uint16_t packetId;
+        uint8_t state;
+        uint8_t qos;
+        uint16_t reserved;
+        uint32_t queuedUs;
+        uint32_t sentUs;
+    };
+    static const uint16_t WRAP = 0xFFFF;
+    static const uint32_t HEADER = sizeof(Record);
+    enum RecordState : uint8_t { QUEUED, IN_FLIGHT, DONE };
+
+    struct Queue {
+        uint8_t* storage;
+        uint32_t capacity;
+        uint32_t head;          // Oldest record
+        uint32_t tail;          // Where the next record goes
+        uint32_t cursor;        // Next record to send
+        uint32_t records;
+        uint32_t unsent;        // Records from the cursor on
+        uint32_t used;          // Bytes, wasted end space included
+        uint32_t highWater;
+    };
+
+    struct InFlight {
+        uint16_t packetId;
+        uint8_t queue;
+        uint32_t offset;
+        uint32_t sentMs;
+    };
+
+    // Record being written; nothing else goes out until it is complete
+    struct Writing {
+        bool active;
+        uint8_t queue;
+        uint32_t offset;
+        uint32_t written;
+    };
+
+    NetStream& stream;
+    HalClock& clock;
+    Queue queues[(uint8_t)MqttPriority::Count];
+    InFlight inFlight[MQTT_MAX_INFLIGHT];
+    uint8_t inFlightCount;
+    uint8_t window;
+    Writing writing;
+
+    // Control packets, written between records
+    uint8_t control[MQTT_CONTROL_PACKET_BYTES];
+    size_t controlLength;
+    size_t controlSent;
+
+    uint8_t rxBuffer[MQTT_RX_PACKET_SIZE];
+    MqttPacketReader reader;
+    Callback callback;
+
+    State state;
+    bool sessionStarted;
+    uint16_t nextPacketId;
+    uint32_t ackTimeoutMs;
+    uint32_t connectTimeoutMs;
+    uint32_t keepAliveMs;
+    uint32_t stateSinceMs;      // Opening, Connecting: when that began
+    uint32_t lastWriteMs;
+    uint32_t pingSentMs;
+    bool pingOutstanding;
+
+    MqttStats counters;
+    LatencyHistogram queueHistogram;
+    LatencyHistogram ackHistogram;
+
+    static uint32_t align4(uint32_t n) { return (n + 3) & ~3u; }
+
+    Record* recordAt(Queue& q, uint32_t offset) {
+        return reinterpret_cast<Record*>(q.storage + offset);
+    }
+
+    /** Offset of the record at offset, following a wrap marker. */
+    uint32_t settle(Queue& q, uint32_t offset) {
+        return recordAt(q, offset)->length == WRAP ? 0 : offset;
+    }
+
+    uint32_t after(Queue& q, uint32_t offset) {
+        uint32_t next = offset + align4(HEADER + recordAt(q, offset)->length);
+        return q.capacity - next < HEADER ? 0 : next;
+    }
+
+    uint16_t takePacketId() {
+        if (++nextPacketId == 0) nextPacketId = 1;
+        return nextPacketId;
+    }
+
+    /** Room for a record of `bytes` at the tail; writes the wrap marker. */
+    bool reserve(Queue& q, uint32_t bytes, uint32_t& offset) {
+        if (q.records == 0) {
+            q.head = q.tail = q.cursor = 0;
+            q.used = 0;
+        }
+        if (q.records > 0 && q.tail == q.head) return false;
+        if (q.tail >= q.head) {
+            if (bytes <= q.capacity - q.tail) {
+                offset = q.tail;
+                return true;
+            }
+            if (q.records > 0 && bytes > q.head) return false;
+            if (q.records == 0 && bytes > q.capacity) return false;
+            recordAt(q, q.tail)->length = WRAP;
+            q.used += q.capacity - q.tail;
+            offset = 0;
+            return true;
+        }
+        if (bytes > q.head - q.tail) return false;
+        offset = q.tail;
+        return true;
+    }
+
+    /** Drop completed records from the front of the queue. */
+    void reclaim(Queue& q) {
+        while (q.records > 0) {
+            uint32_t head = settle(q, q.head);
+            Record* r = recordAt(q, head);
+            if (r->state != DONE) break;
+            uint32_t next = after(q, head);
+            if (q.unsent == q.records) {        // Cursor on the head (after a reconnect)
+                q.cursor = next;
+                q.unsent--;
+            }
+            if (head != q.head) q.used -= q.capacity - q.head;     // Wrap marker
+            q.used -= (next ? next : q.capacity) - head;
+            q.head = next;
+            q.records--;
+        }
+    }
+
+    bool queueControl(const uint8_t* data, size_t length) {
+        if (controlSent == controlLength) {
+            controlLength = controlSent = 0;
+        } else if (controlLength + length > sizeof(control)) {
+            memmove(control, control + controlSent, controlLength - controlSent);
+            controlLength -= controlSent;
+            controlSent = 0;
+        }
+        if (controlLength + length > sizeof(control)) return false;
+        memcpy(control + controlLength, data, length);
+        controlLength += length;
+        return true;
+    }
+
+    /** Next queue with something it may send now, in priority order. */
+    int pickQueue() {
+        for (uint8_t p = 0; p < (uint8_t)MqttPriority::Count; p++) {
+            Queue& q = queues[p];
+            while (q.unsent > 0) {
+                q.cursor = settle(q, q.cursor);
+                Record* r = recordAt(q, q.cursor);
+                if (r->state != DONE) break;
+                q.cursor = after(q, q.cursor);      // Done before a reconnect
+                q.unsent--;
+            }
+            if (q.unsent == 0) continue;
+            Record* r = recordAt(q, q.cursor);
+            if (r->qos && inFlightCount >= window) continue;    // Window full
+            return p;
+        }
+        return -1;
+    }
+
+    void recordWritten(Queue& q, uint8_t p, uint32_t offset) {
+        Record* r = recordAt(q, offset);
+        uint8_t* packet = q.storage + offset + HEADER;
+        uint32_t now = clock.micros();
+        if (packet[0] & MQTT_FLAG_DUP) {
+            counters.retransmits++;
+        } else {
+            queueHistogram.record(now - r->queuedUs);
+        }
+        counters.sent++;
+        r->sentUs = now;
+        q.cursor = after(q, offset);
+        q.unsent--;
+
+        if (r->qos) {
+            r->state = IN_FLIGHT;
+            InFlight& f = inFlight[inFlightCount++];
+            f.packetId = r->packetId;
+            f.queue = p;
+            f.offset = offset;
+            f.sentMs = clock.millis();
+        } else {
+            r->state = DONE;
+            reclaim(q);
+        }
+    }
+
+    size_t writeSome(const uint8_t* data, size_t length) {
+        size_t n = stream.write(data, length);
+        if (n) {
+            counters.bytesOut += n;
+            lastWriteMs = clock.millis();
+        }
+        return n;
+    }
+
+    void writeOut(size_t& budget) {
+        while (budget > 0) {
+            if (writing.active) {
+                Queue& q = queues[writing.queue];
+                Record* r = recordAt(q, writing.offset);
+                size_t left = r->length - writing.written;
+                size_t n = writeSome(q.storage + writing.offset + HEADER + writing.written,
+                                     left < budget ? left : budget);
+                if (n == 0) return;                 // Send buffer full
+                budget -= n;
+                writing.written += (uint32_t)n;
+                if (writing.written == r->length) {
+                    writing.active = false;
+                    recordWritten(q, writing.queue, writing.offset);
+                }
+                continue;
+            }
+            if (controlSent < controlLength) {
+                size_t left = controlLength - controlSent;
+                size_t n = writeSome(control + controlSent, left < budget ? left : budget);
+                if (n == 0) return;
+                budget -= n;
+                controlSent += n;
+                continue;
+            }
+            if (state != State::Connected) return;
+            int p = pickQueue();
+            if (p < 0) return;
+            writing.active = true;
+            writing.queue = (uint8_t)p;
+            writing.offset = queues[p].cursor;
+            writing.written = 0;
+        }
+    }
+
+    void handlePacket() {
+        uint8_t* body = reader.body();
+        size_t length = reader.length();
+
+        switch (reader.type()) {
+        case MqttPacket::Connack:
+            if (state == State::Connecting && length >= 2 && body[1] == 0) {
+                state = State::Connected;
+                sessionStarted = true;
+                counters.connects++;
+            } else {
+                drop();
+            }
+            break;
+
+        case MqttPacket::Puback: {
+            if (length < 2) break;
+            uint16_t id = mqttPacketId(body);
+            for (uint8_t i = 0; i < inFlightCount; i++) {
+                if (inFlight[i].packetId != id) continue;
+                Queue& q = queues[inFlight[i].queue];
+                Record* r = recordAt(q, inFlight[i].offset);
+                ackHistogram.record(clock.micros() - r->sentUs);
+                r->state = DONE;
+                counters.acked++;
+                inFlight[i] = inFlight[--inFlightCount];
+                reclaim(q);
+                break;
+            }
+            break;
+        }
+
+        case MqttPacket::Publish: {
+            const char* topic;
+            const uint8_t* payload;
+            size_t payloadLength;
+            uint16_t id;
+            if (!mqttParsePublish(body, length, reader.flags(), topic, payload, payloadLength, id)) {
+                break;
+            }
+            counters.received++;
+            if (id) {
+                uint8_t ack[4];
+                queueControl(ack, mqttEncodePuback(ack, id));
+            }
+            if (callback) callback(topic, payload, payloadLength);
+            break;
+        }
+
+        case MqttPacket::Pingresp:
+            pingOutstanding = false;
+            break;
+
+        default:
+            break;              // SUBACK: nothing to do
+        }
+    }
+
+    /** Returns the number of packets handled. */
+    size_t readIn() {
+        uint8_t chunk[256];
+        size_t handled = 0;
+        for (int pass = 0; pass < 16 && state != State::Disconnected; pass++) {
+            size_t n = stream.read(chunk, sizeof(chunk));
+            if (n == 0) break;
+            size_t used = 0;
+            while (used < n && state != State::Disconnected) {
+                bool complete;
+                used += reader.feed(chunk + used, n - used, complete);
+                if (reader.failed()) {
+                    drop();
+                    return handled;
+                }
+                if (complete) {
+                    handlePacket();
+                    handled++;
+                }
+            }
+        }
+        return handled;
+    }
+
+    void checkTimers() {
+        uint32_t now = clock.millis();
+        if (state == State::Connecting) {
+            if (now - stateSinceMs > ackTimeoutMs) {
+                counters.ackTimeouts++;
+                drop();
+            }
+            return;
+        }
+        for (uint8_t i = 0; i < inFlightCount; i++) {
+            if (now - inFlight[i].sentMs > ackTimeoutMs) {
+                counters.ackTimeouts++;
+                drop();
+                return;
+            }
+        }
+        if (pingOutstanding) {
+            if (now - pingSentMs > ackTimeoutMs) {
+                counters.ackTimeouts++;
+                drop();
+            }
+        } else if (keepAliveMs && now - lastWriteMs >= keepAliveMs) {
+            uint8_t ping[2];
+            queueControl(ping, mqttEncodeEmpty(ping, MqttPacket::Pingreq));
+            pingOutstanding = true;
+            pingSentMs = now;
+        }
+    }
+
+    /**
+     * Opening: true once the stream is open and CONNECT is on its way.
+     * Gives up if the stream failed or took longer than the connect timeout.
+     */
+    bool opened() {
+        if (stream.connecting()) {
+            if (clock.millis() - stateSinceMs > connectTimeoutMs) drop();
+            return false;
+        }
+        if (!stream.connected()) {
+            drop();
+            return false;
+        }
+        state = State::Connecting;
+        stateSinceMs = lastWriteMs = clock.millis();
+        size_t budget = MQTT_WRITE_BUDGET;
+        writeOut(budget);
+        return true;
+    }
+
+    /**
+     * Connection gone: close the stream and rewind every queue. Messages
+     * that were in flight are marked DUP and go out again first.
+     */
+    void drop() {
+        stream.stop();
+        if (state == State::Connected) counters.disconnects++;
+        state = State::Disconnected;
+        reader.reset();
+        controlLength = controlSent = 0;
+        writing.active = false;
+        pingOutstanding = false;
+
+        for (uint8_t i = 0; i < inFlightCount; i++) {
+            Queue& q = queues[inFlight[i].queue];
+            Record* r = recordAt(q, inFlight[i].offset);
+            r->state = QUEUED;
+            q.storage[inFlight[i].offset + HEADER] |= MQTT_FLAG_DUP;
+        }
+        inFlightCount = 0;
+        for (Queue& q : queues) {
+            q.cursor = q.head;
+            q.unsent = q.records;
+        }
+    }
+
+public:
+    MqttSession(NetStream& netStream, HalClock& halClock)
+        : stream(netStream), clock(halClock), inFlightCount(0), window(MQTT_INFLIGHT_WINDOW),
+          controlLength(0), controlSent(0), reader(rxBuffer, sizeof(rxBuffer)),
+          callback(nullptr), state(State::Disconnected), sessionStarted(false),
+          nextPacketId(0), ackTimeoutMs(MQTT_ACK_TIMEOUT_MS),
+          connectTimeoutMs(MQTT_CONNECT_TIMEOUT_MS),
+          keepAliveMs(MQTT_KEEPALIVE_S * 1000UL), stateSinceMs(0), lastWriteMs(0),
+          pingSentMs(0), pingOutstanding(false), counters() {
+        memset(queues, 0, sizeof(queues));
+        writing.active = false;
+    }
+
+    /** Storage for one priority's queue (4-byte aligned); none = refuse. */
+    void setQueue(MqttPriority priority, uint8_t* storage, size_t bytes) {
+        Queue& q = queues[(uint8_t)priority];
+        memset(&q, 0, sizeof(q));
+        q.storage = storage;
+        q.capacity = (uint32_t)bytes & ~3u;
+    }
+
+    /** QoS 1 messages in flight at once, 1..MQTT_MAX_INFLIGHT. */
+    void setWindow(uint8_t messages) {
+        window = messages < 1 ? 1 : messages > MQTT_MAX_INFLIGHT ? MQTT_MAX_INFLIGHT : messages;
+    }
+
+    void setAckTimeout(uint32_t ms) { ackTimeoutMs = ms; }
+    void setConnectTimeout(uint32_t ms) { connectTimeoutMs = ms; }
+    void setKeepAlive(uint16_t seconds) { keepAliveMs = seconds * 1000UL; }
+    void setCallback(Callback fn) { callback = fn; }
+
+    /**
+     * Start opening the stream and queue CONNECT; loop() finishes opening,
+     * sends it and reads the CONNACK. False if the attempt failed at once.
+     * Credentials may be null. Queued messages are kept and go out after
+     * the CONNACK.
+     */
+    bool connect(const char* host, uint16_t port, const char* clientId,
+                 const char* user, const char* password) {
+        if (state != State::Disconnected) drop();
+        if (!stream.connect(host, port)) return false;
+
+        uint8_t packet[MQTT_CONTROL_PACKET_BYTES];
+        size_t n = mqttEncodeConnect(packet, sizeof(packet), clientId, user, password,
+                                     (uint16_t)(keepAliveMs / 1000), true);
+        if (n == 0 || !queueControl(packet, n)) {
+            stream.stop();
+            controlLength = controlSent = 0;
+            return false;
+        }
+        state = State::Opening;
+        stateSinceMs = clock.millis();
+        opened();
+        return true;
+    }
+
+    /** Queued behind any control packets; the SUBACK is not waited for. */
+    bool subscribe(const char* filter, uint8_t qos) {
+        if (state == State::Disconnected) return false;
+        uint8_t packet[MQTT_CONTROL_PACKET_BYTES];
+        size_t n = mqttEncodeSubscribe(packet, sizeof(packet), takePacketId(), filter, qos);
+        return n && queueControl(packet, n);
+    }
+
+    /** Send DISCONNECT (best effort) and close. */
+    void disconnect() {
+        if (state == State::Disconnected) return;
+        uint8_t packet[2];
+        stream.write(packet, mqttEncodeEmpty(packet, MqttPacket::Disconnect));
+        drop();
+    }
+
+    /** Write, read and check timeouts. Call on every network loop pass. */
+    void loop() {
+        if (state == State::Disconnected) return;
+        if (state == State::Opening && !opened()) return;
+        if (!stream.connected()) {
+            drop();
+            return;
+        }
+        readIn();
+        if (state == State::Disconnected) return;
+        checkTimers();
+
+        // PUBACKs that arrive meanwhile reopen the window; keep going until
+        // the stream stops taking bytes, nothing comes back or the budget
+        // is spent
+        size_t budget = MQTT_WRITE_BUDGET;
+        for (int pass = 0; pass < 8 && state != State::Disconnected && budget > 0; pass++) {
+            writeOut(budget);
+            if (state == State::Disconnected || readIn() == 0) break;
+        }
+    }
+
+    bool connected() override { return state == State::Connected; }
+    State status() const { return state; }
+
+    /** True once after each accepted CONNACK: subscribe and announce here. */
+    bool justConnected() {
+        bool started = sessionStarted;
+        sessionStarted = false;
+        return started;
+    }
+
+    bool publish(const char* topic, const uint8_t* payload, size_t length, bool retained,
+                 uint8_t qos, MqttPriority priority) override {
+        if (state != State::Connected || priority >= MqttPriority::Count) return false;
+        Queue& q = queues[(uint8_t)priority];
+        qos = qos ? 1 : 0;
+        size_t size = mqttPublishSize(strlen(topic), length, qos);
+        uint32_t offset;
+        if (!q.storage || size >= WRAP || !reserve(q, align4(HEADER + (uint32_t)size), offset)) {
+            counters.rejected++;
+            return false;
+        }
+
+        Record* r = recordAt(q, offset);
+        r->length = (uint16_t)size;
+        r->packetId = qos ? takePacketId() : 0;
+        r->state = QUEUED;
+        r->qos = qos;
+        r->reserved = 0;
+        r->queuedUs = clock.micros();
+        r->sentUs = 0;
+        mqttEncodePublish(q.storage + offset + HEADER, topic, payload, length, qos, retained,
+                          r->packetId);
+
+        uint32_t bytes = align4(HEADER + (uint32_t)size);
+        uint32_t next = offset + bytes;
+        q.tail = q.capacity - next < HEADER ? 0 : next;
+        q.used += (q.tail ? q.tail : q.capacity) - offset;
+        if (q.used > q.highWater) q.highWater = q.used;
+        if (q.unsent == 0) q.cursor = offset;
+        q.records++;
+        q.unsent++;
+        counters.queued++;
+        return true;
+    }
+    using MqttTransport::publish;
+
+    const MqttStats& stats() const { return counters; }
+    uint8_t inFlightMessages() const { return inFlightCount; }
+
+    /** Bytes queued (sent or not, until reclaimed) and the peak since boot. */
+    uint32_t queuedBytes(MqttPriority priority) const { return queues[(uint8_t)priority].used; }
+    uint32_t queueHighWater(MqttPriority priority) const {
+        return queues[(uint8_t)priority].highWater;
+    }
+
+    /** Enqueue -> written (µs), first transmissions only. */
+    LatencyHistogram& queueLatency() { return queueHistogram; }
+
+    /** Written -> PUBACK (µs). */
+    LatencyHistogram& ackLatency() { return ackHistogram; }
+};
+
+#endif // MQTT_SESSION_H
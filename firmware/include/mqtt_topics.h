@@ -0,0 +1,80 @@
+/**
+ * Kaldor IIoT - Precomputed MQTT Topics
+ *
+ * All kaldor/loom/{loomId}/... topics, formatted once when MQTT connects
+ * so publishing and message dispatch never build strings.
+ *
+ * Header-only and free of Arduino dependencies.
+ */
+
+#ifndef MQTT_TOPICS_H
+#define MQTT_TOPICS_H
+
+#include <stdio.h>
+#include <string.h>
+
+#define MQTT_TOPIC_SIZE 64
+
+struct MqttTopics {
+    // Published
+    char raw[MQTT_TOPIC_SIZE];
+    char rawFrame[MQTT_TOPIC_SIZE];
+    char processed[MQTT_TOPIC_SIZE];
+    char backlog[MQTT_TOPIC_SIZE];
+    char alerts[MQTT_TOPIC_SIZE];
+    char status[MQTT_TOPIC_SIZE];
+    char timing[MQTT_TOPIC_SIZE];
+    char memory[MQTT_TOPIC_SIZE];
+    char systemDiagnostics[MQTT_TOPIC_SIZE];
+    char otaStatus[MQTT_TOPIC_SIZE];
+    char traceData[MQTT_TOPIC_SIZE];
+    char traceStatus[MQTT_TOPIC_SIZE];
+    char rollup[3][MQTT_TOPIC_SIZE];    // bbw/rollup/1s, 1m, 1h (RollupLevel order)
+
+    // Subscribed
+    char config[MQTT_TOPIC_SIZE];
+    char ota[MQTT_TOPIC_SIZE];
+    char backlogAck[MQTT_TOPIC_SIZE];
+    char timingRequest[MQTT_TOPIC_SIZE];
+    char memoryRequest[MQTT_TOPIC_SIZE];
+    char traceControl[MQTT_TOPIC_SIZE];
+
+    /** Returns false if a loom id is too long for the topic buffers. */
+    bool build(const char* loomId) {
+        bool ok = true;
+        ok &= format(raw, loomId, "bbw/raw");
+        ok &= format(rawFrame, loomId, "bbw/raw/frame");
+        ok &= format(processed, loomId, "bbw/processed");
+        ok &= format(backlog, loomId, "bbw/backlog");
+        ok &= format(alerts, loomId, "alerts");
+        ok &= format(status, loomId, "status");
+        ok &= format(timing, loomId, "diagnostics/timing");
+        ok &= format(memory, loomId, "diagnostics/memory");
+        ok &= format(systemDiagnostics, loomId, "diagnostics/system");
+        ok &= format(otaStatus, loomId, "ota/status");
+        ok &= format(traceData, loomId, "trace/data");
+        ok &= format(traceStatus, loomId, "trace/status");
+        ok &= format(rollup[0], loomId, "bbw/rollup/1s");
+        ok &= format(rollup[1], loomId, "bbw/rollup/1m");
+        ok &= format(rollup[2], loomId, "bbw/rollup/1h");
+        ok &= format(config, loomId, "config");
+        ok &= format(ota, loomId, "ota");
+        ok &= format(backlogAck, loomId, "backlog/ack");
+        ok &= format(timingRequest, loomId, "diagnostics/timing/get");
+        ok &= format(memoryRequest, loomId, "diagnostics/memory/get");
+        ok &= format(traceControl, loomId, "trace");
+        return ok;
+    }
+
+    static bool matches(const char* topic, const char* expected) {
+        return strcmp(topic, expected) == 0;
+    }
+
+private:
+    static bool format(char* out, const char* loomId, const char* suffix) {
+        int n = snprintf(out, MQTT_TOPIC_SIZE, "kaldor/loom/%s/%s", loomId, suffix);
+        return n > 0 && n < MQTT_TOPIC_SIZE;
+    }
+};
+
+#endif // MQTT_TOPICS_H
@@ -0,0 +1,566 @@
+/**
+ * Kaldor IIoT - OTA Image Format
+ *
+ * A firmware update is either a plain .bin or a packed image: a header
+ * followed by operations that rebuild the new firmware from literal bytes,
+ * bytes already produced (compression) and bytes of the firmware the
+ * device is running (delta). A release that changes a few functions then
+ * costs little more than those functions to send.
+ *
+ * Header (all integers little-endian):
+ *
+ *   offset  size  field
+ *   0       4     magic "KOTA"
+ *   4       1     version (OTA_IMAGE_VERSION)
+ *   5       1     flags (bit 0: delta)
+ *   6       1     log2 of the output window the image needs
+ *   7       1     reserved, 0
+ *   8       4     firmware size
+ *   12      4     firmware CRC-32
+ *   16      4     base size (delta only, else 0)
+ *   20      4     base CRC-32, over the first base-size bytes of the
+ *                 running partition
+ *
+ * Operations: a token byte, the operation in the top two bits and the
+ * length in the low six (0: a varint length follows the arguments).
+ * Integers are LEB128 varints.
+ *
+ *   0 [n]         literal: n bytes follow
+ *   1 d [n]       copy n bytes of the base, starting d (zigzag) bytes after
+ *                 the end of the previous base copy
+ *   2 dist [n]    copy n bytes from dist bytes back in the output; may
+ *                 overlap the bytes being produced, as in LZ77
+ *
+ * There is no entropy coding, so the decoder needs nothing but the output
+ * window (OTA_WINDOW_BYTES) and a small copy buffer. OtaImageDecoder takes
+ * the image in pieces of any size as they arrive and writes the firmware
+ * through a FirmwarePort; anything without the magic is written as it is.
+ * otaImagePack() builds packed images on the host (tools/ota_pack.cpp).
+ *
+ * Header-only and free of Arduino dependencies.
+ */
+
+#ifndef OTA_IMAGE_H
+#define OTA_IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "config.h"
+#include "crc32.h"
+#include "hal.h"
+
+#define OTA_IMAGE_VERSION 1
+#define OTA_IMAGE_HEADER_SIZE 24
+#define OTA_IMAGE_FLAG_DELTA 0x01
+
+enum class OtaOp : uint8_t {
+    Literal = 0x00,
+    CopyBase = 0x01,
+    CopyOutput = 0x02
+};
+
+class OtaImageDecoder {
+public:
+    enum class Result : uint8_t {
+        Ok,
+        BadHeader,      // Unknown version, or a window larger than ours
+        WrongBase,      // Delta against firmware this device is not running
+        BadOperation,   // Unknown op, or a copy outside the base or window
+        TooLong,        // More output than the header announced
+        Truncated,      // Image ended early
+        BadCrc,         // Output does not match the header's CRC
+        WriteFailed,    // FirmwarePort refused the data
+        Rejected        // FirmwarePort did not accept the finished image
+    };
+
+private:
+    static const uint32_t MAGIC = 0x41544F4Bu;     // "KOTA"
+    static const size_t COPY_CHUNK = 256;
+
+    enum class Step : uint8_t { Header, Plain, Op, Arg1, Length, Literal, Failed };
+
+    FirmwarePort& firmware;
+    uint8_t* window;
+    uint32_t windowSize;
+    uint8_t copyBuffer[COPY_CHUNK];
+
+    uint8_t header[OTA_IMAGE_HEADER_SIZE];
+    size_t headerLength;
+    uint32_t imageLength;       // Whole image as downloaded; sizes a plain one
+    bool started;               // firmware.begin() done
+
+    Step step;
+    OtaOp op;
+    uint8_t shortLength;        // From the token, 0 = varint
+    uint32_t varint;
+    uint8_t shift;
+    uint32_t arg1;
+    uint32_t remaining;         // Literal bytes still to come
+
+    bool delta;
+    uint32_t targetSize;
+    uint32_t targetCrc;
+    uint32_t baseSize;
+    uint32_t baseEnd;
+    uint32_t produced;
+    uint32_t crc;
+    Result error;
+
+    static uint32_t readLE(const uint8_t* p) {
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+               ((uint32_t)p[3] << 24);
+    }
+
+    bool fail(Result result) {
+        error = result;
+        step = Step::Failed;
+        return false;
+    }
+
+    bool emit(const uint8_t* data, size_t length) {
+        if (length > targetSize - produced) return fail(Result::TooLong);
+        if (!firmware.write(data, length)) return fail(Result::WriteFailed);
+        crc = crc32Update(crc, data, length);
+
+        // Keep the last window's worth for CopyOutput
+        uint32_t start = produced;
+        produced += (uint32_t)length;
+        if (length > windowSize) {
+            data += length - windowSize;
+            start += (uint32_t)(length - windowSize);
+            length = windowSize;
+        }
+        uint32_t at = start & (windowSize - 1);
+        size_t first = length < windowSize - at ? length : windowSize - at;
+        memcpy(window + at, data, first);
+        memcpy(window, data + first, length - first);
+        return true;
+    }
+
+    bool startFirmware(uint32_t size) {
+        targetSize = size;
+        started = true;
+        if (!firmware.begin(size)) return fail(Result::WriteFailed);
+        return true;
+    }
+
+    bool baseMatches() {
+        uint32_t sum = 0;
+        for (uint32_t offset = 0; offset < baseSize; offset += COPY_CHUNK) {
+            size_t n = baseSize - offset < COPY_CHUNK ? baseSize - offset : COPY_CHUNK;
+            if (!firmware.readRunning(offset, copyBuffer, n)) return false;
+            sum = crc32Update(sum, copyBuffer, n);
+        }
+        return sum == readLE(header + 20);
+    }
+
+    bool parseHeader() {
+        if (header[4] != OTA_IMAGE_VERSION || header[6] > 24 ||
+            (1u << header[6]) > windowSize) {
+            return fail(Result::BadHeader);
+        }
+        delta = (header[5] & OTA_IMAGE_FLAG_DELTA) != 0;
+        targetCrc = readLE(header + 12);
+        baseSize = delta ? readLE(header + 16) : 0;
+        if (delta && !baseMatches()) return fail(Result::WrongBase);
+        step = Step::Op;
+        return startFirmware(readLE(header + 8));
+    }
+
+    bool copyBase(int32_t skip, uint32_t length) {
+        uint32_t from = baseEnd + (uint32_t)skip;
+        if (from > baseSize || length > baseSize - from) return fail(Result::BadOperation);
+        while (length) {
+            size_t n = length < COPY_CHUNK ? length : COPY_CHUNK;
+            if (!firmware.readRunning(from, copyBuffer, n)) return fail(Result::BadOperation);
+            if (!emit(copyBuffer, n)) return false;
+            from += (uint32_t)n;
+            length -= (uint32_t)n;
+        }
+        baseEnd = from;
+        return true;
+    }
+
+    bool copyOutput(uint32_t distance, uint32_t length) {
+        if (distance == 0 || distance > produced || distance > windowSize) {
+            return fail(Result::BadOperation);
+        }
+        while (length) {
+            // Never more than distance at once, so every byte read is already written
+            size_t n = length < COPY_CHUNK ? length : COPY_CHUNK;
+            if (n > distance) n = distance;
+            uint32_t from = produced - distance;
+            for (size_t i = 0; i < n; i++) {
+                copyBuffer[i] = window[(from + i) & (windowSize - 1)];
+            }
+            if (!emit(copyBuffer, n)) return false;
+            length -= (uint32_t)n;
+        }
+        return true;
+    }
+
+    /** One more varint byte; true once the value is complete. */
+    bool takeVarint(uint8_t byte) {
+        varint |= (uint32_t)(byte & 0x7F) << shift;
+        shift += 7;
+        return !(byte & 0x80) || shift > 28;
+    }
+
+    bool operation(uint8_t token) {
+        op = (OtaOp)(token >> 6);
+        shortLength = token & 0x3F;
+        if (op > OtaOp::CopyOutput) return fail(Result::BadOperation);
+        if (op == OtaOp::CopyBase && !delta) return fail(Result::BadOperation);
+        varint = 0;
+        shift = 0;
+        if (op != OtaOp::Literal) {
+            step = Step::Arg1;
+            return true;
+        }
+        step = Step::Length;
+        return shortLength ? execute(shortLength) : true;
+    }
+
+    bool argument(uint32_t value) {
+        if (step == Step::Arg1) {
+            arg1 = value;
+            varint = 0;
+            shift = 0;
+            step = Step::Length;
+            return shortLength ? execute(shortLength) : true;
+        }
+        return execute(value);
+    }
+
+    bool execute(uint32_t length) {
+        step = Step::Op;
+        switch (op) {
+        case OtaOp::Literal:
+            remaining = length;
+            if (remaining) step = Step::Literal;
+            return true;
+        case OtaOp::CopyBase:
+            return copyBase((int32_t)((arg1 >> 1) ^ (0u - (arg1 & 1))), length);
+        default:
+            return copyOutput(arg1, length);
+        }
+    }
+
+public:
+    /** window: OTA_WINDOW_BYTES (a power of two) of RAM for the output. */
+    OtaImageDecoder(FirmwarePort& port, uint8_t* windowBuffer, uint32_t windowBytes)
+        : firmware(port), window(windowBuffer), windowSize(windowBytes) {
+        begin(0);
+    }
+
+    /** Start a new image of imageBytes (the whole download). */
+    void begin(uint32_t imageBytes) {
+        headerLength = 0;
+        imageLength = imageBytes;
+        started = false;
+        step = Step::Header;
+        op = OtaOp::Literal;
+        shortLength = 0;
+        varint = 0;
+        shift = 0;
+        arg1 = 0;
+        remaining = 0;
+        delta = false;
+        targetSize = 0;
+        targetCrc = 0;
+        baseSize = 0;
+        baseEnd = 0;
+        produced = 0;
+        crc = 0;
+        error = Result::Ok;
+    }
+
+    /** The next piece of the image. False once the image is known to be bad. */
+    bool feed(const uint8_t* data, size_t length) {
+        size_t used = 0;
+        while (used < length) {
+            switch (step) {
+            case Step::Failed:
+                return false;
+
+            case Step::Header:
+                header[headerLength++] = data[used++];
+                if (headerLength == 4 && readLE(header) != MAGIC) {
+                    // Plain firmware: write what we held back, then the rest
+                    step = Step::Plain;
+                    if (!startFirmware(imageLength) || !emit(header, headerLength)) return false;
+                } else if (headerLength == OTA_IMAGE_HEADER_SIZE && !parseHeader()) {
+                    return false;
+                }
+                break;
+
+            case Step::Plain:
+                if (!emit(data + used, length - used)) return false;
+                used = length;
+                break;
+
+            case Step::Op:
+                if (!operation(data[used++])) return false;
+                break;
+
+            case Step::Arg1:
+            case Step::Length:
+                if (takeVarint(data[used++]) && !argument(varint)) return false;
+                break;
+
+            case Step::Literal: {
+                size_t n = length - used < remaining ? length - used : remaining;
+                if (!emit(data + used, n)) return false;
+                used += n;
+                remaining -= (uint32_t)n;
+                if (!remaining) step = Step::Op;
+                break;
+            }
+            }
+        }
+        return step != Step::Failed;
+    }
+
+    /** The image is complete: check it and hand it to the FirmwarePort. */
+    bool finish() {
+        if (step == Step::Failed) return false;
+        if ((step != Step::Op && step != Step::Plain) || produced != targetSize) {
+            return fail(Result::Truncated);
+        }
+        if (step == Step::Op && crc != targetCrc) return fail(Result::BadCrc);
+        if (!firmware.finish()) return fail(Result::Rejected);
+        started = false;
+        return true;
+    }
+
+    /** Drop the image; the FirmwarePort discards what was written. */
+    void abort() {
+        if (started) firmware.abort();
+        started = false;
+    }
+
+    Result result() const { return error; }
+    bool isDelta() const { return delta; }
+    uint32_t written() const { return produced; }
+    uint32_t firmwareSize() const { return targetSize; }
+};
+
+inline const char* otaImageError(OtaImageDecoder::Result result) {
+    static const char* const names[] = {
+        "ok", "bad header", "wrong base", "bad operation", "too long", "truncated",
+        "crc mismatch", "write failed", "rejected"
+    };
+    return (uint8_t)result < sizeof(names) / sizeof(names[0]) ? names[(uint8_t)result]
+                                                              : "unknown";
+}
+
+// ---- Packing (host) ----
+
+namespace ota_pack_detail {
+
+const size_t MIN_OUTPUT_MATCH = 4;
+const size_t MIN_BASE_MATCH = 6;
+const int CHAIN_DEPTH = 48;
+const uint32_t HASH_BITS = 16;
+const int32_t NONE = -1;
+
+inline uint32_t hash4(const uint8_t* p) {
+    uint32_t v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+                 ((uint32_t)p[3] << 24);
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+inline void putVarint(std::vector<uint8_t>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+inline void putLE(std::vector<uint8_t>& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out.push_back((uint8_t)(value >> (8 * i)));
+}
+
+inline size_t matchLength(const uint8_t* a, const uint8_t* b, size_t limit) {
+    size_t n = 0;
+    while (n < limit && a[n] == b[n]) n++;
+    return n;
+}
+
+struct Match {
+    OtaOp op;                   // Literal: none found
+    size_t from;
+    size_t length;
+};
+
+/** Greedy matcher over hash chains of the base and of the output window. */
+class Packer {
+private:
+    const uint8_t* target;
+    size_t targetSize;
+    const uint8_t* base;
+    size_t baseSize;
+    size_t window;
+    std::vector<int32_t> baseHead;
+    std::vector<int32_t> baseNext;
+    std::vector<int32_t> outHead;
+    std::vector<int32_t> outPrev;
+    size_t inserted;            // Output positions in the chains so far
+
+public:
+    int64_t drift;              // Base offset minus output offset of the last base copy
+
+    Packer(const uint8_t* t, size_t tn, const uint8_t* b, size_t bn, size_t w)
+        : target(t), targetSize(tn), base(b), baseSize(bn), window(w),
+          baseHead(bn ? 1u << HASH_BITS : 0, NONE), baseNext(bn, NONE),
+          outHead(1u << HASH_BITS, NONE), outPrev(tn, NONE), inserted(0), drift(0) {
+        for (size_t j = 0; j + 4 <= baseSize; j++) {
+            uint32_t h = hash4(base + j);
+            baseNext[j] = baseHead[h];
+            baseHead[h] = (int32_t)j;
+        }
+    }
+
+    /** Add output positions below end to the window chains. */
+    void advance(size_t end) {
+        for (; inserted < end; inserted++) {
+            if (inserted + 4 > targetSize) continue;
+            uint32_t h = hash4(target + inserted);
+            outPrev[inserted] = outHead[h];
+            outHead[h] = (int32_t)inserted;
+        }
+    }
+
+    Match find(size_t i) {
+        Match best = {OtaOp::Literal, 0, 0};
+        size_t left = targetSize - i;
+        if (left < 4) return best;
+        advance(i);
+
+        size_t baseLength = 0, baseFrom = 0;
+        if (baseSize) {
+            // The same shift as the last copy is the usual case
+            int64_t guess = (int64_t)i + drift;
+            if (guess >= 0 && (size_t)guess < baseSize) {
+                size_t limit = baseSize - (size_t)guess < left ? baseSize - (size_t)guess : left;
+                baseLength = matchLength(base + guess, target + i, limit);
+                baseFrom = (size_t)guess;
+            }
+            int32_t candidate = baseHead[hash4(target + i)];
+            for (int depth = 0; candidate != NONE && depth < CHAIN_DEPTH; depth++) {
+                size_t limit = baseSize - (size_t)candidate < left ? baseSize - (size_t)candidate
+                                                                   : left;
+                size_t n = matchLength(base + candidate, target + i, limit);
+                if (n > baseLength) {
+                    baseLength = n;
+                    baseFrom = (size_t)candidate;
+                }
+                candidate = baseNext[candidate];
+            }
+        }
+
+        size_t outLength = 0, outFrom = 0;
+        int32_t candidate = outHead[hash4(target + i)];
+        for (int depth = 0; candidate != NONE && depth < CHAIN_DEPTH; depth++) {
+            if (i - (size_t)candidate > window) break;
+            size_t n = matchLength(target + candidate, target + i, left);
+            if (n > outLength) {
+                outLength = n;
+                outFrom = (size_t)candidate;
+            }
+            candidate = outPrev[candidate];
+        }
+
+        if (baseLength >= MIN_BASE_MATCH && baseLength >= outLength) {
+            best = {OtaOp::CopyBase, baseFrom, baseLength};
+        } else if (outLength >= MIN_OUTPUT_MATCH) {
+            best = {OtaOp::CopyOutput, outFrom, outLength};
+        }
+        return best;
+    }
+};
+
+/** Token byte; true if the length has to follow as a varint. */
+inline bool putToken(std::vector<uint8_t>& out, OtaOp op, size_t length) {
+    bool inToken = length > 0 && length < 64;
+    out.push_back((uint8_t)(((uint8_t)op << 6) | (inToken ? length : 0)));
+    return !inToken;
+}
+
+}   // namespace ota_pack_detail
+
+/**
+ * Pack firmware for OtaImageDecoder. With a base (the firmware the devices
+ * run now) the image is a delta and installs only on that firmware.
+ * Greedy matching with one step of lookahead; meant for the host.
+ */
+inline std::vector<uint8_t> otaImagePack(const uint8_t* target, size_t targetSize,
+                                         const uint8_t* base = nullptr, size_t baseSize = 0,
+                                         uint32_t windowBytes = OTA_WINDOW_BYTES) {
+    using namespace ota_pack_detail;
+    uint8_t windowLog = 0;
+    while ((1u << windowLog) < windowBytes) windowLog++;
+    bool delta = base && baseSize > 0;
+
+    std::vector<uint8_t> out;
+    out.reserve(targetSize / 2 + OTA_IMAGE_HEADER_SIZE);
+    putLE(out, 0x41544F4Bu);
+    out.push_back(OTA_IMAGE_VERSION);
+    out.push_back(delta ? OTA_IMAGE_FLAG_DELTA : 0);
+    out.push_back(windowLog);
+    out.push_back(0);
+    putLE(out, (uint32_t)targetSize);
+    putLE(out, crc32(target, targetSize));
+    putLE(out, delta ? (uint32_t)baseSize : 0);
+    putLE(out, delta ? crc32(base, baseSize) : 0);
+
+    Packer packer(target, targetSize, delta ? base : nullptr, delta ? baseSize : 0,
+                  1u << windowLog);
+    size_t literalStart = 0;
+    uint32_t baseEnd = 0;
+    auto flushLiterals = [&](size_t end) {
+        if (end == literalStart) return;
+        if (putToken(out, OtaOp::Literal, end - literalStart)) {
+            putVarint(out, (uint32_t)(end - literalStart));
+        }
+        out.insert(out.end(), target + literalStart, target + end);
+    };
+
+    size_t i = 0;
+    Match match = packer.find(0);
+    while (i < targetSize) {
+        if (match.op == OtaOp::Literal) {
+            match = packer.find(++i);
+            continue;
+        }
+        // Lookahead: a longer match one byte on is worth a literal
+        Match later = packer.find(i + 1);
+        if (later.length > match.length + 1) {
+            i++;
+            match = later;
+            continue;
+        }
+
+        flushLiterals(i);
+        bool longLength = putToken(out, match.op, match.length);
+        if (match.op == OtaOp::CopyBase) {
+            int32_t skip = (int32_t)((int64_t)match.from - (int64_t)baseEnd);
+            putVarint(out, ((uint32_t)skip << 1) ^ (uint32_t)(skip >> 31));
+            baseEnd = (uint32_t)(match.from + match.length);
+            packer.drift = (int64_t)match.from - (int64_t)i;
+        } else {
+            putVarint(out, (uint32_t)(i - match.from));
+        }
+        if (longLength) putVarint(out, (uint32_t)match.length);
+        i += match.length;
+        literalStart = i;
+        match = packer.find(i);
+    }
+    flushLiterals(targetSize);
+    return out;
+}
+
+#endif // OTA_IMAGE_H
@@ -0,0 +1,386 @@
+/**
+ * Kaldor IIoT - Firmware Download
+ *
+ * Fetches a firmware image over HTTP/1.1 and writes it through an
+ * OtaImageDecoder (plain, compressed or delta images) as it arrives. Like
+ * MqttSession it never waits: poll() moves the download along by at most
+ * OTA_CHUNK_BYTES and returns, so on the board it runs in a low-priority
+ * task while sampling and publishing carry on.
+ *
+ *   Connecting   stream opening, request going out, reading the headers
+ *   Downloading  body flowing into the decoder
+ *   Retrying     an attempt failed; waiting out a jittered backoff
+ *   Done         image verified and handed to the FirmwarePort
+ *   Failed       gave up; the update slot was discarded
+ *
+ * A connection that drops, stalls for OTA_IDLE_TIMEOUT_MS or fails to open
+ * is retried with a Range request for the rest of the image, so nothing
+ * already written is fetched again. A server that ignores the Range
+ * answers 200 and the image starts over. OTA_MAX_RETRIES failures in a
+ * row without any data end the update.
+ *
+ * Only http:// URLs with a Content-Length. Images are checked by the
+ * packed header's CRC and by the FirmwarePort (the ESP-IDF image check on
+ * the board), not authenticated; use signed images (secure boot) where
+ * that matters.
+ *
+ * Header-only and free of Arduino dependencies.
+ */
+
+#ifndef OTA_UPDATE_H
+#define OTA_UPDATE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "config.h"
+#include "connection_manager.h"
+#include "hal.h"
+#include "ota_image.h"
+
+#define OTA_URL_SIZE 192
+#define OTA_HOST_SIZE 64
+#define OTA_LINE_SIZE 160
+
+enum class OtaState : uint8_t { Idle, Connecting, Downloading, Retrying, Done, Failed };
+
+inline const char* otaStateName(OtaState state) {
+    static const char* const names[] = {
+        "idle", "connecting", "downloading", "retrying", "done", "failed"
+    };
+    return names[(uint8_t)state];
+}
+
+struct OtaProgress {
+    OtaState state;
+    uint32_t received;          // Image bytes downloaded
+    uint32_t total;             // Image size, 0 until the first response
+    uint32_t written;           // Firmware bytes written to the slot
+    uint32_t firmwareSize;      // 0 until the image header is in
+    uint16_t resumes;           // Attempts that continued with a Range request
+    uint16_t retries;           // Failed attempts
+    bool delta;
+    const char* error;          // Why it failed (static string), else null
+};
+
+class OtaUpdate {
+private:
+    enum class Phase : uint8_t { Opening, Request, Headers, Body };
+
+    NetStream& stream;
+    HalClock& clock;
+    OtaImageDecoder decoder;
+    Backoff backoff;
+
+    char host[OTA_HOST_SIZE];
+    uint16_t port;
+    const char* path;           // Into url
+    char url[OTA_URL_SIZE];
+
+    char request[OTA_URL_SIZE + OTA_HOST_SIZE + 96];
+    size_t requestLength;
+    size_t requestSent;
+    char line[OTA_LINE_SIZE];
+    size_t lineLength;
+    uint8_t buffer[OTA_CHUNK_BYTES];
+
+    Phase phase;
+    int httpStatus;
+    bool haveLength;
+    uint32_t contentLength;
+    bool haveRange;
+    uint32_t rangeStart;
+    uint32_t rangeTotal;
+    bool chunked;
+
+    uint32_t attemptStartMs;
+    uint32_t lastDataMs;
+    uint32_t retryAtMs;
+    uint16_t failuresInRow;
+    OtaProgress progress;
+
+    bool active() const {
+        return progress.state == OtaState::Connecting ||
+               progress.state == OtaState::Downloading || progress.state == OtaState::Retrying;
+    }
+
+    /** http://host[:port]/path into host, port and path. */
+    bool parseUrl(const char* text) {
+        if (strncmp(text, "http://", 7) != 0 || strlen(text) >= sizeof(url)) return false;
+        strcpy(url, text);
+        const char* start = url + 7;
+        const char* end = start + strcspn(start, ":/");
+        size_t hostLength = (size_t)(end - start);
+        if (hostLength == 0 || hostLength >= sizeof(host)) return false;
+        memcpy(host, start, hostLength);
+        host[hostLength] = '\0';
+        port = 80;
+        if (*end == ':') {
+            char* after;
+            unsigned long value = strtoul(end + 1, &after, 10);
+            if (value == 0 || value > 65535 || (*after && *after != '/')) return false;
+            port = (uint16_t)value;
+            end = after;
+        }
+        path = *end ? end : "/";
+        return true;
+    }
+
+    void fail(const char* reason) {
+        stream.stop();
+        decoder.abort();
+        progress.state = OtaState::Failed;
+        progress.error = reason;
+    }
+
+    void attemptFailed(const char* reason, uint32_t now) {
+        stream.stop();
+        progress.retries++;
+        if (++failuresInRow >= OTA_MAX_RETRIES) {
+            fail(reason);
+            return;
+        }
+        progress.state = OtaState::Retrying;
+        progress.error = nullptr;
+        retryAtMs = now + backoff.next();
+    }
+
+    void open(uint32_t now) {
+        phase = Phase::Opening;
+        progress.state = OtaState::Connecting;
+        attemptStartMs = now;
+        lastDataMs = now;
+        lineLength = 0;
+        httpStatus = 0;
+        haveLength = false;
+        contentLength = 0;
+        haveRange = false;
+        rangeStart = 0;
+        rangeTotal = 0;
+        chunked = false;
+
+        int n;
+        if (progress.received) {
+            n = snprintf(request, sizeof(request),
+                         "GET %s HTTP/1.1\r\nHost: %s\r\nRange: bytes=%u-\r\n"
+                         "Connection: close\r\n\r\n",
+                         path, host, (unsigned)progress.received);
+        } else {
+            n = snprintf(request, sizeof(request),
+                         "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n", path, host);
+        }
+        requestLength = (size_t)n;
+        requestSent = 0;
+        if (!stream.connect(host, port)) attemptFailed("connect failed", now);
+    }
+
+    static const char* headerValue(const char* text, const char* name) {
+        size_t n = strlen(name);
+        if (strncasecmp(text, name, n) != 0 || text[n] != ':') return nullptr;
+        text += n + 1;
+        while (*text == ' ' || *text == '\t') text++;
+        return text;
+    }
+
+    void header(const char* text) {
+        const char* value;
+        if (!httpStatus) {
+            // Status line: HTTP/1.x NNN ...
+            const char* space = strchr(text, ' ');
+            httpStatus = space ? atoi(space + 1) : -1;
+        } else if ((value = headerValue(text, "Content-Length"))) {
+            haveLength = true;
+            contentLength = (uint32_t)strtoul(value, nullptr, 10);
+        } else if ((value = headerValue(text, "Content-Range"))) {
+            // bytes first-last/total
+            unsigned first, last, total;
+            if (sscanf(value, "bytes %u-%u/%u", &first, &last, &total) == 3) {
+                haveRange = true;
+                rangeStart = first;
+                rangeTotal = total;
+            }
+        } else if ((value = headerValue(text, "Transfer-Encoding"))) {
+            chunked = strncasecmp(value, "chunked", 7) == 0;
+        }
+    }
+
+    /** Headers complete: decide what the body is. False if the attempt is over. */
+    bool startBody(uint32_t now) {
+        if (httpStatus >= 500 || httpStatus == 408 || httpStatus == 429) {
+            attemptFailed("server error", now);
+            return false;
+        }
+        if (httpStatus == 206 && haveRange && rangeStart == progress.received &&
+            rangeTotal == progress.total) {
+            progress.resumes++;
+        } else if (httpStatus == 200) {
+            if (progress.received) {
+                // Range ignored: start the image over
+                decoder.abort();
+                progress.received = 0;
+            }
+            if (chunked || !haveLength || contentLength == 0) {
+                fail("no content length");
+                return false;
+            }
+            progress.total = contentLength;
+            decoder.begin(progress.total);
+        } else if (httpStatus == 404) {
+            fail("not found");
+            return false;
+        } else {
+            fail("unexpected response");
+            return false;
+        }
+        phase = Phase::Body;
+        progress.state = OtaState::Downloading;
+        return true;
+    }
+
+    /** Feed header bytes; returns how many were used (the rest is body). */
+    size_t takeHeaders(const uint8_t* data, size_t length, uint32_t now) {
+        for (size_t i = 0; i < length; i++) {
+            char c = (char)data[i];
+            if (c == '\r') continue;
+            if (c != '\n') {
+                if (lineLength < sizeof(line) - 1) line[lineLength++] = c;
+                continue;
+            }
+            line[lineLength] = '\0';
+            if (lineLength == 0) {
+                return startBody(now) ? i + 1 : length;
+            }
+            header(line);
+            lineLength = 0;
+        }
+        return length;
+    }
+
+    void takeBody(const uint8_t* data, size_t length) {
+        uint32_t left = progress.total - progress.received;
+        if (length > left) length = left;
+        if (!decoder.feed(data, length)) {
+            fail(otaImageError(decoder.result()));
+            return;
+        }
+        progress.received += (uint32_t)length;
+        progress.written = decoder.written();
+        progress.firmwareSize = decoder.firmwareSize();
+        progress.delta = decoder.isDelta();
+        if (length) {
+            failuresInRow = 0;
+            backoff.reset();
+        }
+        if (progress.received == progress.total) {
+            stream.stop();
+            if (decoder.finish()) {
+                progress.state = OtaState::Done;
+            } else {
+                fail(otaImageError(decoder.result()));
+            }
+        }
+    }
+
+public:
+    /** window: OTA_WINDOW_BYTES of RAM for the image decoder. */
+    OtaUpdate(NetStream& httpStream, FirmwarePort& firmware, HalClock& halClock,
+              uint8_t* window, uint32_t windowBytes)
+        : stream(httpStream), clock(halClock), decoder(firmware, window, windowBytes),
+          backoff(OTA_RETRY_MIN_MS, OTA_RETRY_MAX_MS, 0), host(), port(0), path("/"), url(),
+          requestLength(0), requestSent(0), lineLength(0), phase(Phase::Opening), httpStatus(0),
+          haveLength(false), contentLength(0), haveRange(false), rangeStart(0), rangeTotal(0),
+          chunked(false), attemptStartMs(0), lastDataMs(0), retryAtMs(0), failuresInRow(0),
+          progress() {}
+
+    /**
+     * Start downloading url. False if an update is already running, or the
+     * URL is not http:// (then the state is Failed). seed spreads the
+     * retries of many devices.
+     */
+    bool start(const char* imageUrl, uint32_t seed = 0) {
+        if (active()) return false;
+        progress = OtaProgress();
+        if (!parseUrl(imageUrl)) {
+            progress.state = OtaState::Failed;
+            progress.error = "bad url";
+            return false;
+        }
+        failuresInRow = 0;
+        backoff.seed(seed);
+        backoff.reset();
+        decoder.begin(0);
+        open(clock.millis());
+        return true;
+    }
+
+    /** Stop a running update and discard what was written. */
+    void cancel() {
+        if (active()) fail("cancelled");
+    }
+
+    /** Move the download along. True if it did anything. */
+    bool poll() {
+        uint32_t now = clock.millis();
+        switch (progress.state) {
+        case OtaState::Retrying:
+            if ((int32_t)(now - retryAtMs) < 0) return false;
+            open(now);
+            return true;
+        case OtaState::Connecting:
+        case OtaState::Downloading:
+            break;
+        default:
+            return false;
+        }
+
+        if (phase == Phase::Opening) {
+            if (stream.connecting()) {
+                if (now - attemptStartMs > OTA_CONNECT_TIMEOUT_MS) {
+                    attemptFailed("connect timeout", now);
+                }
+                return false;
+            }
+            if (!stream.connected()) {
+                attemptFailed("connect failed", now);
+                return true;
+            }
+            phase = Phase::Request;
+        }
+
+        if (phase == Phase::Request) {
+            requestSent += stream.write((const uint8_t*)request + requestSent,
+                                        requestLength - requestSent);
+            if (requestSent < requestLength) {
+                if (!stream.connected()) attemptFailed("connection lost", now);
+                return true;
+            }
+            phase = Phase::Headers;
+            lastDataMs = now;
+        }
+
+        size_t n = stream.read(buffer, sizeof(buffer));
+        if (n) {
+            lastDataMs = now;
+            size_t used = phase == Phase::Headers ? takeHeaders(buffer, n, now) : 0;
+            if (phase == Phase::Body && used < n) takeBody(buffer + used, n - used);
+            return true;
+        }
+        if (!stream.connected()) {
+            attemptFailed("connection lost", now);
+            return true;
+        }
+        if (now - lastDataMs > OTA_IDLE_TIMEOUT_MS) {
+            attemptFailed("stalled", now);
+            return true;
+        }
+        return false;
+    }
+
+    const OtaProgress& status() const { return progress; }
+    bool running() const { return active(); }
+    const char* imageUrl() const { return url; }
+};
+
+#endif // OTA_UPDATE_H
@@ -1,25 +1,65 @@
 /**
  * Kaldor IIoT - OTA Update Handler
+ *
+ * ArduinoOTA for uploads from the local network, and firmware downloads
+ * requested over MQTT. A download runs in the OTA task (OtaUpdate over an
+ * EspTcpStream into the next app partition), never in the network task:
+ * the MQTT callback only hands over the URL, and the network task reads
+ * the progress to report it.
  */
 
 #ifndef OTA_UPDATER_H
 #define OTA_UPDATER_H
 
 #include <Arduino.h>
-#include <HTTPUpdate.h>
 #include <ArduinoOTA.h>
+#include "hal_esp32.h"
+#include "ota_update.h"
 
 class OTAUpdater {
 private:
     String deviceId;
-    bool updateInProgress;
+    EspTcpStream stream;
+    EspFirmwareSlot slot;
+    uint8_t window[OTA_WINDOW_BYTES];
+    OtaUpdate download;
+    TaskHandle_t task;
+    uint32_t seed;
+    void (*beforeUpload)();
+
+    // Shared between the OTA task and the others
+    portMUX_TYPE lock;
+    char pendingUrl[OTA_URL_SIZE];
+    bool startRequested;
+    bool cancelRequested;
+    OtaProgress snapshot;
+
+    bool busy() const;          // Holding the lock
 
 public:
-    OTAUpdater();
-    void begin(const String& devId);
+    explicit OTAUpdater(HalClock& clock);
+    void begin(const String& devId, uint32_t retrySeed);
     void handle();
-    void update(const String& url);
+
+    /**
+     * Called when an ArduinoOTA upload starts. The upload takes the network
+     * task until it ends, and the device then restarts.
+     */
+    void setBeforeUpload(void (*prepare)()) { beforeUpload = prepare; }
+
+    /** The task that calls service(); woken when a download is requested. */
+    void setTask(TaskHandle_t handle) { task = handle; }
+
+    /** Download and install url. False if one is already running. Any task. */
+    bool request(const char* url);
+    void cancel();
+
+    /** As of the OTA task's last pass. Any task. */
+    OtaProgress progress();
     bool isUpdateInProgress();
+
+    /** One pass of the OTA task. True if the download moved. */
+    bool service();
 };
 
 #endif // OTA_UPDATER_H
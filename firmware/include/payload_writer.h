@@ -0,0 +1,212 @@
+/**
+ * Kaldor IIoT - Fixed-Buffer JSON Payload Writer
+ *
+ * Writes JSON into a caller-owned buffer without touching the heap, for the
+ * per-sample publish path. Numbers are formatted with integer arithmetic,
+ * so floats never go through printf (newlib's float formatting allocates).
+ * If the buffer is too small the writer stops and ok() returns false.
+ *
+ * Header-only and free of Arduino dependencies.
+ */
+
+#ifndef PAYLOAD_WRITER_H
+#define PAYLOAD_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+#include "sensor_data.h"
+
+#define PAYLOAD_MAX_DEPTH 8
+
+class PayloadWriter {
+private:
+    char* buf;
+    size_t cap;
+    size_t len;
+    bool overflow;
+    uint8_t depth;
+    uint8_t hasItems;   // Bit per nesting level: needs a comma before the next item
+
+    void put(char c) {
+        if (len + 1 < cap) {
+            buf[len++] = c;
+            buf[len] = '\0';
+        } else {
+            overflow = true;
+        }
+    }
+
+    void putRaw(const char* s) {
+        while (*s) put(*s++);
+    }
+
+    void putUnsigned(uint32_t v) {
+        char digits[10];
+        uint8_t n = 0;
+        do {
+            digits[n++] = (char)('0' + v % 10);
+            v /= 10;
+        } while (v);
+        while (n) put(digits[--n]);
+    }
+
+    void putString(const char* s) {
+        put('"');
+        for (; *s; s++) {
+            char c = *s;
+            if (c == '"' || c == '\\') {
+                put('\\');
+                put(c);
+            } else if ((uint8_t)c < 0x20) {
+                put(' ');   // Control characters never appear in ids
+            } else {
+                put(c);
+            }
+        }
+        put('"');
+    }
+
+    // Comma and key before a value inside the current container
+    void item(const char* key) {
+        uint8_t bit = (uint8_t)(1u << depth);
+        if (hasItems & bit) put(',');
+        hasItems |= bit;
+        if (key) {
+            putString(key);
+            put(':');
+        }
+    }
+
+    void open(const char* key, char bracket) {
+        item(key);
+        put(bracket);
+        if (depth + 1 < PAYLOAD_MAX_DEPTH) {
+            depth++;
+            hasItems &= (uint8_t)~(1u << depth);
+        } else {
+            overflow = true;
+        }
+    }
+
+    void close(char bracket) {
+        put(bracket);
+        if (depth > 0) depth--;
+    }
+
+public:
+    PayloadWriter(char* buffer, size_t capacity) : buf(buffer), cap(capacity) {
+        reset();
+    }
+
+    void reset() {
+        len = 0;
+        overflow = (cap == 0);
+        depth = 0;
+        hasItems = 0;
+        if (cap) buf[0] = '\0';
+    }
+
+    PayloadWriter& beginObject(const char* key = nullptr) { open(key, '{'); return *this; }
+    PayloadWriter& endObject() { close('}'); return *this; }
+    PayloadWriter& beginArray(const char* key = nullptr) { open(key, '['); return *this; }
+    PayloadWriter& endArray() { close(']'); return *this; }
+
+    PayloadWriter& add(const char* key, const char* value) {
+        item(key);
+        putString(value);
+        return *this;
+    }
+
+    PayloadWriter& add(const char* key, uint32_t value) {
+        item(key);
+        putUnsigned(value);
+        return *this;
+    }
+
+    PayloadWriter& add(const char* key, int32_t value) {
+        item(key);
+        if (value < 0) {
+            put('-');
+            putUnsigned(0u - (uint32_t)value);
+        } else {
+            putUnsigned((uint32_t)value);
+        }
+        return *this;
+    }
+
+    /** Fixed-point float (0..6 decimals); NaN and infinity become null. */
+    PayloadWriter& add(const char* key, float value, uint8_t decimals) {
+        static const uint32_t scales[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+        if (decimals > 6) decimals = 6;
+        item(key);
+
+        float scaled = fabsf(value) * (float)scales[decimals] + 0.5f;
+        if (isnan(value) || !(scaled < 4294967040.0f)) {
+            putRaw("null");
+            return *this;
+        }
+
+        uint32_t fixed = (uint32_t)scaled;
+        if (value < 0 && fixed != 0) put('-');
+        putUnsigned(fixed / scales[decimals]);
+        if (decimals) {
+            put('.');
+            uint32_t frac = fixed % scales[decimals];
+            for (uint32_t s = scales[decimals] / 10; s > 0; s /= 10) {
+                put((char)('0' + (frac / s) % 10));
+            }
+        }
+        return *this;
+    }
+
+    // Array elements
+    PayloadWriter& value(uint32_t v) { return add(nullptr, v); }
+    PayloadWriter& value(float v, uint8_t decimals) { return add(nullptr, v, decimals); }
+
+    const char* c_str() const { return buf; }
+    size_t length() const { return len; }
+    bool ok() const { return !overflow && depth == 0; }
+};
+
+/**
+ * Raw sample on kaldor/loom/{id}/bbw/raw. bbw is the filtered value; the
+ * reading itself follows as bbw_raw when the outlier filter replaced it.
+ */
+inline bool writeRawSample(PayloadWriter& out, const SensorData& data, const char* deviceId) {
+    out.reset();
+    out.beginObject()
+       .add("timestamp", (uint32_t)data.timestamp)
+       .add("device_id", deviceId)
+       .add("bbw", data.bbw, 2);
+    if (data.bbw_outlier) {
+        out.add("bbw_raw", data.bbw_raw, 2);
+    }
+    out.add("quality", (uint32_t)data.quality)
+       .endObject();
+    return out.ok();
+}
+
+/** Backlog batch on kaldor/loom/{id}/bbw/backlog: rows of [seq, ts, bbw, quality]. */
+inline bool writeBacklogBatch(PayloadWriter& out, const char* deviceId, const char* loomId,
+                              const SensorData* records, const uint32_t* seqs, size_t n) {
+    out.reset();
+    out.beginObject()
+       .add("device_id", deviceId)
+       .add("loom_id", loomId)
+       .add("first_seq", seqs[0])
+       .add("last_seq", seqs[n - 1])
+       .beginArray("samples");
+    for (size_t i = 0; i < n; i++) {
+        out.beginArray()
+           .value(seqs[i])
+           .value((uint32_t)records[i].timestamp)
+           .value(records[i].bbw, 2)
+           .value((uint32_t)records[i].quality)
+           .endArray();
+    }
+    out.endArray().endObject();
+    return out.ok();
+}
+
+#endif // PAYLOAD_WRITER_H
@@ -0,0 +1,168 @@
+/**
+ * Kaldor IIoT - Real-Input FFT
+ *
+ * In-place FFT of N real samples (N a power of two, >= 8). The input is
+ * treated as N/2 complex points, transformed with a radix-2 kernel and then
+ * split into the spectrum of the real signal, which halves the work of a
+ * full complex transform.
+ *
+ * Output is packed in the input array:
+ *
+ *   data[0]          X[0]     (DC, real)
+ *   data[1]          X[N/2]   (Nyquist, real)
+ *   data[2k], [2k+1] Re, Im of X[k] for k = 1 .. N/2-1
+ *
+ * On ESP32 builds with esp-dsp available, the complex stage runs on
+ * dsps_fft2r_fc32 (assembly-optimised); elsewhere, or if esp-dsp cannot be
+ * initialised, the portable kernel is used. Both give the same result.
+ *
+ * Header-only; needs only <math.h>.
+ */
+
+#ifndef REAL_FFT_H
+#define REAL_FFT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+
+#ifndef REAL_FFT_USE_ESP_DSP
+#if defined(ESP_PLATFORM) && defined(__has_include)
+#if __has_include("esp_dsp.h")
+#define REAL_FFT_USE_ESP_DSP 1
+#endif
+#endif
+#endif
+
+#if REAL_FFT_USE_ESP_DSP
+#include "esp_dsp.h"
+#endif
+
+template <size_t N>
+class RealFft {
+    static_assert(N >= 8 && (N & (N - 1)) == 0, "RealFft size must be a power of two >= 8");
+
+private:
+    static const size_t M = N / 2;     // Complex points
+
+    float cosTable[M];                 // cos(2*pi*k/N), k < N/2
+    float sinTable[M];                 // sin(2*pi*k/N)
+    uint16_t bitReverse[M];
+    bool accelerated;
+
+    void complexForward(float* z) {
+        // Bit-reversal permutation
+        for (size_t i = 0; i < M; i++) {
+            size_t j = bitReverse[i];
+            if (j > i) {
+                float re = z[2 * i], im = z[2 * i + 1];
+                z[2 * i] = z[2 * j];
+                z[2 * i + 1] = z[2 * j + 1];
+                z[2 * j] = re;
+                z[2 * j + 1] = im;
+            }
+        }
+
+        // Iterative radix-2 butterflies; W_M^k = W_N^(2k)
+        for (size_t half = 1; half < M; half <<= 1) {
+            size_t step = M / half;    // Index stride into the N-point tables
+            for (size_t start = 0; start < M; start += 2 * half) {
+                for (size_t k = 0; k < half; k++) {
+                    float wr = cosTable[k * step];
+                    float wi = -sinTable[k * step];
+                    float* a = z + 2 * (start + k);
+                    float* b = a + 2 * half;
+                    float tr = b[0] * wr - b[1] * wi;
+                    float ti = b[0] * wi + b[1] * wr;
+                    b[0] = a[0] - tr;
+                    b[1] = a[1] - ti;
+                    a[0] += tr;
+                    a[1] += ti;
+                }
+            }
+        }
+    }
+
+public:
+    RealFft() : accelerated(false) {
+        const float twoPi = 6.28318530718f;
+        for (size_t k = 0; k < M; k++) {
+            cosTable[k] = cosf(twoPi * (float)k / (float)N);
+            sinTable[k] = sinf(twoPi * (float)k / (float)N);
+        }
+
+        size_t bits = 0;
+        while (((size_t)1 << bits) < M) bits++;
+        for (size_t i = 0; i < M; i++) {
+            size_t r = 0;
+            for (size_t b = 0; b < bits; b++) {
+                if (i & ((size_t)1 << b)) r |= (size_t)1 << (bits - 1 - b);
+            }
+            bitReverse[i] = (uint16_t)r;
+        }
+
+#if REAL_FFT_USE_ESP_DSP
+        // Uses esp-dsp's shared table (CONFIG_DSP_MAX_FFT_SIZE)
+        esp_err_t err = dsps_fft2r_init_fc32(NULL, CONFIG_DSP_MAX_FFT_SIZE);
+        accelerated = (err == ESP_OK || err == ESP_ERR_DSP_REINITIALIZED) &&
+                      M <= CONFIG_DSP_MAX_FFT_SIZE;
+#endif
+    }
+
+    /** True if the complex stage runs on esp-dsp. */
+    bool isAccelerated() const { return accelerated; }
+
+    static size_t size() { return N; }
+
+    /** Transform N real samples in place; see the header for the layout. */
+    void forward(float* data) {
+#if REAL_FFT_USE_ESP_DSP
+        if (accelerated) {
+            dsps_fft2r_fc32(data, (int)M);
+            dsps_bit_rev_fc32(data, (int)M);
+        } else {
+            complexForward(data);
+        }
+#else
+        complexForward(data);
+#endif
+
+        // Split Z = FFT(x_even + i*x_odd) into X, in pairs k and M-k:
+        //   Fe = (Z[k] + conj(Z[M-k])) / 2
+        //   Fo = (Z[k] - conj(Z[M-k])) / 2i
+        //   X[k] = Fe + W^k Fo,  X[M-k] = conj(Fe - W^k Fo)
+        float re0 = data[0], im0 = data[1];
+        data[0] = re0 + im0;
+        data[1] = re0 - im0;
+
+        for (size_t k = 1; k <= M / 2; k++) {
+            float* a = data + 2 * k;
+            float* b = data + 2 * (M - k);
+            float feRe = 0.5f * (a[0] + b[0]);
+            float feIm = 0.5f * (a[1] - b[1]);
+            float foRe = 0.5f * (a[1] + b[1]);
+            float foIm = -0.5f * (a[0] - b[0]);
+
+            float wr = cosTable[k];
+            float wi = -sinTable[k];
+            float tRe = wr * foRe - wi * foIm;
+            float tIm = wr * foIm + wi * foRe;
+
+            a[0] = feRe + tRe;
+            a[1] = feIm + tIm;
+            if (k != M - k) {
+                b[0] = feRe - tRe;
+                b[1] = -(feIm - tIm);
+            }
+        }
+    }
+
+    /** |X[k]|^2 for k = 0 .. N/2 from forward() output. */
+    static float power(const float* spectrum, size_t k) {
+        if (k == 0) return spectrum[0] * spectrum[0];
+        if (k == M) return spectrum[1] * spectrum[1];
+        return spectrum[2 * k] * spectrum[2 * k] + spectrum[2 * k + 1] * spectrum[2 * k + 1];
+    }
+};
+
+#endif // REAL_FFT_H
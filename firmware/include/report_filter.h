@@ -0,0 +1,91 @@
+/**
+ * Kaldor IIoT - Report-by-Exception Filter
+ *
+ * Decides whether a sample is worth publishing. A sample is reported when
+ * it moved away from the last reported value by more than the deadband,
+ * when it changes between valid and invalid, when the caller forces it
+ * (e.g. outside the alarm range), or when nothing has been reported for
+ * maxSilenceMs (heartbeat, so silence still means "alive and unchanged").
+ *
+ * The deadband is max(absolute, percent of the last reported value); both
+ * zero reports every sample. Because the comparison is against the last
+ * *reported* value, slow drift is reported once it adds up and a one-sample
+ * spike is never lost.
+ *
+ * Header-only and free of Arduino dependencies.
+ */
+
+#ifndef REPORT_FILTER_H
+#define REPORT_FILTER_H
+
+#include <stdint.h>
+#include <math.h>
+
+class ReportFilter {
+private:
+    float absoluteBand;
+    float percentBand;
+    uint32_t maxSilenceMs;
+
+    bool hasReported;
+    float lastValue;
+    bool lastValid;
+    uint32_t lastReportMs;
+
+    uint32_t reportedCount;
+    uint32_t suppressedCount;
+
+public:
+    ReportFilter(float absolute, float percent, uint32_t silenceMs)
+        : absoluteBand(absolute), percentBand(percent), maxSilenceMs(silenceMs),
+          hasReported(false), lastValue(0), lastValid(false), lastReportMs(0),
+          reportedCount(0), suppressedCount(0) {
+        configure(absolute, percent, silenceMs);
+    }
+
+    /** Change the deadband; takes effect from the next sample. */
+    void configure(float absolute, float percent, uint32_t silenceMs) {
+        absoluteBand = absolute > 0 ? absolute : 0;
+        percentBand = percent > 0 ? percent : 0;
+        maxSilenceMs = silenceMs;
+    }
+
+    bool enabled() const { return absoluteBand > 0 || percentBand > 0; }
+
+    /** Returns true if the sample should be published (and records it). */
+    bool shouldReport(float value, bool valid, uint32_t nowMs, bool force = false) {
+        bool report = force || !enabled() || !hasReported || valid != lastValid;
+
+        if (!report && maxSilenceMs > 0 && nowMs - lastReportMs >= maxSilenceMs) {
+            report = true;
+        }
+        if (!report && valid) {
+            float band = percentBand * 0.01f * fabsf(lastValue);
+            if (absoluteBand > band) band = absoluteBand;
+            report = fabsf(value - lastValue) > band;
+        }
+
+        if (!report) {
+            suppressedCount++;
+            return false;
+        }
+
+        hasReported = true;
+        lastValid = valid;
+        if (valid) lastValue = value;
+        lastReportMs = nowMs;
+        reportedCount++;
+        return true;
+    }
+
+    /** Report the next sample unconditionally (e.g. after reconnecting). */
+    void reset() { hasReported = false; }
+
+    float absolute() const { return absoluteBand; }
+    float percent() const { return percentBand; }
+    uint32_t maxSilence() const { return maxSilenceMs; }
+    uint32_t reported() const { return reportedCount; }
+    uint32_t suppressed() const { return suppressedCount; }
+};
+
+#endif // REPORT_FILTER_H
@@ -0,0 +1,162 @@
+/**
+ * Kaldor IIoT - Rolling Window Statistics
+ *
+ * Fixed-size sliding window that keeps mean, variance, min, max and the
+ * invalid-sample count up to date in O(1) per sample. Min/max come from
+ * monotonic deques, mean/variance from Welford add/remove updates.
+ *
+ * Header-only and free of Arduino dependencies so it can be tested and
+ * benchmarked on the host.
+ */
+
+#ifndef ROLLING_WINDOW_H
+#define ROLLING_WINDOW_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+
+template <typename T, size_t N>
+class RollingWindow {
+    static_assert(N > 0, "RollingWindow needs at least one slot");
+
+private:
+    // Fixed-capacity deque of window slots whose values are monotonic
+    // (increasing for min, decreasing for max), oldest first. Every slot
+    // in it is inside the window, so the evicted slot can only be the front.
+    struct MonotonicQueue {
+        size_t slot[N];
+        size_t head;
+        size_t length;
+
+        void reset() { head = 0; length = 0; }
+        size_t front() const { return slot[head]; }
+        size_t back() const { return slot[(head + length - 1) % N]; }
+        void popFront() { head = (head + 1) % N; length--; }
+        void popBack() { length--; }
+        void pushBack(size_t s) { slot[(head + length) % N] = s; length++; }
+    };
+
+    T values[N];
+    bool validFlags[N];
+    size_t next;          // Slot the next sample goes into; wraps modulo N
+    size_t filled;        // Samples currently in the window
+    size_t valid;         // Valid samples currently in the window
+    size_t sinceResync;   // Evictions since the accumulators were rebuilt
+
+    T runningMean;
+    T runningM2;          // Sum of squared deviations from the mean
+
+    MonotonicQueue minQueue;
+    MonotonicQueue maxQueue;
+
+    void addToMoments(T value) {
+        valid++;
+        T delta = value - runningMean;
+        runningMean += delta / static_cast<T>(valid);
+        runningM2 += delta * (value - runningMean);
+    }
+
+    void removeFromMoments(T value) {
+        if (valid <= 1) {
+            valid = 0;
+            runningMean = 0;
+            runningM2 = 0;
+            return;
+        }
+        T delta = value - runningMean;
+        valid--;
+        runningMean -= delta / static_cast<T>(valid);
+        runningM2 -= delta * (value - runningMean);
+        if (runningM2 < 0) runningM2 = 0;
+    }
+
+    // Rebuild mean/M2 from the stored samples once per window turnover so
+    // that float rounding from add/remove pairs cannot accumulate forever.
+    // Costs O(N) every N samples, i.e. amortised O(1).
+    void resync() {
+        valid = 0;
+        runningMean = 0;
+        runningM2 = 0;
+        size_t slot = (next + N - filled) % N;
+        for (size_t i = 0; i < filled; i++, slot = (slot + 1) % N) {
+            if (validFlags[slot]) addToMoments(values[slot]);
+        }
+        sinceResync = 0;
+    }
+
+public:
+    RollingWindow() { reset(); }
+
+    void reset() {
+        next = 0;
+        filled = 0;
+        valid = 0;
+        sinceResync = 0;
+        runningMean = 0;
+        runningM2 = 0;
+        minQueue.reset();
+        maxQueue.reset();
+        for (size_t i = 0; i < N; i++) {
+            values[i] = 0;
+            validFlags[i] = false;
+        }
+    }
+
+    /**
+     * Add a sample, evicting the oldest one once the window is full.
+     * Invalid samples occupy a slot (and count towards invalidCount())
+     * but are excluded from every statistic.
+     */
+    void push(T value, bool isValid = true) {
+        size_t slot = next;
+
+        if (filled == N) {
+            if (validFlags[slot]) {
+                removeFromMoments(values[slot]);
+                if (minQueue.length && minQueue.front() == slot) minQueue.popFront();
+                if (maxQueue.length && maxQueue.front() == slot) maxQueue.popFront();
+            }
+            sinceResync++;
+        } else {
+            filled++;
+        }
+
+        values[slot] = value;
+        validFlags[slot] = isValid;
+
+        if (isValid) {
+            addToMoments(value);
+            while (minQueue.length && values[minQueue.back()] >= value) minQueue.popBack();
+            minQueue.pushBack(slot);
+            while (maxQueue.length && values[maxQueue.back()] <= value) maxQueue.popBack();
+            maxQueue.pushBack(slot);
+        }
+
+        next = (slot + 1) % N;
+
+        if (sinceResync >= N) {
+            resync();
+        }
+    }
+
+    size_t capacity() const { return N; }
+    size_t count() const { return filled; }
+    size_t validCount() const { return valid; }
+    size_t invalidCount() const { return filled - valid; }
+    bool full() const { return filled == N; }
+
+    T latest() const { return filled ? values[(next + N - 1) % N] : T(0); }
+    T mean() const { return valid ? runningMean : T(0); }
+    T minimum() const { return minQueue.length ? values[minQueue.front()] : T(0); }
+    T maximum() const { return maxQueue.length ? values[maxQueue.front()] : T(0); }
+
+    /** Population variance of the valid samples in the window. */
+    T variance() const {
+        return valid ? runningM2 / static_cast<T>(valid) : T(0);
+    }
+
+    T stddev() const { return sqrt(variance()); }
+};
+
+#endif // ROLLING_WINDOW_H
@@ -0,0 +1,308 @@
+/**
+ * Kaldor IIoT - Multi-Resolution Rollups
+ *
+ * The device-side counterpart of the bbw_1min / bbw_1hour views: samples
+ * are summarised into 1 s buckets, closed 1 s buckets are merged into
+ * 1 min buckets and those into 1 h buckets. Each level is published on its
+ * own topic (kaldor/loom/{id}/bbw/rollup/1s, 1m, 1h) when its bucket
+ * closes, so the backend can store pre-aggregated rows instead of
+ * re-aggregating every raw sample.
+ *
+ * Buckets are aligned to multiples of their length on the device clock
+ * (there is no wall clock on the board) and close with the first sample
+ * past their end. A bucket holds count, mean and the sum of squared
+ * deviations, so merging is exact (Chan et al.) and stddev_bbw is the
+ * standard deviation of all readings in the bucket, not an average of
+ * window deviations. The first bucket after boot and buckets spanning an
+ * outage are partial; sample_count tells.
+ *
+ *   Rollups         acquisition task: one add() per sample, O(1)
+ *   RollupPublisher network task: publishes closed buckets, holds 1 min
+ *                   and 1 h buckets while MQTT is down
+ *
+ * Header-only and free of Arduino dependencies.
+ */
+
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+#include "config.h"
+#include "hal.h"
+#include "mqtt_topics.h"
+#include "payload_writer.h"
+#include "sensor_data.h"
+
+#define ROLLUP_LEVELS 3
+
+enum class RollupLevel : uint8_t {
+    Second,
+    Minute,
+    Hour
+};
+
+static const uint32_t rollupDurationMs[ROLLUP_LEVELS] = {1000, 60000, 3600000};
+static const char* const rollupNames[ROLLUP_LEVELS] = {"1s", "1m", "1h"};
+
+struct RollupBucket {
+    uint32_t start;             // Device ms, a multiple of the level's length
+    uint8_t level;              // RollupLevel
+    uint8_t qualityMin;
+    uint32_t samples;           // All samples, valid or not
+    uint32_t count;             // Valid BBW readings
+    float mean;                 // BBW over the valid readings (mm)
+    float m2;                   // Sum of squared deviations from mean
+    float minimum;
+    float maximum;
+    float qualityMean;          // Over all samples
+    uint32_t temperatureCount;
+    float temperatureMean;      // C
+    float vibrationMean;        // g
+    float vibrationMax;
+    uint32_t outliers;          // Readings replaced by the outlier filter
+
+    void clear(uint8_t bucketLevel, uint32_t bucketStart) {
+        *this = RollupBucket();
+        level = bucketLevel;
+        start = bucketStart;
+        qualityMin = 100;
+    }
+
+    void add(const SensorData& data) {
+        samples++;
+        float n = (float)samples;
+        qualityMean += ((float)data.quality - qualityMean) / n;
+        if (data.quality < qualityMin) qualityMin = data.quality;
+        vibrationMean += (data.vibration - vibrationMean) / n;
+        if (samples == 1 || data.vibration > vibrationMax) vibrationMax = data.vibration;
+        if (data.temperature > -999.0f) {
+            temperatureCount++;
+            temperatureMean += (data.temperature - temperatureMean) / (float)temperatureCount;
+        }
+        if (data.bbw <= 0) return;
+
+        // Welford
+        count++;
+        float d = data.bbw - mean;
+        mean += d / (float)count;
+        m2 += d * (data.bbw - mean);
+        if (count == 1 || data.bbw < minimum) minimum = data.bbw;
+        if (count == 1 || data.bbw > maximum) maximum = data.bbw;
+        if (data.bbw_outlier) outliers++;
+    }
+
+    /** Fold a closed bucket of the level below into this one. */
+    void merge(const RollupBucket& other) {
+        if (other.samples == 0) return;
+        float n = (float)(samples + other.samples);
+        qualityMean += ((float)other.samples / n) * (other.qualityMean - qualityMean);
+        if (other.qualityMin < qualityMin) qualityMin = other.qualityMin;
+        vibrationMean += ((float)other.samples / n) * (other.vibrationMean - vibrationMean);
+        if (samples == 0 || other.vibrationMax > vibrationMax) vibrationMax = other.vibrationMax;
+        samples += other.samples;
+
+        if (other.temperatureCount) {
+            uint32_t t = temperatureCount + other.temperatureCount;
+            temperatureMean += ((float)other.temperatureCount / (float)t) *
+                               (other.temperatureMean - temperatureMean);
+            temperatureCount = t;
+        }
+
+        if (other.count == 0) return;
+        if (count == 0) {
+            minimum = other.minimum;
+            maximum = other.maximum;
+        } else {
+            if (other.minimum < minimum) minimum = other.minimum;
+            if (other.maximum > maximum) maximum = other.maximum;
+        }
+        float na = (float)count;
+        float nb = (float)other.count;
+        float total = na + nb;
+        float d = other.mean - mean;
+        mean += d * (nb / total);
+        m2 += other.m2 + d * d * (na * nb / total);
+        count += other.count;
+        outliers += other.outliers;
+    }
+
+    float stddev() const { return count > 1 ? sqrtf(m2 / (float)count) : 0.0f; }
+    uint32_t durationMs() const { return rollupDurationMs[level]; }
+};
+
+class Rollups {
+private:
+    RollupBucket open[ROLLUP_LEVELS];
+    bool active[ROLLUP_LEVELS];
+
+    template <typename Sink>
+    void close(uint8_t level, Sink& sink) {
+        active[level] = false;
+        const RollupBucket& bucket = open[level];
+        sink(bucket);
+        uint8_t parent = level + 1;
+        if (parent == ROLLUP_LEVELS) return;
+        uint32_t length = rollupDurationMs[parent];
+        if (active[parent] && bucket.start - open[parent].start >= length) close(parent, sink);
+        if (!active[parent]) {
+            open[parent].clear(parent, bucket.start - bucket.start % length);
+            active[parent] = true;
+        }
+        open[parent].merge(bucket);
+    }
+
+public:
+    Rollups() {
+        for (uint8_t l = 0; l < ROLLUP_LEVELS; l++) active[l] = false;
+    }
+
+    /**
+     * Add one sample. Buckets that end at or before its timestamp are
+     * closed first, finest level first, and handed to sink(const
+     * RollupBucket&). Returns the number closed.
+     */
+    template <typename Sink>
+    size_t add(const SensorData& data, Sink&& sink) {
+        uint32_t now = (uint32_t)data.timestamp;
+        size_t closed = 0;
+        auto counted = [&](const RollupBucket& bucket) {
+            closed++;
+            sink(bucket);
+        };
+        for (uint8_t l = 0; l < ROLLUP_LEVELS; l++) {
+            if (active[l] && now - open[l].start >= rollupDurationMs[l]) close(l, counted);
+        }
+        if (!active[0]) {
+            open[0].clear(0, now - now % rollupDurationMs[0]);
+            active[0] = true;
+        }
+        open[0].add(data);
+        return closed;
+    }
+
+    /** The bucket still being filled at a level, if any. */
+    const RollupBucket* current(RollupLevel level) const {
+        uint8_t l = (uint8_t)level;
+        return active[l] ? &open[l] : nullptr;
+    }
+};
+
+/**
+ * One bucket on kaldor/loom/{id}/bbw/rollup/{1s,1m,1h}. Column names
+ * follow the bbw_1min view; the BBW columns are left out when the bucket
+ * has no valid reading.
+ */
+inline bool writeRollup(PayloadWriter& out, const RollupBucket& bucket, const char* deviceId,
+                        const char* loomId) {
+    out.reset();
+    out.beginObject()
+       .add("device_id", deviceId)
+       .add("loom_id", loomId)
+       .add("resolution", rollupNames[bucket.level])
+       .add("timestamp", bucket.start)
+       .add("duration_ms", bucket.durationMs())
+       .add("sample_count", bucket.samples)
+       .add("valid_count", bucket.count);
+    if (bucket.count) {
+        out.add("avg_bbw", bucket.mean, 2)
+           .add("min_bbw", bucket.minimum, 2)
+           .add("max_bbw", bucket.maximum, 2)
+           .add("stddev_bbw", bucket.stddev(), 3)
+           .add("outliers", bucket.outliers);
+    }
+    out.add("avg_quality", bucket.qualityMean, 1)
+       .add("min_quality", (uint32_t)bucket.qualityMin);
+    if (bucket.temperatureCount) {
+        out.add("avg_temp", bucket.temperatureMean, 1);
+    }
+    out.add("avg_vib", bucket.vibrationMean, 4)
+       .add("max_vib", bucket.vibrationMax, 4)
+       .endObject();
+    return out.ok();
+}
+
+/**
+ * Publishes closed buckets of the levels enabled in a bit mask (bit per
+ * RollupLevel). While MQTT is down, or its queue is full, 1 min and 1 h
+ * buckets wait in a ring of ROLLUP_PENDING, dropping the oldest; 1 s
+ * buckets are dropped, the raw backlog covers them.
+ *
+ * Single-threaded: everything here belongs to the network task.
+ */
+class RollupPublisher {
+private:
+    MqttTransport& mqtt;
+    const MqttTopics& topics;
+    PayloadWriter& payload;
+    const char* deviceId;
+    const char* loomId;
+
+    RollupBucket pending[ROLLUP_PENDING];
+    size_t head;                // Oldest pending
+    size_t length;
+
+    uint32_t publishedCount[ROLLUP_LEVELS];
+    uint32_t droppedCount;
+
+    bool send(const RollupBucket& bucket) {
+        if (!mqtt.connected()) return false;
+        if (!writeRollup(payload, bucket, deviceId, loomId)) {
+            droppedCount++;     // Would never fit; don't retry
+            return true;
+        }
+        if (!mqtt.publish(topics.rollup[bucket.level], payload.c_str(), false, MQTT_QOS_ROLLUP,
+                          MqttPriority::Live)) {
+            return false;
+        }
+        publishedCount[bucket.level]++;
+        return true;
+    }
+
+public:
+    RollupPublisher(MqttTransport& transport, const MqttTopics& mqttTopics,
+                    PayloadWriter& writer)
+        : mqtt(transport), topics(mqttTopics), payload(writer), deviceId(""), loomId(""),
+          head(0), length(0), droppedCount(0) {
+        for (uint8_t l = 0; l < ROLLUP_LEVELS; l++) publishedCount[l] = 0;
+    }
+
+    /** Identity strings must outlive the publisher. */
+    void begin(const char* device, const char* loom) {
+        deviceId = device;
+        loomId = loom;
+    }
+
+    /** A bucket the acquisition task closed; levels not in mask are skipped. */
+    void publish(const RollupBucket& bucket, uint8_t mask) {
+        if (!(mask & (1u << bucket.level))) return;
+        drain();
+        if (length == 0 && send(bucket)) return;
+        if (bucket.level == (uint8_t)RollupLevel::Second) {
+            droppedCount++;
+            return;
+        }
+        if (length == ROLLUP_PENDING) {
+            head = (head + 1) % ROLLUP_PENDING;
+            length--;
+            droppedCount++;
+        }
+        pending[(head + length) % ROLLUP_PENDING] = bucket;
+        length++;
+    }
+
+    /** Send held buckets, oldest first, until one does not go out. */
+    void drain() {
+        while (length && send(pending[head])) {
+            head = (head + 1) % ROLLUP_PENDING;
+            length--;
+        }
+    }
+
+    size_t pendingCount() const { return length; }
+    uint32_t published(RollupLevel level) const { return publishedCount[(uint8_t)level]; }
+    uint32_t dropped() const { return droppedCount; }
+};
+
+#endif // ROLLUP_H
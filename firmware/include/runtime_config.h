@@ -0,0 +1,106 @@
+/**
+ * Kaldor IIoT - Runtime Configuration
+ *
+ * Settings that can be changed over MQTT without reflashing: alarm
+ * thresholds, BBW calibration, the outlier filter, sampling rate,
+ * report-by-exception and what is published. The compile-time values in
+ * config.h are only the defaults.
+ *
+ * Stored in NVS one key per field (runtime_config_store.h). layout
+ * identifies the struct as earlier firmware stored it, in a single blob;
+ * such a blob is migrated once. version counts accepted updates and
+ * is echoed in the status message so the backend can tell which settings
+ * a device runs with.
+ *
+ * Header-only and free of Arduino dependencies.
+ */
+
+#ifndef RUNTIME_CONFIG_H
+#define RUNTIME_CONFIG_H
+
+#include <stdint.h>
+#include <math.h>
+
+#define RUNTIME_CONFIG_LAYOUT 3
+
+struct RuntimeConfig {
+    uint16_t layout;
+    uint32_t version;
+
+    // Alarm thresholds
+    float bbwMin;               // mm
+    float bbwMax;               // mm
+    float temperatureMax;       // Celsius
+    float vibrationMax;         // g
+
+    // BBW calibration: (raw + offset) * scale
+    float calibrationOffset;    // mm
+    float calibrationScale;
+
+    // Outlier filter on BBW readings
+    float outlierThreshold;     // Sigmas; 0 = off
+    float outlierMinSigmaMm;    // mm
+
+    // Acquisition
+    uint32_t sampleRateHz;
+    bool adaptiveRate;
+
+    // Report-by-exception
+    float reportDeadbandMm;
+    float reportDeadbandPct;
+    uint32_t reportMaxSilenceMs;
+
+    // What the backend gets: raw samples, and rollup levels (bit per RollupLevel)
+    bool publishRaw;
+    uint32_t rollupLevels;
+};
+
+/**
+ * Check a candidate configuration. Returns nullptr if it can be applied,
+ * otherwise a short reason for the status message.
+ */
+inline const char* validateRuntimeConfig(const RuntimeConfig& cfg) {
+    if (cfg.layout != RUNTIME_CONFIG_LAYOUT) return "unknown layout";
+
+    const float values[] = {
+        cfg.bbwMin, cfg.bbwMax, cfg.temperatureMax, cfg.vibrationMax,
+        cfg.calibrationOffset, cfg.calibrationScale,
+        cfg.outlierThreshold, cfg.outlierMinSigmaMm,
+        cfg.reportDeadbandMm, cfg.reportDeadbandPct,
+    };
+    for (float v : values) {
+        if (!isfinite(v)) return "non-finite value";
+    }
+
+    if (cfg.bbwMin < 0 || cfg.bbwMin >= cfg.bbwMax) return "bbw_min must be >= 0 and below bbw_max";
+    if (cfg.bbwMax > 1000) return "bbw_max above sensor range";
+    if (cfg.temperatureMax < -40 || cfg.temperatureMax > 125) return "temp_max outside -40..125";
+    if (cfg.vibrationMax <= 0 || cfg.vibrationMax > 16) return "vib_max outside 0..16 g";
+    if (cfg.calibrationScale < 0.5f || cfg.calibrationScale > 2.0f) return "calibration scale outside 0.5..2";
+    if (fabsf(cfg.calibrationOffset) > 100) return "calibration offset above 100 mm";
+    if (cfg.outlierThreshold != 0 && (cfg.outlierThreshold < 1 || cfg.outlierThreshold > 20)) {
+        return "outlier threshold must be 0 (off) or 1..20";
+    }
+    if (cfg.outlierMinSigmaMm < 0 || cfg.outlierMinSigmaMm > 50) return "outlier min_sigma_mm outside 0..50";
+    if (cfg.sampleRateHz < 1 || cfg.sampleRateHz > 100) return "sampling_rate outside 1..100 Hz";
+    if (cfg.reportDeadbandMm < 0 || cfg.reportDeadbandPct < 0 || cfg.reportDeadbandPct > 100) {
+        return "report deadband out of range";
+    }
+    if (cfg.reportMaxSilenceMs > 3600000) return "max_silence_ms above 1 h";
+    if (cfg.rollupLevels > 0x7) return "rollup levels outside 0..7";
+    return nullptr;
+}
+
+/** True if anything but the version differs. */
+inline bool runtimeConfigChanged(const RuntimeConfig& a, const RuntimeConfig& b) {
+    return a.bbwMin != b.bbwMin || a.bbwMax != b.bbwMax ||
+           a.temperatureMax != b.temperatureMax || a.vibrationMax != b.vibrationMax ||
+           a.calibrationOffset != b.calibrationOffset || a.calibrationScale != b.calibrationScale ||
+           a.outlierThreshold != b.outlierThreshold || a.outlierMinSigmaMm != b.outlierMinSigmaMm ||
+           a.sampleRateHz != b.sampleRateHz || a.adaptiveRate != b.adaptiveRate ||
+           a.reportDeadbandMm != b.reportDeadbandMm || a.reportDeadbandPct != b.reportDeadbandPct ||
+           a.reportMaxSilenceMs != b.reportMaxSilenceMs ||
+           a.publishRaw != b.publishRaw || a.rollupLevels != b.rollupLevels;
+}
+
+#endif // RUNTIME_CONFIG_H
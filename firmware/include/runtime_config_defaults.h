@@ -0,0 +1,36 @@
+/**
+ * Kaldor IIoT - Runtime Configuration Defaults
+ *
+ * The factory RuntimeConfig built from config.h, shared by the firmware
+ * and the native simulation.
+ */
+
+#ifndef RUNTIME_CONFIG_DEFAULTS_H
+#define RUNTIME_CONFIG_DEFAULTS_H
+
+#include "config.h"
+#include "runtime_config.h"
+
+inline RuntimeConfig defaultRuntimeConfig(uint32_t sampleRateHz) {
+    RuntimeConfig cfg;
+    cfg.layout = RUNTIME_CONFIG_LAYOUT;
+    cfg.version = 0;
+    cfg.bbwMin = BBW_MIN_THRESHOLD;
+    cfg.bbwMax = BBW_MAX_THRESHOLD;
+    cfg.temperatureMax = TEMP_MAX_THRESHOLD;
+    cfg.vibrationMax = VIB_MAX_THRESHOLD;
+    cfg.calibrationOffset = BBW_CALIBRATION_OFFSET;
+    cfg.calibrationScale = BBW_CALIBRATION_SCALE;
+    cfg.outlierThreshold = OUTLIER_THRESHOLD;
+    cfg.outlierMinSigmaMm = OUTLIER_MIN_SIGMA_MM;
+    cfg.sampleRateHz = sampleRateHz;
+    cfg.adaptiveRate = ADAPTIVE_SAMPLE_RATE;
+    cfg.reportDeadbandMm = REPORT_DEADBAND_MM;
+    cfg.reportDeadbandPct = REPORT_DEADBAND_PCT;
+    cfg.reportMaxSilenceMs = REPORT_MAX_SILENCE_MS;
+    cfg.publishRaw = PUBLISH_RAW;
+    cfg.rollupLevels = ROLLUP_PUBLISH_LEVELS;
+    return cfg;
+}
+
+#endif // RUNTIME_CONFIG_DEFAULTS_H
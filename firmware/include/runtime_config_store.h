@@ -0,0 +1,59 @@
+/**
+ * Kaldor IIoT - Runtime Configuration Storage
+ *
+ * RuntimeConfig in NVS with one key per field, named after the config
+ * message's fields. A firmware that adds, drops or reorders fields keeps
+ * the settings that are already stored; a field without a key takes its
+ * default. Works with anything that has Preferences' typed getters and
+ * putters (getFloat/putFloat, getUInt/putUInt, getBool/putBool).
+ *
+ * Header-only and free of Arduino dependencies.
+ */
+
+#ifndef RUNTIME_CONFIG_STORE_H
+#define RUNTIME_CONFIG_STORE_H
+
+#include "runtime_config.h"
+
+/** Overwrite cfg's fields with the stored ones; cfg holds the defaults. */
+template <typename Store>
+inline void readRuntimeConfig(Store& store, RuntimeConfig& cfg) {
+    cfg.version = store.getUInt("version", cfg.version);
+    cfg.bbwMin = store.getFloat("bbw_min", cfg.bbwMin);
+    cfg.bbwMax = store.getFloat("bbw_max", cfg.bbwMax);
+    cfg.temperatureMax = store.getFloat("temp_max", cfg.temperatureMax);
+    cfg.vibrationMax = store.getFloat("vib_max", cfg.vibrationMax);
+    cfg.calibrationOffset = store.getFloat("cal_offset", cfg.calibrationOffset);
+    cfg.calibrationScale = store.getFloat("cal_scale", cfg.calibrationScale);
+    cfg.outlierThreshold = store.getFloat("outlier_thr", cfg.outlierThreshold);
+    cfg.outlierMinSigmaMm = store.getFloat("outlier_sigma", cfg.outlierMinSigmaMm);
+    cfg.sampleRateHz = store.getUInt("sampling_rate", cfg.sampleRateHz);
+    cfg.adaptiveRate = store.getBool("adaptive_rate", cfg.adaptiveRate);
+    cfg.reportDeadbandMm = store.getFloat("deadband_mm", cfg.reportDeadbandMm);
+    cfg.reportDeadbandPct = store.getFloat("deadband_pct", cfg.reportDeadbandPct);
+    cfg.reportMaxSilenceMs = store.getUInt("max_silence_ms", cfg.reportMaxSilenceMs);
+    cfg.publishRaw = store.getBool("publish_raw", cfg.publishRaw);
+    cfg.rollupLevels = store.getUInt("rollups", cfg.rollupLevels);
+}
+
+template <typename Store>
+inline void writeRuntimeConfig(Store& store, const RuntimeConfig& cfg) {
+    store.putUInt("version", cfg.version);
+    store.putFloat("bbw_min", cfg.bbwMin);
+    store.putFloat("bbw_max", cfg.bbwMax);
+    store.putFloat("temp_max", cfg.temperatureMax);
+    store.putFloat("vib_max", cfg.vibrationMax);
+    store.putFloat("cal_offset", cfg.calibrationOffset);
+    store.putFloat("cal_scale", cfg.calibrationScale);
+    store.putFloat("outlier_thr", cfg.outlierThreshold);
+    store.putFloat("outlier_sigma", cfg.outlierMinSigmaMm);
+    store.putUInt("sampling_rate", cfg.sampleRateHz);
+    store.putBool("adaptive_rate", cfg.adaptiveRate);
+    store.putFloat("deadband_mm", cfg.reportDeadbandMm);
+    store.putFloat("deadband_pct", cfg.reportDeadbandPct);
+    store.putUInt("max_silence_ms", cfg.reportMaxSilenceMs);
+    store.putBool("publish_raw", cfg.publishRaw);
+    store.putUInt("rollups", cfg.rollupLevels);
+}
+
+#endif // RUNTIME_CONFIG_STORE_H
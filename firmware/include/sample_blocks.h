@@ -0,0 +1,90 @@
+/**
+ * Kaldor IIoT - Double-Buffered Sample Blocks
+ *
+ * Collects interleaved multi-axis samples into fixed-size blocks for
+ * block-wise analysis. One task (the producer) fills a block while another
+ * (the consumer) works on the previously completed one; no locks, only an
+ * atomic hand-off index. If the consumer still holds the other block when
+ * a new one completes, the new block is discarded and counted.
+ *
+ * Header-only and free of Arduino dependencies.
+ */
+
+#ifndef SAMPLE_BLOCKS_H
+#define SAMPLE_BLOCKS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+template <typename T, size_t Axes, size_t BlockSize>
+class SampleBlocks {
+private:
+    static const uint8_t NONE = 0xFF;
+
+    T blocks[2][BlockSize * Axes];
+    size_t fill;                    // Producer only
+    uint8_t filling;                // Producer only
+    std::atomic<uint8_t> ready;     // Block handed to the consumer, or NONE
+    uint32_t readyTimestamp;
+    uint32_t droppedBlockCount;
+    uint32_t completedCount;
+    uint32_t discardedSamples;      // From restarted partial blocks
+
+public:
+    SampleBlocks()
+        : fill(0), filling(0), ready(NONE), readyTimestamp(0),
+          droppedBlockCount(0), completedCount(0), discardedSamples(0) {}
+
+    // ---- Producer ----
+
+    /** Slot for the next sample (Axes values). */
+    T* next() { return blocks[filling] + fill * Axes; }
+
+    /**
+     * The sample written to next() is complete. Returns true if this
+     * finished a block and it was handed to the consumer.
+     */
+    bool commit(uint32_t nowMs) {
+        if (++fill < BlockSize) return false;
+        fill = 0;
+
+        if (ready.load(std::memory_order_acquire) != NONE) {
+            droppedBlockCount++;    // Consumer busy: refill this block
+            return false;
+        }
+        readyTimestamp = nowMs;
+        ready.store(filling, std::memory_order_release);
+        filling ^= 1;
+        completedCount++;
+        return true;
+    }
+
+    /** Discard the partial block, e.g. after a gap in the samples. */
+    void restart() {
+        discardedSamples += (uint32_t)fill;
+        fill = 0;
+    }
+
+    // ---- Consumer ----
+
+    /** Completed block, or nullptr. Call release() when done with it. */
+    const T* acquire(uint32_t& timestamp) const {
+        uint8_t block = ready.load(std::memory_order_acquire);
+        if (block == NONE) return nullptr;
+        timestamp = readyTimestamp;
+        return blocks[block];
+    }
+
+    void release() { ready.store(NONE, std::memory_order_release); }
+
+    static size_t blockSize() { return BlockSize; }
+    size_t pending() const { return fill; }
+    uint32_t completed() const { return completedCount; }
+    uint32_t droppedBlocks() const { return droppedBlockCount; }
+    uint32_t droppedSamples() const {
+        return droppedBlockCount * (uint32_t)BlockSize + discardedSamples;
+    }
+};
+
+#endif // SAMPLE_BLOCKS_H
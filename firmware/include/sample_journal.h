@@ -0,0 +1,442 @@
+/**
+ * Kaldor IIoT - Append-only Sample Journal
+ *
+ * Persists SensorData as fixed-size, versioned, CRC-protected records in a
+ * ring of append-only segments. Appends are staged in RAM and written as
+ * one block, so each flush costs a single bounded append instead of a full
+ * file rewrite. When the active segment is full the journal rotates to the
+ * next one, erasing the oldest segment.
+ *
+ * Record layout (40 bytes, little-endian, independent of struct packing):
+ *
+ *   0   u8   magic 'J'
+ *   1   u8   version (JOURNAL_RECORD_VERSION)
+ *   2   u8   quality
+ *   3   u8   reserved (0)
+ *   4   u32  sequence number
+ *   8   u32  timestamp (ms)
+ *   12  f32  bbw, bbw_min, bbw_max, bbw_stddev, temperature, vibration
+ *   36  u32  CRC-32 of bytes 0..35
+ *
+ * The outlier filter's raw reading and the analog inputs are not stored:
+ * a decoded record has bbw_raw = bbw, no outlier flag and zero analog
+ * values.
+ *
+ * Records can be streamed out by sequence number (readFrom()) and
+ * segments are only erased once every record in them has been
+ * acknowledged (acknowledge()).
+ *
+ * Replay tolerates crashes: a torn (partial) record at the end of a segment
+ * is ignored, records failing their CRC are skipped and counted, and after
+ * an unclean tail new records go to a fresh segment.
+ */
+
+#ifndef SAMPLE_JOURNAL_H
+#define SAMPLE_JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "crc32.h"
+#include "journal_store.h"
+#include "sensor_data.h"
+
+#define JOURNAL_RECORD_VERSION 1
+#define JOURNAL_RECORD_SIZE 40
+#define JOURNAL_MAX_SEGMENTS 8
+#define JOURNAL_MAX_STAGING 16
+
+class SampleJournal {
+private:
+    JournalStore& store;
+    uint8_t segments;
+    uint32_t segmentRecords;
+    uint8_t flushEvery;
+
+    uint8_t activeSegment;
+    uint32_t nextSeq;
+    uint32_t slots[JOURNAL_MAX_SEGMENTS];      // Complete records per segment
+    uint32_t firstSeq[JOURNAL_MAX_SEGMENTS];   // First valid sequence per segment
+    bool hasValid[JOURNAL_MAX_SEGMENTS];
+
+    uint8_t staging[JOURNAL_MAX_STAGING * JOURNAL_RECORD_SIZE];
+    uint8_t staged;
+
+    uint32_t corruptCount;
+    uint32_t droppedCount;
+    uint32_t writeErrorCount;
+
+    static void putU32(uint8_t* p, uint32_t v) {
+        p[0] = (uint8_t)v;
+        p[1] = (uint8_t)(v >> 8);
+        p[2] = (uint8_t)(v >> 16);
+        p[3] = (uint8_t)(v >> 24);
+    }
+
+    static uint32_t getU32(const uint8_t* p) {
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+               ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    static void putF32(uint8_t* p, float f) {
+        uint32_t v;
+        memcpy(&v, &f, sizeof(v));
+        putU32(p, v);
+    }
+
+    static float getF32(const uint8_t* p) {
+        uint32_t v = getU32(p);
+        float f;
+        memcpy(&f, &v, sizeof(f));
+        return f;
+    }
+
+    // Wrap-safe "a comes after b" for sequence numbers
+    static bool seqAfter(uint32_t a, uint32_t b) { return (int32_t)(a - b) > 0; }
+
+    bool readRecord(uint8_t segment, uint32_t index, uint32_t& seq, SensorData& data) {
+        uint8_t rec[JOURNAL_RECORD_SIZE];
+        if (store.read(segment, (size_t)index * JOURNAL_RECORD_SIZE, rec, sizeof(rec)) != sizeof(rec)) {
+            return false;
+        }
+        return decodeRecord(rec, seq, data);
+    }
+
+    // Segments holding valid records, oldest first
+    uint8_t orderedSegments(uint8_t* order) const {
+        uint8_t used = 0;
+        for (uint8_t seg = 0; seg < segments; seg++) {
+            if (!hasValid[seg]) continue;
+            uint8_t pos = used++;
+            while (pos > 0 && seqAfter(firstSeq[order[pos - 1]], firstSeq[seg])) {
+                order[pos] = order[pos - 1];
+                pos--;
+            }
+            order[pos] = seg;
+        }
+        return used;
+    }
+
+    void rotate() {
+        activeSegment = (activeSegment + 1) % segments;
+        if (slots[activeSegment] > 0) {
+            droppedCount += slots[activeSegment];
+        }
+        store.erase(activeSegment);
+        slots[activeSegment] = 0;
+        hasValid[activeSegment] = false;
+    }
+
+public:
+    /**
+     * @param backend        Segment storage
+     * @param segmentCount   Number of segments in the ring (2..JOURNAL_MAX_SEGMENTS)
+     * @param recordsPerSeg  Records per segment before rotating
+     * @param stagingRecords Records buffered in RAM per flush (1..JOURNAL_MAX_STAGING)
+     */
+    SampleJournal(JournalStore& backend, uint8_t segmentCount, uint32_t recordsPerSeg,
+                  uint8_t stagingRecords)
+        : store(backend),
+          segments(segmentCount < 2 ? 2 : (segmentCount > JOURNAL_MAX_SEGMENTS ? JOURNAL_MAX_SEGMENTS : segmentCount)),
+          segmentRecords(recordsPerSeg ? recordsPerSeg : 1),
+          flushEvery(stagingRecords < 1 ? 1 : (stagingRecords > JOURNAL_MAX_STAGING ? JOURNAL_MAX_STAGING : stagingRecords)),
+          activeSegment(0), nextSeq(0), staged(0),
+          corruptCount(0), droppedCount(0), writeErrorCount(0) {
+        for (uint8_t i = 0; i < JOURNAL_MAX_SEGMENTS; i++) {
+            slots[i] = 0;
+            firstSeq[i] = 0;
+            hasValid[i] = false;
+        }
+    }
+
+    static void encodeRecord(uint32_t seq, const SensorData& data, uint8_t* rec) {
+        rec[0] = 'J';
+        rec[1] = JOURNAL_RECORD_VERSION;
+        rec[2] = data.quality;
+        rec[3] = 0;
+        putU32(rec + 4, seq);
+        putU32(rec + 8, (uint32_t)data.timestamp);
+        putF32(rec + 12, data.bbw);
+        putF32(rec + 16, data.bbw_min);
+        putF32(rec + 20, data.bbw_max);
+        putF32(rec + 24, data.bbw_stddev);
+        putF32(rec + 28, data.temperature);
+        putF32(rec + 32, data.vibration);
+        putU32(rec + 36, crc32(rec, 36));
+    }
+
+    static bool decodeRecord(const uint8_t* rec, uint32_t& seq, SensorData& data) {
+        if (rec[0] != 'J' || rec[1] != JOURNAL_RECORD_VERSION) return false;
+        if (getU32(rec + 36) != crc32(rec, 36)) return false;
+
+        seq = getU32(rec + 4);
+        data = SensorData();
+        data.quality = rec[2];
+        data.timestamp = getU32(rec + 8);
+        data.bbw = getF32(rec + 12);
+        data.bbw_min = getF32(rec + 16);
+        data.bbw_max = getF32(rec + 20);
+        data.bbw_stddev = getF32(rec + 24);
+        data.temperature = getF32(rec + 28);
+        data.vibration = getF32(rec + 32);
+        data.bbw_raw = data.bbw;
+        return true;
+    }
+
+    /**
+     * Scan the segments to recover the write position and next sequence
+     * number. Only the first and last records of each segment are read.
+     */
+    void begin() {
+        bool found = false;
+        bool cleanTail = true;
+        uint32_t lastSeq = 0;
+        activeSegment = 0;
+        staged = 0;
+
+        for (uint8_t seg = 0; seg < segments; seg++) {
+            size_t bytes = store.size(seg);
+            slots[seg] = (uint32_t)(bytes / JOURNAL_RECORD_SIZE);
+            hasValid[seg] = false;
+
+            uint32_t seq;
+            SensorData data;
+            for (uint32_t i = 0; i < slots[seg]; i++) {
+                if (readRecord(seg, i, seq, data)) {
+                    firstSeq[seg] = seq;
+                    hasValid[seg] = true;
+                    break;
+                }
+            }
+            if (!hasValid[seg]) continue;
+
+            bool tailValid = false;
+            uint32_t segLast = firstSeq[seg];
+            for (uint32_t i = slots[seg]; i-- > 0;) {
+                if (readRecord(seg, i, seq, data)) {
+                    segLast = seq;
+                    tailValid = (i == slots[seg] - 1);
+                    break;
+                }
+            }
+
+            if (!found || seqAfter(segLast, lastSeq)) {
+                found = true;
+                lastSeq = segLast;
+                activeSegment = seg;
+                cleanTail = tailValid && (bytes % JOURNAL_RECORD_SIZE == 0);
+            }
+        }
+
+        nextSeq = found ? lastSeq + 1 : 0;
+
+        // Never append after a torn or corrupt tail
+        if (found && !cleanTail) {
+            rotate();
+        } else if (!found && slots[activeSegment] > 0) {
+            store.erase(activeSegment);
+            slots[activeSegment] = 0;
+        }
+    }
+
+    /** Stage a sample; writes a block once flushEvery records are staged. */
+    bool append(const SensorData& data) {
+        return append(data, nextSeq);
+    }
+
+    /**
+     * Stage a sample under a caller-assigned sequence number, for callers
+     * that number samples before they reach flash. Sequence numbers must
+     * keep increasing.
+     */
+    bool append(const SensorData& data, uint32_t seq) {
+        encodeRecord(seq, data, staging + (size_t)staged * JOURNAL_RECORD_SIZE);
+        nextSeq = seq + 1;
+        staged++;
+        if (staged >= flushEvery) {
+            return flush();
+        }
+        return true;
+    }
+
+    /** Write staged records, rotating segments as they fill. */
+    bool flush() {
+        uint8_t written = 0;
+        bool ok = true;
+
+        while (written < staged) {
+            if (slots[activeSegment] >= segmentRecords) {
+                rotate();
+            }
+            uint32_t room = segmentRecords - slots[activeSegment];
+            uint32_t n = staged - written;
+            if (n > room) n = room;
+
+            const uint8_t* block = staging + (size_t)written * JOURNAL_RECORD_SIZE;
+            if (!store.append(activeSegment, block, (size_t)n * JOURNAL_RECORD_SIZE)) {
+                writeErrorCount++;
+                ok = false;
+                // The tail may now be partial; continue in a fresh segment
+                rotate();
+                break;
+            }
+            if (!hasValid[activeSegment]) {
+                firstSeq[activeSegment] = getU32(block + 4);
+                hasValid[activeSegment] = true;
+            }
+            slots[activeSegment] += n;
+            written += n;
+        }
+
+        staged = 0;
+        return ok;
+    }
+
+    /**
+     * Deliver every intact record, oldest first, as fn(seq, data).
+     * The first `skip` records are read but not delivered.
+     * Returns the number of records delivered.
+     */
+    template <typename Fn>
+    size_t replay(Fn fn, size_t skip = 0) {
+        flush();
+
+        uint8_t order[JOURNAL_MAX_SEGMENTS];
+        uint8_t used = orderedSegments(order);
+
+        size_t delivered = 0;
+        size_t seen = 0;
+        uint8_t chunk[8 * JOURNAL_RECORD_SIZE];
+
+        for (uint8_t k = 0; k < used; k++) {
+            uint8_t seg = order[k];
+            for (uint32_t i = 0; i < slots[seg]; i += 8) {
+                uint32_t n = slots[seg] - i;
+                if (n > 8) n = 8;
+                size_t got = store.read(seg, (size_t)i * JOURNAL_RECORD_SIZE, chunk,
+                                        (size_t)n * JOURNAL_RECORD_SIZE);
+                n = (uint32_t)(got / JOURNAL_RECORD_SIZE);
+
+                for (uint32_t r = 0; r < n; r++) {
+                    uint32_t seq;
+                    SensorData data;
+                    if (!decodeRecord(chunk + (size_t)r * JOURNAL_RECORD_SIZE, seq, data)) {
+                        corruptCount++;
+                        continue;
+                    }
+                    if (seen++ < skip) continue;
+                    fn(seq, data);
+                    delivered++;
+                }
+            }
+        }
+
+        return delivered;
+    }
+
+    /**
+     * Deliver up to `max` intact records with sequence >= fromSeq, oldest
+     * first, as fn(seq, data). Returns the number delivered.
+     */
+    template <typename Fn>
+    size_t readFrom(uint32_t fromSeq, size_t max, Fn fn) {
+        flush();
+
+        uint8_t order[JOURNAL_MAX_SEGMENTS];
+        uint8_t used = orderedSegments(order);
+        size_t delivered = 0;
+
+        for (uint8_t k = 0; k < used && delivered < max; k++) {
+            uint8_t seg = order[k];
+
+            // Skip segments that end before fromSeq
+            if (k + 1 < used && !seqAfter(firstSeq[order[k + 1]], fromSeq)) continue;
+
+            // Records in a segment are consecutive unless a write failed, so
+            // jump straight to the expected index and fall back to a scan
+            uint32_t index = 0;
+            if (seqAfter(fromSeq, firstSeq[seg])) {
+                index = fromSeq - firstSeq[seg];
+                uint32_t seq;
+                SensorData data;
+                if (index >= slots[seg] || !readRecord(seg, index, seq, data) || seq != fromSeq) {
+                    index = 0;
+                }
+            }
+
+            for (; index < slots[seg] && delivered < max; index++) {
+                uint32_t seq;
+                SensorData data;
+                if (!readRecord(seg, index, seq, data) || seqAfter(fromSeq, seq)) continue;
+                fn(seq, data);
+                delivered++;
+            }
+        }
+
+        return delivered;
+    }
+
+    /**
+     * Everything up to and including seq has been delivered. Erases each
+     * segment whose records are all acknowledged.
+     */
+    void acknowledge(uint32_t seq) {
+        if (!seqAfter(nextSeq, seq)) {
+            seq = nextSeq - 1;  // Acks may cover samples not spilled to flash
+        }
+
+        if (staged == 0 && seq + 1 == nextSeq) {
+            clear();
+            return;
+        }
+
+        for (uint8_t seg = 0; seg < segments; seg++) {
+            if (!hasValid[seg] || seg == activeSegment) continue;
+            uint32_t last = firstSeq[seg] + slots[seg] - 1;
+            if (!seqAfter(last, seq)) {
+                store.erase(seg);
+                slots[seg] = 0;
+                hasValid[seg] = false;
+            }
+        }
+    }
+
+    /** Sequence number of the oldest stored record (nextSequence() if empty). */
+    uint32_t oldestSequence() const {
+        uint32_t oldest = nextSeq - staged;
+        bool found = false;
+        for (uint8_t seg = 0; seg < segments; seg++) {
+            if (hasValid[seg] && (!found || seqAfter(oldest, firstSeq[seg]))) {
+                oldest = firstSeq[seg];
+                found = true;
+            }
+        }
+        return oldest;
+    }
+
+    /** Erase every segment. Sequence numbers keep counting up. */
+    void clear() {
+        for (uint8_t seg = 0; seg < segments; seg++) {
+            store.erase(seg);
+            slots[seg] = 0;
+            hasValid[seg] = false;
+        }
+        activeSegment = 0;
+        staged = 0;
+    }
+
+    /** Complete records on storage plus staged ones (includes corrupt). */
+    size_t recordCount() const {
+        size_t total = staged;
+        for (uint8_t seg = 0; seg < segments; seg++) total += slots[seg];
+        return total;
+    }
+
+    size_t capacity() const { return (size_t)segments * segmentRecords; }
+    uint32_t nextSequence() const { return nextSeq; }
+    uint32_t corruptRecords() const { return corruptCount; }
+    uint32_t droppedRecords() const { return droppedCount; }
+    uint32_t writeErrors() const { return writeErrorCount; }
+};
+
+#endif // SAMPLE_JOURNAL_H
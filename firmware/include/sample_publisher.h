@@ -0,0 +1,96 @@
+/**
+ * Kaldor IIoT - Raw Sample Publishing
+ *
+ * The network task's per-sample path: report-by-exception filtering, raw
+ * publishing (JSON or binary frames), buffering whatever could not be
+ * sent, and rate-limited backfill of the buffer after a reconnect. Talks
+ * to the broker through MqttTransport, so the same code runs on the board
+ * and in the native simulation.
+ *
+ * Single-threaded: everything here belongs to the network task.
+ */
+
+#ifndef SAMPLE_PUBLISHER_H
+#define SAMPLE_PUBLISHER_H
+
+#include "config.h"
+#include "hal.h"
+#include "sensor_data.h"
+#include "data_buffer.h"
+#include "backfill.h"
+#include "report_filter.h"
+#include "runtime_config.h"
+#include "mqtt_topics.h"
+#include "payload_writer.h"
+#include "telemetry_frame.h"
+#include "stage_timing.h"
+
+class SamplePublisher {
+private:
+    MqttTransport& mqtt;
+    HalClock& clock;
+    DataBuffer& buffer;
+    Backfill& backfill;
+    ReportFilter& filter;
+    const RuntimeConfig& config;
+    const MqttTopics& topics;
+    PayloadWriter& payload;
+
+    const char* deviceId;
+    const char* loomId;
+    StageTimers* timers;
+
+    uint32_t startTimer() { return timers ? timers->start() : 0; }
+    void stopTimer(Stage stage, uint32_t started) {
+        if (timers) timers->stop(stage, started);
+    }
+    void bufferSample(const SensorData& data);
+
+#if RAW_BINARY_FRAMES
+    // Batched raw frames; leave headroom in the MQTT packet for the topic
+    static const size_t RAW_FRAME_CAPACITY = MQTT_MAX_PACKET_SIZE - 64;
+    uint8_t rawFrameBuffer[RAW_FRAME_CAPACITY];
+    TelemetryFrameEncoder rawFrame;
+    SensorData rawFrameSamples[RAW_FRAME_MAX_SAMPLES];  // Buffered if the frame is not sent
+    uint32_t deviceHash;
+    uint16_t rawFrameSequence;
+    uint32_t rawFrameStarted;
+
+    void addToRawFrame(const SensorData& data);
+    void flushRawFrame();
+#endif
+
+public:
+    SamplePublisher(MqttTransport& mqtt, HalClock& clock, DataBuffer& buffer,
+                    Backfill& backfill, ReportFilter& filter, const RuntimeConfig& config,
+                    const MqttTopics& topics, PayloadWriter& payload);
+
+    /** Identity strings must outlive the publisher. */
+    void begin(const char* deviceId, const char* loomId, uint32_t deviceHash);
+
+    /** Optional: time serialise, publish, buffer and backlog stages. */
+    void setTimers(StageTimers* stageTimers) { timers = stageTimers; }
+
+    /** Publish (or buffer) one live sample; nothing when raw publishing is off. */
+    void publish(const SensorData& data);
+
+    /** End of a batch of samples: sends a raw frame that is due. */
+    void flush();
+
+    /**
+     * Before a planned restart: an open raw frame goes to the buffer, and
+     * the buffer's RAM tiers and staged journal records to flash.
+     */
+    bool persist();
+
+    /** After (re)connecting: start the backfill, report the next sample. */
+    void onConnect();
+
+    /** Send the next backlog batch if the backfill allows it. */
+    void drainBacklog();
+
+    /** Backend acknowledged everything up to seq. */
+    void acknowledge(uint32_t seq);
+};
+
+#endif // SAMPLE_PUBLISHER_H
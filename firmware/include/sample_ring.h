@@ -0,0 +1,102 @@
+/**
+ * Kaldor IIoT - Fixed-Capacity Sample Ring
+ *
+ * Ring buffer of sequence-numbered samples over caller-provided storage,
+ * so the same code can sit in internal RAM or PSRAM. Push, evict and
+ * drop-from-front are O(1); view() exposes contiguous runs for bulk reads.
+ */
+
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sensor_data.h"
+
+struct SequencedSample {
+    uint32_t seq;
+    SensorData data;
+};
+
+class SampleRing {
+private:
+    SequencedSample* slots;
+    size_t cap;
+    size_t head;    // Index of the oldest sample
+    size_t count;
+
+public:
+    SampleRing() : slots(nullptr), cap(0), head(0), count(0) {}
+
+    /** Use `capacity` slots at `storage`; a ring without storage holds nothing. */
+    void attach(SequencedSample* storage, size_t capacity) {
+        slots = storage;
+        cap = storage ? capacity : 0;
+        head = 0;
+        count = 0;
+    }
+
+    size_t size() const { return count; }
+    size_t capacity() const { return cap; }
+    bool empty() const { return count == 0; }
+    bool full() const { return count == cap; }
+
+    /** Oldest sample; only valid when not empty. */
+    const SequencedSample& front() const { return slots[head]; }
+
+    /** Sample at logical position i (0 = oldest). */
+    const SequencedSample& at(size_t i) const {
+        size_t idx = head + i;
+        return slots[idx >= cap ? idx - cap : idx];
+    }
+
+    /**
+     * Append a sample. When full, the oldest sample is moved to `evicted`
+     * and true is returned. A zero-capacity ring evicts the input itself.
+     */
+    bool push(const SequencedSample& item, SequencedSample& evicted) {
+        if (cap == 0) {
+            evicted = item;
+            return true;
+        }
+        bool wasFull = (count == cap);
+        if (wasFull) {
+            evicted = slots[head];
+            head = (head + 1 == cap) ? 0 : head + 1;
+            count--;
+        }
+        size_t tail = head + count;
+        slots[tail >= cap ? tail - cap : tail] = item;
+        count++;
+        return wasFull;
+    }
+
+    /** Remove the n oldest samples. */
+    void dropFront(size_t n) {
+        if (n > count) n = count;
+        head = cap ? (head + n) % cap : 0;
+        count -= n;
+    }
+
+    /**
+     * Contiguous run starting at logical position `offset`. Sets `run` and
+     * returns its length (0 past the end); call again with offset + length
+     * for the wrapped remainder.
+     */
+    size_t view(size_t offset, const SequencedSample*& run) const {
+        if (offset >= count) return 0;
+        size_t idx = head + offset;
+        if (idx >= cap) idx -= cap;
+        size_t avail = count - offset;
+        size_t untilWrap = cap - idx;
+        run = slots + idx;
+        return avail < untilWrap ? avail : untilWrap;
+    }
+
+    void clear() {
+        head = 0;
+        count = 0;
+    }
+};
+
+#endif // SAMPLE_RING_H
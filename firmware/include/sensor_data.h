@@ -0,0 +1,32 @@
+/**
+ * Kaldor IIoT - Sensor Sample
+ *
+ * One acquisition sample as produced by SensorManager. Kept free of
+ * Arduino dependencies so buffering and encoding code can use it on the
+ * host.
+ *
+ * Fields are ordered to fill the alignment padding: the buffer tiers hold
+ * thousands of these.
+ */
+
+#ifndef SENSOR_DATA_H
+#define SENSOR_DATA_H
+
+#include <stdint.h>
+
+struct SensorData {
+    float bbw;           // Back Beam Width (mm)
+    float bbw_min;       // Minimum in window
+    float bbw_max;       // Maximum in window
+    float bbw_stddev;    // Standard deviation
+    float temperature;   // Temperature (C)
+    float vibration;     // Vibration (g)
+    uint8_t quality;     // Signal quality (0-100)
+    bool bbw_outlier;    // bbw is the filter's median, not the reading
+    float motor_current; // Loom motor current (A), decimated analog input
+    unsigned long timestamp;
+    float bbw_raw;       // Reading before the outlier filter (mm)
+    float warp_tension;  // Warp tension (N), decimated analog input
+};
+
+#endif // SENSOR_DATA_H
@@ -0,0 +1,553 @@
+/**
+ * Kaldor IIoT - Raw Sensor Traces
+ *
+ * What SensorManager read from the hardware, recorded compactly enough to
+ * capture minutes of a misbehaving loom and replay them on the host
+ * (trace_replay.h): the start of every read(), the edges of every
+ * ultrasonic echo, every DHT reading and every accelerometer sample, plus
+ * the SensorManager state a replay has to start from.
+ *
+ * A trace is a sequence of self-contained chunks, one lane per producer
+ * task so recording never takes a lock:
+ *
+ *   lane 0  acquisition task: reads, echoes, temperatures, state
+ *   lane 1  accelerometer task: FIFO batches and overruns
+ *
+ * Chunk layout (all integers little-endian):
+ *
+ *   offset  size  field
+ *   0       2     magic "KT"
+ *   2       1     version (SENSOR_TRACE_VERSION)
+ *   3       1     lane
+ *   4       1     flags: 1 = first chunk of a capture, 2 = last
+ *   5       1     reserved, 0
+ *   6       2     sequence number in the lane (from 0 each capture, wraps)
+ *   8       2     chunk size in bytes, header included
+ *   10      2     record count
+ *   12      4     base time (ms, device clock)
+ *   16      4     base time (µs, device clock, read with the ms)
+ *   20      ...   records
+ *
+ * Each record is a type byte, a varint time delta (µs) from the previous
+ * record (the first from the base time), then:
+ *
+ *   Read          nothing
+ *   Echo          varint µs from trigger to rising edge, varint echo width
+ *   NoEcho        nothing: no complete echo within the timeout
+ *   Temperature   zigzag varint 0.01 °C
+ *   TemperatureFailed
+ *                 nothing: the DHT did not answer
+ *   Accel         u8 count, then per sample x, y, z as zigzag varint deltas
+ *                 from the previous sample in the record (the first from 0)
+ *   AccelOverrun  nothing
+ *   State         calibration offset and scale, outlier threshold and
+ *                 minimum sigma, air temperature, vibration level (floats,
+ *                 IEEE 754), last slow read (u32 ms), flags (u8: 1 = echo
+ *                 in flight) and that echo's trigger time (u32 µs)
+ *   AccelFill     varint samples already in the vibration block in progress;
+ *                 first in the accelerometer lane of a capture
+ *
+ * Echo and NoEcho records are written when the measurement is collected
+ * and belong to the triggers in order. The ms and µs base times together
+ * give the 64-bit device time (µs alone wrap every 71 minutes).
+ *
+ * Header-only and free of Arduino dependencies.
+ */
+
+#ifndef SENSOR_TRACE_H
+#define SENSOR_TRACE_H
+
+#include <atomic>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "config.h"
+#include "spsc_ring.h"
+
+#define SENSOR_TRACE_VERSION 1
+#define SENSOR_TRACE_HEADER_SIZE 20
+#define SENSOR_TRACE_LANES 2
+#define TRACE_ACCEL_MAX 32          // Samples per Accel record (the ADXL345 FIFO)
+
+#define TRACE_FIRST 0x01
+#define TRACE_LAST 0x02
+
+enum class TraceLane : uint8_t {
+    Acquisition,
+    Accel
+};
+
+enum class TraceRecord : uint8_t {
+    Read = 1,
+    Echo,
+    NoEcho,
+    Temperature,
+    TemperatureFailed,
+    Accel,
+    AccelOverrun,
+    State,
+    AccelFill
+};
+
+/** Where a replay has to pick SensorManager up. */
+struct TraceState {
+    float calibrationOffset;
+    float calibrationScale;
+    float outlierThreshold;
+    float outlierMinSigma;
+    float airTemperature;       // Last valid reading; sets the speed of sound
+    float vibrationRms;         // g, of the last analysed block
+    uint32_t lastSlowRead;      // ms
+    bool echoPending;           // A trigger was still waiting for its echo
+    uint32_t echoTriggerUs;
+};
+
+/** 64-bit device time in µs from a millis()/micros() pair read together. */
+inline uint64_t traceTime(uint32_t ms, uint32_t us) {
+    uint64_t t = (uint64_t)ms * 1000;
+    return t + (uint64_t)(int64_t)(int32_t)(us - (uint32_t)t);
+}
+
+struct TraceChunk {
+    uint16_t length;            // Bytes used in data
+    uint8_t data[TRACE_CHUNK_BYTES];
+};
+
+class SensorTrace;
+
+/**
+ * One lane: the producer task records into an open chunk and hands full
+ * ones to the network task through an SPSC ring. A full ring drops the
+ * chunk; the sequence numbers show the gap.
+ */
+class TraceWriter {
+private:
+    static const size_t MAX_RECORD = 1 + 5 + 1 + TRACE_ACCEL_MAX * 9;
+
+    const SensorTrace* owner;
+    uint8_t laneIndex;
+    SpscRing<TraceChunk, TRACE_RING_CHUNKS> ring;
+
+    TraceChunk chunk;
+    bool open;
+    bool started;
+    uint32_t capture;           // Owner's capture number this lane is recording
+    uint16_t sequence;
+    uint16_t records;
+    uint32_t openedMs;
+    uint32_t lastUs;
+    uint64_t lastTime;          // 64-bit device time of the last record
+    uint32_t chunkCount;
+
+    size_t accelCountAt;        // Count byte of the open Accel record, 0 if none
+    uint8_t accelCount;
+    uint32_t accelUs;
+    int16_t accelPrevious[3];
+
+    void put(uint8_t b) { chunk.data[chunk.length++] = b; }
+
+    void putLE(size_t at, uint32_t value, int bytes) {
+        for (int i = 0; i < bytes; i++) chunk.data[at + i] = (uint8_t)(value >> (8 * i));
+    }
+
+    void put32(uint32_t value) {
+        putLE(chunk.length, value, 4);
+        chunk.length += 4;
+    }
+
+    void putFloat(float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        put32(bits);
+    }
+
+    void putVarint(uint32_t value) {
+        while (value >= 0x80) {
+            put((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        put((uint8_t)value);
+    }
+
+    void putSigned(int32_t value) { putVarint(((uint32_t)value << 1) ^ (uint32_t)(value >> 31)); }
+
+    void begin(uint8_t flags) {
+        chunk.length = 0;
+        put('K');
+        put('T');
+        put(SENSOR_TRACE_VERSION);
+        put(laneIndex);
+        put(flags);
+        put(0);
+        chunk.length = SENSOR_TRACE_HEADER_SIZE;
+        putLE(6, sequence++, 2);
+        putLE(12, (uint32_t)(lastTime / 1000), 4);
+        putLE(16, (uint32_t)lastTime, 4);
+        records = 0;
+        accelCountAt = 0;
+    }
+
+    void finish(uint8_t flags) {
+        endAccel();
+        chunk.data[4] |= flags;
+        putLE(8, chunk.length, 2);
+        putLE(10, records, 2);
+        if (ring.push(chunk)) chunkCount++;
+    }
+
+    /** Room for one more record, continuing in a new chunk if needed. */
+    void reserve(size_t bytes) {
+        if (chunk.length + bytes <= TRACE_CHUNK_BYTES) return;
+        finish(0);
+        begin(0);
+    }
+
+    void record(TraceRecord type, uint32_t nowUs, size_t bytes) {
+        endAccel();
+        reserve(bytes);
+        put((uint8_t)type);
+        putVarint(nowUs - lastUs);
+        lastTime += nowUs - lastUs;
+        lastUs = nowUs;
+        records++;
+    }
+
+public:
+    TraceWriter()
+        : owner(nullptr), laneIndex(0), chunk(), open(false), started(false), capture(0),
+          sequence(0), records(0), openedMs(0), lastUs(0), lastTime(0), chunkCount(0),
+          accelCountAt(0), accelCount(0), accelUs(0), accelPrevious() {}
+
+    void attach(const SensorTrace* trace, TraceLane lane) {
+        owner = trace;
+        laneIndex = (uint8_t)lane;
+    }
+
+    /**
+     * Producer, before recording anything: follows the owner's start and
+     * stop, and closes chunks older than TRACE_FLUSH_MS. False while not
+     * capturing.
+     */
+    inline bool ready(uint32_t nowMs, uint32_t nowUs);
+
+    /** True once after ready() opened a new capture. */
+    bool justStarted() {
+        bool s = started;
+        started = false;
+        return s;
+    }
+
+    void read(uint32_t nowUs) { record(TraceRecord::Read, nowUs, 6); }
+
+    void echo(uint32_t nowUs, uint32_t riseUs, uint32_t widthUs) {
+        record(TraceRecord::Echo, nowUs, 16);
+        putVarint(riseUs);
+        putVarint(widthUs);
+    }
+
+    void noEcho(uint32_t nowUs) { record(TraceRecord::NoEcho, nowUs, 6); }
+
+    /** Degrees Celsius; NAN or -999 for a failed reading. */
+    void temperature(uint32_t nowUs, float celsius) {
+        if (isnan(celsius) || celsius <= -999.0f) {
+            record(TraceRecord::TemperatureFailed, nowUs, 6);
+            return;
+        }
+        record(TraceRecord::Temperature, nowUs, 11);
+        putSigned((int32_t)lroundf(celsius * 100.0f));
+    }
+
+    void state(uint32_t nowUs, const TraceState& s) {
+        record(TraceRecord::State, nowUs, 6 + 33);
+        putFloat(s.calibrationOffset);
+        putFloat(s.calibrationScale);
+        putFloat(s.outlierThreshold);
+        putFloat(s.outlierMinSigma);
+        putFloat(s.airTemperature);
+        putFloat(s.vibrationRms);
+        put32(s.lastSlowRead);
+        put(s.echoPending ? 1 : 0);
+        put32(s.echoTriggerUs);
+    }
+
+    void accelOverrun(uint32_t nowUs) { record(TraceRecord::AccelOverrun, nowUs, 6); }
+
+    /** Samples in the vibration block when the lane started (its producer). */
+    void accelFill(uint32_t nowUs, uint32_t samples) {
+        record(TraceRecord::AccelFill, nowUs, 11);
+        putVarint(samples);
+    }
+
+    /** One FIFO batch: beginAccel(), accelSample() per sample, endAccel(). */
+    void beginAccel(uint32_t nowUs) {
+        endAccel();
+        accelUs = nowUs;
+    }
+
+    void accelSample(const int16_t* xyz) {
+        if (accelCountAt == 0 || accelCount == TRACE_ACCEL_MAX) {
+            uint32_t at = accelUs;
+            record(TraceRecord::Accel, at, MAX_RECORD);
+            accelCountAt = chunk.length;
+            put(0);
+            accelCount = 0;
+            accelPrevious[0] = accelPrevious[1] = accelPrevious[2] = 0;
+        }
+        for (int a = 0; a < 3; a++) {
+            putSigned((int32_t)xyz[a] - (int32_t)accelPrevious[a]);
+            accelPrevious[a] = xyz[a];
+        }
+        chunk.data[accelCountAt] = ++accelCount;
+    }
+
+    void endAccel() { accelCountAt = 0; }
+
+    // Consumer side
+    bool pop(TraceChunk& out) { return ring.pop(out); }
+    size_t queued() const { return ring.size(); }
+    uint32_t chunks() const { return chunkCount; }
+    uint32_t dropped() const { return ring.dropped(); }
+};
+
+/**
+ * The lanes and the capture switch. start() and stop() come from the
+ * network task; each producer follows on its next ready(). The network
+ * task also takes the finished chunks, in lane order.
+ */
+class SensorTrace {
+private:
+    std::atomic<bool> capturing;
+    std::atomic<uint32_t> captureNumber;
+    TraceWriter lanes[SENSOR_TRACE_LANES];
+
+public:
+    SensorTrace() : capturing(false), captureNumber(0) {
+        lanes[0].attach(this, TraceLane::Acquisition);
+        lanes[1].attach(this, TraceLane::Accel);
+    }
+
+    /** A new capture; one in progress ends first. */
+    void start() {
+        captureNumber.fetch_add(1);
+        capturing.store(true);
+    }
+
+    void stop() { capturing.store(false); }
+
+    bool active() const { return capturing.load(); }
+    uint32_t number() const { return captureNumber.load(); }
+
+    TraceWriter& lane(TraceLane lane) { return lanes[(uint8_t)lane]; }
+
+    /** A finished chunk from any lane, acquisition first. */
+    bool next(TraceChunk& out) {
+        for (TraceWriter& writer : lanes) {
+            if (writer.pop(out)) return true;
+        }
+        return false;
+    }
+
+    uint32_t chunks() const { return lanes[0].chunks() + lanes[1].chunks(); }
+    uint32_t dropped() const { return lanes[0].dropped() + lanes[1].dropped(); }
+};
+
+inline bool TraceWriter::ready(uint32_t nowMs, uint32_t nowUs) {
+    bool want = owner->active();
+    uint32_t number = owner->number();
+    if (open && (!want || number != capture)) {
+        finish(TRACE_LAST);
+        open = false;
+    }
+    if (!want) return false;
+
+    if (!open) {
+        open = true;
+        started = true;
+        capture = number;
+        sequence = 0;
+        lastUs = nowUs;
+        lastTime = traceTime(nowMs, nowUs);
+        openedMs = nowMs;
+        begin(TRACE_FIRST);
+    } else if (nowMs - openedMs >= TRACE_FLUSH_MS) {
+        finish(0);
+        openedMs = nowMs;
+        begin(0);
+    }
+    return true;
+}
+
+struct TraceHeader {
+    uint8_t version;
+    uint8_t lane;
+    uint8_t flags;
+    uint16_t sequence;
+    uint16_t length;
+    uint16_t records;
+    uint32_t baseMs;
+    uint32_t baseUs;
+};
+
+struct TraceItem {
+    TraceRecord type;
+    uint64_t time;              // 64-bit device time, µs
+    uint32_t riseUs;            // Echo
+    uint32_t widthUs;
+    float celsius;              // Temperature; NAN if the reading failed
+    uint8_t count;              // Accel
+    uint32_t blockFill;         // AccelFill
+    int16_t xyz[TRACE_ACCEL_MAX][3];
+    TraceState state;
+};
+
+/** Decodes one chunk. */
+class TraceReader {
+private:
+    const uint8_t* buf;
+    size_t length;
+    size_t offset;
+    uint64_t time;
+    TraceHeader hdr;
+
+    uint32_t readLE(size_t at, int bytes) const {
+        uint32_t value = 0;
+        for (int i = 0; i < bytes; i++) value |= (uint32_t)buf[at + i] << (8 * i);
+        return value;
+    }
+
+    bool readVarint(uint32_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            if (offset >= length) return false;
+            uint8_t byte = buf[offset++];
+            value |= (uint32_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+
+    bool readSigned(int32_t& value) {
+        uint32_t raw;
+        if (!readVarint(raw)) return false;
+        value = (int32_t)(raw >> 1) ^ -(int32_t)(raw & 1);
+        return true;
+    }
+
+    bool read32(uint32_t& value) {
+        if (length - offset < 4) return false;
+        value = readLE(offset, 4);
+        offset += 4;
+        return true;
+    }
+
+    bool readFloat(float& value) {
+        uint32_t bits;
+        if (!read32(bits)) return false;
+        memcpy(&value, &bits, sizeof(value));
+        return true;
+    }
+
+public:
+    TraceReader() : buf(nullptr), length(0), offset(0), time(0), hdr() {}
+
+    /**
+     * Parse the header of the chunk at data. False for a short, foreign or
+     * newer chunk; size() then tells nothing.
+     */
+    bool begin(const uint8_t* data, size_t available) {
+        buf = data;
+        length = 0;
+        offset = 0;
+        if (available < SENSOR_TRACE_HEADER_SIZE || data[0] != 'K' || data[1] != 'T' ||
+            data[2] != SENSOR_TRACE_VERSION) {
+            return false;
+        }
+        hdr.version = data[2];
+        hdr.lane = data[3];
+        hdr.flags = data[4];
+        hdr.sequence = (uint16_t)readLE(6, 2);
+        hdr.length = (uint16_t)readLE(8, 2);
+        hdr.records = (uint16_t)readLE(10, 2);
+        hdr.baseMs = readLE(12, 4);
+        hdr.baseUs = readLE(16, 4);
+        if (hdr.length < SENSOR_TRACE_HEADER_SIZE || hdr.length > available ||
+            hdr.lane >= SENSOR_TRACE_LANES) {
+            return false;
+        }
+        length = hdr.length;
+        offset = SENSOR_TRACE_HEADER_SIZE;
+        time = traceTime(hdr.baseMs, hdr.baseUs);
+        return true;
+    }
+
+    const TraceHeader& header() const { return hdr; }
+    size_t size() const { return length; }
+
+    /** Next record; false at the end of the chunk or on a damaged one. */
+    bool next(TraceItem& item) {
+        if (offset >= length) return false;
+        uint8_t type = buf[offset++];
+        uint32_t delta;
+        if (type < (uint8_t)TraceRecord::Read || type > (uint8_t)TraceRecord::AccelFill ||
+            !readVarint(delta)) {
+            offset = length;
+            return false;
+        }
+        time += delta;
+        item.type = (TraceRecord)type;
+        item.time = time;
+
+        bool ok = true;
+        switch (item.type) {
+        case TraceRecord::Echo:
+            ok = readVarint(item.riseUs) && readVarint(item.widthUs);
+            break;
+        case TraceRecord::Temperature: {
+            int32_t centi = 0;
+            ok = readSigned(centi);
+            item.celsius = (float)centi / 100.0f;
+            break;
+        }
+        case TraceRecord::TemperatureFailed:
+            item.celsius = NAN;
+            break;
+        case TraceRecord::Accel: {
+            ok = offset < length;
+            item.count = ok ? buf[offset++] : 0;
+            ok = ok && item.count <= TRACE_ACCEL_MAX;
+            int32_t previous[3] = {0, 0, 0};
+            for (uint8_t i = 0; ok && i < item.count; i++) {
+                for (int a = 0; ok && a < 3; a++) {
+                    int32_t delta = 0;
+                    ok = readSigned(delta);
+                    previous[a] += delta;
+                    item.xyz[i][a] = (int16_t)previous[a];
+                }
+            }
+            break;
+        }
+        case TraceRecord::State: {
+            TraceState& s = item.state;
+            ok = readFloat(s.calibrationOffset) && readFloat(s.calibrationScale) &&
+                 readFloat(s.outlierThreshold) && readFloat(s.outlierMinSigma) &&
+                 readFloat(s.airTemperature) && readFloat(s.vibrationRms) &&
+                 read32(s.lastSlowRead) && offset < length;
+            if (ok) {
+                s.echoPending = (buf[offset++] & 1) != 0;
+                ok = read32(s.echoTriggerUs);
+            }
+            break;
+        }
+        case TraceRecord::AccelFill:
+            ok = readVarint(item.blockFill);
+            break;
+        default:
+            break;
+        }
+        if (!ok) offset = length;
+        return ok;
+    }
+};
+
+#endif // SENSOR_TRACE_H
@@ -1,56 +1,147 @@
 /**
  * Kaldor IIoT - Sensor Management
  *
- * Handles all sensor reading and processing
+ * Handles all sensor reading and processing. Hardware access goes through
+ * the HAL ports (hal.h), so the same code runs on the board and in the
+ * native simulation.
  */
 
 #ifndef SENSORS_H
 #define SENSORS_H
 
-#include <Arduino.h>
-#include <Adafruit_ADXL345_U.h>
-#include <DHT.h>
-
-struct SensorData {
-    float bbw;           // Back Beam Width (mm)
-    float bbw_min;       // Minimum in window
-    float bbw_max;       // Maximum in window
-    float bbw_stddev;    // Standard deviation
-    float temperature;   // Temperature (C)
-    float vibration;     // Vibration (g)
-    uint8_t quality;     // Signal quality (0-100)
-    unsigned long timestamp;
-};
+#include "config.h"
+#include "hal.h"
+#include "sensor_data.h"
+#include "rolling_window.h"
+#include "echo_capture.h"
+#include "sample_blocks.h"
+#include "stage_timing.h"
+#include "hampel_filter.h"
+#include "sensor_trace.h"
+#include <atomic>
 
 class SensorManager {
 private:
-    Adafruit_ADXL345_Unified accel;
-    DHT dht;
+    HalClock& clock;
+    UltrasonicPort& ultrasonic;
+    TemperaturePort& thermometer;
+    AccelPort& accel;
+    EchoCapture echo;
+
+    // BBW calibration, set from the runtime config by the acquisition task
+    float calibrationOffset;
+    float calibrationScale;
+
+    // Outlier filter between the calibrated reading and the statistics
+    HampelFilter<OUTLIER_WINDOW> bbwFilter;
+    float outlierThreshold;
+    float outlierMinSigma;
+    float airTemperature;           // Last valid reading, for the speed of sound
 
-    float bbwReadings[100];
-    int readingIndex;
-    int numReadings;
+    RollingWindow<float, BBW_WINDOW_SIZE> bbwWindow;
+    RollingWindow<float, SLOW_WINDOW_SIZE> temperatureWindow;
+    RollingWindow<float, SLOW_WINDOW_SIZE> vibrationWindow;
+    uint32_t lastSlowRead;
 
-    float readUltrasonic();
+    // High-rate accelerometer blocks: the capture task fills one while the
+    // vibration task analyses the other
+    SampleBlocks<int16_t, 3, VIBRATION_BLOCK_SIZE> vibrationBlocks;
+    std::atomic<float> vibrationRms;
+    std::atomic<float> motorCurrent;    // Newest outputs of the analog task
+    std::atomic<float> warpTension;
+    bool accelReady;
+    uint32_t fifoOverrunCount;
+    uint32_t accelReadErrorCount;
+    StageTimers* timers;            // Optional: times the statistics step
+    SensorTrace* trace;             // Optional: records the raw inputs
+    bool traceStateChanged;
+
+    void triggerUltrasonic();
+    float readUltrasonic(TraceWriter* traced);
+    float measureUltrasonicBlocking();
     float readTemperature();
+    void updateAirTemperature(float celsius);
     float readVibration();
     uint8_t calculateQuality();
-    void updateStatistics();
-
-    float bbw_sum;
-    float bbw_sum_sq;
-    float current_min;
-    float current_max;
-    float current_avg;
-    float current_stddev;
+    void fillStatistics(SensorData& data);
+    TraceWriter* traceLane(TraceLane lane);
 
 public:
-    SensorManager();
+    // ADXL345 in full-resolution mode: 4 mg per count in every range
+    static constexpr float ACCEL_G_PER_COUNT = 0.004f;
+
+    SensorManager(HalClock& clock, UltrasonicPort& ultrasonic,
+                  TemperaturePort& thermometer, AccelPort& accel);
     bool begin();
     SensorData read();
     SensorData getAggregated();
     void calibrate();
     bool selfTest();
+
+    void setTimers(StageTimers* stageTimers) { timers = stageTimers; }
+
+    /**
+     * Record raw inputs into a trace while it is capturing: reads, echoes
+     * and temperatures from read(), accelerometer batches from
+     * drainAccelerometer(). Set before the tasks start.
+     */
+    void setTrace(SensorTrace* sensorTrace) { trace = sensorTrace; }
+
+    /** What a replay needs to continue from here (sensor_trace.h). */
+    TraceState traceState() const;
+
+    /**
+     * Replay: take over a recorded state. resume for the first one of a
+     * capture, which also brings the measurement in flight and the
+     * vibration level. True if that re-armed a measurement; its echo is
+     * the next in the trace.
+     */
+    bool restoreTraceState(const TraceState& state, bool resume);
+
+    /**
+     * Replay: the capture began with samples already in the vibration
+     * block. Pads with zeros so blocks complete where the board's did.
+     */
+    void resumeVibrationBlock(uint32_t samples);
+
+    void setCalibration(float offset, float scale) {
+        if (offset != calibrationOffset || scale != calibrationScale) {
+            bbwFilter.reset();      // Window holds readings in the old calibration
+        }
+        calibrationOffset = offset;
+        calibrationScale = scale;
+        traceStateChanged = true;
+    }
+
+    void setOutlierFilter(float threshold, float minSigmaMm) {
+        bbwFilter.configure(threshold, minSigmaMm);
+        outlierThreshold = threshold;
+        outlierMinSigma = minSigmaMm;
+        traceStateChanged = true;
+    }
+
+    uint32_t echoTimeouts() const { return echo.timeouts(); }
+    uint32_t echoLateSamples() const { return echo.lateSamples(); }
+    uint32_t bbwOutliers() const { return bbwFilter.rejected(); }
+
+    // Accelerometer capture task: wait for the FIFO watermark, then drain
+    bool waitForAccelerometer(uint32_t timeoutMs) { return accel.waitForWatermark(timeoutMs); }
+    size_t drainAccelerometer();
+
+    // Vibration blocks for the analysis task (single consumer)
+    const int16_t* vibrationBlock(uint32_t& timestamp) { return vibrationBlocks.acquire(timestamp); }
+    void releaseVibrationBlock() { vibrationBlocks.release(); }
+    void setVibrationLevel(float rmsG) { vibrationRms.store(rmsG); }
+
+    // Analog task: newest decimated motor current (A) and warp tension (N)
+    void setAnalogLevels(float currentA, float tensionN) {
+        motorCurrent.store(currentA);
+        warpTension.store(tensionN);
+    }
+
+    uint32_t vibrationSamplesDropped() const { return vibrationBlocks.droppedSamples(); }
+    uint32_t fifoOverruns() const { return fifoOverrunCount; }
+    uint32_t accelReadErrors() const { return accelReadErrorCount; }
 };
 
 #endif // SENSORS_H
@@ -0,0 +1,80 @@
+/**
+ * Kaldor IIoT - Single-Producer/Single-Consumer Ring Buffer
+ *
+ * Wait-free hand-off between exactly one producer task and one consumer
+ * task (the acquisition and network tasks). push() and pop() never block
+ * and never take a lock; a full ring drops the new item and counts it.
+ *
+ * Header-only and free of Arduino dependencies so it can be tested and
+ * benchmarked natively.
+ */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+template <typename T, size_t N>
+class SpscRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing capacity must be a power of two");
+
+private:
+    static const uint32_t MASK = N - 1;
+
+    // Producer and consumer indices live on separate cache lines so the
+    // two sides don't invalidate each other on every operation.
+    alignas(64) std::atomic<uint32_t> head;     // Next slot to write (producer)
+    alignas(64) std::atomic<uint32_t> tail;     // Next slot to read (consumer)
+    alignas(64) std::atomic<uint32_t> dropCount;
+    std::atomic<uint32_t> highWater;
+    T slots[N];
+
+public:
+    SpscRing() : head(0), tail(0), dropCount(0), highWater(0), slots() {}
+
+    /** Producer side. Returns false (and counts a drop) when full. */
+    bool push(const T& item) {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        uint32_t used = h - tail.load(std::memory_order_acquire);
+        if (used >= N) {
+            dropCount.store(dropCount.load(std::memory_order_relaxed) + 1,
+                            std::memory_order_relaxed);
+            return false;
+        }
+        slots[h & MASK] = item;
+        head.store(h + 1, std::memory_order_release);
+        if (used + 1 > highWater.load(std::memory_order_relaxed)) {
+            highWater.store(used + 1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    /** Consumer side. Returns false when empty. */
+    bool pop(T& item) {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = slots[t & MASK];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Approximate fill level; exact when called from either side. */
+    size_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    bool empty() const { return size() == 0; }
+    size_t capacity() const { return N; }
+
+    /** Items rejected because the ring was full. */
+    uint32_t dropped() const { return dropCount.load(std::memory_order_relaxed); }
+
+    /** Highest fill level seen since start-up. */
+    uint32_t highWaterMark() const { return highWater.load(std::memory_order_relaxed); }
+};
+
+#endif // SPSC_RING_H
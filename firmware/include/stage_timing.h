@@ -0,0 +1,290 @@
+/**
+ * Kaldor IIoT - Stage Timing
+ *
+ * Where the time goes, measured on the device:
+ *
+ *   LatencyHistogram  fixed buckets (µs) plus count and maximum; one
+ *                     writer task, any reader
+ *   StageTimers       one histogram per pipeline stage, timed with the
+ *                     CPU cycle counter (HalClock::cycles())
+ *   CycleMonitor      sample-interval jitter and missed deadlines of a
+ *                     periodic task, against a drift-free grid like
+ *                     vTaskDelayUntil's
+ *
+ * Readers take snapshots; the difference of two snapshots describes the
+ * interval between them, so periodic summaries need no reset from the
+ * reading side.
+ *
+ * Header-only and free of Arduino dependencies.
+ */
+
+#ifndef STAGE_TIMING_H
+#define STAGE_TIMING_H
+
+#include <atomic>
+#include <stdint.h>
+#include "hal.h"
+#include "payload_writer.h"
+
+#define TIMING_BUCKETS 16
+
+// Upper bucket edges (µs); the last bucket takes everything from 500 ms
+static const uint32_t TIMING_BUCKET_EDGES_US[TIMING_BUCKETS - 1] = {
+    5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000,
+    10000, 20000, 50000, 100000, 500000,
+};
+
+enum class Stage : uint8_t {
+    SensorRead,     // SensorManager::read(), all of it
+    Filter,         // Outlier filter, inside the read
+    Stats,          // Rolling statistics and quality, inside the read
+    Detect,         // Change detection
+    Serialise,      // Raw sample payload
+    Publish,        // MQTT publish of a raw sample or frame
+    Buffer,         // DataBuffer::add() while offline
+    Backlog,        // One backfill pass
+    Telemetry,      // Processed telemetry document and publish
+    MqttLoop,       // MqttSession::loop()
+    Connect,        // ConnectionManager::loop()
+    Ota,            // OTA handler
+    Count
+};
+
+inline const char* stageName(Stage stage) {
+    static const char* const names[] = {
+        "sensor_read", "filter", "stats", "detect", "serialise", "publish", "buffer",
+        "backlog", "telemetry", "mqtt_loop", "connect", "ota",
+    };
+    return stage < Stage::Count ? names[(uint8_t)stage] : "unknown";
+}
+
+/** Plain copy of a histogram, for reporting. */
+struct HistogramSnapshot {
+    uint32_t counts[TIMING_BUCKETS];
+    uint32_t total;
+    uint32_t maxUs;
+
+    /** Counts added since `earlier` (maxUs is left as is). */
+    HistogramSnapshot since(const HistogramSnapshot& earlier) const {
+        HistogramSnapshot d = *this;
+        for (int i = 0; i < TIMING_BUCKETS; i++) d.counts[i] -= earlier.counts[i];
+        d.total -= earlier.total;
+        return d;
+    }
+
+    /**
+     * Upper edge of the bucket holding the p-quantile (0..1), capped at
+     * the maximum; 0 when empty.
+     */
+    uint32_t percentile(float p) const {
+        if (total == 0) return 0;
+        uint32_t rank = (uint32_t)(p * (float)total);
+        if (rank >= total) rank = total - 1;
+        uint32_t seen = 0;
+        for (int i = 0; i < TIMING_BUCKETS; i++) {
+            seen += counts[i];
+            if (seen > rank) {
+                uint32_t edge = i < TIMING_BUCKETS - 1 ? TIMING_BUCKET_EDGES_US[i] : maxUs;
+                return edge < maxUs ? edge : maxUs;
+            }
+        }
+        return maxUs;
+    }
+};
+
+class LatencyHistogram {
+private:
+    std::atomic<uint32_t> counts[TIMING_BUCKETS];
+    std::atomic<uint32_t> total;
+    std::atomic<uint32_t> maxUs;
+    std::atomic<uint32_t> windowMaxUs;      // Since the last takeWindowMax()
+
+    // Single writer: plain load/store instead of read-modify-write
+    static void bump(std::atomic<uint32_t>& a) {
+        a.store(a.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+public:
+    LatencyHistogram() : total(0), maxUs(0), windowMaxUs(0) {
+        for (std::atomic<uint32_t>& c : counts) c.store(0, std::memory_order_relaxed);
+    }
+
+    static int bucketFor(uint32_t us) {
+        int i = 0;
+        while (i < TIMING_BUCKETS - 1 && us >= TIMING_BUCKET_EDGES_US[i]) i++;
+        return i;
+    }
+
+    /** Writer task only. */
+    void record(uint32_t us) {
+        bump(counts[bucketFor(us)]);
+        bump(total);
+        if (us > maxUs.load(std::memory_order_relaxed)) {
+            maxUs.store(us, std::memory_order_relaxed);
+        }
+        // The reader may reset this concurrently, so compare-and-swap
+        uint32_t m = windowMaxUs.load(std::memory_order_relaxed);
+        while (us > m && !windowMaxUs.compare_exchange_weak(m, us, std::memory_order_relaxed)) {
+        }
+    }
+
+    void snapshot(HistogramSnapshot& out) const {
+        for (int i = 0; i < TIMING_BUCKETS; i++) {
+            out.counts[i] = counts[i].load(std::memory_order_relaxed);
+        }
+        out.total = total.load(std::memory_order_relaxed);
+        out.maxUs = maxUs.load(std::memory_order_relaxed);
+    }
+
+    /** Largest value since the previous call (reader side). */
+    uint32_t takeWindowMax() { return windowMaxUs.exchange(0, std::memory_order_relaxed); }
+
+    uint32_t count() const { return total.load(std::memory_order_relaxed); }
+    uint32_t maximum() const { return maxUs.load(std::memory_order_relaxed); }
+};
+
+class StageTimers {
+private:
+    HalClock& clock;
+    LatencyHistogram stages[(uint8_t)Stage::Count];
+
+public:
+    explicit StageTimers(HalClock& clk) : clock(clk) {}
+
+    /** Start timestamp (cycles) for stop(). */
+    uint32_t start() { return clock.cycles(); }
+
+    /** Record the time since `started`. Each stage has one writer task. */
+    void stop(Stage stage, uint32_t started) {
+        uint32_t elapsed = clock.cycles() - started;
+        stages[(uint8_t)stage].record(elapsed / clock.cyclesPerMicrosecond());
+    }
+
+    LatencyHistogram& operator[](Stage stage) { return stages[(uint8_t)stage]; }
+};
+
+/**
+ * Wake-up timing of a periodic task. wake() at the top of every cycle,
+ * done() when its work is finished.
+ *
+ *   jitter    |actual interval - period|, in a histogram
+ *   missed    wakes more than half a period behind the grid
+ *   overruns  cycles whose work took longer than the period
+ *
+ * A period change restarts the grid. Writer: the monitored task.
+ */
+class CycleMonitor {
+private:
+    LatencyHistogram jitterHistogram;
+    std::atomic<uint32_t> missedCount;
+    std::atomic<uint32_t> overrunCount;
+    std::atomic<uint32_t> periodUs;
+
+    uint32_t lastWakeUs;
+    uint32_t expectedUs;
+    bool running;
+
+public:
+    CycleMonitor()
+        : missedCount(0), overrunCount(0), periodUs(0), lastWakeUs(0), expectedUs(0),
+          running(false) {}
+
+    void wake(uint32_t nowUs, uint32_t period) {
+        if (!running || period != periodUs.load(std::memory_order_relaxed)) {
+            periodUs.store(period, std::memory_order_relaxed);
+            running = true;
+            lastWakeUs = nowUs;
+            expectedUs = nowUs + period;
+            return;
+        }
+
+        uint32_t interval = nowUs - lastWakeUs;
+        jitterHistogram.record(interval > period ? interval - period : period - interval);
+        if ((int32_t)(nowUs - expectedUs) > (int32_t)(period / 2)) {
+            missedCount.store(missedCount.load(std::memory_order_relaxed) + 1,
+                              std::memory_order_relaxed);
+        }
+        lastWakeUs = nowUs;
+        expectedUs += period;
+    }
+
+    void done(uint32_t nowUs) {
+        uint32_t period = periodUs.load(std::memory_order_relaxed);
+        if (running && nowUs - lastWakeUs > period) {
+            overrunCount.store(overrunCount.load(std::memory_order_relaxed) + 1,
+                               std::memory_order_relaxed);
+        }
+    }
+
+    LatencyHistogram& jitter() { return jitterHistogram; }
+    uint32_t missed() const { return missedCount.load(std::memory_order_relaxed); }
+    uint32_t overruns() const { return overrunCount.load(std::memory_order_relaxed); }
+    uint32_t period() const { return periodUs.load(std::memory_order_relaxed); }
+};
+
+/** One stage over a reporting interval. */
+struct TimingSummary {
+    uint32_t count;
+    uint32_t p50;
+    uint32_t p99;
+    uint32_t maxUs;
+};
+
+/**
+ * Summary of what `h` recorded since `previous`, which is then moved on.
+ * Reader side; one reader per histogram.
+ */
+inline TimingSummary summarizeSince(LatencyHistogram& h, HistogramSnapshot& previous) {
+    HistogramSnapshot now;
+    h.snapshot(now);
+    HistogramSnapshot window = now.since(previous);
+    window.maxUs = h.takeWindowMax();
+    previous = now;
+    return {window.total, window.percentile(0.5f), window.percentile(0.99f), window.maxUs};
+}
+
+/** Full histogram: count, max and bucket counts up to the last non-empty one. */
+inline void writeHistogram(PayloadWriter& out, const char* key, const LatencyHistogram& h) {
+    HistogramSnapshot s;
+    h.snapshot(s);
+    int last = TIMING_BUCKETS - 1;
+    while (last > 0 && s.counts[last] == 0) last--;
+
+    out.beginObject(key)
+       .add("count", s.total)
+       .add("max", s.maxUs)
+       .beginArray("buckets");
+    for (int i = 0; i <= last; i++) out.value(s.counts[i]);
+    out.endArray().endObject();
+}
+
+/**
+ * Everything since boot, for the diagnostics/timing topic: bucket edges,
+ * then one histogram per stage and the sample-interval jitter. Returns
+ * false if it did not fit.
+ */
+inline bool writeTimingReport(PayloadWriter& out, const char* deviceId, uint32_t uptimeS,
+                              StageTimers& timers, CycleMonitor& sampling) {
+    out.reset();
+    out.beginObject()
+       .add("device_id", deviceId)
+       .add("uptime", uptimeS)
+       .beginArray("bucket_edges_us");
+    for (uint32_t edge : TIMING_BUCKET_EDGES_US) out.value(edge);
+    out.endArray();
+
+    out.beginObject("stages");
+    for (uint8_t s = 0; s < (uint8_t)Stage::Count; s++) {
+        writeHistogram(out, stageName((Stage)s), timers[(Stage)s]);
+    }
+    out.endObject();
+
+    writeHistogram(out, "sample_jitter", sampling.jitter());
+    out.add("sample_period_us", sampling.period())
+       .add("missed_deadlines", sampling.missed())
+       .add("sample_overruns", sampling.overruns())
+       .endObject();
+    return out.ok();
+}
+
+#endif // STAGE_TIMING_H
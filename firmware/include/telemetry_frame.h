@@ -0,0 +1,233 @@
+/**
+ * Kaldor IIoT - Binary Raw-Telemetry Frames
+ *
+ * Compact batched encoding for the 100 Hz raw BBW stream. One frame carries
+ * many samples in a single MQTT publish instead of one JSON document each.
+ *
+ * Frame layout (all integers little-endian):
+ *
+ *   offset  size  field
+ *   0       2     magic "KF"
+ *   2       1     version (TELEMETRY_FRAME_VERSION)
+ *   3       1     flags (reserved, 0)
+ *   4       2     sample count
+ *   6       2     frame sequence number (wraps)
+ *   8       4     device id hash (FNV-1a 32 of the device id string)
+ *   12      4     base timestamp (ms, device clock)
+ *   16      ...   samples
+ *
+ * Each sample is:
+ *   varint        timestamp delta (ms) from the previous sample
+ *                 (the first sample from the base timestamp)
+ *   zigzag varint BBW delta in 0.01 mm from the previous sample
+ *                 (the first sample from 0); negative BBW = invalid reading
+ *   u8            quality (0-100)
+ *
+ * Header-only and free of Arduino dependencies so the same code can be
+ * used on the host by ingest tools and tests.
+ */
+
+#ifndef TELEMETRY_FRAME_H
+#define TELEMETRY_FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+
+#define TELEMETRY_FRAME_VERSION 1
+#define TELEMETRY_FRAME_HEADER_SIZE 16
+#define TELEMETRY_FRAME_MAX_SAMPLE_SIZE 11  // 5 + 5 + 1 bytes worst case
+
+struct FrameHeader {
+    uint8_t version;
+    uint8_t flags;
+    uint16_t count;
+    uint16_t sequence;
+    uint32_t deviceHash;
+    uint32_t baseTimestamp;
+};
+
+struct FrameSample {
+    uint32_t timestamp;  // Absolute device time (ms)
+    float bbw;           // mm, negative if the reading was invalid
+    uint8_t quality;
+};
+
+/** FNV-1a 32-bit hash, used to identify the device in frame headers. */
+inline uint32_t deviceIdHash(const char* id) {
+    uint32_t hash = 2166136261u;
+    while (*id) {
+        hash ^= (uint8_t)*id++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+class TelemetryFrameEncoder {
+private:
+    uint8_t* buf;
+    size_t capacity;
+    size_t length;
+    uint16_t sampleCount;
+    uint32_t lastTimestamp;
+    int32_t lastBbw;
+
+    void writeVarint(uint32_t value) {
+        while (value >= 0x80) {
+            buf[length++] = (uint8_t)(value | 0x80);
+            value >>= 7;
+        }
+        buf[length++] = (uint8_t)value;
+    }
+
+    void writeLE(size_t offset, uint32_t value, int bytes) {
+        for (int i = 0; i < bytes; i++) {
+            buf[offset + i] = (uint8_t)(value >> (8 * i));
+        }
+    }
+
+public:
+    TelemetryFrameEncoder(uint8_t* buffer, size_t bufferCapacity)
+        : buf(buffer), capacity(bufferCapacity), length(0), sampleCount(0),
+          lastTimestamp(0), lastBbw(0) {}
+
+    /** Start a new frame, discarding anything encoded so far. */
+    void begin(uint32_t deviceHash, uint32_t baseTimestamp, uint16_t sequence) {
+        buf[0] = 'K';
+        buf[1] = 'F';
+        buf[2] = TELEMETRY_FRAME_VERSION;
+        buf[3] = 0;
+        writeLE(4, 0, 2);
+        writeLE(6, sequence, 2);
+        writeLE(8, deviceHash, 4);
+        writeLE(12, baseTimestamp, 4);
+        length = TELEMETRY_FRAME_HEADER_SIZE;
+        sampleCount = 0;
+        lastTimestamp = baseTimestamp;
+        lastBbw = 0;
+    }
+
+    /** Append a sample. Returns false (frame unchanged) when it is full. */
+    bool add(uint32_t timestamp, float bbw, uint8_t quality) {
+        if (length + TELEMETRY_FRAME_MAX_SAMPLE_SIZE > capacity || sampleCount == 0xFFFF) {
+            return false;
+        }
+
+        int32_t centi = (int32_t)lroundf(bbw * 100.0f);
+        int32_t delta = centi - lastBbw;
+
+        writeVarint(timestamp - lastTimestamp);
+        writeVarint(((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+        buf[length++] = quality;
+
+        lastTimestamp = timestamp;
+        lastBbw = centi;
+        sampleCount++;
+        writeLE(4, sampleCount, 2);
+        return true;
+    }
+
+    /** Mark the frame as sent; begin() must be called before adding again. */
+    void clear() {
+        length = 0;
+        sampleCount = 0;
+    }
+
+    const uint8_t* data() const { return buf; }
+    size_t size() const { return length; }
+    uint16_t count() const { return sampleCount; }
+    bool empty() const { return sampleCount == 0; }
+};
+
+class TelemetryFrameDecoder {
+private:
+    const uint8_t* buf;
+    size_t length;
+    size_t offset;
+    uint16_t remaining;
+    uint32_t lastTimestamp;
+    int32_t lastBbw;
+    bool failed;
+    FrameHeader hdr;
+
+    uint32_t readLE(size_t at, int bytes) const {
+        uint32_t value = 0;
+        for (int i = 0; i < bytes; i++) {
+            value |= (uint32_t)buf[at + i] << (8 * i);
+        }
+        return value;
+    }
+
+    bool readVarint(uint32_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            if (offset >= length) return false;
+            uint8_t byte = buf[offset++];
+            value |= (uint32_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+
+public:
+    TelemetryFrameDecoder()
+        : buf(nullptr), length(0), offset(0), remaining(0), lastTimestamp(0),
+          lastBbw(0), failed(false), hdr() {}
+
+    /** Parse the header. Returns false for a short, foreign or newer frame. */
+    bool begin(const uint8_t* data, size_t len) {
+        buf = data;
+        length = len;
+        failed = true;
+        remaining = 0;
+
+        if (len < TELEMETRY_FRAME_HEADER_SIZE || data[0] != 'K' || data[1] != 'F' ||
+            data[2] != TELEMETRY_FRAME_VERSION) {
+            return false;
+        }
+
+        hdr.version = data[2];
+        hdr.flags = data[3];
+        hdr.count = (uint16_t)readLE(4, 2);
+        hdr.sequence = (uint16_t)readLE(6, 2);
+        hdr.deviceHash = readLE(8, 4);
+        hdr.baseTimestamp = readLE(12, 4);
+
+        offset = TELEMETRY_FRAME_HEADER_SIZE;
+        remaining = hdr.count;
+        lastTimestamp = hdr.baseTimestamp;
+        lastBbw = 0;
+        failed = false;
+        return true;
+    }
+
+    const FrameHeader& header() const { return hdr; }
+
+    /** Decode the next sample. Returns false at the end or on corruption. */
+    bool next(FrameSample& sample) {
+        if (failed || remaining == 0) {
+            return false;
+        }
+
+        uint32_t dt, zigzag;
+        if (!readVarint(dt) || !readVarint(zigzag) || offset >= length) {
+            failed = true;
+            return false;
+        }
+
+        int32_t delta = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+        lastTimestamp += dt;
+        lastBbw = (int32_t)((uint32_t)lastBbw + (uint32_t)delta);
+
+        sample.timestamp = lastTimestamp;
+        sample.bbw = (float)lastBbw / 100.0f;
+        sample.quality = buf[offset++];
+        remaining--;
+        return true;
+    }
+
+    /** True if the frame ended early or contained a malformed sample. */
+    bool error() const { return failed; }
+};
+
+#endif // TELEMETRY_FRAME_H
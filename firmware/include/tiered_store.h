@@ -0,0 +1,153 @@
+/**
+ * Kaldor IIoT - Tiered Sample Store
+ *
+ * Buffers samples in three tiers, newest to oldest:
+ *
+ *   hot   - ring in internal RAM (seconds)
+ *   warm  - ring in PSRAM (minutes to hours); may have zero capacity
+ *   cold  - SampleJournal on flash, survives reboots
+ *
+ * New samples enter the hot ring; its oldest sample is demoted to the warm
+ * ring, whose oldest spills to the journal. Samples are numbered as they
+ * arrive, so each tier holds a consecutive range of sequence numbers and
+ * reads and acknowledgements can find their position in O(1).
+ *
+ * Header-only and free of Arduino dependencies; the owner supplies the
+ * ring storage (e.g. from PSRAM).
+ */
+
+#ifndef TIERED_STORE_H
+#define TIERED_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sample_ring.h"
+#include "sample_journal.h"
+
+class TieredSampleStore {
+private:
+    SampleRing hot;
+    SampleRing warm;
+    SampleJournal& journal;
+    uint32_t nextSeq;
+    uint32_t spilledCount;
+
+    static bool seqAfter(uint32_t a, uint32_t b) { return (int32_t)(a - b) > 0; }
+
+    void spill(const SequencedSample& s) {
+        journal.append(s.data, s.seq);
+        spilledCount++;
+    }
+
+    // Copy ring samples with seq >= fromSeq until `max` are delivered
+    template <typename Fn>
+    static size_t readRing(const SampleRing& ring, uint32_t fromSeq, size_t max, Fn& fn) {
+        if (ring.empty() || max == 0) return 0;
+        size_t offset = 0;
+        if (seqAfter(fromSeq, ring.front().seq)) {
+            offset = fromSeq - ring.front().seq;
+        }
+
+        size_t delivered = 0;
+        const SequencedSample* run;
+        size_t n;
+        while (delivered < max && (n = ring.view(offset, run)) > 0) {
+            if (n > max - delivered) n = max - delivered;
+            for (size_t i = 0; i < n; i++) fn(run[i].seq, run[i].data);
+            delivered += n;
+            offset += n;
+        }
+        return delivered;
+    }
+
+    static void trimRing(SampleRing& ring, uint32_t seq) {
+        if (ring.empty() || seqAfter(ring.front().seq, seq)) return;
+        ring.dropFront(seq - ring.front().seq + 1);
+    }
+
+public:
+    explicit TieredSampleStore(SampleJournal& flash)
+        : journal(flash), nextSeq(0), spilledCount(0) {}
+
+    /** Attach tier storage and continue numbering after the journal. */
+    void begin(SequencedSample* hotStorage, size_t hotCapacity,
+               SequencedSample* warmStorage, size_t warmCapacity) {
+        hot.attach(hotStorage, hotCapacity);
+        warm.attach(warmStorage, warmCapacity);
+        nextSeq = journal.nextSequence();
+    }
+
+    /** O(1) unless a spill triggers a journal block write. */
+    void add(const SensorData& data) {
+        SequencedSample incoming = {nextSeq++, data};
+        SequencedSample demoted, spilled;
+
+        if (hot.push(incoming, demoted)) {
+            if (warm.push(demoted, spilled)) {
+                spill(spilled);
+            }
+        }
+    }
+
+    /**
+     * Deliver up to `max` samples with sequence >= fromSeq, oldest first,
+     * as fn(seq, data): flash, then PSRAM, then RAM.
+     */
+    template <typename Fn>
+    size_t read(uint32_t fromSeq, size_t max, Fn fn) {
+        size_t delivered = 0;
+        if (journal.recordCount() > 0) {
+            delivered += journal.readFrom(fromSeq, max, fn);
+        }
+        delivered += readRing(warm, fromSeq, max - delivered, fn);
+        delivered += readRing(hot, fromSeq, max - delivered, fn);
+        return delivered;
+    }
+
+    /** Drop everything up to and including seq from every tier. */
+    void acknowledge(uint32_t seq) {
+        journal.acknowledge(seq);
+        trimRing(warm, seq);
+        trimRing(hot, seq);
+    }
+
+    /** Write the RAM tiers to flash, e.g. before a planned restart. */
+    bool persist() {
+        SampleRing* tiers[] = {&warm, &hot};    // Oldest first
+        const SequencedSample* run;
+        size_t n;
+        for (SampleRing* ring : tiers) {
+            size_t offset = 0;
+            while ((n = ring->view(offset, run)) > 0) {
+                for (size_t i = 0; i < n; i++) spill(run[i]);
+                offset += n;
+            }
+            ring->clear();
+        }
+        return journal.flush();
+    }
+
+    void clear() {
+        hot.clear();
+        warm.clear();
+        journal.clear();
+    }
+
+    uint32_t nextSequence() const { return nextSeq; }
+
+    uint32_t oldestSequence() const {
+        if (journal.recordCount() > 0) return journal.oldestSequence();
+        if (!warm.empty()) return warm.front().seq;
+        if (!hot.empty()) return hot.front().seq;
+        return nextSeq;
+    }
+
+    size_t size() const { return hot.size() + warm.size() + journal.recordCount(); }
+    size_t hotSize() const { return hot.size(); }
+    size_t warmSize() const { return warm.size(); }
+    size_t coldSize() const { return journal.recordCount(); }
+    size_t ramCapacity() const { return hot.capacity() + warm.capacity(); }
+    uint32_t spilled() const { return spilledCount; }
+};
+
+#endif // TIERED_STORE_H
@@ -0,0 +1,405 @@
+/**
+ * Kaldor IIoT - Sensor Trace Replay
+ *
+ * Feeds a recorded trace (sensor_trace.h) through a real SensorManager on
+ * the host, as fast as it will go. TraceReplay provides the clock and the
+ * three sensor ports; construct the SensorManager on them, begin() it, then
+ * run() calls read() and drainAccelerometer() at the recorded device times
+ * and hands every SensorData to a sink:
+ *
+ *   TraceReplay replay;
+ *   replay.load(bytes, length);
+ *   SensorManager sensors(replay.clock(), replay.ultrasonic(),
+ *                         replay.thermometer(), replay.accel());
+ *   sensors.begin();
+ *   replay.run(sensors, [&](const SensorData& data) { ... });
+ *
+ * The ports hand back what the board saw: each trigger gets the recorded
+ * echo edges, delivered when the replay clock passes them (so a late echo
+ * is still pending at the next read), each DHT read the recorded value and
+ * each FIFO drain the recorded batch. The first State record puts the
+ * SensorManager where the board was when the capture started, down to
+ * where its vibration blocks begin. Completed blocks are analysed on the
+ * spot, where the board's vibration task does it a little later.
+ *
+ * The same trace always gives the same output. A capture started with
+ * the SensorManager replays bit for bit; one started later matches once
+ * the statistics windows and the first vibration block have filled with
+ * traced samples (to rounding in the running sums). Lost chunks
+ * (sequence gaps, see stats()) desynchronise the echoes and temperatures
+ * that follow in their lane. Analog inputs are not traced and read 0.
+ *
+ * Header-only; host only (std::vector).
+ */
+
+#ifndef TRACE_REPLAY_H
+#define TRACE_REPLAY_H
+
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "config.h"
+#include "hal_sim.h"
+#include "sensor_trace.h"
+#include "sensors.h"
+#include "vibration_analyzer.h"
+
+class TraceReplay {
+public:
+    struct Stats {
+        uint32_t chunks;
+        uint32_t lostChunks;        // Sequence gaps
+        uint32_t damaged;           // Bytes skipped looking for a chunk
+        uint32_t reads;
+        uint32_t echoes;            // Echo and NoEcho records
+        uint32_t temperatures;
+        uint32_t accelSamples;
+        uint32_t states;
+        uint64_t durationUs;        // First to last record
+    };
+
+private:
+    enum class EventKind : uint8_t { State, Read, Accel, AccelOverrun, AccelFill };
+
+    struct Event {
+        uint64_t time;
+        EventKind kind;
+        uint32_t index;             // Into states or batches; AccelFill: samples
+    };
+
+    struct Echo {
+        bool echoed;
+        uint32_t riseUs;
+        uint32_t widthUs;
+    };
+
+    struct Batch {
+        size_t first;               // Sample index
+        uint8_t count;
+    };
+
+    std::vector<Event> events;
+    std::vector<Echo> echoes;
+    std::vector<float> temperatures;
+    std::vector<int16_t> samples;   // x, y, z
+    std::vector<Batch> batches;
+    std::vector<TraceState> states;
+    Stats counts;
+    bool replaying;
+    size_t nextEcho;
+    size_t nextTemperature;
+    bool paddedBlock;           // The first vibration block began before the capture
+    SimClock simClock;
+
+    class Ultrasonic : public UltrasonicPort {
+    private:
+        static const uint32_t SELF_TEST_RISE_US = 300;
+        static const uint32_t SELF_TEST_WIDTH_US = 700;
+
+        TraceReplay& replay;
+        EchoCapture* capture;
+        bool pending;
+        bool risen;
+        uint64_t riseAt;
+        uint64_t fallAt;
+
+    public:
+        explicit Ultrasonic(TraceReplay& owner)
+            : replay(owner), capture(nullptr), pending(false), risen(false), riseAt(0),
+              fallAt(0) {}
+
+        bool begin(EchoCapture& echo) override {
+            capture = &echo;
+            return true;
+        }
+
+        void trigger() override {
+            uint64_t now = replay.simClock.elapsedUs();
+            if (!replay.replaying && capture) {
+                // begin()'s self-test: answer at once (a 120 mm echo) so the
+                // clock does not run past the start of the trace
+                capture->onEdge(true, (uint32_t)now + SELF_TEST_RISE_US);
+                capture->onEdge(false, (uint32_t)now + SELF_TEST_RISE_US + SELF_TEST_WIDTH_US);
+                return;
+            }
+            arm(now);
+        }
+
+        /** The next recorded echo belongs to a trigger at this time. */
+        void arm(uint64_t triggerAt) {
+            pending = false;
+            if (!replay.replaying || replay.nextEcho >= replay.echoes.size()) return;
+            const Echo& echo = replay.echoes[replay.nextEcho++];
+            if (!echo.echoed) return;       // The capture times out
+            riseAt = triggerAt + echo.riseUs;
+            fallAt = riseAt + echo.widthUs;
+            risen = false;
+            pending = true;
+        }
+
+        /** Edges due by now, as the GPIO interrupt would have. */
+        void deliver(uint64_t now) {
+            if (!pending || !capture) return;
+            if (!risen && riseAt <= now) {
+                capture->onEdge(true, (uint32_t)riseAt);
+                risen = true;
+            }
+            if (risen && fallAt <= now) {
+                capture->onEdge(false, (uint32_t)fallAt);
+                pending = false;
+            }
+        }
+    };
+
+    class Thermometer : public TemperaturePort {
+    private:
+        TraceReplay& replay;
+
+    public:
+        explicit Thermometer(TraceReplay& owner) : replay(owner) {}
+        bool begin() override { return true; }
+
+        /** Before run(): the air temperature the capture started with. */
+        float readCelsius() override {
+            if (!replay.replaying) {
+                return replay.states.empty() ? 20.0f : replay.states[0].airTemperature;
+            }
+            if (replay.nextTemperature >= replay.temperatures.size()) return NAN;
+            return replay.temperatures[replay.nextTemperature++];
+        }
+    };
+
+    class Accel : public AccelPort {
+    private:
+        const int16_t* staged;
+        uint8_t stagedCount;
+        uint8_t readCount;
+        bool reported;
+        bool overflowed;
+
+    public:
+        Accel()
+            : staged(nullptr), stagedCount(0), readCount(0), reported(true), overflowed(false) {}
+
+        bool begin(uint32_t, uint8_t) override { return true; }
+        bool waitForWatermark(uint32_t) override { return false; }
+        bool selfTest() override { return true; }
+
+        /** The batch once, then an empty FIFO. */
+        uint8_t fifoEntries() override {
+            if (reported) return 0;
+            reported = true;
+            return (uint8_t)(stagedCount - readCount);
+        }
+
+        bool overrun() override {
+            bool was = overflowed;
+            overflowed = false;
+            return was;
+        }
+
+        bool readSample(int16_t* xyz) override {
+            if (readCount >= stagedCount) return false;
+            memcpy(xyz, staged + 3 * readCount++, 3 * sizeof(int16_t));
+            return true;
+        }
+
+        void stage(const int16_t* xyz, uint8_t count) {
+            staged = xyz;
+            stagedCount = count;
+            readCount = 0;
+            reported = false;
+        }
+
+        void stageOverrun() {
+            overflowed = true;
+            stagedCount = readCount = 0;
+            reported = false;
+        }
+    };
+
+    Ultrasonic echoPort;
+    Thermometer thermometerPort;
+    Accel accelPort;
+    VibrationAnalyzer<VIBRATION_BLOCK_SIZE> analyzer;
+
+    static const float* bandEdges() {
+        static const float edges[] = VIBRATION_BAND_EDGES_HZ;
+        return edges;
+    }
+
+    static size_t bandEdgeCount() {
+        const float edges[] = VIBRATION_BAND_EDGES_HZ;
+        return sizeof(edges) / sizeof(edges[0]);
+    }
+
+    void add(const TraceItem& item) {
+        switch (item.type) {
+        case TraceRecord::Read:
+            events.push_back({item.time, EventKind::Read, 0});
+            counts.reads++;
+            break;
+        case TraceRecord::Echo:
+            echoes.push_back({true, item.riseUs, item.widthUs});
+            counts.echoes++;
+            break;
+        case TraceRecord::NoEcho:
+            echoes.push_back({false, 0, 0});
+            counts.echoes++;
+            break;
+        case TraceRecord::Temperature:
+        case TraceRecord::TemperatureFailed:
+            temperatures.push_back(item.celsius);
+            counts.temperatures++;
+            break;
+        case TraceRecord::Accel:
+            events.push_back({item.time, EventKind::Accel, (uint32_t)batches.size()});
+            batches.push_back({samples.size() / 3, item.count});
+            samples.insert(samples.end(), &item.xyz[0][0], &item.xyz[0][0] + 3 * item.count);
+            counts.accelSamples += item.count;
+            break;
+        case TraceRecord::AccelOverrun:
+            events.push_back({item.time, EventKind::AccelOverrun, 0});
+            break;
+        case TraceRecord::State:
+            events.push_back({item.time, EventKind::State, (uint32_t)states.size()});
+            states.push_back(item.state);
+            counts.states++;
+            break;
+        case TraceRecord::AccelFill:
+            events.push_back({item.time, EventKind::AccelFill, item.blockFill});
+            break;
+        }
+    }
+
+    void analyseVibration(SensorManager& sensors) {
+        uint32_t timestamp;
+        const int16_t* block = sensors.vibrationBlock(timestamp);
+        if (!block) return;
+        if (paddedBlock) {
+            // Partly from before the capture: the board's analysis of it
+            // is not in the trace, keep the recorded level
+            paddedBlock = false;
+            sensors.releaseVibrationBlock();
+            return;
+        }
+        VibrationFeatures features;
+        analyzer.analyze(block, SensorManager::ACCEL_G_PER_COUNT, features);
+        sensors.releaseVibrationBlock();
+        sensors.setVibrationLevel(features.rms);
+    }
+
+public:
+    TraceReplay()
+        : counts(), replaying(false), nextEcho(0), nextTemperature(0), paddedBlock(false), echoPort(*this),
+          thermometerPort(*this),
+          analyzer((float)VIBRATION_SAMPLE_RATE_HZ, bandEdges(), bandEdgeCount()) {}
+
+    HalClock& clock() { return simClock; }
+    UltrasonicPort& ultrasonic() { return echoPort; }
+    TemperaturePort& thermometer() { return thermometerPort; }
+    AccelPort& accel() { return accelPort; }
+
+    /**
+     * Parse a trace: chunks back to back, as written to flash or received
+     * on trace/data. Damaged bytes are skipped up to the next chunk. False
+     * if nothing replayable was found.
+     */
+    bool load(const uint8_t* data, size_t length) {
+        events.clear();
+        echoes.clear();
+        temperatures.clear();
+        samples.clear();
+        batches.clear();
+        states.clear();
+        counts = Stats();
+
+        uint16_t expected[SENSOR_TRACE_LANES] = {0, 0};
+        bool seen[SENSOR_TRACE_LANES] = {false, false};
+        TraceReader reader;
+        TraceItem item;
+        size_t at = 0;
+        while (at < length) {
+            if (!reader.begin(data + at, length - at)) {
+                at++;
+                counts.damaged++;
+                continue;
+            }
+            const TraceHeader& header = reader.header();
+            if ((header.flags & TRACE_FIRST) || !seen[header.lane]) {
+                expected[header.lane] = header.sequence;
+                seen[header.lane] = true;
+            }
+            counts.lostChunks += (uint16_t)(header.sequence - expected[header.lane]);
+            expected[header.lane] = (uint16_t)(header.sequence + 1);
+            counts.chunks++;
+            while (reader.next(item)) add(item);
+            at += reader.size();
+        }
+
+        // Lanes interleave chunk by chunk; each lane is in order already
+        std::stable_sort(events.begin(), events.end(),
+                         [](const Event& a, const Event& b) { return a.time < b.time; });
+        if (!events.empty()) counts.durationUs = events.back().time - events.front().time;
+        return counts.reads > 0;
+    }
+
+    /**
+     * Replay every recorded event into sensors (already begin()-ed on these
+     * ports); sink(const SensorData&) gets the result of each read().
+     * Returns the number of reads.
+     */
+    template <typename Sink>
+    size_t run(SensorManager& sensors, Sink&& sink) {
+        replaying = true;
+        nextEcho = 0;
+        nextTemperature = 0;
+        size_t reads = 0;
+        bool resumed = false;
+        for (const Event& event : events) {
+            uint64_t now = simClock.elapsedUs();
+            if (event.time > now) {
+                simClock.advance(event.time - now);
+                now = event.time;
+            }
+            switch (event.kind) {
+            case EventKind::State:
+                if (sensors.restoreTraceState(states[event.index], !resumed)) {
+                    // The board had a measurement in flight; its echo is next
+                    uint32_t sinceTrigger = (uint32_t)now - states[event.index].echoTriggerUs;
+                    echoPort.arm(now - sinceTrigger);
+                }
+                resumed = true;
+                break;
+            case EventKind::Read:
+                echoPort.deliver(now);
+                sink(sensors.read());
+                reads++;
+                break;
+            case EventKind::Accel: {
+                const Batch& batch = batches[event.index];
+                accelPort.stage(&samples[3 * batch.first], batch.count);
+                sensors.drainAccelerometer();
+                analyseVibration(sensors);
+                break;
+            }
+            case EventKind::AccelOverrun:
+                accelPort.stageOverrun();
+                sensors.drainAccelerometer();
+                break;
+            case EventKind::AccelFill:
+                sensors.resumeVibrationBlock(event.index);
+                paddedBlock = event.index > 0;
+                break;
+            }
+        }
+        replaying = false;
+        return reads;
+    }
+
+    const Stats& stats() const { return counts; }
+};
+
+#endif // TRACE_REPLAY_H
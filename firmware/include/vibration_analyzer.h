@@ -0,0 +1,152 @@
+/**
+ * Kaldor IIoT - Vibration Feature Extraction
+ *
+ * Turns a block of N three-axis accelerometer samples into a few numbers
+ * worth sending upstream instead of the waveform:
+ *
+ *   per axis   RMS, peak, crest factor (peak / RMS), kurtosis
+ *   combined   vector RMS and energy per frequency band
+ *
+ * Each axis has its mean (gravity, offset) removed first, so every figure
+ * describes the vibration only. Kurtosis is m4 / m2^2 (3 for Gaussian
+ * noise, 1.5 for a sine; impacts from bearing or beam faults push it up).
+ *
+ * Band energies come from a Hann-windowed real FFT of each axis, summed over
+ * the three axes and scaled so that the bands add up to the mean-square
+ * acceleration (g^2) in that frequency range.
+ *
+ * Header-only and free of Arduino dependencies.
+ */
+
+#ifndef VIBRATION_ANALYZER_H
+#define VIBRATION_ANALYZER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+#include "real_fft.h"
+
+#define VIBRATION_AXES 3
+#define VIBRATION_MAX_BANDS 8
+
+struct AxisFeatures {
+    float rms;          // g
+    float peak;         // g, largest deviation from the mean
+    float crest;        // peak / rms
+    float kurtosis;
+};
+
+struct VibrationFeatures {
+    AxisFeatures axis[VIBRATION_AXES];
+    float rms;                               // Vector RMS over all axes (g)
+    float bandEnergy[VIBRATION_MAX_BANDS];   // g^2 per band
+    uint8_t bandCount;
+    uint32_t timestamp;                      // End of the block (ms)
+};
+
+template <size_t N>
+class VibrationAnalyzer {
+private:
+    RealFft<N> fft;
+    float window[N];
+    float work[N];
+    float windowPower;          // Mean of window^2
+
+    uint16_t bandFirst[VIBRATION_MAX_BANDS];
+    uint16_t bandLast[VIBRATION_MAX_BANDS];    // Inclusive
+    uint8_t bands;
+
+    void axisStats(const int16_t* xyz, size_t axis, float scale, AxisFeatures& out) {
+        // Two passes: mean, then central moments (float is precise enough
+        // for 13-bit samples over a few thousand points)
+        float sum = 0;
+        for (size_t i = 0; i < N; i++) sum += (float)xyz[i * VIBRATION_AXES + axis];
+        float mean = sum / (float)N;
+
+        float m2 = 0, m4 = 0, peak = 0;
+        for (size_t i = 0; i < N; i++) {
+            float d = ((float)xyz[i * VIBRATION_AXES + axis] - mean) * scale;
+            float d2 = d * d;
+            m2 += d2;
+            m4 += d2 * d2;
+            float a = fabsf(d);
+            if (a > peak) peak = a;
+            work[i] = d * window[i];
+        }
+        m2 /= (float)N;
+        m4 /= (float)N;
+
+        out.rms = sqrtf(m2);
+        out.peak = peak;
+        out.crest = out.rms > 0 ? peak / out.rms : 0;
+        out.kurtosis = m2 > 0 ? m4 / (m2 * m2) : 0;
+    }
+
+public:
+    /**
+     * @param sampleRateHz Accelerometer output data rate
+     * @param edgesHz      Band edges, ascending; edgeCount - 1 bands
+     *                     (at most VIBRATION_MAX_BANDS)
+     */
+    VibrationAnalyzer(float sampleRateHz, const float* edgesHz, size_t edgeCount) : bands(0) {
+        const float twoPi = 6.28318530718f;
+        float power = 0;
+        for (size_t i = 0; i < N; i++) {
+            window[i] = 0.5f - 0.5f * cosf(twoPi * (float)i / (float)N);
+            power += window[i] * window[i];
+        }
+        windowPower = power / (float)N;
+
+        // Bin k covers frequency k * fs / N; a bin belongs to the band
+        // containing its centre
+        float binHz = sampleRateHz / (float)N;
+        for (size_t b = 0; b + 1 < edgeCount && bands < VIBRATION_MAX_BANDS; b++) {
+            long first = (long)ceilf(edgesHz[b] / binHz);
+            long last = (long)ceilf(edgesHz[b + 1] / binHz) - 1;
+            if (first < 1) first = 1;                       // Skip DC
+            if (last > (long)(N / 2)) last = (long)(N / 2);
+            if (b + 2 == edgeCount && edgesHz[b + 1] * 2.0f >= sampleRateHz) {
+                last = (long)(N / 2);                       // Top band includes Nyquist
+            }
+            bandFirst[bands] = (uint16_t)first;
+            bandLast[bands] = (uint16_t)(last < first ? first - 1 : last);
+            bands++;
+        }
+    }
+
+    static size_t blockSize() { return N; }
+    uint8_t bandCount() const { return bands; }
+    bool isAccelerated() const { return fft.isAccelerated(); }
+
+    /**
+     * Analyse one block of N interleaved x, y, z samples (raw counts).
+     * @param scale g per count
+     */
+    void analyze(const int16_t* xyz, float scale, VibrationFeatures& out) {
+        out.bandCount = bands;
+        for (uint8_t b = 0; b < VIBRATION_MAX_BANDS; b++) out.bandEnergy[b] = 0;
+
+        // One-sided spectrum to mean square: 2|X|^2 / (N^2 * window power),
+        // DC and Nyquist counted once
+        float norm = 1.0f / ((float)N * (float)N * windowPower);
+
+        float meanSquare = 0;
+        for (size_t axis = 0; axis < VIBRATION_AXES; axis++) {
+            axisStats(xyz, axis, scale, out.axis[axis]);
+            meanSquare += out.axis[axis].rms * out.axis[axis].rms;
+
+            fft.forward(work);
+            for (uint8_t b = 0; b < bands; b++) {
+                float energy = 0;
+                for (size_t k = bandFirst[b]; k <= bandLast[b]; k++) {
+                    float p = RealFft<N>::power(work, k);
+                    energy += (k == N / 2) ? p : 2.0f * p;
+                }
+                out.bandEnergy[b] += energy * norm;
+            }
+        }
+        out.rms = sqrtf(meanSquare);
+    }
+};
+
+#endif // VIBRATION_ANALYZER_H
@@ -3,102 +3,107 @@
  */
 
 #include "data_buffer.h"
-#include <SPIFFS.h>
-#include <ArduinoJson.h>
+#include "hal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef ARDUINO
+#include <Arduino.h>
+#include "esp_heap_caps.h"
+#endif
+
+DataBuffer::DataBuffer()
+    : fileStore(JOURNAL_PATH_PREFIX),
+      journal(fileStore, JOURNAL_SEGMENTS, JOURNAL_SEGMENT_RECORDS, JOURNAL_STAGING_RECORDS),
+      store(journal), hotStorage(nullptr), warmStorage(nullptr) {}
+
+void DataBuffer::begin(size_t hotSize, size_t warmSize) {
+    // Hot tier in internal RAM
+    hotStorage = (SequencedSample*)malloc(hotSize * sizeof(SequencedSample));
+    if (!hotStorage) {
+        halLog("WARNING: No RAM for hot buffer, spilling straight to flash\n");
+        hotSize = 0;
+    }
 
-DataBuffer::DataBuffer() : maxSize(100), bufferFile("/buffer.dat") {}
+    // Warm tier in PSRAM, if fitted. With PSRAM, the libraries' larger
+    // allocations (TLS buffers among them) land there too: leave them
+    // PSRAM_RESERVE_BYTES, shrinking the tier if the module is smaller.
+    warmStorage = nullptr;
+#ifdef BOARD_HAS_PSRAM
+    if (warmSize > 0 && psramFound()) {
+        size_t room = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
+        size_t fits = room > PSRAM_RESERVE_BYTES
+            ? (room - PSRAM_RESERVE_BYTES) / sizeof(SequencedSample) : 0;
+        if (warmSize > fits) {
+            halLog("PSRAM tier shrunk to %u samples\n", (unsigned)fits);
+            warmSize = fits;
+        }
+        if (warmSize > 0) {
+            warmStorage = (SequencedSample*)ps_malloc(warmSize * sizeof(SequencedSample));
+        }
+    }
+#endif
+    if (!warmStorage) {
+        warmSize = 0;
+    }
 
-void DataBuffer::begin(size_t size) {
-    maxSize = size;
-    buffer.reserve(size);
+#ifdef ARDUINO
+    // Drop the old whole-file dump; its layout depended on the compiler
+    remove("/spiffs/buffer.dat");
+#endif
 
-    // Try to load existing buffered data
+    journal.begin();
+    store.begin(hotStorage, hotSize, warmStorage, warmSize);
     loadFromFile();
+
+    halLog("Buffer tiers: %u RAM, %u PSRAM, %u flash\n",
+                  (unsigned)hotSize, (unsigned)warmSize, (unsigned)journal.capacity());
 }
 
 void DataBuffer::add(const SensorData& data) {
-    if (buffer.size() >= maxSize) {
-        // Buffer full - remove oldest entry
-        buffer.erase(buffer.begin());
-    }
-
-    buffer.push_back(data);
-
-    // Persist to flash every 10 entries
-    if (buffer.size() % 10 == 0) {
-        saveToFile();
-    }
+    // O(1); the oldest sample cascades RAM -> PSRAM -> flash journal
+    store.add(data);
 }
 
 bool DataBuffer::isFull() {
-    return buffer.size() >= maxSize;
+    // RAM tiers full: further samples go to flash
+    return store.hotSize() + store.warmSize() >= store.ramCapacity();
 }
 
 size_t DataBuffer::size() {
-    return buffer.size();
-}
-
-SensorData DataBuffer::get(int index) {
-    if (index >= 0 && index < buffer.size()) {
-        return buffer[index];
-    }
-    return SensorData{};
+    return store.size();
 }
 
 void DataBuffer::clear() {
-    buffer.clear();
-    SPIFFS.remove(bufferFile.c_str());
+    store.clear();
 }
 
-bool DataBuffer::saveToFile() {
-    File file = SPIFFS.open(bufferFile.c_str(), "w");
-    if (!file) {
-        return false;
-    }
-
-    // Write buffer size
-    file.write((uint8_t*)&maxSize, sizeof(maxSize));
-
-    size_t count = buffer.size();
-    file.write((uint8_t*)&count, sizeof(count));
+size_t DataBuffer::readBacklog(uint32_t fromSeq, SensorData* out, uint32_t* seqs, size_t max) {
+    size_t n = 0;
+    store.read(fromSeq, max, [&](uint32_t seq, const SensorData& data) {
+        seqs[n] = seq;
+        out[n] = data;
+        n++;
+    });
+    return n;
+}
 
-    // Write all entries
-    for (const auto& data : buffer) {
-        file.write((uint8_t*)&data, sizeof(SensorData));
-    }
+void DataBuffer::acknowledge(uint32_t seq) {
+    store.acknowledge(seq);
+}
 
-    file.close();
-    return true;
+bool DataBuffer::saveToFile() {
+    // RAM tiers do not survive a reboot; move them to flash first
+    return store.persist();
 }
 
 bool DataBuffer::loadFromFile() {
-    if (!SPIFFS.exists(bufferFile.c_str())) {
-        return false;
-    }
-
-    File file = SPIFFS.open(bufferFile.c_str(), "r");
-    if (!file) {
+    // Journaled records stay on flash and are read back by sequence number
+    size_t stored = journal.recordCount();
+    if (stored == 0) {
         return false;
     }
 
-    // Read buffer size
-    size_t savedMaxSize;
-    file.read((uint8_t*)&savedMaxSize, sizeof(savedMaxSize));
-
-    // Read count
-    size_t count;
-    file.read((uint8_t*)&count, sizeof(count));
-
-    // Read all entries
-    buffer.clear();
-    for (size_t i = 0; i < count; i++) {
-        SensorData data;
-        file.read((uint8_t*)&data, sizeof(SensorData));
-        buffer.push_back(data);
-    }
-
-    file.close();
-
-    Serial.printf("Loaded %d buffered readings from flash\n", buffer.size());
+    halLog("Found %u buffered readings on flash (seq %u..%u)\n",
+                  (unsigned)stored, journal.oldestSequence(), journal.nextSequence() - 1);
     return true;
 }
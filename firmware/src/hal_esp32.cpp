@@ -0,0 +1,581 @@
+/**
+ * Kaldor IIoT - ESP32 HAL Implementation
+ */
+
+#include "hal_esp32.h"
+#include "config.h"
+#include "echo_capture.h"
+#include <Wire.h>
+#include "driver/i2c.h"
+#include "lwip/netdb.h"
+#include "lwip/sockets.h"
+#include "mbedtls/version.h"
+#include <errno.h>
+#include <stdarg.h>
+
+void halLog(const char* format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    Serial.print(line);
+}
+
+// ---- HC-SR04 ----
+
+// Capture instance serviced by the echo pin interrupt
+static EchoCapture* activeEcho = nullptr;
+static uint8_t activeEchoPin = 0;
+
+static void IRAM_ATTR onEchoEdge() {
+    if (activeEcho) {
+        activeEcho->onEdge(digitalRead(activeEchoPin) == HIGH, micros());
+    }
+}
+
+bool Hcsr04Ultrasonic::begin(EchoCapture& capture) {
+    pinMode(trigPin, OUTPUT);
+    pinMode(echoPin, INPUT);
+    digitalWrite(trigPin, LOW);
+    activeEcho = &capture;
+    activeEchoPin = echoPin;
+    attachInterrupt(digitalPinToInterrupt(echoPin), onEchoEdge, CHANGE);
+    return true;
+}
+
+void Hcsr04Ultrasonic::trigger() {
+    // 10 µs trigger pulse; edges are timestamped by onEchoEdge()
+    digitalWrite(trigPin, LOW);
+    delayMicroseconds(2);
+    digitalWrite(trigPin, HIGH);
+    delayMicroseconds(10);
+    digitalWrite(trigPin, LOW);
+}
+
+// ---- DHT22 ----
+
+bool DhtTemperature::begin() {
+    dht.begin();
+    return true;
+}
+
+// ---- ADXL345 ----
+
+// Task woken by the accelerometer's FIFO watermark interrupt
+static TaskHandle_t accelTask = nullptr;
+
+static void IRAM_ATTR onAccelWatermark() {
+    BaseType_t woken = pdFALSE;
+    if (accelTask) {
+        vTaskNotifyGiveFromISR(accelTask, &woken);
+    }
+    if (woken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+// ADXL345 INT_ENABLE / INT_SOURCE bits
+static const uint8_t ACCEL_INT_WATERMARK = 0x02;
+static const uint8_t ACCEL_INT_OVERRUN = 0x01;
+
+// BW_RATE code for an output data rate (3200 Hz = 0x0F, halving per step)
+static uint8_t accelRateCode(uint32_t hz) {
+    uint8_t code = 0x0F;
+    for (uint32_t rate = 3200; rate > hz && code > 0x06; rate /= 2) {
+        code--;
+    }
+    return code;
+}
+
+bool Adxl345Fifo::begin(uint32_t rateHz, uint8_t watermark) {
+    if (!accel.begin()) {
+        return false;
+    }
+    accel.setRange(ADXL345_RANGE_16_G);
+    fetchedCount = fetchedNext = 0;
+
+    // Stream mode: the FIFO keeps the newest 32 samples and raises INT1
+    // once `watermark` are queued (and on overrun)
+    accel.writeRegister(ADXL345_REG_BW_RATE, accelRateCode(rateHz));
+    accel.writeRegister(ADXL345_REG_FIFO_CTL, 0x80 | (watermark & 0x1F));
+    accel.writeRegister(ADXL345_REG_INT_MAP, 0x00);
+    pinMode(intPin, INPUT);
+    attachInterrupt(digitalPinToInterrupt(intPin), onAccelWatermark, RISING);
+    accel.writeRegister(ADXL345_REG_INT_ENABLE, ACCEL_INT_WATERMARK | ACCEL_INT_OVERRUN);
+    return true;
+}
+
+bool Adxl345Fifo::waitForWatermark(uint32_t timeoutMs) {
+    accelTask = xTaskGetCurrentTaskHandle();
+    return ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeoutMs)) > 0;
+}
+
+uint8_t Adxl345Fifo::fifoEntries() {
+    if (fetchedNext < fetchedCount) {
+        return fetchedCount - fetchedNext;  // Last fetch not handed out yet
+    }
+    fetchedCount = fetchedNext = 0;
+    uint8_t entries = accel.readRegister(ADXL345_REG_FIFO_STATUS) & 0x3F;
+    if (entries > FIFO_DEPTH) {
+        entries = FIFO_DEPTH;
+    }
+    if (entries > 0 && readEntries(entries)) {
+        fetchedCount = entries;
+    }
+    return entries;                         // On failure readSample() retries singly
+}
+
+// Command link for a full FIFO: five commands per entry and the stop
+static uint8_t accelLink[I2C_LINK_RECOMMENDED_SIZE(32)];
+
+bool Adxl345Fifo::readEntries(uint8_t count) {
+    // Wire drives I2C_NUM_0 through the ESP-IDF driver; one command holds
+    // the bus for every entry. Each entry's address phase takes far longer
+    // than the 5 us the FIFO needs to pop between reads.
+    static const uint8_t select[2] = {ADXL345_DEFAULT_ADDRESS << 1 | I2C_MASTER_WRITE,
+                                      ADXL345_REG_DATAX0};
+    uint8_t raw[FIFO_DEPTH][6];
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(accelLink, sizeof(accelLink));
+    if (!cmd) {
+        return false;
+    }
+    bool queued = true;
+    for (uint8_t i = 0; i < count && queued; i++) {
+        queued = i2c_master_start(cmd) == ESP_OK &&
+                 i2c_master_write(cmd, select, sizeof(select), true) == ESP_OK &&
+                 i2c_master_start(cmd) == ESP_OK &&
+                 i2c_master_write_byte(cmd, ADXL345_DEFAULT_ADDRESS << 1 | I2C_MASTER_READ,
+                                       true) == ESP_OK &&
+                 i2c_master_read(cmd, raw[i], 6, I2C_MASTER_LAST_NACK) == ESP_OK;
+    }
+    queued = queued && i2c_master_stop(cmd) == ESP_OK &&
+             i2c_master_cmd_begin(I2C_NUM_0, cmd, pdMS_TO_TICKS(50)) == ESP_OK;
+    i2c_cmd_link_delete_static(cmd);
+    if (!queued) {
+        return false;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        for (int axis = 0; axis < 3; axis++) {
+            fetched[i][axis] = (int16_t)((raw[i][2 * axis + 1] << 8) | raw[i][2 * axis]);
+        }
+    }
+    return true;
+}
+
+bool Adxl345Fifo::overrun() {
+    return accel.readRegister(ADXL345_REG_INT_SOURCE) & ACCEL_INT_OVERRUN;
+}
+
+bool Adxl345Fifo::readSample(int16_t* xyz) {
+    if (fetchedNext < fetchedCount) {
+        memcpy(xyz, fetched[fetchedNext++], sizeof(fetched[0]));
+        return true;
+    }
+
+    // Nothing fetched: one FIFO entry, DATAX0..DATAZ1 in a 6-byte read
+    Wire.beginTransmission(ADXL345_DEFAULT_ADDRESS);
+    Wire.write(ADXL345_REG_DATAX0);
+    if (Wire.endTransmission(false) != 0 ||
+        Wire.requestFrom((uint8_t)ADXL345_DEFAULT_ADDRESS, (uint8_t)6) != 6) {
+        return false;
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        uint8_t lo = Wire.read();
+        uint8_t hi = Wire.read();
+        xyz[axis] = (int16_t)((hi << 8) | lo);
+    }
+    return true;
+}
+
+bool Adxl345Fifo::selfTest() {
+    sensors_event_t event;
+    return accel.getEvent(&event);
+}
+
+// ---- Analog inputs ----
+
+bool EspAnalogDma::begin(uint32_t rateHz) {
+    adc_digi_pattern_config_t pattern[2] = {};
+    uint16_t mask = 0;
+    for (int i = 0; i < 2; i++) {
+        int8_t channel = digitalPinToAnalogChannel(pins[i]);
+        if (channel < 0 || channel >= 8) {
+            return false;                   // Not an ADC1 pin
+        }
+        channels[i] = (uint8_t)channel;
+        mask |= 1 << channel;
+        pattern[i].atten = ADC_ATTEN_DB_11;
+        pattern[i].channel = channel;
+        pattern[i].unit = 0;                // ADC1
+        pattern[i].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+    }
+
+    // Room for four frames before conversions are lost
+    adc_digi_init_config_t init = {};
+    init.max_store_buf_size = sizeof(buffer) * 4;
+    init.conv_num_each_intr = sizeof(buffer);
+    init.adc1_chan_mask = mask;
+    init.adc2_chan_mask = 0;
+    if (adc_digi_initialize(&init) != ESP_OK) {
+        return false;
+    }
+
+    adc_digi_configuration_t config = {};
+    config.conv_limit_en = ADC_CONV_LIMIT_EN;
+    config.conv_limit_num = 250;
+    config.pattern_num = 2;
+    config.adc_pattern = pattern;
+    config.sample_freq_hz = rateHz * 2;     // Conversions in total
+    config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+    if (adc_digi_controller_configure(&config) != ESP_OK) {
+        adc_digi_deinitialize();
+        return false;
+    }
+    return adc_digi_start() == ESP_OK;
+}
+
+size_t EspAnalogDma::read(AnalogConversion* out, size_t max, uint32_t timeoutMs) {
+    uint32_t bytes = 0;
+    uint32_t want = max * SOC_ADC_DIGI_RESULT_BYTES;
+    if (want > sizeof(buffer)) {
+        want = sizeof(buffer);
+    }
+    esp_err_t err = adc_digi_read_bytes(buffer, want, &bytes, timeoutMs);
+    if (err == ESP_ERR_INVALID_STATE) {
+        overflowed = true;                  // Pool was full; the data is still valid
+    } else if (err != ESP_OK) {
+        return 0;
+    }
+
+    size_t n = 0;
+    for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= bytes; i += SOC_ADC_DIGI_RESULT_BYTES) {
+        const adc_digi_output_data_t* d = (const adc_digi_output_data_t*)&buffer[i];
+        for (uint8_t c = 0; c < 2; c++) {
+            if (d->type1.channel == channels[c]) {
+                out[n].channel = c;
+                out[n].value = d->type1.data;
+                n++;
+                break;
+            }
+        }
+    }
+    return n;
+}
+
+bool EspAnalogDma::overrun() {
+    bool was = overflowed;
+    overflowed = false;
+    return was;
+}
+
+// ---- WiFi ----
+
+void EspWifiLink::begin(const char* hostname) {
+    WiFi.persistent(false);             // No flash write on every join
+    WiFi.mode(WIFI_STA);
+    WiFi.setHostname(hostname);
+    WiFi.setAutoReconnect(false);
+}
+
+void EspWifiLink::join() {
+    WiFi.disconnect();
+    if (known) {
+        WiFi.begin(ssid, password, channel, bssid);     // Same AP, no scan
+    } else {
+        WiFi.begin(ssid, password);
+    }
+}
+
+bool EspWifiLink::up() {
+    if (WiFi.status() != WL_CONNECTED) {
+        return false;
+    }
+    if (!known) {
+        const uint8_t* ap = WiFi.BSSID();
+        if (ap) {
+            memcpy(bssid, ap, sizeof(bssid));
+            channel = WiFi.channel();
+            known = true;
+        }
+    }
+    return true;
+}
+
+void EspWifiLink::leave() {
+    WiFi.disconnect();
+    known = false;                      // The AP may have moved; scan next time
+}
+
+// ---- MQTT connection ----
+
+// mbedTLS randomness from the hardware RNG (true random while the radio is on)
+static int espRandom(void*, unsigned char* out, size_t length) {
+    esp_fill_random(out, length);
+    return 0;
+}
+
+// A resumed session carries over the master secret of the one offered; a
+// full handshake derives a new one. The field went private in mbedTLS 3.
+#if MBEDTLS_VERSION_MAJOR >= 3
+#define SESSION_MASTER(s) ((s).MBEDTLS_PRIVATE(master))
+#else
+#define SESSION_MASTER(s) ((s).master)
+#endif
+
+EspNetStream::EspNetStream()
+    : haveSession(false), caCert(nullptr), host(nullptr), state(State::Closed),
+      handshakes(0), resumed(0), stagedLength(0), stagedSent(0) {
+    mbedtls_net_init(&net);
+    mbedtls_ssl_init(&ssl);
+    mbedtls_ssl_config_init(&sslConfig);
+    mbedtls_x509_crt_init(&caChain);
+    mbedtls_ssl_session_init(&session);
+}
+
+bool EspNetStream::connect(const char* brokerHost, uint16_t brokerPort) {
+    stop();
+    host = brokerHost;
+
+    // Name lookup (blocks unless cached), then a TCP connect that doesn't wait
+    struct addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    char service[6];
+    snprintf(service, sizeof(service), "%u", brokerPort);
+    struct addrinfo* address = nullptr;
+    if (getaddrinfo(host, service, &hints, &address) != 0 || !address) {
+        return false;
+    }
+    net.fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    bool started = net.fd >= 0 && mbedtls_net_set_nonblock(&net) == 0 &&
+                   (::connect(net.fd, address->ai_addr, address->ai_addrlen) == 0 ||
+                    errno == EINPROGRESS);
+    freeaddrinfo(address);
+    if (!started) {
+        stop();
+        return false;
+    }
+    state = State::Connecting;
+    return connecting() || state == State::Open;
+}
+
+bool EspNetStream::connecting() {
+    if (state == State::Connecting) {
+        // Writable once the TCP connect has finished, one way or the other
+        fd_set writable;
+        FD_ZERO(&writable);
+        FD_SET(net.fd, &writable);
+        struct timeval now = {0, 0};
+        int ready = select(net.fd + 1, nullptr, &writable, nullptr, &now);
+        if (ready == 0) {
+            return true;
+        }
+        int error = 0;
+        socklen_t errorLength = sizeof(error);
+        if (ready < 0 || getsockopt(net.fd, SOL_SOCKET, SO_ERROR, &error, &errorLength) != 0 ||
+            error != 0 || !startHandshake()) {
+            stop();
+            return false;
+        }
+        state = State::Handshaking;
+    }
+    if (state != State::Handshaking) {
+        return false;
+    }
+
+    int result = mbedtls_ssl_handshake(&ssl);
+    if (result == MBEDTLS_ERR_SSL_WANT_READ || result == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        return true;                    // Handshake in progress
+    }
+    if (result != 0) {
+        stop();
+        return false;
+    }
+    state = State::Open;
+    handshakes++;
+    keepSession();
+    return false;
+}
+
+bool EspNetStream::startHandshake() {
+    // Verified as esp-tls would: the broker's chain against caCert and its
+    // certificate against host. Without a CA certificate there is no
+    // connection, unless the SDK is built to skip verification.
+    if (mbedtls_ssl_config_defaults(&sslConfig, MBEDTLS_SSL_IS_CLIENT,
+                                    MBEDTLS_SSL_TRANSPORT_STREAM,
+                                    MBEDTLS_SSL_PRESET_DEFAULT) != 0) {
+        return false;
+    }
+    mbedtls_ssl_conf_rng(&sslConfig, espRandom, nullptr);
+    if (caCert) {
+        if (mbedtls_x509_crt_parse(&caChain, (const unsigned char*)caCert,
+                                   strlen(caCert) + 1) != 0) {
+            return false;
+        }
+        mbedtls_ssl_conf_ca_chain(&sslConfig, &caChain, nullptr);
+        mbedtls_ssl_conf_authmode(&sslConfig, MBEDTLS_SSL_VERIFY_REQUIRED);
+    } else {
+#ifdef CONFIG_ESP_TLS_SKIP_SERVER_CERT_VERIFY
+        mbedtls_ssl_conf_authmode(&sslConfig, MBEDTLS_SSL_VERIFY_NONE);
+#else
+        return false;
+#endif
+    }
+    if (mbedtls_ssl_setup(&ssl, &sslConfig) != 0 || mbedtls_ssl_set_hostname(&ssl, host) != 0) {
+        return false;
+    }
+    mbedtls_ssl_set_bio(&ssl, &net, mbedtls_net_send, mbedtls_net_recv, nullptr);
+    if (haveSession) {
+        mbedtls_ssl_set_session(&ssl, &session);    // Failing only costs the full handshake
+    }
+    return true;
+}
+
+void EspNetStream::keepSession() {
+    mbedtls_ssl_session latest;
+    mbedtls_ssl_session_init(&latest);
+    if (mbedtls_ssl_get_session(&ssl, &latest) != 0) {
+        mbedtls_ssl_session_free(&latest);
+        return;                         // Keep offering the previous one
+    }
+    if (haveSession &&
+        memcmp(SESSION_MASTER(latest), SESSION_MASTER(session), sizeof(SESSION_MASTER(latest))) == 0) {
+        resumed++;
+    }
+    mbedtls_ssl_session_free(&session);
+    session = latest;                   // Takes over its ticket and certificate
+    haveSession = true;
+}
+
+bool EspNetStream::flush() {
+    while (stagedSent < stagedLength) {
+        int n = mbedtls_ssl_write(&ssl, staging + stagedSent, stagedLength - stagedSent);
+        if (n > 0) {
+            stagedSent += (size_t)n;
+        } else if (n == MBEDTLS_ERR_SSL_WANT_WRITE || n == MBEDTLS_ERR_SSL_WANT_READ) {
+            return false;               // Socket full; same arguments next time
+        } else {
+            stop();
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t EspNetStream::write(const uint8_t* data, size_t length) {
+    if (state != State::Open || !flush()) {
+        return 0;
+    }
+    if (length > sizeof(staging)) {
+        length = sizeof(staging);
+    }
+    memcpy(staging, data, length);
+    stagedLength = length;
+    stagedSent = 0;
+    flush();
+    return state == State::Open ? length : 0;
+}
+
+size_t EspNetStream::read(uint8_t* data, size_t length) {
+    if (state != State::Open) {
+        return 0;
+    }
+    flush();                            // Staged bytes go out even when nothing new is written
+    if (state != State::Open) {
+        return 0;
+    }
+    int n = mbedtls_ssl_read(&ssl, data, length);
+    if (n > 0) {
+        return (size_t)n;
+    }
+    if (n != MBEDTLS_ERR_SSL_WANT_READ && n != MBEDTLS_ERR_SSL_WANT_WRITE) {
+        stop();                         // Closed by the broker, or failed
+    }
+    return 0;
+}
+
+void EspNetStream::stop() {
+    mbedtls_ssl_free(&ssl);
+    mbedtls_ssl_init(&ssl);
+    mbedtls_ssl_config_free(&sslConfig);
+    mbedtls_ssl_config_init(&sslConfig);
+    mbedtls_x509_crt_free(&caChain);
+    mbedtls_x509_crt_init(&caChain);
+    mbedtls_net_free(&net);             // Closes the socket
+    state = State::Closed;
+    stagedLength = stagedSent = 0;
+}
+
+// ---- Firmware download ----
+
+bool EspTcpStream::connect(const char* host, uint16_t port) {
+    client.stop();
+    return client.connect(host, port, OTA_CONNECT_TIMEOUT_MS) == 1;
+}
+
+size_t EspTcpStream::write(const uint8_t* data, size_t length) {
+    return client.write(data, length);
+}
+
+size_t EspTcpStream::read(uint8_t* data, size_t length) {
+    int available = client.available();
+    if (available <= 0) return 0;
+    int n = client.read(data, length < (size_t)available ? length : (size_t)available);
+    return n > 0 ? (size_t)n : 0;
+}
+
+// ---- OTA partitions ----
+
+bool EspFirmwareSlot::readRunning(uint32_t offset, uint8_t* data, size_t length) {
+    if (!running) running = esp_ota_get_running_partition();
+    if (!running || offset > running->size || length > running->size - offset) return false;
+    return esp_partition_read(running, offset, data, length) == ESP_OK;
+}
+
+bool EspFirmwareSlot::begin(uint32_t size) {
+    abort();
+    target = esp_ota_get_next_update_partition(nullptr);
+    if (!target || size > target->size) return false;
+    writing = esp_ota_begin(target, OTA_WITH_SEQUENTIAL_WRITES, &handle) == ESP_OK;
+    return writing;
+}
+
+bool EspFirmwareSlot::write(const uint8_t* data, size_t length) {
+    return writing && esp_ota_write(handle, data, length) == ESP_OK;
+}
+
+bool EspFirmwareSlot::finish() {
+    if (!writing) return false;
+    writing = false;
+    if (esp_ota_end(handle) != ESP_OK) return false;
+    return esp_ota_set_boot_partition(target) == ESP_OK;
+}
+
+void EspFirmwareSlot::abort() {
+    if (writing) esp_ota_abort(handle);
+    writing = false;
+}
+
+// ---- Memory ----
+
+void EspMemory::heap(HeapKind kind, HeapRegion& out) {
+    uint32_t caps = kind == HeapKind::Psram ? MALLOC_CAP_SPIRAM
+                                            : MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+    out = HeapRegion();
+    out.total = heap_caps_get_total_size(caps);
+    if (out.total == 0) return;
+
+    multi_heap_info_t info;
+    heap_caps_get_info(&info, caps);
+    out.free = info.total_free_bytes;
+    out.largestFree = info.largest_free_block;
+    out.minimumFree = info.minimum_free_bytes;
+    out.allocatedBlocks = info.allocated_blocks;
+    out.freeBlocks = info.free_blocks;
+}
+
+uint32_t EspMemory::stackUnused(void* task) {
+    return task ? uxTaskGetStackHighWaterMark((TaskHandle_t)task) : 0;
+}
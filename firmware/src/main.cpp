@@ -5,11 +5,15 @@
  *
  * Features:
  * - Multi-sensor data acquisition (ultrasonic, temperature, vibration)
+ * - Motor current and warp tension from a DMA ADC stream, decimated on the device
  * - MQTT communication with TLS
  * - Local data buffering for offline operation
+ * - 1 s, 1 min and 1 h rollups, so the backend can skip raw ingest
  * - OTA firmware updates
  * - Watchdog timer for reliability
- * - WiFi auto-reconnection
+ * - WiFi and MQTT reconnection with backoff, off the sampling path
+ * - Heap, PSRAM and task stack diagnostics
+ * - Raw sensor traces for deterministic replay on the host
  *
  * @author Kaldor IIoT Team
  * @version 1.0.0
@@ -18,50 +22,200 @@
 
 #include <Arduino.h>
 #include <WiFi.h>
-#include <WiFiClientSecure.h>
-#include <PubSubClient.h>
 #include <ArduinoJson.h>
 #include <Preferences.h>
 #include <SPIFFS.h>
 #include <Wire.h>
-#include <Adafruit_Sensor.h>
-#include <Adafruit_ADXL345_U.h>
-#include <DHT.h>
 #include "config.h"
+#include "hal_esp32.h"
 #include "sensors.h"
 #include "mqtt_handler.h"
+#include "mqtt_session.h"
+#include "connection_manager.h"
 #include "ota_updater.h"
 #include "data_buffer.h"
+#include "spsc_ring.h"
+#include "telemetry_frame.h"
+#include "backfill.h"
+#include "mqtt_topics.h"
+#include "payload_writer.h"
+#include "vibration_analyzer.h"
+#include "analog_frontend.h"
+#include "report_filter.h"
+#include "sample_publisher.h"
+#include "adaptive_rate.h"
+#include "runtime_config.h"
+#include "runtime_config_defaults.h"
+#include "runtime_config_store.h"
+#include "config_snapshot.h"
+#include "change_detector.h"
+#include "rollup.h"
+#include "stage_timing.h"
+#include "memory_metrics.h"
+#include "sensor_trace.h"
+#include "journal_store.h"
+#include <atomic>
 
 // Hardware watchdog
 #include "esp_system.h"
 #include "esp_task_wdt.h"
+#include "esp_heap_caps.h"
 
 // Global objects
-WiFiClientSecure wifiClient;
-PubSubClient mqttClient(wifiClient);
 Preferences preferences;
-SensorManager sensorManager;
+EspClock halClock;
+Hcsr04Ultrasonic ultrasonic(ULTRASONIC_TRIG, ULTRASONIC_ECHO);
+DhtTemperature thermometer(DHT_PIN, DHT_TYPE);
+Adxl345Fifo accelerometer(ACCEL_INT_PIN);
+EspAnalogDma analogInputs(ANALOG_SENSOR_1, ANALOG_SENSOR_2);
+SensorManager sensorManager(halClock, ultrasonic, thermometer, accelerometer);
+EspWifiLink wifiLink(WIFI_SSID, WIFI_PASSWORD);
+EspNetStream mqttStream;
+MqttSession mqttSession(mqttStream, halClock);
+ConnectionManager connection(wifiLink, mqttSession, halClock);
+char mqttClientId[48];
 DataBuffer dataBuffer;
-OTAUpdater otaUpdater;
+OTAUpdater otaUpdater(halClock);
+Backfill backfill(BACKFILL_INTERVAL_MS, BACKFILL_ACK_TIMEOUT_MS, BACKFILL_WINDOW);
+
+// Acquisition (core 1) -> network (core 0) hand-off, no locks
+SpscRing<SensorData, 256> sampleRing;    // ~2.5 s of 100 Hz samples
+SpscRing<SensorData, 4> aggregateRing;   // 1 Hz aggregated windows
+SpscRing<VibrationFeatures, 2> vibrationRing;
+SpscRing<ChangeEvent, 8> changeRing;     // Detector alarms
+SpscRing<AnalogSummary, 2> analogRing;   // Per-second analog statistics
+SpscRing<RollupBucket, 8> rollupRing;    // Closed 1 s, 1 min and 1 h buckets
+TaskHandle_t acquisitionTaskHandle = NULL;
+TaskHandle_t networkTaskHandle = NULL;
+TaskHandle_t vibrationTaskHandle = NULL;
+TaskHandle_t accelTaskHandle = NULL;
+TaskHandle_t analogTaskHandle = NULL;
+TaskHandle_t otaTaskHandle = NULL;
+
+// Vibration features from high-rate accelerometer blocks
+const float vibrationBandEdges[] = VIBRATION_BAND_EDGES_HZ;
+VibrationAnalyzer<VIBRATION_BLOCK_SIZE> vibrationAnalyzer(
+    VIBRATION_SAMPLE_RATE_HZ, vibrationBandEdges,
+    sizeof(vibrationBandEdges) / sizeof(vibrationBandEdges[0]));
+
+// Motor current and warp tension, decimated from the continuous ADC stream
+AnalogFrontEnd analogFrontEnd(analogInputs, halClock);
 
 // Device identification
 String deviceId;
 String loomId;
-
-// Timing variables
-unsigned long lastSensorRead = 0;
-unsigned long lastTelemetry = 0;
-unsigned long lastWiFiCheck = 0;
-unsigned long lastMQTTCheck = 0;
+uint32_t deviceHash = 0;
+
+// Publish path: topics are formatted once per connect and payloads are
+// written into one static buffer, so steady-state publishing never
+// touches the heap. Only the network task uses these.
+MqttTopics topics;
+const size_t PAYLOAD_BUFFER_SIZE = MQTT_MAX_PACKET_SIZE - MQTT_TOPIC_SIZE;
+char payloadBuffer[PAYLOAD_BUFFER_SIZE];
+PayloadWriter payload(payloadBuffer, PAYLOAD_BUFFER_SIZE);
+uint32_t payloadOverflows = 0;      // ArduinoJson documents that did not fit
+
+// Outbound MQTT queues, one per priority (network task only)
+alignas(4) uint8_t mqttControlQueue[MQTT_QUEUE_CONTROL_BYTES];
+alignas(4) uint8_t mqttLiveQueue[MQTT_QUEUE_LIVE_BYTES];
+alignas(4) uint8_t mqttBulkQueue[MQTT_QUEUE_BULK_BYTES];
+
+// Report-by-exception (network task only)
+ReportFilter reportFilter(REPORT_DEADBAND_MM, REPORT_DEADBAND_PCT, REPORT_MAX_SILENCE_MS);
+
+// Adaptive acquisition rate (acquisition task)
+const AdaptiveRateConfig adaptiveRateConfig = {
+    SAMPLE_INTERVAL_FAST_MS, SAMPLE_INTERVAL_IDLE_MS,
+    ADAPTIVE_ACTIVE_STDDEV_MM, ADAPTIVE_IDLE_STDDEV_MM,
+    ADAPTIVE_ACTIVE_VIBRATION_G, ADAPTIVE_IDLE_VIBRATION_G,
+    ADAPTIVE_HOLD_MS,
+};
+std::atomic<uint32_t> sampleIntervalMs(0);
+
+// Change detection on every BBW sample (acquisition task)
+const ChangeDetectorConfig changeDetectorConfig = {
+    DETECTOR_BASELINE_ALPHA, DETECTOR_EWMA_LAMBDA, DETECTOR_EWMA_LIMIT,
+    DETECTOR_CUSUM_K, DETECTOR_CUSUM_H, DETECTOR_MAX_RATE_MM_S,
+    DETECTOR_SIGMA_FLOOR_MM, DETECTOR_WARMUP_SAMPLES, DETECTOR_HOLDOFF_MS,
+};
+
+// Stage latency histograms and acquisition jitter. Each stage is written
+// by one task; the network task reports them in the processed telemetry
+// (per interval, on diagnostics/system) and on request on
+// diagnostics/timing (since boot).
+StageTimers stageTimers(halClock);
+CycleMonitor samplingMonitor;
+HistogramSnapshot timingReported[(uint8_t)Stage::Count + 1];   // + sample jitter
+HistogramSnapshot mqttQueueReported;
+HistogramSnapshot mqttAckReported;
+bool timingReportRequested = false;
+bool systemDiagnosticsDue = false;  // With each processed telemetry message
+
+// Heap and stack snapshots on diagnostics/memory (network task; setup()
+// registers the other tasks before starting it)
+EspMemory memoryPort;
+MemoryMetrics memoryMetrics(memoryPort, halClock);
+bool memorySnapshotRequested = false;
+
+// Raw sensor traces on request (trace topic). The acquisition and accel
+// tasks record, the network task publishes the chunks on trace/data or
+// stores them in flash for a later upload.
+SensorTrace sensorTrace;
+FileJournalStore traceStore(TRACE_PATH_PREFIX);     // Segment 0: the stored capture
+bool traceToFlash = false;
+uint32_t traceStartedMs = 0;
+uint32_t traceLimitMs = 0;
+uint32_t traceStoppedMs = 0;
+uint32_t traceBytes = 0;            // Of the current or last capture
+bool traceFlashFull = false;        // The rest of the capture is discarded
+TraceChunk traceChunk;              // Taken from the lanes, not yet sent
+bool traceChunkHeld = false;
+bool traceUploading = false;
+size_t traceUploadOffset = 0;
+const char* traceEnded = "";       // Why the last capture stopped
+bool traceStatusDue = false;
 
 // Configuration
-const unsigned long SENSOR_INTERVAL = 10;      // 100Hz -> 10ms
+const unsigned long SENSOR_INTERVAL = 10;      // 100Hz -> 10ms (default rate)
 const unsigned long TELEMETRY_INTERVAL = 1000;  // 1Hz -> 1000ms
-const unsigned long WIFI_CHECK_INTERVAL = 5000; // Check WiFi every 5s
-const unsigned long MQTT_CHECK_INTERVAL = 5000; // Check MQTT every 5s
 const unsigned long WDT_TIMEOUT = 30;           // 30 second watchdog timeout
 
+// Runtime configuration (thresholds, calibration, rate, reporting).
+// config.h holds the defaults; NVS holds the last accepted update. The
+// network task owns runtimeConfig and hands copies to the acquisition task
+// through configSnapshot, which it polls without locks.
+RuntimeConfig runtimeConfig = defaultRuntimeConfig(1000 / SENSOR_INTERVAL);
+ConfigSnapshot<RuntimeConfig> configSnapshot(runtimeConfig);
+const char* configResetReason = nullptr;   // Why the stored settings were dropped at boot
+
+// Raw samples, offline buffering and backfill (network task)
+SamplePublisher samplePublisher(mqttSession, halClock, dataBuffer, backfill, reportFilter,
+                                runtimeConfig, topics, payload);
+
+// 1 s, 1 min and 1 h rollups (network task)
+RollupPublisher rollupPublisher(mqttSession, topics, payload);
+
+// Task layout: acquisition is pinned to core 1 (APP_CPU), networking to
+// core 0 alongside the WiFi/LwIP stack.
+const uint32_t ACQUISITION_STACK = 4096;
+const uint32_t NETWORK_STACK = 8192;
+const uint32_t VIBRATION_STACK = 4096;
+const uint32_t ACCEL_STACK = 3072;
+const uint32_t ANALOG_STACK = 3072;
+const uint32_t OTA_STACK = 6144;
+const UBaseType_t ACCEL_PRIORITY = 6;       // Short bursts; keeps the FIFO from overrunning
+const UBaseType_t ACQUISITION_PRIORITY = 5;
+const UBaseType_t ANALOG_PRIORITY = 4;      // DMA frames absorb waits behind sampling
+const UBaseType_t NETWORK_PRIORITY = 2;
+const UBaseType_t VIBRATION_PRIORITY = 1;   // Uses core 1's idle time
+const UBaseType_t OTA_PRIORITY = 1;         // Below the network task; flash writes wait
+const BaseType_t ACQUISITION_CORE = 1;
+const BaseType_t NETWORK_CORE = 0;
+const BaseType_t VIBRATION_CORE = 1;
+const BaseType_t ACCEL_CORE = 1;
+const BaseType_t ANALOG_CORE = 1;
+const BaseType_t OTA_CORE = 0;
+
 // Status LEDs
 #define LED_STATUS GPIO_NUM_2
 #define LED_WIFI GPIO_NUM_4
@@ -70,12 +224,30 @@ const unsigned long WDT_TIMEOUT = 30;           // 30 second watchdog timeout
 // Function prototypes
 void setupWiFi();
 void setupMQTT();
-void reconnectWiFi();
-void reconnectMQTT();
-void readSensors();
+void onMQTTConnected();
+void updateConnectionLeds();
+void acquisitionTask(void* param);
+void networkTask(void* param);
+void vibrationTask(void* param);
+void accelTask(void* param);
+void analogTask(void* param);
+void otaTask(void* param);
+void publishSamples();
 void publishTelemetry();
+void publishSystemDiagnostics();
+void publishRollups();
+void publishAlert(const char* alertType, float value);
+void publishChangeAlerts();
+void publishStatus(const char* configError);
+void publishTimingReport();
+void publishMemory();
+void handleTraceCommand(JsonDocument& doc);
+void publishTrace();
+void applyConfigUpdate(JsonDocument& doc);
 void processCommands();
 void handleOTA();
+void publishOtaStatus(const OtaProgress& progress);
+void persistBeforeRestart();
 void blinkLED(uint8_t pin, int times);
 void loadConfiguration();
 void saveConfiguration();
@@ -113,11 +285,18 @@ void setup() {
         deviceId = "BBW-" + String((uint32_t)chipid, HEX);
         preferences.putString("deviceId", deviceId);
     }
+    deviceHash = deviceIdHash(deviceId.c_str());
+    samplePublisher.begin(deviceId.c_str(), loomId.c_str(), deviceHash);
+    samplePublisher.setTimers(&stageTimers);
+    rollupPublisher.begin(deviceId.c_str(), loomId.c_str());
+    sensorManager.setTimers(&stageTimers);
+    sensorManager.setTrace(&sensorTrace);
     Serial.printf("✓ Device ID: %s\n", deviceId.c_str());
     Serial.printf("✓ Loom ID: %s\n", loomId.c_str());
 
     // Initialize I2C bus
     Wire.begin(I2C_SDA, I2C_SCL);
+    Wire.setClock(400000);  // Fast mode for the accelerometer FIFO reads
     Serial.println("✓ I2C initialized");
 
     // Initialize sensors
@@ -127,8 +306,21 @@ void setup() {
         Serial.println("✓ All sensors initialized");
     }
 
+    // Analog inputs: continuous DMA conversion, decimated per channel
+    if (!analogFrontEnd.configure(0, ANALOG_CURRENT_OUTPUT_HZ, ANALOG_CURRENT_SCALE,
+                                  ANALOG_CURRENT_OFFSET) ||
+        !analogFrontEnd.configure(1, ANALOG_TENSION_OUTPUT_HZ, ANALOG_TENSION_SCALE,
+                                  ANALOG_TENSION_OFFSET)) {
+        Serial.println("WARNING: Analog output rates do not fit the decimation limits");
+    } else if (!analogFrontEnd.begin()) {
+        Serial.println("WARNING: Analog DMA setup failed");
+    } else {
+        Serial.printf("✓ Analog inputs: %d Hz each, decimated to %d and %d Hz\n",
+                      ANALOG_SAMPLE_RATE_HZ, ANALOG_CURRENT_OUTPUT_HZ, ANALOG_TENSION_OUTPUT_HZ);
+    }
+
     // Initialize data buffer
-    dataBuffer.begin(100); // Buffer up to 100 readings
+    dataBuffer.begin(MAX_BUFFER_SIZE, PSRAM_BUFFER_SIZE);
     Serial.println("✓ Data buffer initialized");
 
     // Setup WiFi
@@ -138,224 +330,400 @@ void setup() {
     setupMQTT();
 
     // Initialize OTA updater
-    otaUpdater.begin(deviceId);
+    otaUpdater.begin(deviceId, deviceHash ^ esp_random());
     Serial.println("✓ OTA updater ready");
 
-    // Configure watchdog timer
+    // Configure watchdog timer (each task subscribes itself)
     esp_task_wdt_init(WDT_TIMEOUT, true);
-    esp_task_wdt_add(NULL);
     Serial.printf("✓ Watchdog timer configured (%ds timeout)\n", WDT_TIMEOUT);
 
+    // Start acquisition and network tasks
+    xTaskCreatePinnedToCore(acquisitionTask, "acquisition", ACQUISITION_STACK,
+                            NULL, ACQUISITION_PRIORITY, &acquisitionTaskHandle,
+                            ACQUISITION_CORE);
+    xTaskCreatePinnedToCore(accelTask, "accel", ACCEL_STACK,
+                            NULL, ACCEL_PRIORITY, &accelTaskHandle,
+                            ACCEL_CORE);
+    if (analogFrontEnd.isRunning()) {
+        xTaskCreatePinnedToCore(analogTask, "analog", ANALOG_STACK,
+                                NULL, ANALOG_PRIORITY, &analogTaskHandle,
+                                ANALOG_CORE);
+    }
+    xTaskCreatePinnedToCore(vibrationTask, "vibration", VIBRATION_STACK,
+                            NULL, VIBRATION_PRIORITY, &vibrationTaskHandle,
+                            VIBRATION_CORE);
+    xTaskCreatePinnedToCore(otaTask, "ota", OTA_STACK,
+                            NULL, OTA_PRIORITY, &otaTaskHandle,
+                            OTA_CORE);
+    otaUpdater.setTask(otaTaskHandle);
+    otaUpdater.setBeforeUpload(persistBeforeRestart);
+
+    // Stacks to watch; the network task adds its own and takes over the
+    // metrics once it runs
+    memoryMetrics.addTask("acquisition", acquisitionTaskHandle, ACQUISITION_STACK);
+    memoryMetrics.addTask("accel", accelTaskHandle, ACCEL_STACK);
+    if (analogTaskHandle) memoryMetrics.addTask("analog", analogTaskHandle, ANALOG_STACK);
+    memoryMetrics.addTask("vibration", vibrationTaskHandle, VIBRATION_STACK);
+    memoryMetrics.addTask("ota", otaTaskHandle, OTA_STACK);
+    xTaskCreatePinnedToCore(networkTask, "network", NETWORK_STACK,
+                            NULL, NETWORK_PRIORITY, &networkTaskHandle,
+                            NETWORK_CORE);
+    Serial.println("✓ Acquisition (core 1) and network (core 0) tasks started");
+    Serial.printf("✓ Vibration analysis: %d-point blocks at %d Hz (%s FFT)\n",
+                  VIBRATION_BLOCK_SIZE, VIBRATION_SAMPLE_RATE_HZ,
+                  vibrationAnalyzer.isAccelerated() ? "esp-dsp" : "portable");
+
     // All ready!
     blinkLED(LED_STATUS, 3);
-    Serial.println("\n✓ System ready - entering main loop\n");
+    Serial.println("\n✓ System ready\n");
 }
 
 void loop() {
-    unsigned long currentMillis = millis();
+    // All work runs in the pinned tasks
+    vTaskDelete(NULL);
+}
 
-    // Reset watchdog timer
-    esp_task_wdt_reset();
+/**
+ * Acquisition task (core 1): samples sensors at the current period, keeps
+ * the rolling statistics, and hands data to the network task through the
+ * SPSC rings. Never touches the network or flash.
+ */
+void acquisitionTask(void* param) {
+    esp_task_wdt_add(NULL);
 
-    // Check WiFi connection
-    if (currentMillis - lastWiFiCheck >= WIFI_CHECK_INTERVAL) {
-        lastWiFiCheck = currentMillis;
-        if (WiFi.status() != WL_CONNECTED) {
-            digitalWrite(LED_WIFI, LOW);
-            reconnectWiFi();
-        } else {
-            digitalWrite(LED_WIFI, HIGH);
+    // Local copy of the runtime configuration, refreshed when the network
+    // task publishes a new one
+    uint32_t configGeneration = configSnapshot.generation();
+    RuntimeConfig cfg;
+    configSnapshot.read(cfg);
+    sensorManager.setCalibration(cfg.calibrationOffset, cfg.calibrationScale);
+    sensorManager.setOutlierFilter(cfg.outlierThreshold, cfg.outlierMinSigmaMm);
+
+    AdaptiveRate rate(adaptiveRateConfig, SENSOR_INTERVAL, cfg.adaptiveRate);
+    rate.setRate(cfg.sampleRateHz);
+    ChangeDetector detector(changeDetectorConfig);
+    ChangeEvent change;
+    Rollups rollups;
+
+    uint32_t interval = rate.interval();
+    TickType_t lastWake = xTaskGetTickCount();
+    unsigned long lastAggregate = millis();
+
+    for (;;) {
+        esp_task_wdt_reset();
+
+        samplingMonitor.wake(micros(), interval * 1000);
+
+        uint32_t started = stageTimers.start();
+        SensorData data = sensorManager.read();
+        stageTimers.stop(Stage::SensorRead, started);
+        sampleRing.push(data);
+
+        started = stageTimers.start();
+        ChangeKind kind = detector.update(data.bbw, data.bbw > 0, data.timestamp, change);
+        stageTimers.stop(Stage::Detect, started);
+        if (kind != ChangeKind::None) {
+            changeRing.push(change);
         }
-    }
 
-    // Check MQTT connection
-    if (currentMillis - lastMQTTCheck >= MQTT_CHECK_INTERVAL) {
-        lastMQTTCheck = currentMillis;
-        if (!mqttClient.connected()) {
-            digitalWrite(LED_MQTT, LOW);
-            reconnectMQTT();
-        } else {
-            digitalWrite(LED_MQTT, HIGH);
+        // 1 s, 1 min and 1 h buckets; closed ones go to the network task
+        rollups.add(data, [](const RollupBucket& bucket) { rollupRing.push(bucket); });
+
+        // Pick up configuration updates (one atomic load when unchanged)
+        uint32_t generation = configSnapshot.generation();
+        if (generation != configGeneration) {
+            configGeneration = generation;
+            RuntimeConfig previous = cfg;
+            configSnapshot.read(cfg);
+            sensorManager.setCalibration(cfg.calibrationOffset, cfg.calibrationScale);
+            sensorManager.setOutlierFilter(cfg.outlierThreshold, cfg.outlierMinSigmaMm);
+            if (cfg.calibrationOffset != previous.calibrationOffset ||
+                cfg.calibrationScale != previous.calibrationScale) {
+                detector.reset();   // Baseline was in the old calibration
+            }
+            rate.setRate(cfg.sampleRateHz);
+            if (cfg.adaptiveRate != rate.isAdaptive()) {
+                rate.setAdaptive(cfg.adaptiveRate);
+            }
         }
-    }
+        interval = rate.update(data.bbw_stddev, data.vibration, millis());
+        sampleIntervalMs.store(interval);
 
-    // Process MQTT messages
-    mqttClient.loop();
+        if (millis() - lastAggregate >= TELEMETRY_INTERVAL) {
+            lastAggregate = millis();
+            aggregateRing.push(sensorManager.getAggregated());
+        }
 
-    // Read sensors at high frequency
-    if (currentMillis - lastSensorRead >= SENSOR_INTERVAL) {
-        lastSensorRead = currentMillis;
-        readSensors();
+        samplingMonitor.done(micros());
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(interval));
     }
-
-    // Publish telemetry at lower frequency
-    if (currentMillis - lastTelemetry >= TELEMETRY_INTERVAL) {
-        lastTelemetry = currentMillis;
-        publishTelemetry();
-    }
-
-    // Handle OTA updates
-    handleOTA();
-
-    // Small delay to prevent watchdog triggers
-    delay(1);
 }
 
-void setupWiFi() {
-    Serial.printf("Connecting to WiFi: %s ", WIFI_SSID);
-
-    WiFi.mode(WIFI_STA);
-    WiFi.setHostname(deviceId.c_str());
-    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+/**
+ * Accelerometer capture task (core 1): sleeps until the ADXL345 FIFO
+ * reaches its watermark, then drains it into the vibration blocks. The
+ * timeout recovers from a missed interrupt edge.
+ */
+void accelTask(void* param) {
+    esp_task_wdt_add(NULL);
+    const uint32_t timeoutMs = 2000UL * ACCEL_FIFO_WATERMARK / VIBRATION_SAMPLE_RATE_HZ + 1;
 
-    int attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 30) {
-        delay(500);
-        Serial.print(".");
-        attempts++;
+    for (;;) {
+        esp_task_wdt_reset();
+        sensorManager.waitForAccelerometer(timeoutMs);
+        sensorManager.drainAccelerometer();
     }
+}
 
-    if (WiFi.status() == WL_CONNECTED) {
-        Serial.println(" Connected!");
-        Serial.printf("✓ IP Address: %s\n", WiFi.localIP().toString().c_str());
-        Serial.printf("✓ Signal Strength: %d dBm\n", WiFi.RSSI());
-        digitalWrite(LED_WIFI, HIGH);
-    } else {
-        Serial.println(" Failed!");
-        Serial.println("WARNING: Running in offline mode");
-        digitalWrite(LED_WIFI, LOW);
+/**
+ * Analog task (core 1): waits for each DMA frame of the analog inputs and
+ * decimates it. The newest values go into every sample, the per-second
+ * statistics into the processed telemetry.
+ */
+void analogTask(void* param) {
+    esp_task_wdt_add(NULL);
+    AnalogSummary summary;
+
+    for (;;) {
+        esp_task_wdt_reset();
+        analogFrontEnd.poll(100);
+        sensorManager.setAnalogLevels(analogFrontEnd.latest(0), analogFrontEnd.latest(1));
+        if (analogFrontEnd.takeSummary(summary)) {
+            analogRing.push(summary);
+        }
     }
 }
 
-void reconnectWiFi() {
-    static unsigned long lastAttempt = 0;
-    unsigned long currentMillis = millis();
+/**
+ * Vibration task (core 1, lowest priority): turns each completed
+ * accelerometer block into features for the processed telemetry. Runs in
+ * the gaps between acquisition ticks.
+ */
+void vibrationTask(void* param) {
+    esp_task_wdt_add(NULL);
+    VibrationFeatures features;
 
-    // Only attempt reconnection every 10 seconds
-    if (currentMillis - lastAttempt < 10000) {
-        return;
-    }
-    lastAttempt = currentMillis;
+    for (;;) {
+        esp_task_wdt_reset();
 
-    Serial.println("Attempting WiFi reconnection...");
-    WiFi.disconnect();
-    delay(100);
-    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+        uint32_t timestamp;
+        const int16_t* block = sensorManager.vibrationBlock(timestamp);
+        if (!block) {
+            vTaskDelay(pdMS_TO_TICKS(50));
+            continue;
+        }
 
-    // Wait up to 5 seconds
-    int attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 10) {
-        delay(500);
-        attempts++;
-    }
+        vibrationAnalyzer.analyze(block, SensorManager::ACCEL_G_PER_COUNT, features);
+        sensorManager.releaseVibrationBlock();
 
-    if (WiFi.status() == WL_CONNECTED) {
-        Serial.println("✓ WiFi reconnected");
-        digitalWrite(LED_WIFI, HIGH);
+        features.timestamp = timestamp;
+        sensorManager.setVibrationLevel(features.rms);
+        vibrationRing.push(features);
     }
 }
 
-void setupMQTT() {
-    // Load CA certificate for TLS
-    // wifiClient.setCACert(MQTT_CA_CERT);
+/**
+ * Network task (core 0): connection management, MQTT, publishing, ArduinoOTA
+ * and reporting firmware download progress.
+ * Stalls here no longer delay sampling.
+ */
+void networkTask(void* param) {
+    esp_task_wdt_add(NULL);
+    memoryMetrics.addTask("network", xTaskGetCurrentTaskHandle(), NETWORK_STACK);
+
+    for (;;) {
+        // Reset watchdog timer
+        esp_task_wdt_reset();
+
+        // Join WiFi and connect to the broker; never waits, failed
+        // attempts are retried after a jittered backoff
+        uint32_t started = stageTimers.start();
+        connection.loop();
+        stageTimers.stop(Stage::Connect, started);
+        updateConnectionLeds();
+        if (!mqttSession.connected()) {
+            backfill.stop();
+        }
 
-    mqttClient.setServer(MQTT_BROKER, MQTT_PORT);
-    mqttClient.setCallback(mqttCallback);
-    mqttClient.setKeepAlive(60);
-    mqttClient.setSocketTimeout(30);
+        // Write queued messages, read incoming ones, keep the session alive
+        started = stageTimers.start();
+        mqttSession.loop();
+        stageTimers.stop(Stage::MqttLoop, started);
+        if (mqttSession.justConnected()) {
+            onMQTTConnected();
+        }
 
-    reconnectMQTT();
-}
+        // Forward everything the acquisition task produced
+        publishSamples();
+        publishChangeAlerts();
+        publishTelemetry();
+        publishSystemDiagnostics();
+        publishRollups();
+        samplePublisher.drainBacklog();
+        if (timingReportRequested) {
+            timingReportRequested = false;
+            publishTimingReport();
+        }
+        publishMemory();
+        publishTrace();
 
-void reconnectMQTT() {
-    static unsigned long lastAttempt = 0;
-    unsigned long currentMillis = millis();
+        // ArduinoOTA, and progress of a download running in the OTA task
+        started = stageTimers.start();
+        handleOTA();
+        stageTimers.stop(Stage::Ota, started);
 
-    if (!WiFi.isConnected()) {
-        return; // Can't connect to MQTT without WiFi
+        // Yield to the WiFi stack
+        vTaskDelay(1);
     }
+}
 
-    // Only attempt reconnection every 5 seconds
-    if (currentMillis - lastAttempt < 5000) {
-        return;
+/**
+ * OTA task (core 0, below the network task): downloads and writes a
+ * firmware image requested over MQTT. Sleeps until a request arrives; while
+ * one runs it polls as fast as data comes and naps briefly when none does.
+ * Not on the watchdog: a slow flash erase or server may legitimately stall
+ * it, and OtaUpdate times those out itself.
+ */
+void otaTask(void* param) {
+    for (;;) {
+        bool worked = otaUpdater.service();
+        if (otaUpdater.isUpdateInProgress()) {
+            vTaskDelay(worked ? 1 : pdMS_TO_TICKS(5));
+        } else {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
     }
-    lastAttempt = currentMillis;
+}
 
-    Serial.print("Attempting MQTT connection...");
+/**
+ * Station mode only; ConnectionManager joins the network from the
+ * network task, so setup() does not wait for the access point.
+ */
+void setupWiFi() {
+    wifiLink.begin(deviceId.c_str());
+    Serial.printf("✓ WiFi: joining %s in the background\n", WIFI_SSID);
+}
 
-    // Create client ID
-    String clientId = "kaldor-" + deviceId;
+void setupMQTT() {
+    // Load CA certificate for TLS
+    // mqttStream.setCACert(MQTT_CA_CERT);
+
+    mqttSession.setQueue(MqttPriority::Control, mqttControlQueue, sizeof(mqttControlQueue));
+    mqttSession.setQueue(MqttPriority::Live, mqttLiveQueue, sizeof(mqttLiveQueue));
+    mqttSession.setQueue(MqttPriority::Bulk, mqttBulkQueue, sizeof(mqttBulkQueue));
+    mqttSession.setWindow(MQTT_INFLIGHT_WINDOW);
+    mqttSession.setAckTimeout(MQTT_ACK_TIMEOUT_MS);
+    mqttSession.setConnectTimeout(MQTT_CONNECT_TIMEOUT_MS);
+    mqttSession.setKeepAlive(MQTT_KEEPALIVE_S);
+    mqttSession.setCallback(mqttCallback);
+
+    // Topics only change with the loom id, which is fixed until reboot
+    if (!topics.build(loomId.c_str())) {
+        Serial.println("ERROR: Loom ID too long for MQTT topics, staying offline");
+        return;
+    }
+    snprintf(mqttClientId, sizeof(mqttClientId), "kaldor-%s", deviceId.c_str());
+    connection.setBroker(MQTT_BROKER, MQTT_PORT, mqttClientId, MQTT_USER, MQTT_PASSWORD);
 
-    // Attempt connection
-    if (mqttClient.connect(clientId.c_str(), MQTT_USER, MQTT_PASSWORD)) {
-        Serial.println(" Connected!");
-        digitalWrite(LED_MQTT, HIGH);
+    // Seeded per device so that looms losing the same AP retry at
+    // different times
+    connection.begin(deviceHash ^ esp_random());
+}
 
-        // Subscribe to command topics
-        String cmdTopic = "kaldor/loom/" + loomId + "/config";
-        mqttClient.subscribe(cmdTopic.c_str());
+/** Status LEDs follow the WiFi link and the MQTT session. */
+void updateConnectionLeds() {
+    static bool wifiLed = false;
+    static bool mqttLed = false;
+    bool wifiUp = wifiLink.up();
+    bool mqttUp = mqttSession.connected();
+    if (wifiUp != wifiLed) {
+        wifiLed = wifiUp;
+        digitalWrite(LED_WIFI, wifiUp ? HIGH : LOW);
+    }
+    if (mqttUp != mqttLed) {
+        mqttLed = mqttUp;
+        digitalWrite(LED_MQTT, mqttUp ? HIGH : LOW);
+    }
+}
 
-        String otaTopic = "kaldor/loom/" + loomId + "/ota";
-        mqttClient.subscribe(otaTopic.c_str());
+/**
+ * Session established (CONNACK accepted): subscribe, restart the backfill
+ * and announce the device. Messages still queued from before the
+ * disconnect are already going out again.
+ */
+void onMQTTConnected() {
+    Serial.println("✓ MQTT session established");
 
-        Serial.printf("✓ Subscribed to topics\n");
+    // Subscribe to command topics
+    mqttSession.subscribe(topics.config, 1);
+    mqttSession.subscribe(topics.ota, 1);
+    mqttSession.subscribe(topics.backlogAck, 1);
+    mqttSession.subscribe(topics.timingRequest, 0);
+    mqttSession.subscribe(topics.memoryRequest, 0);
+    mqttSession.subscribe(topics.traceControl, 1);
 
-        // Publish online status
-        String statusTopic = "kaldor/loom/" + loomId + "/status";
-        StaticJsonDocument<200> doc;
-        doc["device_id"] = deviceId;
-        doc["loom_id"] = loomId;
-        doc["status"] = "online";
-        doc["firmware_version"] = FIRMWARE_VERSION;
-        doc["ip"] = WiFi.localIP().toString();
+    // Start the backfill; report the next sample whatever its value
+    samplePublisher.onConnect();
 
-        String payload;
-        serializeJson(doc, payload);
-        mqttClient.publish(statusTopic.c_str(), payload.c_str(), true);
+    publishStatus(nullptr);
+}
 
-    } else {
-        Serial.print(" Failed, rc=");
-        Serial.println(mqttClient.state());
-        digitalWrite(LED_MQTT, LOW);
+/**
+ * Forward everything the acquisition task queued; the publisher filters,
+ * publishes or buffers each sample.
+ */
+void publishSamples() {
+    SensorData data;
+    while (sampleRing.pop(data)) {
+        samplePublisher.publish(data);
     }
+    samplePublisher.flush();
 }
 
-void readSensors() {
-    SensorData data = sensorManager.read();
-
-    // Add to local buffer (for offline resilience)
-    dataBuffer.add(data);
-
-    // If we have MQTT connection, publish high-frequency data
-    if (mqttClient.connected()) {
-        String topic = "kaldor/loom/" + loomId + "/bbw/raw";
-
-        StaticJsonDocument<256> doc;
-        doc["timestamp"] = millis();
-        doc["device_id"] = deviceId;
-        doc["bbw"] = data.bbw;
-        doc["quality"] = data.quality;
-
-        String payload;
-        serializeJson(doc, payload);
-        mqttClient.publish(topic.c_str(), payload.c_str());
+/**
+ * Serialise an ArduinoJson document into the payload buffer. A document
+ * that ran out of pool or does not fit the buffer whole is not sent (a
+ * truncated one would not parse) and counts in payload_overflows.
+ */
+static bool serializePayload(JsonDocument& doc, const char* what) {
+    if (doc.overflowed() || measureJson(doc) >= PAYLOAD_BUFFER_SIZE) {
+        payloadOverflows++;
+        Serial.printf("%s does not fit the payload buffer\n", what);
+        return false;
     }
+    serializeJson(doc, payloadBuffer, PAYLOAD_BUFFER_SIZE);
+    return true;
+}
+
+static void addTimingSummary(JsonObject timing, const char* key, LatencyHistogram& histogram,
+                             HistogramSnapshot& previous) {
+    TimingSummary summary = summarizeSince(histogram, previous);
+    JsonArray values = timing.createNestedArray(key);
+    values.add(summary.count);
+    values.add(summary.p50);
+    values.add(summary.p99);
+    values.add(summary.maxUs);
 }
 
 void publishTelemetry() {
-    if (!mqttClient.connected()) {
-        return; // Queue data in buffer for later
+    // Get aggregated sensor data from the acquisition task
+    SensorData data;
+    if (!aggregateRing.pop(data)) {
+        return;
     }
 
-    // Get aggregated sensor data
-    SensorData data = sensorManager.getAggregated();
+    if (!mqttSession.connected()) {
+        return; // Queue data in buffer for later
+    }
 
-    String topic = "kaldor/loom/" + loomId + "/bbw/processed";
+    uint32_t started = stageTimers.start();
+    systemDiagnosticsDue = true;
 
-    StaticJsonDocument<512> doc;
+    // 1 Hz, so ArduinoJson is fine; the document lives on the stack
+    StaticJsonDocument<3072> doc;
     doc["timestamp"] = millis();
-    doc["device_id"] = deviceId;
-    doc["loom_id"] = loomId;
+    doc["device_id"] = deviceId.c_str();
+    doc["loom_id"] = loomId.c_str();
 
     JsonObject measurements = doc.createNestedObject("measurements");
     measurements["bbw_avg"] = data.bbw;
@@ -364,42 +732,426 @@ void publishTelemetry() {
     measurements["bbw_stddev"] = data.bbw_stddev;
     measurements["temperature"] = data.temperature;
     measurements["vibration"] = data.vibration;
+    measurements["motor_current"] = data.motor_current;
+    measurements["warp_tension"] = data.warp_tension;
+
+    // Spectral features of the newest vibration block, if one finished
+    VibrationFeatures features;
+    bool haveFeatures = false;
+    while (vibrationRing.pop(features)) {
+        haveFeatures = true;
+    }
+    if (haveFeatures) {
+        static const char* const axisNames[VIBRATION_AXES] = {"x", "y", "z"};
+        JsonObject vibration = doc.createNestedObject("vibration");
+        vibration["timestamp"] = features.timestamp;
+        vibration["rms"] = features.rms;
+        for (size_t a = 0; a < VIBRATION_AXES; a++) {
+            JsonObject axis = vibration.createNestedObject(axisNames[a]);
+            axis["rms"] = features.axis[a].rms;
+            axis["peak"] = features.axis[a].peak;
+            axis["crest"] = features.axis[a].crest;
+            axis["kurtosis"] = features.axis[a].kurtosis;
+        }
+        JsonArray bands = vibration.createNestedArray("band_energy");
+        for (uint8_t b = 0; b < features.bandCount; b++) {
+            bands.add(features.bandEnergy[b]);
+        }
+    }
+
+    // Analog input statistics of the last second, if the analog task is running
+    AnalogSummary analog;
+    bool haveAnalog = false;
+    while (analogRing.pop(analog)) {
+        haveAnalog = true;
+    }
+    if (haveAnalog) {
+        static const char* const channelNames[ANALOG_CHANNELS] = {
+            "motor_current", "warp_tension"
+        };
+        JsonObject inputs = doc.createNestedObject("analog");
+        inputs["interval_ms"] = analog.intervalMs;
+        inputs["overruns"] = analog.overruns;
+        for (size_t c = 0; c < ANALOG_CHANNELS; c++) {
+            const AnalogChannelSummary& s = analog.channel[c];
+            JsonObject channel = inputs.createNestedObject(channelNames[c]);
+            channel["mean"] = s.mean;
+            channel["min"] = s.minimum;
+            channel["max"] = s.maximum;
+            channel["stddev"] = s.stddev;
+            channel["output_hz"] = s.outputHz;
+            channel["samples"] = s.samples;
+            channel["cpu_us"] = s.cpuUs;
+        }
+    }
 
     JsonObject system = doc.createNestedObject("system");
     system["uptime"] = millis() / 1000;
     system["free_heap"] = ESP.getFreeHeap();
+    system["largest_free_block"] = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    system["min_free_heap"] = ESP.getMinFreeHeap();
     system["wifi_rssi"] = WiFi.RSSI();
     system["buffer_size"] = dataBuffer.size();
-
-    String payload;
-    serializeJson(doc, payload);
-    mqttClient.publish(topic.c_str(), payload.c_str());
+    system["buffer_flash"] = dataBuffer.flashSize();
+    system["journal_errors"] = dataBuffer.journalWriteErrors();
+    system["backlog_depth"] = backfill.depth(dataBuffer.oldestSequence(),
+                                             dataBuffer.nextSequence());
+    system["backlog_drain_rate"] = backfill.drainRate(millis());
+    system["echo_timeouts"] = sensorManager.echoTimeouts();
+    system["echo_late"] = sensorManager.echoLateSamples();
+    system["bbw_outliers"] = sensorManager.bbwOutliers();
+    system["ring_dropped"] = sampleRing.dropped();
+    system["ring_high_water"] = sampleRing.highWaterMark();
+    system["change_alerts_dropped"] = changeRing.dropped();
+    system["rollups_pending"] = rollupPublisher.pendingCount();
+    system["rollups_dropped"] = rollupRing.dropped() + rollupPublisher.dropped();
+    system["sample_interval_ms"] = sampleIntervalMs.load();
+    system["report_sent"] = reportFilter.reported();
+    system["report_suppressed"] = reportFilter.suppressed();
+    system["vibration_dropped"] = sensorManager.vibrationSamplesDropped();
+    system["accel_fifo_overruns"] = sensorManager.fifoOverruns();
+    system["accel_read_errors"] = sensorManager.accelReadErrors();
+
+    if (serializePayload(doc, "Processed telemetry")) {
+        mqttSession.publish(topics.processed, payloadBuffer, false, MQTT_QOS_TELEMETRY,
+                            MqttPriority::Live);
+    }
+    stageTimers.stop(Stage::Telemetry, started);
 
     // Check for alerts
-    if (data.bbw < BBW_MIN_THRESHOLD || data.bbw > BBW_MAX_THRESHOLD) {
+    if (data.bbw < runtimeConfig.bbwMin || data.bbw > runtimeConfig.bbwMax) {
         publishAlert("bbw_out_of_range", data.bbw);
     }
+    if (data.temperature > runtimeConfig.temperatureMax) {
+        publishAlert("temperature_high", data.temperature);
+    }
+    if (data.vibration > runtimeConfig.vibrationMax) {
+        publishAlert("vibration_high", data.vibration);
+    }
 }
 
-void publishAlert(const char* alertType, float value) {
-    String topic = "kaldor/loom/" + loomId + "/alerts";
+/**
+ * Connection, MQTT session and stage timing counters, after each processed
+ * telemetry message. Kept off bbw/processed so that one stays within the
+ * payload buffer, and in a function of its own so the two documents are
+ * not on the network task's stack at once.
+ */
+void publishSystemDiagnostics() {
+    if (!systemDiagnosticsDue) {
+        return;
+    }
+    systemDiagnosticsDue = false;
+
+    StaticJsonDocument<2048> doc;
+    doc["timestamp"] = millis();
+    doc["device_id"] = deviceId.c_str();
+
+    // Reconnects since boot; the latencies (ms) are those of the last one
+    const ConnectionStats& linkStats = connection.stats();
+    JsonObject net = doc.createNestedObject("connection");
+    net["wifi_joins"] = linkStats.joins;
+    net["wifi_join_failures"] = linkStats.joinFailures;
+    net["wifi_losses"] = linkStats.linkLosses;
+    net["broker_connects"] = linkStats.connects;
+    net["broker_failures"] = linkStats.connectFailures;
+    net["join_ms"] = linkStats.lastJoinMs;
+    net["connect_ms"] = linkStats.lastConnectMs;
+    net["outage_ms"] = linkStats.lastOutageMs;
+    net["max_outage_ms"] = linkStats.maxOutageMs;
+    net["tls_handshakes"] = mqttStream.handshakeCount();
+    net["tls_resumed"] = mqttStream.resumedCount();
+    net["tls_resumable"] = mqttStream.canResume();
+
+    // MQTT session since boot; queue_bytes is the current fill per priority
+    const MqttStats& mqttStats = mqttSession.stats();
+    JsonObject mqtt = doc.createNestedObject("mqtt");
+    mqtt["queued"] = mqttStats.queued;
+    mqtt["rejected"] = mqttStats.rejected;
+    mqtt["sent"] = mqttStats.sent;
+    mqtt["acked"] = mqttStats.acked;
+    mqtt["retransmits"] = mqttStats.retransmits;
+    mqtt["ack_timeouts"] = mqttStats.ackTimeouts;
+    mqtt["connects"] = mqttStats.connects;
+    mqtt["disconnects"] = mqttStats.disconnects;
+    mqtt["in_flight"] = mqttSession.inFlightMessages();
+    JsonArray queueBytes = mqtt.createNestedArray("queue_bytes");
+    for (uint8_t p = 0; p < (uint8_t)MqttPriority::Count; p++) {
+        queueBytes.add(mqttSession.queuedBytes((MqttPriority)p));
+    }
+
+    // Stage timing since the previous message, [count, p50, p99, max] in µs
+    JsonObject timing = doc.createNestedObject("timing");
+    for (uint8_t s = 0; s < (uint8_t)Stage::Count; s++) {
+        addTimingSummary(timing, stageName((Stage)s), stageTimers[(Stage)s], timingReported[s]);
+    }
+    addTimingSummary(timing, "sample_jitter", samplingMonitor.jitter(),
+                     timingReported[(uint8_t)Stage::Count]);
+    addTimingSummary(timing, "mqtt_queue", mqttSession.queueLatency(), mqttQueueReported);
+    addTimingSummary(timing, "mqtt_ack", mqttSession.ackLatency(), mqttAckReported);
+    doc["missed_deadlines"] = samplingMonitor.missed();
+    doc["sample_overruns"] = samplingMonitor.overruns();
+    doc["payload_overflows"] = payloadOverflows;
+
+    if (serializePayload(doc, "System diagnostics")) {
+        mqttSession.publish(topics.systemDiagnostics, payloadBuffer, false, MQTT_QOS_TELEMETRY,
+                            MqttPriority::Live);
+    }
+}
+
+/**
+ * Rollup buckets the acquisition task closed, on their level's topic if
+ * that level is enabled; 1 min and 1 h buckets held while offline go first.
+ */
+void publishRollups() {
+    RollupBucket bucket;
+    while (rollupRing.pop(bucket)) {
+        rollupPublisher.publish(bucket, runtimeConfig.rollupLevels);
+    }
+    rollupPublisher.drain();
+}
 
+void publishAlert(const char* alertType, float value) {
     StaticJsonDocument<256> doc;
     doc["timestamp"] = millis();
-    doc["device_id"] = deviceId;
-    doc["loom_id"] = loomId;
+    doc["device_id"] = deviceId.c_str();
+    doc["loom_id"] = loomId.c_str();
     doc["alert_type"] = alertType;
     doc["value"] = value;
     doc["severity"] = "warning";
 
-    String payload;
-    serializeJson(doc, payload);
-    mqttClient.publish(topic.c_str(), payload.c_str(), true); // Retained message
+    serializeJson(doc, payloadBuffer, PAYLOAD_BUFFER_SIZE);
+    mqttSession.publish(topics.alerts, payloadBuffer, true, MQTT_QOS_ALERTS,  // Retained
+                        MqttPriority::Control);
+}
+
+/**
+ * Alerts from the change detector, with the detector state at the time it
+ * fired. Stay queued while disconnected (up to the ring size).
+ */
+void publishChangeAlerts() {
+    if (!mqttSession.connected()) {
+        return;
+    }
+
+    ChangeEvent event;
+    while (changeRing.pop(event)) {
+        char alertType[16];
+        snprintf(alertType, sizeof(alertType), "bbw_%s", ChangeDetector::name(event.kind));
+
+        StaticJsonDocument<512> doc;
+        doc["timestamp"] = event.timestamp;
+        doc["device_id"] = deviceId.c_str();
+        doc["loom_id"] = loomId.c_str();
+        doc["alert_type"] = alertType;
+        doc["value"] = event.value;
+        doc["severity"] = "warning";
+
+        JsonObject detector = doc.createNestedObject("detector");
+        detector["direction"] = event.direction;
+        detector["baseline"] = event.baseline;
+        detector["sigma"] = event.sigma;
+        detector["ewma"] = event.ewma;
+        detector["cusum_high"] = event.cusumHigh;
+        detector["cusum_low"] = event.cusumLow;
+        detector["rate"] = event.rate;
+        detector["samples"] = event.samples;
+
+        serializeJson(doc, payloadBuffer, PAYLOAD_BUFFER_SIZE);
+        mqttSession.publish(topics.alerts, payloadBuffer, true, MQTT_QOS_ALERTS,
+                            MqttPriority::Control);
+    }
+}
+
+/**
+ * Retained device status. Carries the runtime config version so the
+ * backend can see which settings are live, and the reason the last config
+ * update was rejected, if it was.
+ */
+void publishStatus(const char* configError) {
+    StaticJsonDocument<320> doc;
+    doc["device_id"] = deviceId.c_str();
+    doc["loom_id"] = loomId.c_str();
+    doc["status"] = "online";
+    doc["firmware_version"] = FIRMWARE_VERSION;
+    doc["ip"] = WiFi.localIP().toString();
+    doc["config_version"] = runtimeConfig.version;
+    if (configError) {
+        doc["config_error"] = configError;
+    }
+    if (configResetReason) {
+        doc["config_reset"] = configResetReason;
+    }
+
+    serializeJson(doc, payloadBuffer, PAYLOAD_BUFFER_SIZE);
+    mqttSession.publish(topics.status, payloadBuffer, true, MQTT_QOS_ALERTS, MqttPriority::Control);
+}
+
+/**
+ * Full stage and jitter histograms since boot, on request. Written with
+ * PayloadWriter into the shared payload buffer.
+ */
+void publishTimingReport() {
+    if (!writeTimingReport(payload, deviceId.c_str(), millis() / 1000, stageTimers,
+                           samplingMonitor)) {
+        Serial.println("Timing report does not fit the payload buffer");
+        return;
+    }
+    mqttSession.publish(topics.timing, payloadBuffer, false, 0, MqttPriority::Control);
+}
+
+/**
+ * Heap and stack snapshots: one every MEMORY_SNAPSHOT_MS, or now if one
+ * was requested, then every snapshot not yet published, oldest first. Those
+ * taken while MQTT was down wait in the metrics' ring.
+ */
+void publishMemory() {
+    if (memorySnapshotRequested) {
+        memorySnapshotRequested = false;
+        memoryMetrics.take();
+    } else {
+        memoryMetrics.poll();
+    }
+    if (!mqttSession.connected()) return;
+
+    while (const MemorySnapshot* snapshot = memoryMetrics.unsent()) {
+        if (writeMemorySnapshot(payload, memoryMetrics, *snapshot, deviceId.c_str()) &&
+            !mqttSession.publish(topics.memory, payloadBuffer, false, MQTT_QOS_MEMORY,
+                                 MqttPriority::Control)) {
+            return;     // Queue full; try again next pass
+        }
+        memoryMetrics.markSent();
+    }
+}
+
+/** End a capture; the lanes close their last chunk on their next record. */
+void stopTrace(const char* reason) {
+    if (!sensorTrace.active()) return;
+    sensorTrace.stop();
+    traceEnded = reason;
+    traceStoppedMs = millis();
+    traceStatusDue = true;
+    Serial.printf("Trace stopped (%s), %u bytes\n", reason, traceBytes);
+}
+
+/**
+ * {"start": seconds, "to": "mqtt" | "flash"} starts a capture (at most
+ * TRACE_MAX_SECONDS; one to flash replaces the stored capture),
+ * {"stop": true} ends it and {"upload": true} sends the stored capture
+ * on trace/data.
+ */
+void handleTraceCommand(JsonDocument& doc) {
+    if (doc["stop"] | false) {
+        stopTrace("command");
+        traceUploading = false;
+    } else if (doc.containsKey("start")) {
+        uint32_t seconds = doc["start"] | 0;
+        if (seconds == 0 || seconds > TRACE_MAX_SECONDS) seconds = TRACE_MAX_SECONDS;
+        traceUploading = false;
+        traceToFlash = strcmp(doc["to"] | "mqtt", "flash") == 0;
+        if (traceToFlash) traceStore.erase(0);
+        traceBytes = 0;
+        traceFlashFull = false;
+        traceStartedMs = millis();
+        traceLimitMs = seconds * 1000;
+        traceEnded = "";
+        sensorTrace.start();
+        Serial.printf("Trace started: %u s to %s\n", seconds, traceToFlash ? "flash" : "MQTT");
+    } else if (doc["upload"] | false) {
+        if (!sensorTrace.active() && traceStore.size(0) > 0) {
+            traceUploading = true;
+            traceUploadOffset = 0;
+        }
+    }
+    traceStatusDue = true;
+}
+
+/**
+ * Sensor trace chunks as the lanes close them: on trace/data, or appended
+ * to flash until TRACE_FLASH_BYTES. A chunk MQTT cannot take yet is held
+ * while the lanes' rings absorb the next ones (and drop, counted, when
+ * they fill). Then the stored capture if an upload was asked for, and
+ * trace/status after every change.
+ */
+void publishTrace() {
+    if (sensorTrace.active() && millis() - traceStartedMs >= traceLimitMs) {
+        stopTrace("time");
+    }
+
+    for (;;) {
+        if (!traceChunkHeld) {
+            if (!sensorTrace.next(traceChunk)) break;
+            traceChunkHeld = true;
+        }
+        if (traceToFlash) {
+            if (traceFlashFull || traceBytes + traceChunk.length > TRACE_FLASH_BYTES ||
+                !traceStore.append(0, traceChunk.data, traceChunk.length)) {
+                stopTrace("flash_full");
+                traceFlashFull = true;
+                traceChunkHeld = false;     // Discard what is still coming
+                continue;
+            }
+        } else if (!mqttSession.publish(topics.traceData, traceChunk.data, traceChunk.length,
+                                        false, MQTT_QOS_TRACE, MqttPriority::Bulk)) {
+            break;      // Offline or queue full; try again next pass
+        }
+        traceBytes += traceChunk.length;
+        traceChunkHeld = false;
+    }
+
+    // Upload of the stored capture, chunk by chunk
+    while (traceUploading && !traceChunkHeld && mqttSession.connected()) {
+        static uint8_t chunk[TRACE_CHUNK_BYTES];
+        size_t got = traceStore.read(0, traceUploadOffset, chunk, SENSOR_TRACE_HEADER_SIZE);
+        size_t length = got == SENSOR_TRACE_HEADER_SIZE ? (size_t)(chunk[8] | chunk[9] << 8) : 0;
+        if (length < SENSOR_TRACE_HEADER_SIZE || length > sizeof(chunk) ||
+            traceStore.read(0, traceUploadOffset, chunk, length) != length) {
+            traceUploading = false;     // End of the capture (or a damaged one)
+            traceStatusDue = true;
+            break;
+        }
+        if (!mqttSession.publish(topics.traceData, chunk, length, false, MQTT_QOS_TRACE,
+                                 MqttPriority::Bulk)) {
+            break;
+        }
+        traceUploadOffset += length;
+    }
+
+    if (!traceStatusDue || !mqttSession.connected()) return;
+    payload.reset();
+    payload.beginObject()
+           .add("device_id", deviceId.c_str())
+           .add("state", sensorTrace.active() ? "recording" : traceUploading ? "uploading" : "idle")
+           .add("to", traceToFlash ? "flash" : "mqtt")
+           .add("seconds", (uint32_t)(((sensorTrace.active() ? millis() : traceStoppedMs) -
+                                        traceStartedMs) / 1000))
+           .add("bytes", traceBytes)
+           .add("dropped", sensorTrace.dropped())
+           .add("stored", (uint32_t)traceStore.size(0))
+           .add("ended", traceEnded)
+           .endObject();
+    if (payload.ok() && mqttSession.publish(topics.traceStatus, payloadBuffer, false,
+                                            MQTT_QOS_TRACE, MqttPriority::Control)) {
+        traceStatusDue = false;
+    }
 }
 
-void mqttCallback(char* topic, byte* payload, unsigned int length) {
+void mqttCallback(const char* topic, const uint8_t* payload, size_t length) {
     Serial.printf("Message received [%s]: ", topic);
 
+    // Timing dump request: any payload, answered from the network loop
+    if (MqttTopics::matches(topic, topics.timingRequest)) {
+        Serial.println("Timing report requested");
+        timingReportRequested = true;
+        return;
+    }
+
+    // Memory snapshot request: one now, published with any not yet sent
+    if (MqttTopics::matches(topic, topics.memoryRequest)) {
+        Serial.println("Memory snapshot requested");
+        memorySnapshotRequested = true;
+        return;
+    }
+
     // Parse JSON payload
     StaticJsonDocument<512> doc;
     DeserializationError error = deserializeJson(doc, payload, length);
@@ -409,50 +1161,219 @@ void mqttCallback(char* topic, byte* payload, unsigned int length) {
         return;
     }
 
-    String topicStr = String(topic);
+    // Backlog acknowledgement: everything up to "seq" is stored upstream
+    if (MqttTopics::matches(topic, topics.backlogAck)) {
+        uint32_t seq = doc["seq"];
+        samplePublisher.acknowledge(seq);
+        return;
+    }
 
     // Handle configuration updates
-    if (topicStr.indexOf("/config") > 0) {
+    if (MqttTopics::matches(topic, topics.config)) {
         Serial.println("Configuration update received");
+        applyConfigUpdate(doc);
+    }
 
-        if (doc.containsKey("sampling_rate")) {
-            // Update sampling rate
-            int rate = doc["sampling_rate"];
-            Serial.printf("  Sampling rate: %d Hz\n", rate);
-        }
-
-        if (doc.containsKey("thresholds")) {
-            // Update thresholds
-            JsonObject thresholds = doc["thresholds"];
-            Serial.println("  Thresholds updated");
-        }
-
-        saveConfiguration();
+    // Sensor trace control
+    else if (MqttTopics::matches(topic, topics.traceControl)) {
+        Serial.println("Trace command received");
+        handleTraceCommand(doc);
     }
 
     // Handle OTA update requests
-    else if (topicStr.indexOf("/ota") > 0) {
+    else if (MqttTopics::matches(topic, topics.ota)) {
         Serial.println("OTA update requested");
 
-        if (doc.containsKey("url")) {
-            String url = doc["url"].as<String>();
-            otaUpdater.update(url);
+        if (doc["cancel"] | false) {
+            otaUpdater.cancel();
+        } else if (doc.containsKey("url")) {
+            const char* url = doc["url"] | "";
+            if (!otaUpdater.request(url)) {
+                Serial.println("  Rejected: an update is already running or the URL is too long");
+            }
         }
     }
 }
 
+/**
+ * Merge a config message into the runtime configuration. Omitted fields
+ * keep their value. The result is validated as a whole, then persisted and
+ * handed to the acquisition task; a rejected update changes nothing.
+ */
+void applyConfigUpdate(JsonDocument& doc) {
+    RuntimeConfig candidate = runtimeConfig;
+
+    JsonObject thresholds = doc["thresholds"];
+    candidate.bbwMin = thresholds["bbw_min"] | candidate.bbwMin;
+    candidate.bbwMax = thresholds["bbw_max"] | candidate.bbwMax;
+    candidate.temperatureMax = thresholds["temp_max"] | candidate.temperatureMax;
+    candidate.vibrationMax = thresholds["vib_max"] | candidate.vibrationMax;
+
+    JsonObject calibration = doc["calibration"];
+    candidate.calibrationOffset = calibration["offset"] | candidate.calibrationOffset;
+    candidate.calibrationScale = calibration["scale"] | candidate.calibrationScale;
+
+    JsonObject outlier = doc["outlier_filter"];
+    candidate.outlierThreshold = outlier["threshold"] | candidate.outlierThreshold;
+    candidate.outlierMinSigmaMm = outlier["min_sigma_mm"] | candidate.outlierMinSigmaMm;
+
+    candidate.sampleRateHz = doc["sampling_rate"] | candidate.sampleRateHz;
+    candidate.adaptiveRate = doc["adaptive_rate"] | candidate.adaptiveRate;
+
+    JsonObject report = doc["report"];
+    candidate.reportDeadbandMm = report["deadband_mm"] | candidate.reportDeadbandMm;
+    candidate.reportDeadbandPct = report["deadband_pct"] | candidate.reportDeadbandPct;
+    candidate.reportMaxSilenceMs = report["max_silence_ms"] | candidate.reportMaxSilenceMs;
+
+    JsonObject publish = doc["publish"];
+    candidate.publishRaw = publish["raw"] | candidate.publishRaw;
+    candidate.rollupLevels = publish["rollups"] | candidate.rollupLevels;
+
+    const char* error = validateRuntimeConfig(candidate);
+    if (error) {
+        Serial.printf("  Rejected: %s\n", error);
+        publishStatus(error);
+        return;
+    }
+    if (!runtimeConfigChanged(candidate, runtimeConfig)) {
+        Serial.println("  No change");
+        return;
+    }
+
+    candidate.version = runtimeConfig.version + 1;
+    runtimeConfig = candidate;
+    configResetReason = nullptr;
+    configSnapshot.publish(runtimeConfig);
+    reportFilter.configure(runtimeConfig.reportDeadbandMm, runtimeConfig.reportDeadbandPct,
+                           runtimeConfig.reportMaxSilenceMs);
+    saveConfiguration();
+
+    Serial.printf("  Applied config v%u: BBW %.1f-%.1f mm, cal (x+%.2f)*%.4f, %u Hz%s\n",
+                  runtimeConfig.version, runtimeConfig.bbwMin, runtimeConfig.bbwMax,
+                  runtimeConfig.calibrationOffset, runtimeConfig.calibrationScale,
+                  runtimeConfig.sampleRateHz, runtimeConfig.adaptiveRate ? " (adaptive)" : "");
+    publishStatus(nullptr);
+}
+
+/**
+ * ArduinoOTA, and a firmware download's progress on ota/status: on every
+ * state change and every OTA_PROGRESS_INTERVAL_MS while it runs. Once an
+ * image is installed the device restarts into it, as soon as the final
+ * status has left the device or after OTA_RESTART_GRACE_MS.
+ */
 void handleOTA() {
+    static OtaState lastState = OtaState::Idle;
+    static uint32_t lastReportMs = 0;
+    static uint32_t doneAtMs = 0;
+
     otaUpdater.handle();
+
+    OtaProgress progress = otaUpdater.progress();
+    uint32_t now = millis();
+    bool changed = progress.state != lastState;
+    bool running = progress.state == OtaState::Connecting ||
+                   progress.state == OtaState::Downloading ||
+                   progress.state == OtaState::Retrying;
+    if (changed || (running && now - lastReportMs >= OTA_PROGRESS_INTERVAL_MS)) {
+        if (changed) {
+            Serial.printf("Firmware download: %s%s%s\n", otaStateName(progress.state),
+                          progress.error ? ", " : "", progress.error ? progress.error : "");
+        }
+        publishOtaStatus(progress);
+        lastState = progress.state;
+        lastReportMs = now;
+        if (changed && progress.state == OtaState::Done) {
+            doneAtMs = now;
+        }
+    }
+
+    if (progress.state == OtaState::Done) {
+        bool sent = mqttSession.inFlightMessages() == 0 &&
+                    mqttSession.queuedBytes(MqttPriority::Control) == 0;
+        if (sent || now - doneAtMs >= OTA_RESTART_GRACE_MS) {
+            Serial.println("Restarting into the new firmware");
+            persistBeforeRestart();
+            delay(100);
+            ESP.restart();
+        }
+    }
+}
+
+/**
+ * Before a planned restart (network task): what the acquisition task has
+ * queued goes through the publisher, then everything buffered in RAM goes
+ * to flash, where the backfill finds it after the restart.
+ */
+void persistBeforeRestart() {
+    publishSamples();
+    if (!samplePublisher.persist()) {
+        Serial.println("WARNING: Buffered samples not all written to flash");
+    }
+}
+
+/** Retained so the backend sees how the last update went. */
+void publishOtaStatus(const OtaProgress& progress) {
+    StaticJsonDocument<320> doc;
+    doc["device_id"] = deviceId.c_str();
+    doc["state"] = otaStateName(progress.state);
+    doc["received"] = progress.received;
+    doc["total"] = progress.total;
+    doc["percent"] = progress.total
+        ? (uint32_t)((uint64_t)progress.received * 100 / progress.total) : 0;
+    doc["written"] = progress.written;
+    doc["firmware_size"] = progress.firmwareSize;
+    doc["delta"] = progress.delta;
+    doc["resumes"] = progress.resumes;
+    doc["retries"] = progress.retries;
+    if (progress.error) {
+        doc["error"] = progress.error;
+    }
+
+    serializeJson(doc, payloadBuffer, PAYLOAD_BUFFER_SIZE);
+    mqttSession.publish(topics.otaStatus, payloadBuffer, true, MQTT_QOS_ALERTS, MqttPriority::Control);
 }
 
 void loadConfiguration() {
     loomId = preferences.getString("loomId", "LOOM-001");
     deviceId = preferences.getString("deviceId", "");
+
+    // Runtime settings, one key per field; fields without a key keep the
+    // config.h default. Earlier firmware stored a single blob (layout 3):
+    // convert it once.
+    RuntimeConfig defaults = defaultRuntimeConfig(1000 / SENSOR_INTERVAL);
+    RuntimeConfig stored = defaults;
+    if (preferences.isKey("runtime")) {
+        if (preferences.getBytesLength("runtime") != sizeof(stored) ||
+            preferences.getBytes("runtime", &stored, sizeof(stored)) != sizeof(stored)) {
+            stored.layout = 0;              // Not a blob this firmware can read
+        }
+        if (validateRuntimeConfig(stored) == nullptr) {
+            writeRuntimeConfig(preferences, stored);
+        }
+        preferences.remove("runtime");
+    } else {
+        readRuntimeConfig(preferences, stored);
+    }
+
+    // Stored settings that no longer validate are dropped as a whole; the
+    // status message says so until the next accepted update
+    configResetReason = validateRuntimeConfig(stored);
+    if (configResetReason) {
+        runtimeConfig = defaults;
+        Serial.printf("Stored runtime config reset to defaults: %s\n", configResetReason);
+    } else {
+        runtimeConfig = stored;
+        Serial.printf("✓ Runtime config v%u loaded\n", runtimeConfig.version);
+    }
+    configSnapshot.publish(runtimeConfig);
+    reportFilter.configure(runtimeConfig.reportDeadbandMm, runtimeConfig.reportDeadbandPct,
+                           runtimeConfig.reportMaxSilenceMs);
 }
 
 void saveConfiguration() {
     preferences.putString("loomId", loomId);
     preferences.putString("deviceId", deviceId);
+    writeRuntimeConfig(preferences, runtimeConfig);
 }
 
 void blinkLED(uint8_t pin, int times) {
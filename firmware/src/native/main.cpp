@@ -0,0 +1,628 @@
+/**
+ * Kaldor IIoT - Native Pipeline Simulation
+ *
+ * Runs SensorManager, DataBuffer and SamplePublisher on Linux against the
+ * simulated ports in hal_sim.h and reports end-to-end throughput and
+ * latency as one JSON line on stdout (diagnostics go to stderr).
+ *
+ * Threads mirror the firmware tasks: acquisition (sensors -> SPSC ring,
+ * rollups, accelerometer FIFO drain, analog frames through the decimators;
+ * the board runs the last in a task of its own), vibration analysis, and
+ * the network loop (ring -> publisher -> MqttSession -> SimBrokerStream,
+ * backfill, rollups). Virtual
+ * time advances one sample period per acquisition tick; by default as fast
+ * as the pipeline keeps up, with --realtime at the configured rate.
+ *
+ *   pio run -e native && .pio/build/native/program --seconds 60
+ *
+ * Options:
+ *   --seconds N        Simulated duration (default 60)
+ *   --rate HZ          Sample rate (default 100)
+ *   --realtime         Pace acquisition with the wall clock
+ *   --outage AT,LEN    Broker unreachable from AT for LEN seconds
+ *   --link-outage AT,LEN
+ *                      WiFi gone from AT for LEN seconds
+ *   --connect-delay MS TCP and TLS handshake time of the broker connection
+ *   --write-limit N    Bytes the broker connection takes per write (default all)
+ *   --ack-delay MS     Broker PUBACK delay in virtual time (default 0)
+ *   --no-raw           Publish rollups only, as a loom with raw ingest off
+ *   --broker HOST:PORT A real broker instead of the simulated one (plain TCP,
+ *                      e.g. a local mosquitto) in real time; latencies
+ *                      are then not measured
+ *   --record FILE      Capture the raw sensor inputs of the run into a trace
+ *   --replay FILE      Replay a trace (from --record, the board's flash or
+ *                      trace/data) through SensorManager, the change detector,
+ *                      the rollups and the threshold alerts as fast as they go
+ *                      instead of simulating; the output checksum is the same
+ *                      on every run of the same trace
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+#include "hal_sim.h"
+#include "mqtt_session.h"
+#include "connection_manager.h"
+#include "posix_net_stream.h"
+#include "sensors.h"
+#include "data_buffer.h"
+#include "sample_publisher.h"
+#include "runtime_config_defaults.h"
+#include "spsc_ring.h"
+#include "vibration_analyzer.h"
+#include "analog_frontend.h"
+#include "rollup.h"
+#include "change_detector.h"
+#include "sensor_trace.h"
+#include "trace_replay.h"
+
+void halLog(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+namespace {
+
+struct Options {
+    uint32_t seconds = 60;
+    uint32_t rateHz = 100;
+    bool realtime = false;
+    uint32_t outageAt = 0;
+    uint32_t outageFor = 0;
+    uint32_t linkOutageAt = 0;
+    uint32_t linkOutageFor = 0;
+    uint32_t connectDelayMs = 0;
+    uint32_t writeLimit = 0;
+    uint32_t ackDelayMs = 0;
+    bool noRaw = false;
+    std::string brokerHost;
+    uint16_t brokerPort = 1883;
+    std::string recordPath;
+    std::string replayPath;
+};
+
+bool parseOptions(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (strcmp(arg, "--realtime") == 0) {
+            opt.realtime = true;
+        } else if (strcmp(arg, "--no-raw") == 0) {
+            opt.noRaw = true;
+        } else if (strcmp(arg, "--seconds") == 0 && value) {
+            opt.seconds = (uint32_t)strtoul(value, nullptr, 10);
+            i++;
+        } else if (strcmp(arg, "--rate") == 0 && value) {
+            opt.rateHz = (uint32_t)strtoul(value, nullptr, 10);
+            i++;
+        } else if (strcmp(arg, "--outage") == 0 && value) {
+            if (sscanf(value, "%u,%u", &opt.outageAt, &opt.outageFor) != 2) return false;
+            i++;
+        } else if (strcmp(arg, "--link-outage") == 0 && value) {
+            if (sscanf(value, "%u,%u", &opt.linkOutageAt, &opt.linkOutageFor) != 2) return false;
+            i++;
+        } else if (strcmp(arg, "--connect-delay") == 0 && value) {
+            opt.connectDelayMs = (uint32_t)strtoul(value, nullptr, 10);
+            i++;
+        } else if (strcmp(arg, "--write-limit") == 0 && value) {
+            opt.writeLimit = (uint32_t)strtoul(value, nullptr, 10);
+            i++;
+        } else if (strcmp(arg, "--ack-delay") == 0 && value) {
+            opt.ackDelayMs = (uint32_t)strtoul(value, nullptr, 10);
+            i++;
+        } else if (strcmp(arg, "--broker") == 0 && value) {
+            const char* colon = strrchr(value, ':');
+            opt.brokerHost.assign(value, colon ? (size_t)(colon - value) : strlen(value));
+            if (colon) opt.brokerPort = (uint16_t)strtoul(colon + 1, nullptr, 10);
+            i++;
+        } else if (strcmp(arg, "--record") == 0 && value) {
+            opt.recordPath = value;
+            i++;
+        } else if (strcmp(arg, "--replay") == 0 && value) {
+            opt.replayPath = value;
+            i++;
+        } else {
+            return false;
+        }
+    }
+    // A real broker answers in wall time, so virtual time must keep pace
+    if (!opt.brokerHost.empty()) opt.realtime = true;
+    return opt.seconds > 0 && opt.rateHz > 0 && opt.rateHz <= 1000;
+}
+
+uint64_t wallNs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/** Value of a numeric JSON field, 0 if absent. Enough for our own payloads. */
+uint32_t jsonField(const char* json, size_t length, const char* key) {
+    std::string text(json, length);
+    std::string needle = std::string("\"") + key + "\":";
+    size_t at = text.find(needle);
+    return at == std::string::npos ? 0 : (uint32_t)strtoul(text.c_str() + at + needle.size(), nullptr, 10);
+}
+
+uint32_t percentile(std::vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t i = (size_t)(p * (double)(sorted.size() - 1) + 0.5);
+    return sorted[i];
+}
+
+// Backlog acknowledgements from the backend, through the session callback
+SamplePublisher* ackTarget = nullptr;
+const char* ackTopic = nullptr;
+
+void onMessage(const char* topic, const uint8_t* payload, size_t length) {
+    if (ackTarget && MqttTopics::matches(topic, ackTopic)) {
+        ackTarget->acknowledge(jsonField((const char*)payload, length, "seq"));
+    }
+}
+
+/** FNV-1a over the replay outputs. */
+struct Checksum {
+    uint32_t hash = 2166136261u;
+
+    void add(const void* data, size_t length) {
+        const uint8_t* p = (const uint8_t*)data;
+        for (size_t i = 0; i < length; i++) hash = (hash ^ p[i]) * 16777619u;
+    }
+    void add(float value) { add(&value, sizeof(value)); }
+    void add(uint32_t value) { add(&value, sizeof(value)); }
+};
+
+/**
+ * --replay: the trace through SensorManager and what the acquisition task
+ * does with each sample (change detector, rollups, the threshold alerts on
+ * the per-second aggregate), with the default runtime configuration.
+ */
+int replayTrace(const Options& opt) {
+    FILE* file = fopen(opt.replayPath.c_str(), "rb");
+    if (!file) {
+        halLog("Cannot open %s\n", opt.replayPath.c_str());
+        return 1;
+    }
+    std::vector<uint8_t> bytes;
+    uint8_t chunk[4096];
+    while (size_t n = fread(chunk, 1, sizeof(chunk), file)) bytes.insert(bytes.end(), chunk, chunk + n);
+    fclose(file);
+
+    static TraceReplay replay;          // The vibration analyser is large
+    if (!replay.load(bytes.data(), bytes.size())) {
+        halLog("No sensor reads in %s\n", opt.replayPath.c_str());
+        return 1;
+    }
+    SensorManager sensors(replay.clock(), replay.ultrasonic(), replay.thermometer(), replay.accel());
+    if (!sensors.begin()) {
+        halLog("Replayed sensors failed self-test\n");
+        return 1;
+    }
+
+    const ChangeDetectorConfig detectorConfig = {
+        DETECTOR_BASELINE_ALPHA, DETECTOR_EWMA_LAMBDA, DETECTOR_EWMA_LIMIT,
+        DETECTOR_CUSUM_K, DETECTOR_CUSUM_H, DETECTOR_MAX_RATE_MM_S,
+        DETECTOR_SIGMA_FLOOR_MM, DETECTOR_WARMUP_SAMPLES, DETECTOR_HOLDOFF_MS,
+    };
+    const uint32_t aggregateMs = 1000;  // TELEMETRY_INTERVAL on the board
+    ChangeDetector detector(detectorConfig);
+    ChangeEvent change;
+    Rollups rollups;
+    RuntimeConfig config = defaultRuntimeConfig(opt.rateHz);
+    Checksum checksum;
+    uint32_t valid = 0;
+    uint32_t changes = 0;
+    uint32_t alerts = 0;
+    uint32_t buckets[ROLLUP_LEVELS] = {0, 0, 0};
+    bool first = true;
+    uint32_t lastAggregate = 0;
+    double bbwSum = 0.0;
+
+    uint64_t wallStart = wallNs();
+    size_t samples = replay.run(sensors, [&](const SensorData& data) {
+        if (data.bbw > 0) {
+            valid++;
+            bbwSum += (double)data.bbw;
+        }
+        checksum.add((uint32_t)data.timestamp);
+        checksum.add(data.bbw);
+        checksum.add(data.bbw_stddev);
+        checksum.add(data.temperature);
+        checksum.add(data.vibration);
+        checksum.add((uint32_t)data.quality);
+
+        if (detector.update(data.bbw, data.bbw > 0, data.timestamp, change) != ChangeKind::None) {
+            changes++;
+            checksum.add(change.timestamp);
+            checksum.add((uint32_t)change.kind);
+        }
+        rollups.add(data, [&](const RollupBucket& bucket) {
+            buckets[bucket.level]++;
+            checksum.add(bucket.start);
+            checksum.add(bucket.count);
+            checksum.add(bucket.mean);
+            checksum.add(bucket.m2);
+        });
+
+        if (first) {
+            first = false;
+            lastAggregate = data.timestamp;
+        } else if (data.timestamp - lastAggregate >= aggregateMs) {
+            lastAggregate = data.timestamp;
+            SensorData aggregate = sensors.getAggregated();
+            if (aggregate.bbw < config.bbwMin || aggregate.bbw > config.bbwMax) alerts++;
+            if (aggregate.temperature > config.temperatureMax) alerts++;
+            if (aggregate.vibration > config.vibrationMax) alerts++;
+            checksum.add(aggregate.bbw);
+        }
+    });
+    double wallS = (double)(wallNs() - wallStart) / 1e9;
+
+    const TraceReplay::Stats& stats = replay.stats();
+    double traceS = (double)stats.durationUs / 1e6;
+    printf("{\"samples\":%zu,\"trace_s\":%.3f,\"wall_s\":%.3f,\"samples_per_s\":%.0f,"
+           "\"speedup\":%.0f,\"valid\":%u,\"bbw_mean\":%.3f,\"outliers\":%u,"
+           "\"echo_timeouts\":%u,\"changes\":%u,\"alerts\":%u,"
+           "\"rollups\":{\"1s\":%u,\"1m\":%u,\"1h\":%u},"
+           "\"trace\":{\"chunks\":%u,\"lost_chunks\":%u,\"damaged_bytes\":%u,"
+           "\"accel_samples\":%u,\"states\":%u},\"checksum\":\"%08x\"}\n",
+           samples, traceS, wallS, wallS > 0 ? (double)samples / wallS : 0.0,
+           wallS > 0 ? traceS / wallS : 0.0, valid, valid ? bbwSum / valid : 0.0,
+           sensors.bbwOutliers(), sensors.echoTimeouts(),
+           changes, alerts,
+           buckets[0], buckets[1], buckets[2],
+           stats.chunks, stats.lostChunks, stats.damaged, stats.accelSamples, stats.states,
+           checksum.hash);
+    return 0;
+}
+
+}   // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseOptions(argc, argv, opt)) {
+        fprintf(stderr, "usage: %s [--seconds N] [--rate HZ] [--realtime] [--outage AT,LEN]\n"
+                "          [--link-outage AT,LEN] [--connect-delay MS] [--write-limit N]\n"
+                "          [--ack-delay MS] [--no-raw] [--broker HOST:PORT] [--record FILE]\n"
+                "       %s --replay FILE\n", argv[0], argv[0]);
+        return 2;
+    }
+    if (!opt.replayPath.empty()) return replayTrace(opt);
+    const uint32_t periodUs = 1000000 / opt.rateHz;
+    const uint32_t total = opt.seconds * opt.rateHz;
+
+    // Simulated board: beat-up oscillation on the BBW, 25 Hz loom vibration
+    SimClock clock;
+    SimUltrasonic ultrasonic(clock, [](uint32_t ms) {
+        return 120.0f + 0.4f * sinf(6.2831853f * 8.0f * (float)ms / 1000.0f);
+    });
+    SimTemperature thermometer(24.5f);
+    ultrasonic.setAirTemperature(24.5f);       // Same air as the thermometer
+    SimAccel accel(clock, 0.2f, 25.0f);
+    // Motor current with a 150 Hz drive ripple; warp tension pulsing with each
+    // beat-up (8 Hz) over a slow 0.5 Hz let-off swing
+    SimAnalog analog(clock, {
+        [](double t) { return (float)(1600.0 + 120.0 * sin(2 * M_PI * 150.0 * t)); },
+        [](double t) {
+            return (float)(2000.0 + 300.0 * sin(2 * M_PI * 0.5 * t) +
+                           150.0 * sin(2 * M_PI * 8.0 * t));
+        },
+    });
+    SimBrokerStream broker(clock);
+    broker.setWriteLimit(opt.writeLimit);
+    broker.setAckDelay(opt.ackDelayMs);
+    broker.setConnectDelay(opt.connectDelayMs);
+    SimLink wifi(clock);
+    PosixNetStream tcp;
+    const bool external = !opt.brokerHost.empty();
+
+    static uint8_t controlQueue[MQTT_QUEUE_CONTROL_BYTES] __attribute__((aligned(4)));
+    static uint8_t liveQueue[MQTT_QUEUE_LIVE_BYTES] __attribute__((aligned(4)));
+    static uint8_t bulkQueue[MQTT_QUEUE_BULK_BYTES] __attribute__((aligned(4)));
+    MqttSession session(external ? (NetStream&)tcp : (NetStream&)broker, clock);
+    session.setQueue(MqttPriority::Control, controlQueue, sizeof(controlQueue));
+    session.setQueue(MqttPriority::Live, liveQueue, sizeof(liveQueue));
+    session.setQueue(MqttPriority::Bulk, bulkQueue, sizeof(bulkQueue));
+    session.setCallback(onMessage);
+    ConnectionManager connection(wifi, session, clock);
+    connection.setBroker(external ? opt.brokerHost.c_str() : "sim", opt.brokerPort, "kaldor-sim",
+                         nullptr, nullptr);
+
+    SensorManager sensors(clock, ultrasonic, thermometer, accel);
+    AnalogFrontEnd analogInputs(analog, clock);
+    DataBuffer buffer;
+    Backfill backfill(BACKFILL_INTERVAL_MS, BACKFILL_ACK_TIMEOUT_MS, BACKFILL_WINDOW);
+    ReportFilter filter(REPORT_DEADBAND_MM, REPORT_DEADBAND_PCT, REPORT_MAX_SILENCE_MS);
+    RuntimeConfig config = defaultRuntimeConfig(opt.rateHz);
+    config.publishRaw = !opt.noRaw;
+    MqttTopics topics;
+    topics.build("sim");
+    static char payloadBuffer[MQTT_MAX_PACKET_SIZE - MQTT_TOPIC_SIZE];
+    PayloadWriter payload(payloadBuffer, sizeof(payloadBuffer));
+    SamplePublisher publisher(session, clock, buffer, backfill, filter, config, topics, payload);
+    RollupPublisher rollupPublisher(session, topics, payload);
+    Rollups rollups;
+
+    // --record: the raw inputs of the run, written out by the network loop
+    static SensorTrace trace;
+    FILE* recording = nullptr;
+    if (!opt.recordPath.empty()) {
+        recording = fopen(opt.recordPath.c_str(), "wb");
+        if (!recording) {
+            halLog("Cannot create %s\n", opt.recordPath.c_str());
+            return 1;
+        }
+        sensors.setTrace(&trace);
+        trace.start();
+    }
+    TraceChunk traceChunk;
+
+    if (!sensors.begin()) {
+        halLog("Simulated sensors failed self-test\n");
+        return 1;
+    }
+    analogInputs.configure(0, ANALOG_CURRENT_OUTPUT_HZ, ANALOG_CURRENT_SCALE, ANALOG_CURRENT_OFFSET);
+    analogInputs.configure(1, ANALOG_TENSION_OUTPUT_HZ, ANALOG_TENSION_SCALE, ANALOG_TENSION_OFFSET);
+    analogInputs.begin();
+    buffer.begin(MAX_BUFFER_SIZE, 0);
+    buffer.clear();         // Don't replay a previous run's journal
+    publisher.begin("kaldor-sim", "sim", deviceIdHash("kaldor-sim"));
+    rollupPublisher.begin("kaldor-sim", "sim");
+    ackTarget = &publisher;
+    ackTopic = topics.backlogAck;
+    connection.begin(deviceIdHash("kaldor-sim"));
+
+    // Wall time each sample was read, by index from the first timestamp
+    std::vector<std::atomic<uint64_t>> readAt(total + 1);
+    std::vector<uint32_t> latencyUs;
+    latencyUs.reserve(total);
+    const uint32_t firstTimestamp = clock.millis();
+    const uint32_t periodMs = periodUs / 1000 ? periodUs / 1000 : 1;
+
+    uint32_t livePublished = 0;
+    uint32_t backlogDelivered = 0;
+    uint32_t rollupsDelivered[ROLLUP_LEVELS] = {0, 0, 0};
+    uint64_t rollupBytes = 0;
+
+    auto indexOf = [&](uint32_t timestamp) -> size_t {
+        return (size_t)((timestamp - firstTimestamp) / periodMs);
+    };
+    auto recordLatency = [&](uint32_t timestamp, uint64_t now) {
+        size_t i = indexOf(timestamp);
+        if (i < readAt.size()) {
+            uint64_t at = readAt[i].load();
+            if (at) latencyUs.push_back((uint32_t)((now - at) / 1000));
+        }
+    };
+
+    broker.onPublish([&](const char* topic, const uint8_t* data, size_t length) {
+        uint64_t now = wallNs();
+        if (MqttTopics::matches(topic, topics.raw)) {
+            livePublished++;
+            recordLatency(jsonField((const char*)data, length, "timestamp"), now);
+        } else if (MqttTopics::matches(topic, topics.rawFrame)) {
+            TelemetryFrameDecoder frame;
+            FrameSample sample;
+            if (!frame.begin(data, length)) return;
+            while (frame.next(sample)) {
+                livePublished++;
+                recordLatency(sample.timestamp, now);
+            }
+        } else if (MqttTopics::matches(topic, topics.backlog)) {
+            uint32_t first = jsonField((const char*)data, length, "first_seq");
+            uint32_t last = jsonField((const char*)data, length, "last_seq");
+            backlogDelivered += last - first + 1;
+            char ack[32];       // The backend's answer, read by the session next pass
+            snprintf(ack, sizeof(ack), "{\"seq\":%u}", last);
+            broker.deliver(topics.backlogAck, ack);
+        } else {
+            for (uint8_t l = 0; l < ROLLUP_LEVELS; l++) {
+                if (MqttTopics::matches(topic, topics.rollup[l])) {
+                    rollupsDelivered[l]++;
+                    rollupBytes += length;
+                }
+            }
+        }
+    });
+
+    SpscRing<SensorData, 256> sampleRing;
+    SpscRing<RollupBucket, 16> rollupRing;
+    std::atomic<bool> acquisitionDone(false);
+    std::atomic<bool> stop(false);
+    std::atomic<uint32_t> ringFullWaits(0);
+    AnalogSummary analogSummary = AnalogSummary();
+    uint64_t analogNs = 0;
+    uint64_t analogConversions = 0;
+
+    // Acquisition: one sample per period of virtual time
+    std::thread acquisition([&]() {
+        uint64_t start = wallNs();
+        for (uint32_t i = 0; i < total; i++) {
+            if (opt.realtime) {
+                uint64_t due = start + (uint64_t)i * periodUs * 1000;
+                while (wallNs() < due) std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+
+            SensorData data = sensors.read();
+            size_t index = indexOf(data.timestamp);
+            if (index < readAt.size()) readAt[index].store(wallNs());
+
+            // Simulation only: wait for the consumer instead of dropping,
+            // so the run measures the pipeline rather than the ring size
+            while (!sampleRing.push(data)) {
+                ringFullWaits++;
+                std::this_thread::yield();
+            }
+            // and, under --record, for room in the trace rings
+            while (recording && (trace.lane(TraceLane::Acquisition).queued() >= TRACE_RING_CHUNKS - 1 ||
+                                 trace.lane(TraceLane::Accel).queued() >= TRACE_RING_CHUNKS - 1)) {
+                std::this_thread::yield();
+            }
+
+            rollups.add(data, [&](const RollupBucket& bucket) {
+                while (!rollupRing.push(bucket)) std::this_thread::yield();
+            });
+
+            sensors.drainAccelerometer();
+
+            uint64_t analogStart = wallNs();
+            while (size_t n = analogInputs.poll(0)) analogConversions += n;
+            analogNs += wallNs() - analogStart;
+            sensors.setAnalogLevels(analogInputs.latest(0), analogInputs.latest(1));
+            analogInputs.takeSummary(analogSummary);
+            clock.advance(periodUs);
+        }
+        acquisitionDone = true;
+    });
+
+    // Vibration analysis on completed accelerometer blocks
+    std::thread vibration([&]() {
+        const float bandEdges[] = VIBRATION_BAND_EDGES_HZ;
+        static VibrationAnalyzer<VIBRATION_BLOCK_SIZE> analyzer(
+            VIBRATION_SAMPLE_RATE_HZ, bandEdges, sizeof(bandEdges) / sizeof(bandEdges[0]));
+        VibrationFeatures features;
+        while (!stop.load()) {
+            uint32_t timestamp;
+            const int16_t* block = sensors.vibrationBlock(timestamp);
+            if (!block) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            analyzer.analyze(block, SensorManager::ACCEL_G_PER_COUNT, features);
+            sensors.releaseVibrationBlock();
+            sensors.setVibrationLevel(features.rms);
+        }
+    });
+
+    // Network loop, on this thread
+    const uint64_t outageStartMs = (uint64_t)opt.outageAt * 1000;
+    const uint64_t outageEndMs = outageStartMs + (uint64_t)opt.outageFor * 1000;
+    const uint64_t linkOutageStartMs = (uint64_t)opt.linkOutageAt * 1000;
+    const uint64_t linkOutageEndMs = linkOutageStartMs + (uint64_t)opt.linkOutageFor * 1000;
+    uint64_t wallStart = wallNs();
+    uint64_t wallEnd = 0;
+    uint32_t consumed = 0;
+
+    for (;;) {
+        uint64_t virtualMs = clock.elapsedUs() / 1000;
+        bool online = opt.outageFor == 0 || virtualMs < outageStartMs || virtualMs >= outageEndMs;
+        broker.setOnline(online);
+        wifi.setAvailable(opt.linkOutageFor == 0 || virtualMs < linkOutageStartMs ||
+                          virtualMs >= linkOutageEndMs);
+
+        // Join and reconnect with backoff, like the firmware
+        connection.loop();
+        if (!session.connected()) backfill.stop();
+        session.loop();
+        if (session.justConnected()) {
+            session.subscribe(topics.backlogAck, 1);
+            publisher.onConnect();
+        }
+
+        // A bounded batch per pass: unpaced acquisition would otherwise
+        // keep this loop busy and the outage would never end, and a whole
+        // ring at once overflows the session queue the board drains every
+        // millisecond
+        SensorData data;
+        bool worked = false;
+        for (size_t n = 0; n < 32 && sampleRing.pop(data); n++) {
+            publisher.publish(data);
+            consumed++;
+            worked = true;
+        }
+        publisher.flush();
+        publisher.drainBacklog();
+        RollupBucket bucket;
+        while (rollupRing.pop(bucket)) {
+            rollupPublisher.publish(bucket, config.rollupLevels);
+            worked = true;
+        }
+        rollupPublisher.drain();
+        while (recording && trace.next(traceChunk)) {
+            fwrite(traceChunk.data, 1, traceChunk.length, recording);
+        }
+
+        if (acquisitionDone.load() && sampleRing.empty()) {
+            if (!wallEnd) wallEnd = wallNs();
+            // Let the backfill and the session queues finish; nothing else
+            // moves the clock now. Samples read before the first connect
+            // wait in the backlog, which a real broker (no backend behind
+            // it) never acknowledges
+            bool drained = (buffer.size() == 0 || external) && session.inFlightMessages() == 0 &&
+                           session.queuedBytes(MqttPriority::Live) == 0;
+            uint64_t lastOutageEndMs = std::max(outageEndMs, linkOutageEndMs);
+            if (drained || clock.elapsedUs() / 1000 > lastOutageEndMs + 600000) {
+                break;
+            }
+            clock.advance(1000);
+            if (opt.realtime) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        } else if (!worked) {
+            std::this_thread::yield();
+        }
+    }
+    publisher.flush();
+    session.loop();
+    stop = true;
+    acquisition.join();
+    vibration.join();
+    if (recording) {
+        // The producers are done: close their last chunks from here
+        trace.stop();
+        trace.lane(TraceLane::Acquisition).ready(clock.millis(), clock.micros());
+        trace.lane(TraceLane::Accel).ready(clock.millis(), clock.micros());
+        while (trace.next(traceChunk)) fwrite(traceChunk.data, 1, traceChunk.length, recording);
+        fclose(recording);
+        halLog("Trace: %u chunks, %u dropped\n", trace.chunks(), trace.dropped());
+    }
+
+    std::sort(latencyUs.begin(), latencyUs.end());
+    const MqttStats& stats = session.stats();
+    const ConnectionStats& links = connection.stats();
+    HistogramSnapshot queued, acked;
+    session.queueLatency().snapshot(queued);
+    session.ackLatency().snapshot(acked);
+    double wallS = (double)(wallEnd - wallStart) / 1e9;
+    printf("{\"samples\":%u,\"rate_hz\":%u,\"realtime\":%s,\"wall_s\":%.3f,"
+           "\"samples_per_s\":%.0f,\"published\":%u,\"backlog_delivered\":%u,"
+           "\"still_buffered\":%u,\"ring_full_waits\":%u,"
+           "\"latency_us\":{\"p50\":%u,\"p99\":%u,\"max\":%u},"
+           "\"publishes\":%u,\"bytes\":%llu,\"fifo_overruns\":%u,"
+           "\"mqtt\":{\"queued\":%u,\"rejected\":%u,\"sent\":%u,\"acked\":%u,"
+           "\"retransmits\":%u,\"ack_timeouts\":%u,\"connects\":%u,"
+           "\"queue_p99_us\":%u,\"ack_p99_us\":%u},"
+           "\"connection\":{\"joins\":%u,\"connects\":%u,\"connect_failures\":%u,"
+           "\"connect_ms\":%u,\"max_outage_ms\":%u},"
+           "\"analog\":{\"conversions\":%llu,\"overruns\":%u,\"filter_ns_per_conversion\":%.1f,"
+           "\"motor_current_a\":%.3f,\"warp_tension_n\":%.1f,\"outputs\":[%u,%u]},"
+           "\"rollups\":{\"1s\":%u,\"1m\":%u,\"1h\":%u,\"bytes\":%llu,\"pending\":%u,"
+           "\"dropped\":%u}}\n",
+           consumed, opt.rateHz, opt.realtime ? "true" : "false", wallS,
+           wallS > 0 ? (double)consumed / wallS : 0.0, livePublished, backlogDelivered,
+           (unsigned)buffer.size(), ringFullWaits.load(),
+           percentile(latencyUs, 0.5), percentile(latencyUs, 0.99),
+           latencyUs.empty() ? 0 : latencyUs.back(),
+           broker.publishes(), (unsigned long long)broker.bytes(), sensors.fifoOverruns(),
+           stats.queued, stats.rejected, stats.sent, stats.acked, stats.retransmits,
+           stats.ackTimeouts, stats.connects, queued.percentile(0.99f), acked.percentile(0.99f),
+           links.joins, links.connects, links.connectFailures, links.lastConnectMs,
+           links.maxOutageMs,
+           (unsigned long long)analogConversions, analogInputs.overruns(),
+           analogConversions ? (double)analogNs / (double)analogConversions : 0.0,
+           (double)analogSummary.channel[0].mean, (double)analogSummary.channel[1].mean,
+           analogSummary.channel[0].outputs, analogSummary.channel[1].outputs,
+           rollupsDelivered[0], rollupsDelivered[1], rollupsDelivered[2],
+           (unsigned long long)rollupBytes, (unsigned)rollupPublisher.pendingCount(),
+           rollupPublisher.dropped());
+
+    return 0;
+}
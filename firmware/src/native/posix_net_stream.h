@@ -0,0 +1,85 @@
+/**
+ * Kaldor IIoT - POSIX TCP NetStream
+ *
+ * Plain TCP to a real broker for the native simulation (--broker), e.g. a
+ * local mosquitto. Connecting blocks; afterwards the socket is
+ * non-blocking, so write() and read() return whatever the kernel takes or
+ * has right now, like the board's stream.
+ */
+
+#ifndef POSIX_NET_STREAM_H
+#define POSIX_NET_STREAM_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "hal.h"
+
+class PosixNetStream : public NetStream {
+private:
+    int fd;
+
+    bool failed(ssize_t n) {
+        if (n > 0) return false;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return false;
+        stop();                             // Error, or closed by the broker
+        return true;
+    }
+
+public:
+    PosixNetStream() : fd(-1) {}
+    ~PosixNetStream() override { stop(); }
+
+    bool connect(const char* host, uint16_t port) override {
+        stop();
+        char service[8];
+        snprintf(service, sizeof(service), "%u", port);
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* found = nullptr;
+        if (getaddrinfo(host, service, &hints, &found) != 0) return false;
+
+        for (addrinfo* a = found; a && fd < 0; a = a->ai_next) {
+            fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (fd < 0) continue;
+            if (::connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(found);
+        if (fd < 0) return false;
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        return true;
+    }
+
+    bool connected() override { return fd >= 0; }
+
+    size_t write(const uint8_t* data, size_t length) override {
+        if (fd < 0 || length == 0) return 0;
+        ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+        return failed(n) || n < 0 ? 0 : (size_t)n;
+    }
+
+    size_t read(uint8_t* data, size_t length) override {
+        if (fd < 0 || length == 0) return 0;
+        ssize_t n = recv(fd, data, length, 0);
+        return failed(n) || n < 0 ? 0 : (size_t)n;
+    }
+
+    void stop() override {
+        if (fd >= 0) close(fd);
+        fd = -1;
+    }
+};
+
+#endif // POSIX_NET_STREAM_H
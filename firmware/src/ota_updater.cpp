@@ -4,16 +4,22 @@
 
 #include "ota_updater.h"
 
-OTAUpdater::OTAUpdater() : updateInProgress(false) {}
+OTAUpdater::OTAUpdater(HalClock& clock)
+    : stream(), slot(), download(stream, slot, clock, window, sizeof(window)), task(nullptr),
+      seed(0), beforeUpload(nullptr), lock(portMUX_INITIALIZER_UNLOCKED), startRequested(false),
+      cancelRequested(false), snapshot() {
+    pendingUrl[0] = '\0';
+}
 
-void OTAUpdater::begin(const String& devId) {
+void OTAUpdater::begin(const String& devId, uint32_t retrySeed) {
     deviceId = devId;
+    seed = retrySeed;
 
     // Configure ArduinoOTA
     ArduinoOTA.setHostname(deviceId.c_str());
     ArduinoOTA.setPassword("kaldor_ota_2024");
 
-    ArduinoOTA.onStart([]() {
+    ArduinoOTA.onStart([this]() {
         String type;
         if (ArduinoOTA.getCommand() == U_FLASH) {
             type = "sketch";
@@ -21,6 +27,9 @@ void OTAUpdater::begin(const String& devId) {
             type = "filesystem";
         }
         Serial.println("Start updating " + type);
+        if (beforeUpload) {
+            beforeUpload();
+        }
     });
 
     ArduinoOTA.onEnd([]() {
@@ -47,35 +56,65 @@ void OTAUpdater::handle() {
     ArduinoOTA.handle();
 }
 
-void OTAUpdater::update(const String& url) {
-    Serial.println("Starting HTTP OTA update from: " + url);
-    updateInProgress = true;
+bool OTAUpdater::busy() const {
+    return startRequested || snapshot.state == OtaState::Connecting ||
+           snapshot.state == OtaState::Downloading || snapshot.state == OtaState::Retrying;
+}
 
-    WiFiClient client;
-    httpUpdate.setLedPin(LED_BUILTIN, LOW);
+bool OTAUpdater::request(const char* url) {
+    if (strlen(url) >= sizeof(pendingUrl)) return false;
+    bool accepted;
+    portENTER_CRITICAL(&lock);
+    accepted = !busy();
+    if (accepted) {
+        strcpy(pendingUrl, url);
+        startRequested = true;
+    }
+    portEXIT_CRITICAL(&lock);
+    if (accepted && task) xTaskNotifyGive(task);
+    return accepted;
+}
 
-    t_httpUpdate_return ret = httpUpdate.update(client, url);
+void OTAUpdater::cancel() {
+    portENTER_CRITICAL(&lock);
+    cancelRequested = true;
+    portEXIT_CRITICAL(&lock);
+    if (task) xTaskNotifyGive(task);
+}
 
-    switch (ret) {
-        case HTTP_UPDATE_FAILED:
-            Serial.printf("HTTP_UPDATE_FAILED Error (%d): %s\n",
-                httpUpdate.getLastError(),
-                httpUpdate.getLastErrorString().c_str());
-            break;
+OtaProgress OTAUpdater::progress() {
+    portENTER_CRITICAL(&lock);
+    OtaProgress copy = snapshot;
+    portEXIT_CRITICAL(&lock);
+    return copy;
+}
 
-        case HTTP_UPDATE_NO_UPDATES:
-            Serial.println("HTTP_UPDATE_NO_UPDATES");
-            break;
+bool OTAUpdater::isUpdateInProgress() {
+    portENTER_CRITICAL(&lock);
+    bool running = busy();
+    portEXIT_CRITICAL(&lock);
+    return running;
+}
 
-        case HTTP_UPDATE_OK:
-            Serial.println("HTTP_UPDATE_OK");
-            ESP.restart();
-            break;
+bool OTAUpdater::service() {
+    char url[OTA_URL_SIZE];
+    portENTER_CRITICAL(&lock);
+    bool start = startRequested;
+    bool stop = cancelRequested;
+    if (start) strcpy(url, pendingUrl);
+    cancelRequested = false;
+    portEXIT_CRITICAL(&lock);
+
+    if (stop) download.cancel();
+    if (start) {
+        Serial.printf("Firmware download from %s\n", url);
+        download.start(url, seed);
     }
+    bool worked = download.poll();
 
-    updateInProgress = false;
-}
-
-bool OTAUpdater::isUpdateInProgress() {
-    return updateInProgress;
+    portENTER_CRITICAL(&lock);
+    snapshot = download.status();
+    if (start) startRequested = false;      // Only now does the snapshot show it
+    portEXIT_CRITICAL(&lock);
+    return worked;
 }
@@ -0,0 +1,186 @@
+/**
+ * Kaldor IIoT - Raw Sample Publishing Implementation
+ */
+
+#include "sample_publisher.h"
+
+SamplePublisher::SamplePublisher(MqttTransport& mqtt, HalClock& clock, DataBuffer& buffer,
+                                 Backfill& backfill, ReportFilter& filter,
+                                 const RuntimeConfig& config, const MqttTopics& topics,
+                                 PayloadWriter& payload)
+    : mqtt(mqtt), clock(clock), buffer(buffer), backfill(backfill), filter(filter),
+      config(config), topics(topics), payload(payload), deviceId(""), loomId(""),
+      timers(nullptr)
+#if RAW_BINARY_FRAMES
+      , rawFrame(rawFrameBuffer, RAW_FRAME_CAPACITY), deviceHash(0),
+      rawFrameSequence(0), rawFrameStarted(0)
+#endif
+{}
+
+void SamplePublisher::begin(const char* device, const char* loom, uint32_t hash) {
+    deviceId = device;
+    loomId = loom;
+#if RAW_BINARY_FRAMES
+    deviceHash = hash;
+#else
+    (void)hash;
+#endif
+}
+
+void SamplePublisher::publish(const SensorData& data) {
+    // Looms that only need rollups neither publish nor buffer raw samples
+    if (!config.publishRaw) {
+        return;
+    }
+
+    // Report-by-exception: skip samples inside the deadband. Readings
+    // outside the alarm range always go out.
+    bool valid = data.bbw > 0;
+    bool alarm = valid && (data.bbw < config.bbwMin || data.bbw > config.bbwMax);
+    if (!filter.shouldReport(data.bbw, valid, data.timestamp, alarm)) {
+        return;
+    }
+
+    // Offline: keep the sample for backfill after reconnect
+    if (!mqtt.connected()) {
+#if RAW_BINARY_FRAMES
+        // A frame begun before the outage is buffered first, in order
+        if (!rawFrame.empty()) {
+            flushRawFrame();
+        }
+#endif
+        bufferSample(data);
+        return;
+    }
+
+#if RAW_BINARY_FRAMES
+    addToRawFrame(data);
+#else
+    uint32_t started = startTimer();
+    bool written = writeRawSample(payload, data, deviceId);
+    stopTimer(Stage::Serialise, started);
+
+    started = startTimer();
+    bool sent = written &&
+                mqtt.publish(topics.raw, payload.c_str(), false, MQTT_QOS_RAW, MqttPriority::Live);
+    stopTimer(Stage::Publish, started);
+    if (!sent) {
+        bufferSample(data);
+    }
+#endif
+}
+
+void SamplePublisher::bufferSample(const SensorData& data) {
+    uint32_t started = startTimer();
+    buffer.add(data);
+    stopTimer(Stage::Buffer, started);
+}
+
+void SamplePublisher::flush() {
+#if RAW_BINARY_FRAMES
+    // Don't hold a partial frame back for too long
+    if (!rawFrame.empty() && clock.millis() - rawFrameStarted >= RAW_FRAME_MAX_AGE_MS) {
+        flushRawFrame();
+    }
+#endif
+}
+
+bool SamplePublisher::persist() {
+#if RAW_BINARY_FRAMES
+    // Published now, the frame could still be queued at the restart;
+    // buffered, it goes out with the backlog
+    for (uint16_t i = 0; i < rawFrame.count(); i++) {
+        bufferSample(rawFrameSamples[i]);
+    }
+    rawFrame.clear();
+#endif
+    return buffer.saveToFile();
+}
+
+#if RAW_BINARY_FRAMES
+void SamplePublisher::addToRawFrame(const SensorData& data) {
+    uint32_t started = startTimer();
+    if (rawFrame.empty()) {
+        rawFrame.begin(deviceHash, data.timestamp, rawFrameSequence);
+        rawFrameStarted = clock.millis();
+    }
+
+    if (!rawFrame.add(data.timestamp, data.bbw, data.quality)) {
+        // Frame full - send it and start the next one with this sample
+        flushRawFrame();
+        rawFrame.begin(deviceHash, data.timestamp, rawFrameSequence);
+        rawFrameStarted = clock.millis();
+        rawFrame.add(data.timestamp, data.bbw, data.quality);
+    }
+    rawFrameSamples[rawFrame.count() - 1] = data;
+
+    stopTimer(Stage::Serialise, started);
+
+    if (rawFrame.count() >= RAW_FRAME_MAX_SAMPLES) {
+        flushRawFrame();
+    }
+}
+
+/**
+ * Publish the frame. One that cannot go out (offline, or the live queue
+ * is full) has its samples buffered for backfill, as the JSON path does,
+ * and its sequence number is reused by the next frame.
+ */
+void SamplePublisher::flushRawFrame() {
+    bool sent = false;
+    if (mqtt.connected()) {
+        uint32_t started = startTimer();
+        sent = mqtt.publish(topics.rawFrame, rawFrame.data(), rawFrame.size(), false,
+                            MQTT_QOS_RAW, MqttPriority::Live);
+        stopTimer(Stage::Publish, started);
+    }
+    if (sent) {
+        rawFrameSequence++;
+    } else {
+        for (uint16_t i = 0; i < rawFrame.count(); i++) {
+            bufferSample(rawFrameSamples[i]);
+        }
+    }
+    rawFrame.clear();
+}
+#endif
+
+void SamplePublisher::onConnect() {
+    // Start forwarding whatever was buffered while offline
+    backfill.start(buffer.oldestSequence(), clock.millis());
+
+    // Let the subscriber see the current value straight away
+    filter.reset();
+}
+
+/**
+ * Send the next batch of buffered records on the backlog topic, if the
+ * backfill rate limit and acknowledgement window allow it. At most one
+ * batch per pass so live samples keep flowing.
+ */
+void SamplePublisher::drainBacklog() {
+    if (!mqtt.connected() ||
+        !backfill.due(buffer.nextSequence(), clock.millis())) {
+        return;
+    }
+
+    uint32_t started = startTimer();
+    SensorData records[BACKFILL_BATCH_SIZE];
+    uint32_t seqs[BACKFILL_BATCH_SIZE];
+    size_t n = buffer.readBacklog(backfill.nextToSend(), records, seqs, BACKFILL_BATCH_SIZE);
+    if (n > 0) {
+        if (!writeBacklogBatch(payload, deviceId, loomId, records, seqs, n)) {
+            halLog("Backlog batch does not fit the payload buffer\n");
+        } else if (mqtt.publish(topics.backlog, payload.c_str(), false, MQTT_QOS_BACKLOG,
+                                MqttPriority::Bulk)) {
+            backfill.sent(seqs[n - 1], clock.millis());
+        }
+    }
+    stopTimer(Stage::Backlog, started);     // Every pass that read the buffer
+}
+
+void SamplePublisher::acknowledge(uint32_t seq) {
+    if (backfill.acknowledge(seq, clock.millis())) {
+        buffer.acknowledge(seq);
+    }
+}
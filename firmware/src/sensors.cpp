@@ -2,46 +2,63 @@
  * Kaldor IIoT - Sensor Implementation
  */
 
+// Everything from the echo to the statistics is single precision: the
+// ESP32's FPU has no double support, so a stray double (an unsuffixed
+// literal, a promoted argument) would be emulated in software. Any
+// promotion in this file or the headers it includes fails the build.
+#pragma GCC diagnostic error "-Wdouble-promotion"
+#pragma GCC diagnostic error "-Wfloat-conversion"
+
 #include "sensors.h"
 #include "config.h"
 #include <math.h>
 
-SensorManager::SensorManager()
-    : accel(12345), dht(DHT_PIN, DHT_TYPE), readingIndex(0), numReadings(0),
-      bbw_sum(0), bbw_sum_sq(0), current_min(9999), current_max(0) {
-
-    for (int i = 0; i < 100; i++) {
-        bbwReadings[i] = 0;
-    }
-}
+// Template bodies are only checked where explicitly instantiated
+template class RollingWindow<float, BBW_WINDOW_SIZE>;
+template class HampelFilter<OUTLIER_WINDOW>;
+template class SlidingMedian<OUTLIER_WINDOW>;
+
+SensorManager::SensorManager(HalClock& clock, UltrasonicPort& ultrasonic,
+                             TemperaturePort& thermometer, AccelPort& accel)
+    : clock(clock), ultrasonic(ultrasonic), thermometer(thermometer), accel(accel),
+      echo(ULTRASONIC_TIMEOUT_US, ULTRASONIC_DEADLINE_US),
+      calibrationOffset(BBW_CALIBRATION_OFFSET), calibrationScale(BBW_CALIBRATION_SCALE),
+      bbwFilter(OUTLIER_THRESHOLD, OUTLIER_MIN_SIGMA_MM),
+      outlierThreshold(OUTLIER_THRESHOLD), outlierMinSigma(OUTLIER_MIN_SIGMA_MM),
+      airTemperature(20.0f),
+      lastSlowRead(0), vibrationRms(0), motorCurrent(0), warpTension(0), accelReady(false),
+      fifoOverrunCount(0), accelReadErrorCount(0), timers(nullptr), trace(nullptr),
+      traceStateChanged(false) {}
 
 bool SensorManager::begin() {
     bool success = true;
 
-    // Initialize ultrasonic sensor pins
-    pinMode(ULTRASONIC_TRIG, OUTPUT);
-    pinMode(ULTRASONIC_ECHO, INPUT);
-    digitalWrite(ULTRASONIC_TRIG, LOW);
+    // Initialize ultrasonic sensor; echo edges are timestamped into echo
+    if (!ultrasonic.begin(echo)) {
+        halLog("  ✗ Ultrasonic sensor setup failed\n");
+        success = false;
+    }
 
-    // Initialize DHT sensor
-    dht.begin();
-    Serial.println("  ✓ Temperature sensor initialized");
+    // Initialize DHT sensor; its first reading sets the speed of sound
+    thermometer.begin();
+    updateAirTemperature(readTemperature());
+    halLog("  ✓ Temperature sensor initialized\n");
 
-    // Initialize accelerometer
-    if (!accel.begin()) {
-        Serial.println("  ✗ ADXL345 not found");
+    // Initialize accelerometer: stream-mode FIFO with watermark interrupt
+    if (!accel.begin(VIBRATION_SAMPLE_RATE_HZ, ACCEL_FIFO_WATERMARK)) {
+        halLog("  ✗ ADXL345 not found\n");
         success = false;
     } else {
-        accel.setRange(ADXL345_RANGE_16_G);
-        Serial.println("  ✓ Accelerometer initialized");
+        accelReady = true;
+        halLog("  ✓ Accelerometer initialized (%d Hz)\n", VIBRATION_SAMPLE_RATE_HZ);
     }
 
     // Perform self-test
     if (!selfTest()) {
-        Serial.println("  ⚠ Sensor self-test failed");
+        halLog("  ⚠ Sensor self-test failed\n");
         success = false;
     } else {
-        Serial.println("  ✓ Sensor self-test passed");
+        halLog("  ✓ Sensor self-test passed\n");
     }
 
     return success;
@@ -49,74 +66,136 @@ bool SensorManager::begin() {
 
 SensorData SensorManager::read() {
     SensorData data;
-    data.timestamp = millis();
+    data.timestamp = clock.millis();
+    TraceWriter* traced = traceLane(TraceLane::Acquisition);
+    if (traced) traced->read(clock.micros());
 
     // Read BBW from ultrasonic sensor
-    data.bbw = readUltrasonic();
-
-    // Apply calibration
-    data.bbw = (data.bbw + BBW_CALIBRATION_OFFSET) * BBW_CALIBRATION_SCALE;
+    data.bbw = readUltrasonic(traced);
 
-    // Update rolling statistics
-    bbwReadings[readingIndex] = data.bbw;
-    readingIndex = (readingIndex + 1) % 100;
-    if (numReadings < 100) numReadings++;
+    // Apply calibration (invalid readings stay negative)
+    if (data.bbw > 0) {
+        data.bbw = (data.bbw + calibrationOffset) * calibrationScale;
+    }
 
-    updateStatistics();
+    // Replace spikes and multipath echoes with the recent median; the
+    // statistics and everything downstream see the filtered value
+    data.bbw_raw = data.bbw;
+    data.bbw_outlier = false;
+    if (data.bbw > 0) {
+        uint32_t filterStart = timers ? timers->start() : 0;
+        data.bbw = bbwFilter.apply(data.bbw, data.bbw_outlier);
+        if (timers) timers->stop(Stage::Filter, filterStart);
+    }
 
     // Read other sensors at lower frequency
-    static unsigned long lastSlowRead = 0;
-    if (millis() - lastSlowRead > 1000) {
-        lastSlowRead = millis();
-        data.temperature = readTemperature();
-        data.vibration = readVibration();
+    uint32_t now = clock.millis();
+    if (now - lastSlowRead > 1000) {
+        lastSlowRead = now;
+        float temp = readTemperature();
+        if (traced) traced->temperature(clock.micros(), temp);
+        temperatureWindow.push(temp, temp > -999);
+        updateAirTemperature(temp);
+        vibrationWindow.push(readVibration());
     }
 
-    data.quality = calculateQuality();
+    // Update rolling statistics (O(1) per sample)
+    uint32_t statsStart = timers ? timers->start() : 0;
+    bbwWindow.push(data.bbw, data.bbw > 0);
+    fillStatistics(data);
+    if (timers) timers->stop(Stage::Stats, statsStart);
+    data.temperature = temperatureWindow.latest();
+    data.vibration = vibrationWindow.latest();
+    data.motor_current = motorCurrent.load();
+    data.warp_tension = warpTension.load();
 
     return data;
 }
 
 SensorData SensorManager::getAggregated() {
     SensorData data;
-    data.timestamp = millis();
-
-    data.bbw = current_avg;
-    data.bbw_min = current_min;
-    data.bbw_max = current_max;
-    data.bbw_stddev = current_stddev;
-    data.temperature = readTemperature();
-    data.vibration = readVibration();
-    data.quality = calculateQuality();
+    data.timestamp = clock.millis();
+
+    fillStatistics(data);
+    data.bbw = bbwWindow.mean();
+    data.bbw_raw = data.bbw;
+    data.bbw_outlier = false;
+    data.temperature = temperatureWindow.mean();
+    data.vibration = vibrationWindow.mean();
+    data.motor_current = motorCurrent.load();
+    data.warp_tension = warpTension.load();
 
     return data;
 }
 
-float SensorManager::readUltrasonic() {
-    // Send trigger pulse
-    digitalWrite(ULTRASONIC_TRIG, LOW);
-    delayMicroseconds(2);
-    digitalWrite(ULTRASONIC_TRIG, HIGH);
-    delayMicroseconds(10);
-    digitalWrite(ULTRASONIC_TRIG, LOW);
+void SensorManager::fillStatistics(SensorData& data) {
+    data.bbw_min = bbwWindow.minimum();
+    data.bbw_max = bbwWindow.maximum();
+    data.bbw_stddev = bbwWindow.stddev();
+    data.quality = calculateQuality();
+}
 
-    // Read echo pulse
-    long duration = pulseIn(ULTRASONIC_ECHO, HIGH, 30000); // 30ms timeout
+void SensorManager::triggerUltrasonic() {
+    // Arm the capture, then send the trigger pulse; the port timestamps
+    // the echo edges into echo
+    echo.trigger(clock.micros());
+    ultrasonic.trigger();
+}
+
+float SensorManager::readUltrasonic(TraceWriter* traced) {
+    // Collect the echo of the previous trigger, then start the next
+    // measurement. Never waits for the echo itself.
+    float distance = -1;
+    EchoStatus status = echo.poll(clock.micros(), distance);
+
+    // Record how the measurement ended; a replay delivers the same edges
+    if (traced && (status == EchoStatus::Ready || status == EchoStatus::Timeout)) {
+        uint32_t riseUs, widthUs;
+        if (echo.lastEcho(riseUs, widthUs)) {
+            traced->echo(clock.micros(), riseUs, widthUs);
+        } else {
+            traced->noEcho(clock.micros());
+        }
+    }
 
-    if (duration == 0) {
-        return -1; // Measurement failed
+    if (status == EchoStatus::Pending) {
+        // Previous echo still in flight - don't retrigger over it
+        return -1;
     }
 
-    // Calculate distance in mm
-    // Speed of sound = 343 m/s = 0.343 mm/μs
-    // Distance = (duration / 2) * 0.343
-    float distance = (duration / 2.0) * 0.343;
+    triggerUltrasonic();
+
+    if (status != EchoStatus::Ready) {
+        return -1; // Measurement failed (or first call)
+    }
 
     return distance;
 }
 
+float SensorManager::measureUltrasonicBlocking() {
+    // Only for calibration and self-test, outside the sampling loop
+    float distance = -1;
+    triggerUltrasonic();
+
+    EchoStatus status;
+    while ((status = echo.poll(clock.micros(), distance)) == EchoStatus::Pending) {
+        clock.delay(1);
+    }
+
+    return status == EchoStatus::Ready ? distance : -1;
+}
+
+void SensorManager::updateAirTemperature(float celsius) {
+    // The echo time is converted with the speed of sound at the last valid
+    // air temperature (about 0.17 % per °C); -999 keeps the previous one
+    if (celsius > -999) {
+        echo.setSpeedOfSound(speedOfSound(celsius));
+        airTemperature = celsius;
+    }
+}
+
 float SensorManager::readTemperature() {
-    float temp = dht.readTemperature();
+    float temp = thermometer.readCelsius();
 
     if (isnan(temp)) {
         return -999; // Error value
@@ -126,24 +205,112 @@ float SensorManager::readTemperature() {
 }
 
 float SensorManager::readVibration() {
-    sensors_event_t event;
-    accel.getEvent(&event);
+    // Vector RMS (g) of the latest analysed block
+    return vibrationRms.load();
+}
 
-    // Calculate magnitude of acceleration
-    float magnitude = sqrt(
-        event.acceleration.x * event.acceleration.x +
-        event.acceleration.y * event.acceleration.y +
-        event.acceleration.z * event.acceleration.z
-    );
+size_t SensorManager::drainAccelerometer() {
+    if (!accelReady) {
+        return 0;
+    }
+    TraceWriter* traced = traceLane(TraceLane::Accel);
+
+    // Overrun: the FIFO filled up and samples were overwritten. The block
+    // in progress now has a gap, so start it again.
+    if (accel.overrun()) {
+        fifoOverrunCount++;
+        vibrationBlocks.restart();
+        if (traced) traced->accelOverrun(clock.micros());
+    }
 
-    // Subtract gravity (9.8 m/s²)
-    magnitude = abs(magnitude - 9.8);
+    // Read everything queued. The watermark line only drops once the FIFO
+    // is below the watermark, so keep going while samples keep arriving
+    // or the next rising edge would never come.
+    size_t total = 0;
+    uint8_t entries;
+    do {
+        entries = accel.fifoEntries();
+        if (traced) traced->beginAccel(clock.micros());
+        for (uint8_t i = 0; i < entries; i++) {
+            int16_t* sample = vibrationBlocks.next();
+            if (!accel.readSample(sample)) {
+                accelReadErrorCount++;
+                vibrationBlocks.restart();
+                return total;
+            }
+            if (traced) traced->accelSample(sample);
+            vibrationBlocks.commit(clock.millis());
+            total++;
+        }
+        if (traced) traced->endAccel();
+    } while (entries >= ACCEL_FIFO_WATERMARK);
 
-    return magnitude;
+    return total;
+}
+
+TraceWriter* SensorManager::traceLane(TraceLane lane) {
+    if (!trace) {
+        return nullptr;
+    }
+
+    // Follows the trace's start and stop; a new capture (or a changed
+    // calibration or filter) records the state a replay starts from
+    TraceWriter& writer = trace->lane(lane);
+    uint32_t nowMs = clock.millis();
+    uint32_t nowUs = clock.micros();
+    if (!writer.ready(nowMs, nowUs)) {
+        return nullptr;
+    }
+    if (lane == TraceLane::Acquisition && (writer.justStarted() || traceStateChanged)) {
+        traceStateChanged = false;
+        writer.state(nowUs, traceState());
+    } else if (lane == TraceLane::Accel && writer.justStarted()) {
+        writer.accelFill(nowUs, (uint32_t)vibrationBlocks.pending());
+    }
+    return &writer;
+}
+
+TraceState SensorManager::traceState() const {
+    TraceState state;
+    state.calibrationOffset = calibrationOffset;
+    state.calibrationScale = calibrationScale;
+    state.outlierThreshold = outlierThreshold;
+    state.outlierMinSigma = outlierMinSigma;
+    state.airTemperature = airTemperature;
+    state.vibrationRms = vibrationRms.load();
+    state.lastSlowRead = lastSlowRead;
+    state.echoPending = echo.inFlight();
+    state.echoTriggerUs = echo.triggerTime();
+    return state;
+}
+
+bool SensorManager::restoreTraceState(const TraceState& state, bool resume) {
+    setCalibration(state.calibrationOffset, state.calibrationScale);
+    setOutlierFilter(state.outlierThreshold, state.outlierMinSigma);
+    updateAirTemperature(state.airTemperature);
+    lastSlowRead = state.lastSlowRead;
+    if (!resume) {
+        return false;
+    }
+    setVibrationLevel(state.vibrationRms);
+    if (state.echoPending && !echo.inFlight()) {
+        echo.trigger(state.echoTriggerUs);     // The replay delivers its edges
+        return true;
+    }
+    return false;
+}
+
+void SensorManager::resumeVibrationBlock(uint32_t samples) {
+    vibrationBlocks.restart();
+    for (uint32_t i = 0; i < samples && i + 1 < VIBRATION_BLOCK_SIZE; i++) {
+        int16_t* sample = vibrationBlocks.next();
+        sample[0] = sample[1] = sample[2] = 0;
+        vibrationBlocks.commit(clock.millis());
+    }
 }
 
 uint8_t SensorManager::calculateQuality() {
-    if (numReadings < 10) {
+    if (bbwWindow.count() < 10) {
         return 50; // Not enough data
     }
 
@@ -152,90 +319,50 @@ uint8_t SensorManager::calculateQuality() {
     // 2. Number of valid readings
     // 3. Sensor health
 
-    uint8_t quality = 100;
+    int quality = 100;
 
     // Penalize high variability
-    if (current_stddev > 5.0) {
+    float stddev = bbwWindow.stddev();
+    if (stddev > 5.0f) {
         quality -= 20;
-    } else if (current_stddev > 2.0) {
+    } else if (stddev > 2.0f) {
         quality -= 10;
     }
 
     // Penalize if we have invalid readings
-    int invalidCount = 0;
-    for (int i = 0; i < numReadings; i++) {
-        if (bbwReadings[i] < 0) {
-            invalidCount++;
-        }
-    }
-    quality -= (invalidCount * 100) / numReadings;
-
-    return max(0, min(100, quality));
-}
-
-void SensorManager::updateStatistics() {
-    if (numReadings == 0) return;
-
-    // Calculate mean
-    bbw_sum = 0;
-    bbw_sum_sq = 0;
-    current_min = 9999;
-    current_max = -9999;
-
-    int validCount = 0;
-    for (int i = 0; i < numReadings; i++) {
-        float value = bbwReadings[i];
-        if (value > 0) { // Valid reading
-            bbw_sum += value;
-            bbw_sum_sq += value * value;
-            current_min = min(current_min, value);
-            current_max = max(current_max, value);
-            validCount++;
-        }
-    }
+    quality -= (int)((bbwWindow.invalidCount() * 100) / bbwWindow.count());
 
-    if (validCount > 0) {
-        current_avg = bbw_sum / validCount;
-
-        // Calculate standard deviation
-        float variance = (bbw_sum_sq / validCount) - (current_avg * current_avg);
-        current_stddev = sqrt(max(0.0f, variance));
-    } else {
-        current_avg = 0;
-        current_stddev = 0;
-        current_min = 0;
-        current_max = 0;
-    }
+    return quality < 0 ? 0 : (quality > 100 ? 100 : quality);
 }
 
 void SensorManager::calibrate() {
-    Serial.println("Starting calibration...");
-    Serial.println("Please ensure BBW is at known reference (100mm)");
-    delay(5000);
+    halLog("Starting calibration...\n");
+    halLog("Please ensure BBW is at known reference (100mm)\n");
+    clock.delay(5000);
 
     // Take multiple readings
     float sum = 0;
     int count = 0;
 
     for (int i = 0; i < 100; i++) {
-        float reading = readUltrasonic();
+        float reading = measureUltrasonicBlocking();
         if (reading > 0) {
             sum += reading;
             count++;
         }
-        delay(100);
+        clock.delay(100);
     }
 
     if (count > 0) {
         float avgReading = sum / count;
-        float calibrationFactor = 100.0 / avgReading;
+        float calibrationFactor = 100.0f / avgReading;
 
-        Serial.printf("Calibration complete:\n");
-        Serial.printf("  Average reading: %.2f mm\n", avgReading);
-        Serial.printf("  Calibration factor: %.4f\n", calibrationFactor);
-        Serial.printf("  Update BBW_CALIBRATION_SCALE to %.4f in config.h\n", calibrationFactor);
+        halLog("Calibration complete:\n");
+        halLog("  Average reading: %.2f mm\n", (double)avgReading);
+        halLog("  Calibration factor: %.4f\n", (double)calibrationFactor);
+        halLog("  Set calibration.scale to %.4f on the config topic\n", (double)calibrationFactor);
     } else {
-        Serial.println("Calibration failed - no valid readings");
+        halLog("Calibration failed - no valid readings\n");
     }
 }
 
@@ -243,23 +370,22 @@ bool SensorManager::selfTest() {
     bool success = true;
 
     // Test ultrasonic sensor
-    float ultrasonicReading = readUltrasonic();
+    float ultrasonicReading = measureUltrasonicBlocking();
     if (ultrasonicReading < 0 || ultrasonicReading > 1000) {
-        Serial.println("  ✗ Ultrasonic sensor test failed");
+        halLog("  ✗ Ultrasonic sensor test failed\n");
         success = false;
     }
 
     // Test temperature sensor
     float tempReading = readTemperature();
     if (tempReading < -50 || tempReading > 100) {
-        Serial.println("  ✗ Temperature sensor test failed");
+        halLog("  ✗ Temperature sensor test failed\n");
         success = false;
     }
 
     // Test accelerometer
-    sensors_event_t event;
-    if (!accel.getEvent(&event)) {
-        Serial.println("  ✗ Accelerometer test failed");
+    if (!accel.selfTest()) {
+        halLog("  ✗ Accelerometer test failed\n");
         success = false;
     }
 
@@ -0,0 +1,131 @@
+/**
+ * Kaldor IIoT - Store-and-forward backfill tests (native)
+ *
+ * Run with: pio test -e native -f test_backfill
+ */
+
+#include <unity.h>
+#include <stdlib.h>
+#include <vector>
+#include "backfill.h"
+#include "sample_journal.h"
+
+static char dir[40];
+static char prefix[56];
+
+void setUp() {
+    snprintf(dir, sizeof(dir), "/tmp/kaldor-backfill-XXXXXX");
+    TEST_ASSERT_NOT_NULL(mkdtemp(dir));
+    snprintf(prefix, sizeof(prefix), "%s/journal-", dir);
+}
+
+void tearDown() {
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    (void)system(cmd);
+}
+
+static SensorData sample(uint32_t i) {
+    SensorData d = {};
+    d.bbw = 100.0f + (float)i;
+    d.timestamp = i * 10;
+    return d;
+}
+
+void test_rate_limit_and_window() {
+    Backfill bf(50, 10000, 40);
+    TEST_ASSERT_FALSE(bf.due(100, 0));  // Not started
+    bf.start(0, 1000);
+    TEST_ASSERT_TRUE(bf.due(100, 1000));
+    bf.sent(19, 1000);
+    TEST_ASSERT_FALSE(bf.due(100, 1020));   // Rate limited
+    TEST_ASSERT_TRUE(bf.due(100, 1050));
+    bf.sent(39, 1050);
+    TEST_ASSERT_FALSE(bf.due(100, 1200));   // 40 unacknowledged
+    TEST_ASSERT_TRUE(bf.acknowledge(19, 1210));
+    TEST_ASSERT_TRUE(bf.due(100, 1210));
+    TEST_ASSERT_EQUAL_UINT32(40, bf.nextToSend());
+    TEST_ASSERT_EQUAL_UINT32(80, bf.depth(0, 100));
+}
+
+void test_stale_and_future_acks_ignored() {
+    Backfill bf(0, 10000, 100);
+    bf.start(10, 0);
+    bf.sent(29, 0);
+    TEST_ASSERT_FALSE(bf.acknowledge(40, 1));   // Never sent
+    TEST_ASSERT_TRUE(bf.acknowledge(19, 2));
+    TEST_ASSERT_FALSE(bf.acknowledge(15, 3));   // Stale
+    TEST_ASSERT_EQUAL_UINT32(10, bf.acknowledgedTotal());
+}
+
+void test_timeout_rewinds_to_last_ack() {
+    Backfill bf(0, 5000, 100);
+    bf.start(0, 0);
+    bf.sent(19, 0);
+    bf.sent(39, 10);
+    TEST_ASSERT_TRUE(bf.due(100, 4000));
+    TEST_ASSERT_EQUAL_UINT32(40, bf.nextToSend());
+    TEST_ASSERT_TRUE(bf.due(100, 5001));
+    TEST_ASSERT_EQUAL_UINT32(0, bf.nextToSend());
+    TEST_ASSERT_EQUAL_UINT32(1, bf.resends());
+}
+
+void test_reconnect_resends_unacknowledged() {
+    Backfill bf(0, 5000, 100);
+    bf.start(0, 0);
+    bf.sent(49, 0);
+    bf.acknowledge(9, 1);
+    bf.stop();
+    TEST_ASSERT_FALSE(bf.due(100, 2));
+    bf.start(0, 100);
+    TEST_ASSERT_EQUAL_UINT32(10, bf.nextToSend());
+}
+
+void test_journal_drains_and_trims_only_acked() {
+    FileJournalStore store(prefix);
+    SampleJournal journal(store, 4, 25, 5);
+    journal.begin();
+    for (uint32_t i = 0; i < 90; i++) journal.append(sample(i));
+
+    Backfill bf(0, 10000, 1000);
+    bf.start(journal.oldestSequence(), 0);
+
+    std::vector<uint32_t> received;
+    uint32_t now = 0;
+    while (bf.due(journal.nextSequence(), now)) {
+        uint32_t last = 0;
+        size_t n = journal.readFrom(bf.nextToSend(), 20, [&](uint32_t seq, const SensorData& d) {
+            TEST_ASSERT_EQUAL_FLOAT(100.0f + (float)seq, d.bbw);
+            received.push_back(seq);
+            last = seq;
+        });
+        if (n == 0) break;
+        bf.sent(last, now++);
+
+        // Ingest acknowledges up to 30 only: segment 0 (0..24) may go
+        if (last >= 39 && bf.acknowledge(30, now)) journal.acknowledge(30);
+    }
+
+    TEST_ASSERT_EQUAL(90, received.size());
+    for (uint32_t i = 0; i < 90; i++) TEST_ASSERT_EQUAL_UINT32(i, received[i]);
+    TEST_ASSERT_EQUAL_UINT32(25, journal.oldestSequence());
+    TEST_ASSERT_EQUAL_UINT32(59, bf.depth(journal.oldestSequence(), journal.nextSequence()));
+
+    // Everything acknowledged: journal empties, sequence keeps counting
+    TEST_ASSERT_TRUE(bf.acknowledge(89, now));
+    journal.acknowledge(89);
+    TEST_ASSERT_EQUAL(0, journal.recordCount());
+    TEST_ASSERT_EQUAL_UINT32(90, journal.oldestSequence());
+    journal.append(sample(90));
+    TEST_ASSERT_EQUAL_UINT32(91, journal.nextSequence());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_rate_limit_and_window);
+    RUN_TEST(test_stale_and_future_acks_ignored);
+    RUN_TEST(test_timeout_rewinds_to_last_ack);
+    RUN_TEST(test_reconnect_resends_unacknowledged);
+    RUN_TEST(test_journal_drains_and_trims_only_acked);
+    return UNITY_END();
+}
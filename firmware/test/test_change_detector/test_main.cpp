@@ -0,0 +1,210 @@
+/**
+ * Kaldor IIoT - ChangeDetector unit tests (native)
+ *
+ * Synthetic BBW traces at 100 Hz (0.5 mm noise) with a step, ramp or spike
+ * at a known sample; each test checks which detector fires and how many
+ * samples after the onset (printed as the detection latency).
+ *
+ * Run with: pio test -e native -f test_change_detector
+ */
+
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include "change_detector.h"
+
+static const ChangeDetectorConfig CFG = {
+    0.01f,      // baseline alpha
+    0.1f,       // EWMA lambda
+    4.5f,       // EWMA limit
+    1.0f,       // CUSUM k
+    8.0f,       // CUSUM h
+    500.0f,     // max rate (mm/s)
+    0.05f,      // sigma floor (mm)
+    100,        // warm-up samples
+    1000,       // hold-off (ms)
+};
+
+static const uint32_t PERIOD_MS = 10;
+static const float LEVEL = 120.0f;
+static const float NOISE = 0.5f;
+
+static uint32_t lcg;
+static float uniform() {
+    lcg = lcg * 1664525u + 1013904223u;
+    return ((float)(lcg >> 8) + 0.5f) / 16777216.0f;
+}
+static float gaussian() {
+    return sqrtf(-2.0f * logf(uniform())) * cosf(6.2831853f * uniform());
+}
+
+struct Detection {
+    ChangeKind kind;
+    long latency;       // Samples after onset, -1 if nothing fired
+    uint32_t alarms;    // All alarms from onset to the end
+    uint32_t early;     // Alarms before the onset (false alarms)
+};
+
+/**
+ * Run `total` samples of level + noise + shape(i - onset) through a fresh
+ * detector; report the first alarm at or after the onset and count the
+ * ones before it.
+ */
+template <typename Shape>
+static Detection run(long onset, long total, Shape shape, const char* label) {
+    ChangeDetector detector(CFG);
+    ChangeEvent event;
+    Detection d = {ChangeKind::None, -1, 0, 0};
+    lcg = 12345;
+
+    for (long i = 0; i < total; i++) {
+        float x = LEVEL + NOISE * gaussian() + (i >= onset ? shape(i - onset) : 0.0f);
+        ChangeKind kind = detector.update(x, true, (uint32_t)(i * PERIOD_MS), event);
+        if (kind == ChangeKind::None) continue;
+
+        if (i < onset || event.kind != kind) {
+            d.early++;
+            continue;
+        }
+        d.alarms++;
+        if (d.latency < 0) {
+            d.kind = kind;
+            d.latency = i - onset;
+        }
+    }
+    printf("  %-28s %-5s after %ld samples\n", label, ChangeDetector::name(d.kind), d.latency);
+    return d;
+}
+
+static void expectNoFalseAlarms(const Detection& d) {
+    TEST_ASSERT_EQUAL_UINT32(0, d.early);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_no_alarms_on_stationary_noise() {
+    // Ten minutes of in-control noise
+    Detection d = run(60000, 60000, [](long) { return 0.0f; }, "stationary 10 min");
+    expectNoFalseAlarms(d);
+    TEST_ASSERT_EQUAL(-1, d.latency);
+}
+
+void test_step_detected_by_cusum() {
+    Detection d = run(1000, 3000, [](long) { return 3.0f * NOISE; }, "step +3 sigma");
+    expectNoFalseAlarms(d);
+    TEST_ASSERT_TRUE(d.kind == ChangeKind::Shift);
+    TEST_ASSERT_LESS_OR_EQUAL(5, d.latency);
+    // Re-baselined on the new level: one alarm, not one per hold-off
+    TEST_ASSERT_EQUAL_UINT32(1, d.alarms);
+}
+
+void test_downward_step_detected() {
+    Detection d = run(1000, 3000, [](long) { return -2.0f * NOISE; }, "step -2 sigma");
+    expectNoFalseAlarms(d);
+    TEST_ASSERT_TRUE(d.kind == ChangeKind::Shift || d.kind == ChangeKind::Ewma);
+    TEST_ASSERT_LESS_OR_EQUAL(10, d.latency);
+}
+
+void test_jump_detected_by_rate_on_onset() {
+    Detection d = run(1000, 3000, [](long) { return -10.0f; }, "jump -10 mm");
+    expectNoFalseAlarms(d);
+    TEST_ASSERT_TRUE(d.kind == ChangeKind::Rate);
+    TEST_ASSERT_EQUAL(0, d.latency);
+}
+
+void test_ramp_detected() {
+    // 1 mm/s drift: hidden in a 1 s mean for a while
+    Detection d = run(1000, 3000, [](long i) { return 0.01f * (float)i; }, "ramp 1 mm/s");
+    expectNoFalseAlarms(d);
+    TEST_ASSERT_TRUE(d.kind == ChangeKind::Shift || d.kind == ChangeKind::Ewma);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, d.latency);
+    TEST_ASSERT_LESS_OR_EQUAL(150, d.latency);
+}
+
+void test_spike_reported_once() {
+    Detection d = run(1000, 3000, [](long i) { return i == 0 ? 15.0f : 0.0f; }, "spike 15 mm");
+    expectNoFalseAlarms(d);
+    TEST_ASSERT_TRUE(d.kind == ChangeKind::Rate);
+    TEST_ASSERT_EQUAL(0, d.latency);
+    // A single outlier must not look like a level change afterwards
+    TEST_ASSERT_EQUAL_UINT32(1, d.alarms);
+}
+
+void test_loom_like_trace() {
+    // Beat-up oscillation (480 picks/min), 0.1 mm quantisation and 1 %
+    // dropouts, then a step
+    ChangeDetector detector(CFG);
+    ChangeEvent event;
+    lcg = 777;
+    long first = -1;
+    uint32_t early = 0;
+    const long onset = 30000;
+
+    for (long i = 0; i < 33000; i++) {
+        uint32_t now = (uint32_t)(i * PERIOD_MS);
+        bool valid = uniform() > 0.01f;
+        float x = LEVEL + 0.4f * sinf(6.2831853f * 8.0f * (float)now / 1000.0f) + 0.3f * gaussian();
+        if (i >= onset) x += 2.0f;
+        x = roundf(x * 10.0f) / 10.0f;
+
+        if (detector.update(valid ? x : -1.0f, valid, now, event) != ChangeKind::None) {
+            if (i < onset) early++;
+            else if (first < 0) first = i - onset;
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, early);
+    printf("  %-28s after %ld samples\n", "loom-like step +2 mm", first);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, first);
+    TEST_ASSERT_LESS_OR_EQUAL(10, first);
+}
+
+void test_gap_does_not_count_as_rate() {
+    ChangeDetector detector(CFG);
+    ChangeEvent event;
+    uint32_t now = 0;
+    for (int i = 0; i < 200; i++, now += PERIOD_MS) {
+        detector.update(LEVEL, true, now, event);
+    }
+    // Invalid readings, then a valid one far away from the last
+    detector.update(-1, false, now, event);
+    now += PERIOD_MS;
+    ChangeKind kind = detector.update(LEVEL + 8.0f, true, now, event);
+    TEST_ASSERT_TRUE(kind != ChangeKind::Rate);
+}
+
+void test_event_carries_state() {
+    ChangeDetector detector(CFG);
+    ChangeEvent event;
+    uint32_t now = 0;
+    lcg = 99;
+    for (int i = 0; i < 500; i++, now += PERIOD_MS) {
+        detector.update(LEVEL + NOISE * gaussian(), true, now, event);
+    }
+    TEST_ASSERT_TRUE(detector.ready());
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, LEVEL, detector.baseline());
+    TEST_ASSERT_FLOAT_WITHIN(0.15f, NOISE, detector.sigma());
+
+    ChangeKind kind = detector.update(LEVEL + 12.0f, true, now, event);
+    TEST_ASSERT_TRUE(kind == ChangeKind::Rate);
+    TEST_ASSERT_EQUAL(1, event.direction);
+    TEST_ASSERT_EQUAL_UINT32(now, event.timestamp);
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, LEVEL, event.baseline);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, LEVEL + 12.0f, event.value);
+    TEST_ASSERT_GREATER_THAN(500.0f, event.rate);
+    TEST_ASSERT_EQUAL_UINT32(1, detector.alarms(ChangeKind::Rate));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_no_alarms_on_stationary_noise);
+    RUN_TEST(test_step_detected_by_cusum);
+    RUN_TEST(test_downward_step_detected);
+    RUN_TEST(test_jump_detected_by_rate_on_onset);
+    RUN_TEST(test_ramp_detected);
+    RUN_TEST(test_spike_reported_once);
+    RUN_TEST(test_loom_like_trace);
+    RUN_TEST(test_gap_does_not_count_as_rate);
+    RUN_TEST(test_event_carries_state);
+    return UNITY_END();
+}
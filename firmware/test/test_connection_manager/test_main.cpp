@@ -0,0 +1,187 @@
+/**
+ * Kaldor IIoT - Connection manager unit tests (native)
+ *
+ * Backoff bounds and spread, and ConnectionManager against SimLink and
+ * the broker stand-in: join, connect, retries after failures, link and
+ * session loss, and the latency counters.
+ *
+ * Run with: pio test -e native -f test_connection_manager
+ */
+
+#include <unity.h>
+#include "connection_manager.h"
+#include "hal_sim.h"
+
+static SimClock* clock;
+static SimLink* link;
+static SimBrokerStream* broker;
+static MqttSession* session;
+static ConnectionManager* manager;
+alignas(4) static uint8_t liveQueue[1024];
+
+void setUp() {
+    clock = new SimClock();
+    clock->advance(1000000);
+    link = new SimLink(*clock);
+    broker = new SimBrokerStream(*clock);
+    session = new MqttSession(*broker, *clock);
+    session->setQueue(MqttPriority::Live, liveQueue, sizeof(liveQueue));
+    manager = new ConnectionManager(*link, *session, *clock);
+    manager->setBroker("sim", 8883, "kaldor-test", nullptr, nullptr);
+}
+
+void tearDown() {
+    delete manager;
+    delete session;
+    delete broker;
+    delete link;
+    delete clock;
+}
+
+/** Network loop passes, 1 ms apart; stops early once online. */
+static bool runUntilOnline(uint32_t ms) {
+    for (uint32_t t = 0; t < ms; t++) {
+        manager->loop();
+        session->loop();
+        if (manager->online()) return true;
+        clock->advance(1000);
+    }
+    return false;
+}
+
+static void runFor(uint32_t ms) {
+    for (uint32_t t = 0; t < ms; t++) {
+        manager->loop();
+        session->loop();
+        clock->advance(1000);
+    }
+}
+
+void test_backoff_grows_and_is_capped() {
+    Backoff backoff(1000, 60000, 1);
+    uint32_t expected[] = {1000, 2000, 4000, 8000, 16000, 32000, 60000, 60000};
+    for (uint32_t limit : expected) {
+        TEST_ASSERT_EQUAL_UINT32(limit, backoff.ceiling());
+        TEST_ASSERT_TRUE(backoff.next() <= limit);
+    }
+    backoff.reset();
+    TEST_ASSERT_EQUAL_UINT32(1000, backoff.ceiling());
+}
+
+void test_backoff_jitter_spreads_devices() {
+    // 100 devices with different seeds retrying after the same failure
+    uint32_t buckets[10] = {};
+    for (uint32_t device = 1; device <= 100; device++) {
+        Backoff backoff(1000, 60000, device * 2654435761u);
+        uint32_t delay = backoff.next();
+        TEST_ASSERT_TRUE(delay <= 1000);
+        buckets[delay * 10 / 1001]++;
+    }
+    for (uint32_t count : buckets) {
+        TEST_ASSERT_TRUE(count > 0);                    // No 100 ms slot left empty
+        TEST_ASSERT_TRUE(count < 30);                   // Nor a crowd in one
+    }
+}
+
+void test_joins_then_connects_without_blocking() {
+    link->setJoinDelay(300);
+    broker->setConnectDelay(200);
+    manager->begin(12345);
+    manager->loop();
+    TEST_ASSERT_TRUE(manager->status() == ConnectionManager::State::Joining);
+
+    TEST_ASSERT_TRUE(runUntilOnline(1000));
+    TEST_ASSERT_TRUE(session->connected());
+    const ConnectionStats& stats = manager->stats();
+    TEST_ASSERT_EQUAL_UINT32(1, stats.joins);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.connects);
+    TEST_ASSERT_EQUAL_UINT32(300, stats.lastJoinMs);
+    TEST_ASSERT_INT_WITHIN(2, 200, stats.lastConnectMs);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.lastOutageMs);    // Boot is not an outage
+}
+
+void test_join_timeout_backs_off_and_retries() {
+    manager->setJoinTimeout(1000);
+    link->setAvailable(false);
+    manager->begin(12345);
+    runFor(1002);
+    TEST_ASSERT_EQUAL_UINT32(1, manager->stats().joinFailures);
+    TEST_ASSERT_TRUE(manager->status() == ConnectionManager::State::Waiting);
+    TEST_ASSERT_TRUE(manager->retryInMs() <= RECONNECT_BACKOFF_MIN_MS);
+
+    // Each failure doubles the ceiling; nothing is tried while waiting
+    runFor(20000);
+    uint32_t failures = manager->stats().joinFailures;
+    TEST_ASSERT_TRUE(failures >= 4 && failures <= 12);
+    TEST_ASSERT_EQUAL_UINT32(failures + (manager->status() == ConnectionManager::State::Joining),
+                             link->joins());
+
+    link->setAvailable(true);
+    TEST_ASSERT_TRUE(runUntilOnline(RECONNECT_BACKOFF_MAX_MS + 2000));
+    TEST_ASSERT_EQUAL_UINT32(1, manager->stats().joins);
+}
+
+void test_broker_failures_back_off_then_reset() {
+    broker->setOnline(false);
+    manager->begin(12345);
+    runFor(10000);
+    uint32_t failures = manager->stats().connectFailures;
+    TEST_ASSERT_TRUE(failures >= 3);
+    TEST_ASSERT_EQUAL_UINT32(1, manager->stats().joins);    // The link stayed up
+
+    broker->setOnline(true);
+    TEST_ASSERT_TRUE(runUntilOnline(RECONNECT_BACKOFF_MAX_MS + 2000));
+    TEST_ASSERT_EQUAL_UINT32(1, manager->stats().connects);
+
+    // A later loss starts over at the shortest backoff
+    broker->setOnline(false);
+    runFor(2);
+    TEST_ASSERT_TRUE(manager->status() == ConnectionManager::State::Waiting);
+    TEST_ASSERT_TRUE(manager->retryInMs() <= RECONNECT_BACKOFF_MIN_MS);
+}
+
+void test_session_loss_reconnects_and_measures_the_outage() {
+    manager->begin(12345);
+    TEST_ASSERT_TRUE(runUntilOnline(100));
+
+    broker->setOnline(false);
+    runFor(3000);
+    TEST_ASSERT_FALSE(manager->online());
+    broker->setOnline(true);
+    TEST_ASSERT_TRUE(runUntilOnline(RECONNECT_BACKOFF_MAX_MS));
+
+    const ConnectionStats& stats = manager->stats();
+    TEST_ASSERT_EQUAL_UINT32(2, stats.connects);
+    TEST_ASSERT_TRUE(stats.lastOutageMs >= 3000);
+    TEST_ASSERT_EQUAL_UINT32(stats.lastOutageMs, stats.maxOutageMs);
+    TEST_ASSERT_EQUAL_UINT32(1, link->joins());             // Only the broker was gone
+}
+
+void test_link_loss_drops_the_session_and_rejoins() {
+    manager->begin(12345);
+    TEST_ASSERT_TRUE(runUntilOnline(100));
+    TEST_ASSERT_TRUE(session->publish("a", "1", false, 1, MqttPriority::Live));
+
+    link->setAvailable(false);
+    runFor(1);
+    TEST_ASSERT_EQUAL_UINT32(1, manager->stats().linkLosses);
+    TEST_ASSERT_FALSE(session->connected());
+    TEST_ASSERT_FALSE(broker->connected());
+
+    link->setAvailable(true);
+    TEST_ASSERT_TRUE(runUntilOnline(RECONNECT_BACKOFF_MAX_MS));
+    TEST_ASSERT_EQUAL_UINT32(2, link->joins());
+    TEST_ASSERT_EQUAL_UINT32(2, manager->stats().joins);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_backoff_grows_and_is_capped);
+    RUN_TEST(test_backoff_jitter_spreads_devices);
+    RUN_TEST(test_joins_then_connects_without_blocking);
+    RUN_TEST(test_join_timeout_backs_off_and_retries);
+    RUN_TEST(test_broker_failures_back_off_then_reset);
+    RUN_TEST(test_session_loss_reconnects_and_measures_the_outage);
+    RUN_TEST(test_link_loss_drops_the_session_and_rejoins);
+    return UNITY_END();
+}
@@ -0,0 +1,187 @@
+/**
+ * Kaldor IIoT - Decimation filter unit tests (native)
+ *
+ * CIC and compensating FIR stages on synthetic ADC streams: unity DC gain,
+ * a flat passband, rejection of tones that would alias into it, results
+ * independent of the block size, the configuration limits, and
+ * AnalogFrontEnd's statistics over SimAnalog.
+ *
+ * Run with: pio test -e native -f test_decimator
+ */
+
+#include <unity.h>
+#include <math.h>
+#include <vector>
+#include "decimator.h"
+#include "analog_frontend.h"
+#include "hal_sim.h"
+
+static const uint32_t INPUT_HZ = 10000;
+
+/** Counts around mid-scale: offset + amplitude * sin(2 pi f t). */
+static std::vector<int16_t> tone(double hz, double amplitude, double offset, size_t n) {
+    std::vector<int16_t> samples(n);
+    for (size_t i = 0; i < n; i++) {
+        double t = (double)i / INPUT_HZ;
+        samples[i] = (int16_t)lrint(offset + amplitude * sin(2.0 * M_PI * hz * t));
+    }
+    return samples;
+}
+
+static std::vector<float> decimate(DecimationChain<3>& chain, const std::vector<int16_t>& in,
+                                   size_t piece) {
+    std::vector<float> out(in.size() / chain.decimation() + 1);
+    size_t produced = 0;
+    for (size_t at = 0; at < in.size(); at += piece) {
+        size_t n = in.size() - at < piece ? in.size() - at : piece;
+        produced += chain.process(in.data() + at, n, out.data() + produced);
+    }
+    out.resize(produced);
+    return out;
+}
+
+/** Amplitude of the AC part after the filters have settled. */
+static float amplitude(const std::vector<float>& out, size_t settle) {
+    double sum = 0, sumSq = 0;
+    size_t n = out.size() - settle;
+    for (size_t i = settle; i < out.size(); i++) sum += (double)out[i];
+    double mean = sum / n;
+    for (size_t i = settle; i < out.size(); i++) {
+        double d = (double)out[i] - mean;
+        sumSq += d * d;
+    }
+    return (float)sqrt(2.0 * sumSq / n);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_cic_alone_passes_dc_exactly() {
+    CicDecimator<3> cic;
+    TEST_ASSERT_TRUE(cic.configure(25, 12));
+    std::vector<int16_t> in(2500, 4095);
+    float out[100];
+    TEST_ASSERT_EQUAL_UINT32(100, cic.process(in.data(), in.size(), out));
+    TEST_ASSERT_EQUAL_FLOAT(4095.0f, out[99]);      // Full scale, no wrap
+}
+
+void test_chain_has_unity_dc_gain() {
+    DecimationChain<3> chain;
+    TEST_ASSERT_TRUE(chain.configure(INPUT_HZ, 100, 4, 63, 12));
+    TEST_ASSERT_EQUAL_UINT32(100, chain.decimation());
+    std::vector<float> out = decimate(chain, std::vector<int16_t>(20000, 2000), 256);
+    TEST_ASSERT_EQUAL_UINT32(200, out.size());
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, 2000.0f, out.back());
+}
+
+void test_passband_is_flat() {
+    // The FIR undoes the CIC droop up to well into the passband
+    for (double hz : {2.0, 10.0, 25.0, 35.0}) {
+        DecimationChain<3> chain;
+        chain.configure(INPUT_HZ, 100, 4, 63, 12);
+        std::vector<float> out = decimate(chain, tone(hz, 1000.0, 2048.0, 40000), 256);
+        TEST_ASSERT_FLOAT_WITHIN(5.0f, 1000.0f, amplitude(out, 50));
+    }
+}
+
+void test_tones_above_the_output_nyquist_are_rejected() {
+    // 70 and 95 Hz would fold to 30 and 5 Hz; the others land near CIC nulls
+    for (double hz : {70.0, 95.0, 390.0, 1234.0, 4000.0}) {
+        DecimationChain<3> chain;
+        chain.configure(INPUT_HZ, 100, 4, 63, 12);
+        std::vector<float> out = decimate(chain, tone(hz, 2000.0, 2048.0, 40000), 256);
+        TEST_ASSERT_TRUE(amplitude(out, 50) < 2.0f);    // At least 60 dB down
+    }
+}
+
+void test_block_size_does_not_change_the_output() {
+    std::vector<int16_t> in = tone(13.0, 900.0, 2048.0, 12345);
+    DecimationChain<3> reference;
+    reference.configure(INPUT_HZ, 50, 4, 63, 12);
+    std::vector<float> expected = decimate(reference, in, in.size());
+    for (size_t piece : {1u, 7u, 100u, 256u, 5000u}) {
+        DecimationChain<3> chain;
+        chain.configure(INPUT_HZ, 50, 4, 63, 12);
+        std::vector<float> out = decimate(chain, in, piece);
+        TEST_ASSERT_EQUAL_UINT32(expected.size(), out.size());
+        TEST_ASSERT_EQUAL_MEMORY(expected.data(), out.data(), out.size() * sizeof(float));
+    }
+}
+
+void test_configure_rejects_rates_that_do_not_fit() {
+    DecimationChain<3> chain;
+    TEST_ASSERT_FALSE(chain.configure(INPUT_HZ, 30, 4, 63, 12));     // Not a divisor
+    TEST_ASSERT_FALSE(chain.configure(INPUT_HZ, 25, 4, 63, 12));     // CIC 100: overflows
+    TEST_ASSERT_FALSE(chain.configure(INPUT_HZ, 100, 4, 65, 12));    // Too many taps
+    TEST_ASSERT_FALSE(chain.configure(INPUT_HZ, 40, 4, 63, 12));     // 250 not a multiple of 4
+    TEST_ASSERT_TRUE(chain.configure(INPUT_HZ, 40, 5, 63, 12));      // CIC 50
+    TEST_ASSERT_TRUE(chain.configure(INPUT_HZ, 125, 4, 63, 12));     // CIC 20
+}
+
+void test_front_end_scales_and_summarises_each_input() {
+    SimClock clock;
+    // Motor current: mid-scale with a 150 Hz ripple above its 100 Hz output
+    // rate; tension: a slow 1 Hz swing
+    SimAnalog adc(clock, {
+        [](double t) { return (float)(2048.0 + 300.0 * sin(2 * M_PI * 150.0 * t)); },
+        [](double t) { return (float)(1000.0 + 500.0 * sin(2 * M_PI * 1.0 * t)); },
+    });
+    AnalogFrontEnd frontEnd(adc, clock);
+    TEST_ASSERT_TRUE(frontEnd.configure(0, 100, 10.0f, 0.0f));
+    TEST_ASSERT_TRUE(frontEnd.configure(1, 50, 250.0f, -5.0f));
+    TEST_ASSERT_FALSE(frontEnd.configure(1, 30, 1.0f, 0.0f));
+    TEST_ASSERT_TRUE(frontEnd.begin());
+
+    AnalogSummary summary;
+    bool have = false;
+    for (int ms = 0; ms < 3000; ms++) {
+        clock.advance(1000);
+        frontEnd.poll(0);
+        if (frontEnd.takeSummary(summary)) have = true;
+    }
+    TEST_ASSERT_TRUE(have);
+    TEST_ASSERT_EQUAL_UINT32(1000, summary.intervalMs);
+    TEST_ASSERT_EQUAL_UINT32(0, summary.overruns);
+
+    const float voltsPerCount = ANALOG_FULL_SCALE_V / 4095.0f;
+    const AnalogChannelSummary& current = summary.channel[0];
+    TEST_ASSERT_EQUAL_UINT32(100, current.outputHz);
+    TEST_ASSERT_INT_WITHIN(1, 100, (int)current.outputs);
+    TEST_ASSERT_INT_WITHIN(100, 10000, (int)current.samples);
+    TEST_ASSERT_FLOAT_WITHIN(0.02f, 2048.0f * voltsPerCount * 10.0f, current.mean);
+    TEST_ASSERT_TRUE(current.stddev < 0.05f);               // 150 Hz ripple filtered out
+
+    const AnalogChannelSummary& tension = summary.channel[1];
+    TEST_ASSERT_INT_WITHIN(1, 50, (int)tension.outputs);
+    float centre = 1000.0f * voltsPerCount * 250.0f - 5.0f;
+    float swing = 500.0f * voltsPerCount * 250.0f;
+    TEST_ASSERT_FLOAT_WITHIN(swing * 0.05f, centre, tension.mean);
+    TEST_ASSERT_FLOAT_WITHIN(swing * 0.05f, centre + swing, tension.maximum);
+    TEST_ASSERT_FLOAT_WITHIN(swing * 0.05f, centre - swing, tension.minimum);
+    TEST_ASSERT_FLOAT_WITHIN(swing * 0.05f, swing / sqrtf(2.0f), tension.stddev);
+}
+
+void test_front_end_counts_lost_frames() {
+    SimClock clock;
+    SimAnalog adc(clock, {[](double) { return 100.0f; }, [](double) { return 200.0f; }});
+    AnalogFrontEnd frontEnd(adc, clock);
+    frontEnd.configure(0, 100, 1.0f, 0.0f);
+    frontEnd.begin();
+    clock.advance(1000000);                                 // A second without reading
+    frontEnd.poll(0);
+    frontEnd.poll(0);
+    TEST_ASSERT_EQUAL_UINT32(1, frontEnd.overruns());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_cic_alone_passes_dc_exactly);
+    RUN_TEST(test_chain_has_unity_dc_gain);
+    RUN_TEST(test_passband_is_flat);
+    RUN_TEST(test_tones_above_the_output_nyquist_are_rejected);
+    RUN_TEST(test_block_size_does_not_change_the_output);
+    RUN_TEST(test_configure_rejects_rates_that_do_not_fit);
+    RUN_TEST(test_front_end_scales_and_summarises_each_input);
+    RUN_TEST(test_front_end_counts_lost_frames);
+    return UNITY_END();
+}
@@ -0,0 +1,114 @@
+/**
+ * Kaldor IIoT - EchoCapture unit tests (native)
+ *
+ * Run with: pio test -e native -f test_echo_capture
+ */
+
+#include <unity.h>
+#include "echo_capture.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_idle_until_triggered() {
+    EchoCapture echo;
+    float distance = 0;
+    TEST_ASSERT_TRUE(echo.poll(0, distance) == EchoStatus::Idle);
+    echo.onEdge(true, 10);   // stray edge is ignored
+    echo.onEdge(false, 20);
+    TEST_ASSERT_TRUE(echo.poll(30, distance) == EchoStatus::Idle);
+}
+
+void test_edges_give_distance() {
+    EchoCapture echo;
+    float distance = 0;
+    echo.trigger(1000);
+    TEST_ASSERT_TRUE(echo.poll(1200, distance) == EchoStatus::Pending);
+    echo.onEdge(true, 1500);
+    echo.onEdge(false, 1500 + 700);  // 700 µs round trip
+    TEST_ASSERT_TRUE(echo.poll(2500, distance) == EchoStatus::Ready);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 120.05f, distance);
+    TEST_ASSERT_TRUE(echo.poll(2600, distance) == EchoStatus::Idle);
+    TEST_ASSERT_EQUAL(1, echo.completed());
+    TEST_ASSERT_EQUAL(0, echo.lateSamples());
+}
+
+void test_missing_echo_times_out() {
+    EchoCapture echo(30000, 10000);
+    float distance = 0;
+    echo.trigger(0);
+    TEST_ASSERT_TRUE(echo.poll(15000, distance) == EchoStatus::Pending);
+    TEST_ASSERT_TRUE(echo.poll(30001, distance) == EchoStatus::Timeout);
+    TEST_ASSERT_EQUAL(1, echo.timeouts());
+    TEST_ASSERT_EQUAL(1, echo.lateSamples());
+    TEST_ASSERT_FALSE(echo.busy());
+}
+
+void test_late_echo_counted_once() {
+    EchoCapture echo(30000, 10000);
+    float distance = 0;
+    echo.trigger(0);
+    echo.onEdge(true, 500);
+    TEST_ASSERT_TRUE(echo.poll(11000, distance) == EchoStatus::Pending);
+    TEST_ASSERT_TRUE(echo.poll(12000, distance) == EchoStatus::Pending);
+    echo.onEdge(false, 12500);
+    TEST_ASSERT_TRUE(echo.poll(13000, distance) == EchoStatus::Ready);
+    TEST_ASSERT_EQUAL(1, echo.lateSamples());
+}
+
+void test_timestamps_wrap() {
+    EchoCapture echo;
+    float distance = 0;
+    uint32_t start = 0xFFFFFF00u;
+    echo.trigger(start);
+    echo.onEdge(true, start + 100);
+    echo.onEdge(false, start + 100 + 1000);  // wraps past zero
+    TEST_ASSERT_TRUE(echo.poll(start + 2000, distance) == EchoStatus::Ready);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 171.5f, distance);
+}
+
+void test_speed_of_sound_is_configurable() {
+    EchoCapture echo;
+    float distance = 0;
+    echo.setSpeedOfSound(0.350f);
+    echo.trigger(0);
+    echo.onEdge(true, 100);
+    echo.onEdge(false, 1100);
+    TEST_ASSERT_TRUE(echo.poll(1200, distance) == EchoStatus::Ready);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 175.0f, distance);
+}
+
+void test_last_echo_for_traces() {
+    EchoCapture echo(30000, 10000);
+    float distance = 0;
+    uint32_t rise = 0, width = 0;
+    echo.trigger(1000);
+    echo.onEdge(true, 1450);
+    echo.onEdge(false, 2150);
+    TEST_ASSERT_FALSE(echo.busy());         // Complete but not collected
+    TEST_ASSERT_TRUE(echo.inFlight());
+    TEST_ASSERT_EQUAL_UINT32(1000, echo.triggerTime());
+    TEST_ASSERT_TRUE(echo.poll(3000, distance) == EchoStatus::Ready);
+    TEST_ASSERT_FALSE(echo.inFlight());
+    TEST_ASSERT_TRUE(echo.lastEcho(rise, width));
+    TEST_ASSERT_EQUAL_UINT32(450, rise);
+    TEST_ASSERT_EQUAL_UINT32(700, width);
+
+    // A rising edge alone is no echo
+    echo.trigger(5000);
+    echo.onEdge(true, 5400);
+    TEST_ASSERT_TRUE(echo.poll(40000, distance) == EchoStatus::Timeout);
+    TEST_ASSERT_FALSE(echo.lastEcho(rise, width));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_idle_until_triggered);
+    RUN_TEST(test_edges_give_distance);
+    RUN_TEST(test_missing_echo_times_out);
+    RUN_TEST(test_late_echo_counted_once);
+    RUN_TEST(test_timestamps_wrap);
+    RUN_TEST(test_speed_of_sound_is_configurable);
+    RUN_TEST(test_last_echo_for_traces);
+    return UNITY_END();
+}
@@ -0,0 +1,117 @@
+/**
+ * Kaldor IIoT - Simulated HAL ports unit tests (native)
+ *
+ * The native simulation is only as good as its stand-ins, so check that
+ * they behave like the parts they replace.
+ *
+ * Run with: pio test -e native -f test_hal_sim
+ */
+
+#include <unity.h>
+#include <string.h>
+#include "hal_sim.h"
+#include "echo_capture.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_clock_moves_only_when_advanced() {
+    SimClock clock;
+    TEST_ASSERT_EQUAL_UINT32(0, clock.micros());
+    clock.advance(2500);
+    TEST_ASSERT_EQUAL_UINT32(2500, clock.micros());
+    TEST_ASSERT_EQUAL_UINT32(2, clock.millis());
+    clock.delay(10);
+    TEST_ASSERT_EQUAL_UINT32(12, clock.millis());
+}
+
+void test_ultrasonic_echo_gives_profile_distance() {
+    SimClock clock;
+    SimUltrasonic sensor(clock, [](uint32_t) { return 120.0f; });
+    EchoCapture echo;
+    TEST_ASSERT_TRUE(sensor.begin(echo));
+
+    echo.trigger(clock.micros());
+    sensor.trigger();
+    clock.advance(10000);
+
+    float distance = 0;
+    TEST_ASSERT_TRUE(echo.poll(clock.micros(), distance) == EchoStatus::Ready);
+    TEST_ASSERT_FLOAT_WITHIN(0.2f, 120.0f, distance);
+}
+
+void test_ultrasonic_without_echo_times_out() {
+    SimClock clock;
+    SimUltrasonic sensor(clock, [](uint32_t) { return -1.0f; });
+    EchoCapture echo(30000, 10000);
+    sensor.begin(echo);
+
+    echo.trigger(clock.micros());
+    sensor.trigger();
+    float distance = 0;
+    clock.advance(5000);
+    TEST_ASSERT_TRUE(echo.poll(clock.micros(), distance) == EchoStatus::Pending);
+    clock.advance(30000);
+    TEST_ASSERT_TRUE(echo.poll(clock.micros(), distance) == EchoStatus::Timeout);
+}
+
+void test_accel_fifo_fills_at_data_rate() {
+    SimClock clock;
+    SimAccel accel(clock, 0.5f, 25.0f);
+    TEST_ASSERT_TRUE(accel.begin(800, 16));
+    TEST_ASSERT_FALSE(accel.waitForWatermark(0));
+
+    clock.advance(20000);                   // 16 samples at 800 Hz
+    TEST_ASSERT_EQUAL_UINT8(16, accel.fifoEntries());
+    TEST_ASSERT_TRUE(accel.waitForWatermark(0));
+
+    int16_t xyz[3];
+    for (int i = 0; i < 16; i++) {
+        TEST_ASSERT_TRUE(accel.readSample(xyz));
+    }
+    TEST_ASSERT_FALSE(accel.readSample(xyz));
+    TEST_ASSERT_FALSE(accel.overrun());
+    TEST_ASSERT_INT_WITHIN(70, 256, xyz[2]);    // About 1 g on z
+}
+
+void test_accel_overrun_keeps_newest() {
+    SimClock clock;
+    SimAccel accel(clock, 0.5f, 25.0f);
+    accel.begin(800, 16);
+
+    clock.advance(100000);                  // 80 samples, FIFO holds 32
+    TEST_ASSERT_EQUAL_UINT8(32, accel.fifoEntries());
+    TEST_ASSERT_TRUE(accel.overrun());
+    TEST_ASSERT_FALSE(accel.overrun());     // Reported once
+}
+
+void test_broker_counts_and_refuses_when_offline() {
+    SimBroker broker;
+    uint32_t hooked = 0;
+    char lastTopic[32] = "";
+    broker.onPublish([&](const char* topic, const uint8_t*, size_t) {
+        hooked++;
+        strncpy(lastTopic, topic, sizeof(lastTopic) - 1);
+    });
+
+    TEST_ASSERT_TRUE(broker.publish("a/b", "{\"x\":1}", false, 0, MqttPriority::Live));
+    TEST_ASSERT_EQUAL_UINT32(1, broker.publishes());
+    TEST_ASSERT_EQUAL_UINT32(7, (uint32_t)broker.bytes());
+    TEST_ASSERT_EQUAL_STRING("a/b", lastTopic);
+
+    broker.setConnected(false);
+    TEST_ASSERT_FALSE(broker.connected());
+    TEST_ASSERT_FALSE(broker.publish("a/b", "{}", false, 0, MqttPriority::Live));
+    TEST_ASSERT_EQUAL_UINT32(1, hooked);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_clock_moves_only_when_advanced);
+    RUN_TEST(test_ultrasonic_echo_gives_profile_distance);
+    RUN_TEST(test_ultrasonic_without_echo_times_out);
+    RUN_TEST(test_accel_fifo_fills_at_data_rate);
+    RUN_TEST(test_accel_overrun_keeps_newest);
+    RUN_TEST(test_broker_counts_and_refuses_when_offline);
+    return UNITY_END();
+}
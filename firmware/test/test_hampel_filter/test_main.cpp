@@ -0,0 +1,155 @@
+/**
+ * Kaldor IIoT - Sliding median / Hampel filter unit tests (native)
+ *
+ * The treap's median and MAD are checked against sorting the window on
+ * every sample; the filter against spikes, steps and quantised readings.
+ *
+ * Run with: pio test -e native -f test_hampel_filter
+ */
+
+#include <unity.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include "hampel_filter.h"
+
+void setUp() {}
+void tearDown() {}
+
+static float sortedMedian(std::vector<float> v) {
+    std::sort(v.begin(), v.end());
+    size_t n = v.size();
+    return n % 2 ? v[n / 2] : 0.5f * (v[n / 2 - 1] + v[n / 2]);
+}
+
+static float sortedMad(const std::vector<float>& v, float m) {
+    std::vector<float> d;
+    for (float x : v) d.push_back(fabsf(x - m));
+    return sortedMedian(d);
+}
+
+template <size_t N>
+static void checkAgainstSort(uint32_t samples, float quantum) {
+    SlidingMedian<N> window;
+    std::vector<float> recent;
+    uint32_t state = 12345;
+    for (uint32_t i = 0; i < samples; i++) {
+        state = state * 1664525u + 1013904223u;
+        float x = (float)((state >> 8) % 2000) * quantum;  // Many ties when coarse
+        window.push(x);
+        recent.push_back(x);
+        if (recent.size() > N) recent.erase(recent.begin());
+
+        TEST_ASSERT_EQUAL_UINT32((uint32_t)recent.size(), (uint32_t)window.size());
+        float m = sortedMedian(recent);
+        TEST_ASSERT_EQUAL_FLOAT(m, window.median());
+        TEST_ASSERT_EQUAL_FLOAT(sortedMad(recent, m), window.mad(m));
+        if (i % 97 == 0) {
+            std::vector<float> sorted = recent;
+            std::sort(sorted.begin(), sorted.end());
+            for (size_t k = 0; k < sorted.size(); k++) {
+                TEST_ASSERT_EQUAL_FLOAT(sorted[k], window.select(k));
+            }
+        }
+    }
+}
+
+void test_odd_window_matches_sort() {
+    checkAgainstSort<15>(3000, 0.01f);
+}
+
+void test_even_window_matches_sort() {
+    checkAgainstSort<16>(3000, 0.01f);
+}
+
+void test_ties_match_sort() {
+    checkAgainstSort<31>(3000, 1.0f / 128.0f * 100.0f);     // ~20 distinct values
+}
+
+void test_filling_window_matches_sort() {
+    checkAgainstSort<101>(80, 0.01f);
+}
+
+void test_spike_replaced_by_median() {
+    HampelFilter<15> filter(3.0f, 0.1f);
+    bool rejected;
+    for (int i = 0; i < 30; i++) {
+        filter.apply(120.0f + (i % 3) * 0.2f, rejected);
+        TEST_ASSERT_FALSE(rejected);
+    }
+    float out = filter.apply(180.0f, rejected);     // Multipath echo
+    TEST_ASSERT_TRUE(rejected);
+    TEST_ASSERT_FLOAT_WITHIN(0.25f, 120.2f, out);
+    TEST_ASSERT_EQUAL_UINT32(1, filter.rejected());
+
+    out = filter.apply(120.4f, rejected);
+    TEST_ASSERT_FALSE(rejected);
+    TEST_ASSERT_EQUAL_FLOAT(120.4f, out);
+}
+
+void test_step_passes_after_half_window() {
+    HampelFilter<15> filter(3.0f, 0.1f);
+    bool rejected;
+    for (int i = 0; i < 30; i++) filter.apply(120.0f + (i % 2) * 0.1f, rejected);
+
+    int held = 0;
+    float out = 0;
+    for (int i = 0; i < 15; i++) {
+        out = filter.apply(130.0f + (i % 2) * 0.1f, rejected);
+        if (rejected) held++;
+    }
+    TEST_ASSERT_EQUAL_INT(8, held);                 // Until the new level is the median
+    TEST_ASSERT_FLOAT_WITHIN(0.2f, 130.0f, out);
+}
+
+void test_min_sigma_keeps_quantised_readings() {
+    // Identical readings give MAD 0; the floor stops 1-count steps being outliers
+    HampelFilter<15> filter(3.0f, 0.5f);
+    bool rejected;
+    for (int i = 0; i < 20; i++) filter.apply(100.0f, rejected);
+    filter.apply(101.0f, rejected);
+    TEST_ASSERT_FALSE(rejected);
+    filter.apply(102.0f, rejected);
+    TEST_ASSERT_TRUE(rejected);
+}
+
+void test_nothing_rejected_while_warming_up_or_disabled() {
+    HampelFilter<15> filter(3.0f, 0.1f);
+    bool rejected;
+    filter.apply(100.0f, rejected);
+    filter.apply(500.0f, rejected);
+    TEST_ASSERT_FALSE(rejected);
+
+    HampelFilter<15> off(0.0f, 0.1f);
+    for (int i = 0; i < 20; i++) off.apply(100.0f, rejected);
+    TEST_ASSERT_EQUAL_FLOAT(500.0f, off.apply(500.0f, rejected));
+    TEST_ASSERT_FALSE(rejected);
+}
+
+void test_reset_clears_window_not_counter() {
+    HampelFilter<15> filter(3.0f, 0.1f);
+    bool rejected;
+    for (int i = 0; i < 20; i++) filter.apply(100.0f, rejected);
+    filter.apply(150.0f, rejected);
+    TEST_ASSERT_TRUE(rejected);
+
+    filter.reset();
+    TEST_ASSERT_EQUAL_UINT32(0, (uint32_t)filter.samples().size());
+    filter.apply(150.0f, rejected);
+    TEST_ASSERT_FALSE(rejected);
+    TEST_ASSERT_EQUAL_UINT32(1, filter.rejected());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_odd_window_matches_sort);
+    RUN_TEST(test_even_window_matches_sort);
+    RUN_TEST(test_ties_match_sort);
+    RUN_TEST(test_filling_window_matches_sort);
+    RUN_TEST(test_spike_replaced_by_median);
+    RUN_TEST(test_step_passes_after_half_window);
+    RUN_TEST(test_min_sigma_keeps_quantised_readings);
+    RUN_TEST(test_nothing_rejected_while_warming_up_or_disabled);
+    RUN_TEST(test_reset_clears_window_not_counter);
+    return UNITY_END();
+}
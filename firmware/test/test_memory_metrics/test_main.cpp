@@ -0,0 +1,157 @@
+/**
+ * Kaldor IIoT - Memory metrics unit tests (native)
+ *
+ * Snapshot timing, the ring and which snapshots are still to be published
+ * after an outage, the free-heap trend, and the diagnostics/memory
+ * payload.
+ *
+ * Run with: pio test -e native -f test_memory_metrics
+ */
+
+#include <unity.h>
+#include <string.h>
+#include "memory_metrics.h"
+#include "hal_sim.h"
+
+static int acquisitionTask;
+static int networkTask;
+
+static void setHeap(SimMemory& memory, uint32_t free, uint32_t largest) {
+    memory.internal.total = 300000;
+    memory.internal.free = free;
+    memory.internal.largestFree = largest;
+    memory.internal.minimumFree = free - 1000;
+    memory.internal.allocatedBlocks = 400;
+    memory.internal.freeBlocks = 12;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_snapshots_follow_the_interval() {
+    SimClock clock;
+    SimMemory memory;
+    setHeap(memory, 200000, 110000);
+    memory.stacks.push_back({&acquisitionTask, 812});
+    memory.stacks.push_back({&networkTask, 70000});     // Saturates in a snapshot
+    MemoryMetrics metrics(memory, clock, 60000);
+    TEST_ASSERT_TRUE(metrics.addTask("acquisition", &acquisitionTask, 4096));
+    TEST_ASSERT_TRUE(metrics.addTask("network", &networkTask, 8192));
+
+    TEST_ASSERT_TRUE(metrics.poll());       // First one straight away
+    TEST_ASSERT_FALSE(metrics.poll());
+    clock.advance(59999000);
+    TEST_ASSERT_FALSE(metrics.poll());
+    clock.advance(1000);
+    TEST_ASSERT_TRUE(metrics.poll());
+    TEST_ASSERT_EQUAL_UINT32(2, metrics.size());
+
+    const MemorySnapshot* s = metrics.latest();
+    TEST_ASSERT_EQUAL_UINT32(1, s->seq);
+    TEST_ASSERT_EQUAL_UINT32(60, s->uptime);
+    TEST_ASSERT_EQUAL_UINT32(200000, s->internalFree);
+    TEST_ASSERT_EQUAL_UINT32(110000, s->internalLargest);
+    TEST_ASSERT_EQUAL_UINT32(199000, s->internalMinimum);
+    TEST_ASSERT_EQUAL_UINT16(400, s->allocatedBlocks);
+    TEST_ASSERT_EQUAL_UINT16(812, s->stackUnused[0]);
+    TEST_ASSERT_EQUAL_UINT16(0xFFFF, s->stackUnused[1]);
+    TEST_ASSERT_EQUAL_UINT32(812, metrics.lowestStackUnused(*s));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.45f, heapFragmentation(s->internalFree, s->internalLargest));
+
+    for (int i = 2; i < MEMORY_MAX_TASKS; i++) metrics.addTask("other", nullptr, 1024);
+    TEST_ASSERT_FALSE(metrics.addTask("one_too_many", nullptr, 1024));
+}
+
+void test_unsent_snapshots_survive_until_the_ring_wraps() {
+    SimClock clock;
+    SimMemory memory;
+    setHeap(memory, 200000, 100000);
+    MemoryMetrics metrics(memory, clock, 1000);
+
+    metrics.take();
+    TEST_ASSERT_EQUAL_UINT32(0, metrics.unsent()->seq);
+    metrics.markSent();
+    TEST_ASSERT_NULL(metrics.unsent());
+
+    // Offline for longer than the ring holds: the oldest are lost
+    for (uint32_t i = 0; i < MEMORY_HISTORY + 5; i++) {
+        clock.advance(1000000);
+        metrics.poll();
+    }
+    TEST_ASSERT_EQUAL_UINT32(MEMORY_HISTORY, metrics.size());
+    TEST_ASSERT_EQUAL_UINT32(5, metrics.lost());    // 1..5; 0 had gone out
+
+    uint32_t expected = 6;
+    while (const MemorySnapshot* s = metrics.unsent()) {
+        TEST_ASSERT_EQUAL_UINT32(expected++, s->seq);
+        metrics.markSent();
+    }
+    TEST_ASSERT_EQUAL_UINT32(MEMORY_HISTORY + 6, expected);
+}
+
+void test_trend_finds_a_slow_leak() {
+    SimClock clock;
+    SimMemory memory;
+    MemoryMetrics metrics(memory, clock, 60000);
+
+    setHeap(memory, 200000, 100000);
+    metrics.take();
+    metrics.take();
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, metrics.freeTrend());     // Too few
+
+    // 120 bytes a minute, with some noise from the publish path
+    for (uint32_t i = 0; i < MEMORY_HISTORY; i++) {
+        clock.advance(60000000);
+        uint32_t noise = (i * 7919u) % 600;
+        setHeap(memory, 200000 - 120 * i - noise, 100000);
+        metrics.poll();
+    }
+    TEST_ASSERT_FLOAT_WITHIN(150.0f, -7200.0f, metrics.freeTrend());
+
+    // Steady
+    for (uint32_t i = 0; i < MEMORY_HISTORY; i++) {
+        clock.advance(60000000);
+        setHeap(memory, 180000, 100000);
+        metrics.poll();
+    }
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, metrics.freeTrend());
+}
+
+void test_payload() {
+    SimClock clock;
+    SimMemory memory;
+    setHeap(memory, 200000, 110000);
+    memory.stacks.push_back({&acquisitionTask, 812});
+    MemoryMetrics metrics(memory, clock, 60000);
+    metrics.addTask("acquisition", &acquisitionTask, 4096);
+    clock.advance(5000000);
+
+    char buf[512];
+    PayloadWriter out(buf, sizeof(buf));
+    TEST_ASSERT_TRUE(writeMemorySnapshot(out, metrics, metrics.take(), "BBW-1"));
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"device_id\":\"BBW-1\",\"seq\":0,\"uptime\":5,"
+        "\"heap\":{\"total\":300000,\"free\":200000,\"largest_free_block\":110000,"
+        "\"min_free\":199000,\"allocated_blocks\":400,\"free_blocks\":12,"
+        "\"fragmentation\":0.450},"
+        "\"stacks\":{\"acquisition\":[4096,812]},\"free_trend_bph\":0.0,\"lost\":0}",
+        out.c_str());
+
+    // PSRAM, when the module has it
+    memory.psram.total = 4194304;
+    memory.psram.free = 4000000;
+    memory.psram.largestFree = 4000000;
+    TEST_ASSERT_TRUE(writeMemorySnapshot(out, metrics, metrics.take(), "BBW-1"));
+    TEST_ASSERT_NOT_NULL(strstr(out.c_str(),
+        "\"psram\":{\"total\":4194304,\"free\":4000000,\"largest_free_block\":4000000,"
+        "\"min_free\":0,\"fragmentation\":0.000}"));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_snapshots_follow_the_interval);
+    RUN_TEST(test_unsent_snapshots_survive_until_the_ring_wraps);
+    RUN_TEST(test_trend_finds_a_slow_leak);
+    RUN_TEST(test_payload);
+    return UNITY_END();
+}
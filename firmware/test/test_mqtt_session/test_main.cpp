@@ -0,0 +1,377 @@
+/**
+ * Kaldor IIoT - MQTT session unit tests (native)
+ *
+ * MqttSession against the broker stand-in in hal_sim.h: handshake, a slow
+ * connect, the QoS 1 window, priorities, partial writes, full queues,
+ * resending after a reconnect, timeouts and incoming messages.
+ *
+ * Run with: pio test -e native -f test_mqtt_session
+ */
+
+#include <unity.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "mqtt_codec.h"
+#include "mqtt_session.h"
+#include "hal_sim.h"
+
+static SimClock* clock;
+static SimBrokerStream* broker;
+static MqttSession* session;
+alignas(4) static uint8_t controlQueue[1024];
+alignas(4) static uint8_t liveQueue[2048];
+alignas(4) static uint8_t bulkQueue[2048];
+
+static std::vector<std::string> arrived;        // Topics in broker order
+static std::string lastTopic;
+static std::string lastPayload;
+
+static void onMessage(const char* topic, const uint8_t* payload, size_t length) {
+    lastTopic = topic;
+    lastPayload.assign((const char*)payload, length);
+}
+
+void setUp() {
+    clock = new SimClock();
+    broker = new SimBrokerStream(*clock);
+    session = new MqttSession(*broker, *clock);
+    session->setQueue(MqttPriority::Control, controlQueue, sizeof(controlQueue));
+    session->setQueue(MqttPriority::Live, liveQueue, sizeof(liveQueue));
+    session->setQueue(MqttPriority::Bulk, bulkQueue, sizeof(bulkQueue));
+    arrived.clear();
+    lastTopic.clear();
+    lastPayload.clear();
+    broker->onPublish([](const char* topic, const uint8_t*, size_t) { arrived.push_back(topic); });
+}
+
+void tearDown() {
+    delete session;
+    delete broker;
+    delete clock;
+}
+
+static void connectSession() {
+    TEST_ASSERT_TRUE(session->connect("sim", 1883, "kaldor-test", "user", "secret"));
+    session->loop();
+    TEST_ASSERT_TRUE(session->connected());
+}
+
+static void loopFor(uint32_t ms) {
+    for (uint32_t t = 0; t < ms; t++) {
+        session->loop();
+        clock->advance(1000);
+    }
+}
+
+void test_codec_publish_survives_byte_by_byte_reassembly() {
+    const char* payload = "{\"bbw\":120.5}";
+    uint8_t packet[64];
+    size_t n = mqttEncodePublish(packet, "kaldor/a", (const uint8_t*)payload, strlen(payload),
+                                 1, true, 0x1234);
+    TEST_ASSERT_EQUAL(mqttPublishSize(8, strlen(payload), 1), n);
+    TEST_ASSERT_EQUAL_HEX8(0x33, packet[0]);            // PUBLISH, QoS 1, retained
+
+    uint8_t body[64];
+    MqttPacketReader reader(body, sizeof(body));
+    bool complete = false;
+    for (size_t i = 0; i < n; i++) {
+        TEST_ASSERT_FALSE(complete);
+        TEST_ASSERT_EQUAL(1, reader.feed(packet + i, 1, complete));
+    }
+    TEST_ASSERT_TRUE(complete);
+    TEST_ASSERT_TRUE(reader.type() == MqttPacket::Publish);
+
+    const char* topic;
+    const uint8_t* data;
+    size_t length;
+    uint16_t id;
+    TEST_ASSERT_TRUE(mqttParsePublish(reader.body(), reader.length(), reader.flags(),
+                                      topic, data, length, id));
+    TEST_ASSERT_EQUAL_STRING("kaldor/a", topic);
+    TEST_ASSERT_EQUAL_UINT16(0x1234, id);
+    TEST_ASSERT_EQUAL(strlen(payload), length);
+    TEST_ASSERT_EQUAL_MEMORY(payload, data, length);
+}
+
+void test_reader_skips_oversized_packets() {
+    std::vector<uint8_t> big(300, 'x');
+    std::vector<uint8_t> stream(mqttPublishSize(1, big.size(), 0) + 4);
+    size_t n = mqttEncodePublish(stream.data(), "t", big.data(), big.size(), 0, false, 0);
+    n += mqttEncodePuback(stream.data() + n, 42);
+
+    uint8_t body[64];
+    MqttPacketReader reader(body, sizeof(body));
+    bool complete;
+    size_t used = reader.feed(stream.data(), n, complete);
+    TEST_ASSERT_TRUE(complete);                         // Only the PUBACK
+    TEST_ASSERT_EQUAL(n, used);
+    TEST_ASSERT_TRUE(reader.type() == MqttPacket::Puback);
+    TEST_ASSERT_EQUAL_UINT16(42, mqttPacketId(reader.body()));
+    TEST_ASSERT_EQUAL_UINT32(1, reader.oversized());
+}
+
+void test_connect_waits_for_connack() {
+    TEST_ASSERT_FALSE(session->publish("a", "{}", false, 0, MqttPriority::Live));
+    TEST_ASSERT_TRUE(session->connect("sim", 1883, "kaldor-test", nullptr, nullptr));
+    TEST_ASSERT_FALSE(session->connected());            // CONNECT written, no CONNACK read yet
+    TEST_ASSERT_EQUAL_UINT32(1, broker->connects());
+
+    session->loop();
+    TEST_ASSERT_TRUE(session->connected());
+    TEST_ASSERT_TRUE(session->justConnected());
+    TEST_ASSERT_FALSE(session->justConnected());        // Once per session
+    TEST_ASSERT_EQUAL_UINT32(1, session->stats().connects);
+
+    broker->setOnline(false);
+    TEST_ASSERT_FALSE(session->connect("sim", 1883, "kaldor-test", nullptr, nullptr));
+    TEST_ASSERT_FALSE(session->connected());
+}
+
+void test_slow_connect_is_polled_and_times_out() {
+    session->setConnectTimeout(3000);
+    broker->setConnectDelay(500);                       // TLS handshake
+    TEST_ASSERT_TRUE(session->connect("sim", 1883, "kaldor-test", nullptr, nullptr));
+    TEST_ASSERT_TRUE(session->status() == MqttSession::State::Opening);
+    loopFor(499);
+    TEST_ASSERT_EQUAL_UINT32(0, broker->connects());    // Nothing written before it opens
+    loopFor(2);
+    TEST_ASSERT_TRUE(session->connected());
+
+    broker->setOnline(false);
+    session->loop();
+    broker->setOnline(true);
+    broker->setConnectDelay(5000);                      // Never opens in time
+    TEST_ASSERT_TRUE(session->connect("sim", 1883, "kaldor-test", nullptr, nullptr));
+    loopFor(3000);
+    TEST_ASSERT_TRUE(session->status() == MqttSession::State::Opening);
+    loopFor(2);
+    TEST_ASSERT_TRUE(session->status() == MqttSession::State::Disconnected);
+    TEST_ASSERT_FALSE(broker->connected());
+    TEST_ASSERT_EQUAL_UINT32(1, session->stats().disconnects);     // Only the real session
+}
+
+void test_window_limits_unacknowledged_messages() {
+    session->setWindow(4);
+    broker->setAckDelay(20);
+    connectSession();
+
+    for (int i = 0; i < 10; i++) {
+        TEST_ASSERT_TRUE(session->publish("kaldor/raw", "{\"x\":1}", false, 1, MqttPriority::Live));
+    }
+    session->loop();
+    TEST_ASSERT_EQUAL_UINT32(4, broker->publishes());
+    TEST_ASSERT_EQUAL_UINT8(4, session->inFlightMessages());
+
+    clock->advance(20000);                              // First four acknowledged
+    session->loop();
+    TEST_ASSERT_EQUAL_UINT32(8, broker->publishes());
+
+    loopFor(100);
+    TEST_ASSERT_EQUAL_UINT32(10, broker->publishes());
+    TEST_ASSERT_EQUAL_UINT32(10, session->stats().acked);
+    TEST_ASSERT_EQUAL_UINT8(0, session->inFlightMessages());
+    TEST_ASSERT_EQUAL_UINT32(0, session->queuedBytes(MqttPriority::Live));
+
+    HistogramSnapshot acks;
+    session->ackLatency().snapshot(acks);
+    TEST_ASSERT_EQUAL_UINT32(10, acks.total);
+    TEST_ASSERT_TRUE(acks.maxUs >= 20000);
+}
+
+void test_control_goes_before_live_before_bulk() {
+    connectSession();
+    session->publish("bulk", "{}", false, 1, MqttPriority::Bulk);
+    session->publish("live", "{}", false, 0, MqttPriority::Live);
+    session->publish("alert", "{}", true, 1, MqttPriority::Control);
+    session->loop();
+
+    TEST_ASSERT_EQUAL(3, arrived.size());
+    TEST_ASSERT_EQUAL_STRING("alert", arrived[0].c_str());
+    TEST_ASSERT_EQUAL_STRING("live", arrived[1].c_str());
+    TEST_ASSERT_EQUAL_STRING("bulk", arrived[2].c_str());
+}
+
+void test_partial_writes_keep_messages_intact() {
+    broker->setWriteLimit(7);
+    std::string received;
+    broker->onPublish([&](const char*, const uint8_t* payload, size_t length) {
+        received.append((const char*)payload, length);
+    });
+    connectSession();
+
+    std::string expected;
+    for (int i = 0; i < 5; i++) {
+        std::string payload(100 + i * 37, (char)('a' + i));
+        expected += payload;
+        TEST_ASSERT_TRUE(session->publish("t", (const uint8_t*)payload.data(), payload.size(),
+                                          false, 1, MqttPriority::Live));
+    }
+    loopFor(10);
+    TEST_ASSERT_EQUAL_UINT32(5, broker->publishes());
+    TEST_ASSERT_TRUE(received == expected);
+}
+
+void test_full_queue_refuses_and_recovers() {
+    broker->setAcking(false);
+    connectSession();
+
+    std::string payload(200, 'p');
+    uint32_t accepted = 0;
+    while (session->publish("t", payload.c_str(), false, 1, MqttPriority::Bulk)) {
+        accepted++;
+    }
+    TEST_ASSERT_TRUE(accepted >= 8);                    // 2 KB of ~224-byte records
+    TEST_ASSERT_EQUAL_UINT32(1, session->stats().rejected);
+    TEST_ASSERT_TRUE(session->queueHighWater(MqttPriority::Bulk) > 2048 - 256);
+
+    // Other queues are not affected
+    TEST_ASSERT_TRUE(session->publish("s", "{}", true, 1, MqttPriority::Control));
+
+    session->loop();                                    // Written, never acknowledged
+    TEST_ASSERT_FALSE(session->publish("t", payload.c_str(), false, 1, MqttPriority::Bulk));
+
+    broker->setOnline(false);                           // Reconnect resends them all
+    broker->setOnline(true);
+    broker->setAcking(true);
+    session->loop();
+    connectSession();
+    loopFor(10);
+    TEST_ASSERT_EQUAL_UINT32(0, session->queuedBytes(MqttPriority::Bulk));
+    TEST_ASSERT_TRUE(session->publish("t", payload.c_str(), false, 1, MqttPriority::Bulk));
+}
+
+void test_reconnect_resends_unacknowledged_with_dup() {
+    broker->setAcking(false);
+    connectSession();
+    session->publish("a", "1", false, 1, MqttPriority::Live);
+    session->publish("b", "2", false, 0, MqttPriority::Live);
+    session->publish("c", "3", false, 1, MqttPriority::Bulk);
+    session->loop();
+    TEST_ASSERT_EQUAL_UINT32(3, broker->publishes());
+
+    broker->setOnline(false);
+    session->loop();
+    TEST_ASSERT_FALSE(session->connected());
+    TEST_ASSERT_EQUAL_UINT32(1, session->stats().disconnects);
+    TEST_ASSERT_FALSE(session->publish("d", "4", false, 1, MqttPriority::Live));
+
+    broker->setOnline(true);
+    broker->setAcking(true);
+    arrived.clear();
+    connectSession();
+    loopFor(5);
+
+    // QoS 0 was gone once written; the QoS 1 ones go again, flagged
+    TEST_ASSERT_EQUAL(2, arrived.size());
+    TEST_ASSERT_EQUAL_STRING("a", arrived[0].c_str());
+    TEST_ASSERT_EQUAL_STRING("c", arrived[1].c_str());
+    TEST_ASSERT_EQUAL_UINT32(2, broker->duplicates());
+    TEST_ASSERT_EQUAL_UINT32(2, session->stats().retransmits);
+    TEST_ASSERT_EQUAL_UINT32(2, session->stats().acked);
+    TEST_ASSERT_EQUAL_UINT32(5, session->stats().sent);
+}
+
+void test_missing_puback_drops_the_connection() {
+    session->setAckTimeout(1000);
+    broker->setAcking(false);
+    connectSession();
+    session->publish("a", "1", false, 1, MqttPriority::Live);
+    session->loop();
+
+    clock->advance(1000000);
+    session->loop();
+    TEST_ASSERT_TRUE(session->connected());             // Not past the timeout yet
+    clock->advance(1000);
+    session->loop();
+    TEST_ASSERT_FALSE(session->connected());
+    TEST_ASSERT_EQUAL_UINT32(1, session->stats().ackTimeouts);
+    TEST_ASSERT_FALSE(broker->connected());
+}
+
+void test_incoming_message_is_acknowledged_and_handed_over() {
+    session->setCallback(onMessage);
+    connectSession();
+    TEST_ASSERT_TRUE(session->subscribe("kaldor/config", 1));
+    session->loop();
+
+    broker->deliver("kaldor/other", "{}", 1, 6);        // Not subscribed
+    broker->deliver("kaldor/config", "{\"v\":2}", 1, 7);
+    session->loop();
+    TEST_ASSERT_EQUAL_STRING("kaldor/config", lastTopic.c_str());
+    TEST_ASSERT_EQUAL_STRING("{\"v\":2}", lastPayload.c_str());
+    TEST_ASSERT_EQUAL_UINT32(1, session->stats().received);
+
+    session->loop();
+    TEST_ASSERT_EQUAL_UINT32(1, broker->pubacks());
+}
+
+void test_keepalive_pings_an_idle_connection() {
+    session->setKeepAlive(10);
+    session->setAckTimeout(2000);
+    connectSession();
+
+    clock->advance(9999000);
+    session->loop();
+    TEST_ASSERT_EQUAL_UINT32(0, broker->pings());
+    clock->advance(1000);
+    session->loop();
+    TEST_ASSERT_EQUAL_UINT32(1, broker->pings());
+    clock->advance(3000000);                            // PINGRESP was read
+    session->loop();
+    TEST_ASSERT_TRUE(session->connected());
+}
+
+void test_queue_wraps_without_corrupting_messages() {
+    broker->setAckDelay(3);
+    session->setWindow(3);
+    uint32_t nextExpected = 0;
+    uint32_t bad = 0;
+    broker->onPublish([&](const char*, const uint8_t* payload, size_t length) {
+        uint32_t seq = (uint32_t)strtoul((const char*)payload, nullptr, 10);
+        if (seq != nextExpected++) bad++;
+        for (size_t i = 6; i < length; i++) {
+            if (payload[i] != (uint8_t)('a' + seq % 26)) bad++;
+        }
+    });
+    connectSession();
+
+    uint32_t published = 0;
+    char payload[300];
+    for (int step = 0; step < 3000; step++) {
+        size_t length = 6 + (published * 97) % 250;
+        snprintf(payload, sizeof(payload), "%05u", published);
+        memset(payload + 6, 'a' + published % 26, length - 6);
+        if (session->publish("kaldor/wrap", (const uint8_t*)payload, length, false, 1,
+                             MqttPriority::Live)) {
+            published++;
+        }
+        session->loop();
+        clock->advance(1000);
+    }
+    loopFor(50);
+    TEST_ASSERT_TRUE(published > 500);
+    TEST_ASSERT_EQUAL_UINT32(0, bad);
+    TEST_ASSERT_EQUAL_UINT32(published, broker->publishes());
+    TEST_ASSERT_EQUAL_UINT32(published, session->stats().acked);
+    TEST_ASSERT_TRUE(session->queueHighWater(MqttPriority::Live) <= sizeof(liveQueue));
+    TEST_ASSERT_EQUAL_UINT32(0, session->queuedBytes(MqttPriority::Live));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_codec_publish_survives_byte_by_byte_reassembly);
+    RUN_TEST(test_reader_skips_oversized_packets);
+    RUN_TEST(test_connect_waits_for_connack);
+    RUN_TEST(test_slow_connect_is_polled_and_times_out);
+    RUN_TEST(test_window_limits_unacknowledged_messages);
+    RUN_TEST(test_control_goes_before_live_before_bulk);
+    RUN_TEST(test_partial_writes_keep_messages_intact);
+    RUN_TEST(test_full_queue_refuses_and_recovers);
+    RUN_TEST(test_reconnect_resends_unacknowledged_with_dup);
+    RUN_TEST(test_missing_puback_drops_the_connection);
+    RUN_TEST(test_incoming_message_is_acknowledged_and_handed_over);
+    RUN_TEST(test_keepalive_pings_an_idle_connection);
+    RUN_TEST(test_queue_wraps_without_corrupting_messages);
+    return UNITY_END();
+}
@@ -0,0 +1,180 @@
+/**
+ * Kaldor IIoT - OTA image format unit tests (native)
+ *
+ * Packing and decoding plain, compressed and delta images into SimFirmware,
+ * fed whole and byte by byte, and the checks that keep a bad image from
+ * being installed.
+ *
+ * Run with: pio test -e native -f test_ota_image
+ */
+
+#include <unity.h>
+#include "hal_sim.h"
+#include "ota_image.h"
+
+alignas(4) static uint8_t window[OTA_WINDOW_BYTES];
+
+/** Something shaped like firmware: repeated instruction patterns, strings, padding. */
+static std::vector<uint8_t> fakeFirmware(size_t size, uint32_t seed) {
+    static const uint8_t opcodes[][3] = {
+        {0x36, 0x41, 0x00}, {0x1d, 0xf0, 0x00}, {0x0c, 0x02, 0x00},
+        {0x81, 0x00, 0x00}, {0xe0, 0x08, 0x00}, {0x22, 0xa0, 0x00}
+    };
+    static const char* const strings[] = {"sensor read failed", "MQTT connected", "BBW-", "%u Hz"};
+    std::vector<uint8_t> image;
+    uint32_t state = seed;
+    auto next = [&]() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    };
+    while (image.size() < size) {
+        uint32_t r = next();
+        if (r % 50 == 0) {
+            const char* s = strings[(r >> 8) % 4];
+            image.insert(image.end(), s, s + strlen(s) + 1);
+        } else if (r % 97 == 0) {
+            image.insert(image.end(), 16 + (r >> 8) % 48, 0xFF);
+        } else {
+            const uint8_t* op = opcodes[(r >> 8) % 6];
+            image.insert(image.end(), op, op + 3);
+            image.back() = (uint8_t)(r >> 16) & 0x0F;       // Operand
+        }
+    }
+    image.resize(size);
+    return image;
+}
+
+/** The next release: a few functions changed, one added, code shifted. */
+static std::vector<uint8_t> nextRelease(const std::vector<uint8_t>& base) {
+    std::vector<uint8_t> image(base.begin(), base.begin() + 20000);
+    std::vector<uint8_t> added = fakeFirmware(1500, 99);
+    image.insert(image.end(), added.begin(), added.end());
+    image.insert(image.end(), base.begin() + 20000, base.end());
+    for (size_t i = 40000; i < 40300; i++) image[i] ^= 0x5A;
+    for (size_t i = 70000; i < 70100; i++) image[i] = (uint8_t)i;
+    return image;
+}
+
+static bool install(SimFirmware& firmware, const std::vector<uint8_t>& image, size_t piece) {
+    OtaImageDecoder decoder(firmware, window, sizeof(window));
+    decoder.begin((uint32_t)image.size());
+    for (size_t at = 0; at < image.size(); at += piece) {
+        size_t n = image.size() - at < piece ? image.size() - at : piece;
+        if (!decoder.feed(image.data() + at, n)) return false;
+    }
+    return decoder.finish();
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_plain_image_is_written_as_is() {
+    std::vector<uint8_t> image = fakeFirmware(10000, 1);
+    image[0] = 0xE9;                                    // ESP32 image magic
+    SimFirmware firmware;
+    TEST_ASSERT_TRUE(install(firmware, image, 1000));
+    TEST_ASSERT_TRUE(firmware.isInstalled());
+    TEST_ASSERT_TRUE(firmware.written() == image);
+}
+
+void test_packed_image_is_smaller_and_decodes() {
+    std::vector<uint8_t> image = fakeFirmware(100000, 2);
+    std::vector<uint8_t> packed = otaImagePack(image.data(), image.size());
+    TEST_ASSERT_TRUE(packed.size() < image.size() * 3 / 4);
+
+    SimFirmware firmware;
+    TEST_ASSERT_TRUE(install(firmware, packed, 1024));
+    TEST_ASSERT_TRUE(firmware.written() == image);
+}
+
+void test_delta_against_running_firmware() {
+    std::vector<uint8_t> running = fakeFirmware(100000, 3);
+    std::vector<uint8_t> image = nextRelease(running);
+    std::vector<uint8_t> delta = otaImagePack(image.data(), image.size(), running.data(),
+                                              running.size());
+    std::vector<uint8_t> full = otaImagePack(image.data(), image.size());
+    TEST_ASSERT_TRUE(delta.size() < image.size() / 20);
+    TEST_ASSERT_TRUE(delta.size() < full.size() / 10);
+
+    SimFirmware firmware(running);
+    TEST_ASSERT_TRUE(install(firmware, delta, 700));
+    TEST_ASSERT_TRUE(firmware.written() == image);
+}
+
+void test_any_piece_size_gives_the_same_firmware() {
+    std::vector<uint8_t> running = fakeFirmware(30000, 4);
+    std::vector<uint8_t> image = fakeFirmware(30000, 5);
+    image.insert(image.end(), running.begin(), running.begin() + 10000);
+    std::vector<uint8_t> delta = otaImagePack(image.data(), image.size(), running.data(),
+                                              running.size());
+    for (size_t piece : {1u, 3u, 24u, 4096u, 100000u}) {
+        SimFirmware firmware(running);
+        TEST_ASSERT_TRUE(install(firmware, delta, piece));
+        TEST_ASSERT_TRUE(firmware.written() == image);
+    }
+}
+
+void test_delta_for_other_firmware_is_refused_before_writing() {
+    std::vector<uint8_t> running = fakeFirmware(100000, 6);
+    std::vector<uint8_t> image = nextRelease(running);
+    std::vector<uint8_t> delta = otaImagePack(image.data(), image.size(), running.data(),
+                                              running.size());
+
+    running[12345] ^= 1;                                // A different build is running
+    SimFirmware firmware(running);
+    OtaImageDecoder decoder(firmware, window, sizeof(window));
+    decoder.begin((uint32_t)delta.size());
+    TEST_ASSERT_FALSE(decoder.feed(delta.data(), delta.size()));
+    TEST_ASSERT_TRUE(decoder.result() == OtaImageDecoder::Result::WrongBase);
+    TEST_ASSERT_EQUAL_UINT32(0, firmware.begins());
+}
+
+void test_corrupt_image_is_not_installed() {
+    std::vector<uint8_t> image = fakeFirmware(20000, 7);
+    std::vector<uint8_t> packed = otaImagePack(image.data(), image.size());
+    packed[12] ^= 0x01;                                 // Firmware CRC in the header
+
+    SimFirmware firmware;
+    OtaImageDecoder decoder(firmware, window, sizeof(window));
+    decoder.begin((uint32_t)packed.size());
+    decoder.feed(packed.data(), packed.size());
+    TEST_ASSERT_FALSE(decoder.finish());
+    TEST_ASSERT_TRUE(decoder.result() == OtaImageDecoder::Result::BadCrc);
+    TEST_ASSERT_FALSE(firmware.isInstalled());
+}
+
+void test_truncated_image_is_not_installed() {
+    std::vector<uint8_t> image = fakeFirmware(20000, 8);
+    std::vector<uint8_t> packed = otaImagePack(image.data(), image.size());
+    packed.resize(packed.size() - 100);
+
+    SimFirmware firmware;
+    TEST_ASSERT_FALSE(install(firmware, packed, 512));
+    TEST_ASSERT_FALSE(firmware.isInstalled());
+}
+
+void test_window_larger_than_the_device_is_refused() {
+    std::vector<uint8_t> image = fakeFirmware(20000, 9);
+    std::vector<uint8_t> packed = otaImagePack(image.data(), image.size(), nullptr, 0,
+                                               OTA_WINDOW_BYTES * 4);
+    SimFirmware firmware;
+    OtaImageDecoder decoder(firmware, window, sizeof(window));
+    decoder.begin((uint32_t)packed.size());
+    TEST_ASSERT_FALSE(decoder.feed(packed.data(), packed.size()));
+    TEST_ASSERT_TRUE(decoder.result() == OtaImageDecoder::Result::BadHeader);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_plain_image_is_written_as_is);
+    RUN_TEST(test_packed_image_is_smaller_and_decodes);
+    RUN_TEST(test_delta_against_running_firmware);
+    RUN_TEST(test_any_piece_size_gives_the_same_firmware);
+    RUN_TEST(test_delta_for_other_firmware_is_refused_before_writing);
+    RUN_TEST(test_corrupt_image_is_not_installed);
+    RUN_TEST(test_truncated_image_is_not_installed);
+    RUN_TEST(test_window_larger_than_the_device_is_refused);
+    return UNITY_END();
+}
@@ -0,0 +1,214 @@
+/**
+ * Kaldor IIoT - Firmware download unit tests (native)
+ *
+ * OtaUpdate against SimHttpServer and SimFirmware: plain and delta images,
+ * resuming with Range requests after dropped connections, servers without
+ * range support, error statuses and giving up after repeated failures.
+ *
+ * Run with: pio test -e native -f test_ota_update
+ */
+
+#include <unity.h>
+#include "hal_sim.h"
+#include "ota_update.h"
+
+static SimClock* clock;
+static SimHttpServer* server;
+static SimFirmware* firmware;
+static OtaUpdate* update;
+alignas(4) static uint8_t window[OTA_WINDOW_BYTES];
+
+static std::vector<uint8_t> image(size_t size, uint32_t seed) {
+    std::vector<uint8_t> bytes(size);
+    uint32_t state = seed;
+    for (size_t i = 0; i < size; i++) {
+        state = state * 1103515245u + 12345u;
+        bytes[i] = (uint8_t)(i % 7 == 0 ? 0x36 : state >> 24);
+    }
+    bytes[0] = 0xE9;
+    return bytes;
+}
+
+void setUp() {
+    clock = new SimClock();
+    server = new SimHttpServer();
+    firmware = new SimFirmware(image(60000, 1));
+    update = new OtaUpdate(*server, *firmware, *clock, window, sizeof(window));
+}
+
+void tearDown() {
+    delete update;
+    delete firmware;
+    delete server;
+    delete clock;
+}
+
+/** Poll every millisecond until the update ends; false on timeout. */
+static bool runUntilFinished(uint32_t ms) {
+    for (uint32_t t = 0; t < ms; t++) {
+        update->poll();
+        if (!update->running()) return true;
+        clock->advance(1000);
+    }
+    return false;
+}
+
+void test_downloads_and_installs_a_plain_image() {
+    std::vector<uint8_t> bin = image(50000, 2);
+    server->serve("/fw/kaldor.bin", bin);
+    server->setReadLimit(700);
+
+    TEST_ASSERT_TRUE(update->start("http://updates.local:8080/fw/kaldor.bin"));
+    update->poll();
+    TEST_ASSERT_TRUE(update->status().state == OtaState::Downloading);
+    TEST_ASSERT_TRUE(runUntilFinished(1000));
+
+    const OtaProgress& progress = update->status();
+    TEST_ASSERT_TRUE(progress.state == OtaState::Done);
+    TEST_ASSERT_EQUAL_UINT32(bin.size(), progress.received);
+    TEST_ASSERT_EQUAL_UINT32(bin.size(), progress.total);
+    TEST_ASSERT_EQUAL_UINT32(bin.size(), progress.written);
+    TEST_ASSERT_EQUAL_UINT32(1, server->requests());
+    TEST_ASSERT_TRUE(firmware->isInstalled());
+    TEST_ASSERT_TRUE(firmware->written() == bin);
+}
+
+void test_each_poll_reads_a_bounded_chunk() {
+    server->serve("/fw.bin", image(20000, 3));
+    update->start("http://updates.local/fw.bin");
+    update->poll();                                     // Headers and the first chunk
+    uint32_t before = update->status().received;
+    update->poll();
+    TEST_ASSERT_TRUE(update->status().received - before <= OTA_CHUNK_BYTES);
+}
+
+void test_dropped_connections_resume_with_a_range() {
+    std::vector<uint8_t> bin = image(50000, 4);
+    server->serve("/fw.bin", bin);
+    server->setDropAfter(12000);
+
+    update->start("http://updates.local/fw.bin");
+    TEST_ASSERT_TRUE(runUntilFinished(60000));
+
+    const OtaProgress& progress = update->status();
+    TEST_ASSERT_TRUE(progress.state == OtaState::Done);
+    TEST_ASSERT_EQUAL_UINT32(4, progress.resumes);      // 12000 x 4 + the rest
+    TEST_ASSERT_EQUAL_UINT32(4, server->rangeRequests());
+    TEST_ASSERT_EQUAL_UINT32(48000, server->lastRange());
+    TEST_ASSERT_EQUAL_UINT64(bin.size(), server->bodyBytes());  // Nothing fetched twice
+    TEST_ASSERT_TRUE(firmware->written() == bin);
+}
+
+void test_server_without_ranges_starts_over() {
+    std::vector<uint8_t> bin = image(30000, 5);
+    server->serve("/fw.bin", bin);
+    server->setRanges(false);
+    server->setDropAfter(10000);
+
+    update->start("http://updates.local/fw.bin");
+    while (update->status().state != OtaState::Retrying) {
+        update->poll();
+        clock->advance(1000);
+    }
+    server->setDropAfter(0);
+    TEST_ASSERT_TRUE(runUntilFinished(60000));
+
+    TEST_ASSERT_TRUE(update->status().state == OtaState::Done);
+    TEST_ASSERT_EQUAL_UINT32(0, update->status().resumes);
+    TEST_ASSERT_EQUAL_UINT32(2, firmware->begins());
+    TEST_ASSERT_TRUE(firmware->written() == bin);
+}
+
+void test_delta_image_over_http() {
+    std::vector<uint8_t> running = image(60000, 1);
+    std::vector<uint8_t> next = running;
+    for (size_t i = 30000; i < 30500; i++) next[i] ^= 0xA5;
+    std::vector<uint8_t> delta = otaImagePack(next.data(), next.size(), running.data(),
+                                              running.size());
+    server->serve("/fw.kota", delta);
+    server->setDropAfter(300);
+
+    update->start("http://updates.local/fw.kota");
+    TEST_ASSERT_TRUE(runUntilFinished(60000));
+
+    const OtaProgress& progress = update->status();
+    TEST_ASSERT_TRUE(progress.state == OtaState::Done);
+    TEST_ASSERT_TRUE(progress.delta);
+    TEST_ASSERT_TRUE(progress.total < 1000);
+    TEST_ASSERT_EQUAL_UINT32(next.size(), progress.firmwareSize);
+    TEST_ASSERT_TRUE(progress.resumes > 0);
+    TEST_ASSERT_TRUE(firmware->written() == next);
+}
+
+void test_missing_image_fails_without_retrying() {
+    update->start("http://updates.local/nothing.bin");
+    TEST_ASSERT_TRUE(runUntilFinished(1000));
+    TEST_ASSERT_TRUE(update->status().state == OtaState::Failed);
+    TEST_ASSERT_EQUAL_STRING("not found", update->status().error);
+    TEST_ASSERT_EQUAL_UINT32(1, server->requests());
+}
+
+void test_unreachable_server_gives_up_and_discards_the_slot() {
+    std::vector<uint8_t> bin = image(20000, 6);
+    server->serve("/fw.bin", bin);
+    server->setDropAfter(5000);
+    update->start("http://updates.local/fw.bin");
+    while (update->status().received == 0) {
+        update->poll();
+        clock->advance(1000);
+    }
+    server->setOnline(false);
+
+    TEST_ASSERT_TRUE(runUntilFinished(OTA_RETRY_MAX_MS * (OTA_MAX_RETRIES + 2)));
+    const OtaProgress& progress = update->status();
+    TEST_ASSERT_TRUE(progress.state == OtaState::Failed);
+    TEST_ASSERT_EQUAL_STRING("connect failed", progress.error);
+    TEST_ASSERT_EQUAL_UINT32(OTA_MAX_RETRIES, progress.retries);        // The drop counts too
+    TEST_ASSERT_EQUAL_UINT32(1, firmware->aborts());
+    TEST_ASSERT_FALSE(firmware->isInstalled());
+}
+
+void test_server_errors_are_retried() {
+    std::vector<uint8_t> bin = image(20000, 7);
+    server->serve("/fw.bin", bin);
+    server->setStatus(503);
+    update->start("http://updates.local/fw.bin");
+    runUntilFinished(10000);
+    TEST_ASSERT_TRUE(update->status().retries >= 2);
+    TEST_ASSERT_TRUE(update->running());
+
+    server->setStatus(0);
+    TEST_ASSERT_TRUE(runUntilFinished(OTA_RETRY_MAX_MS * 2));
+    TEST_ASSERT_TRUE(update->status().state == OtaState::Done);
+}
+
+void test_start_rejects_bad_urls_and_a_second_update() {
+    TEST_ASSERT_FALSE(update->start("https://updates.local/fw.bin"));
+    TEST_ASSERT_FALSE(update->start("http:///fw.bin"));
+    TEST_ASSERT_FALSE(update->start("http://updates.local:99999/fw.bin"));
+    TEST_ASSERT_TRUE(update->status().state == OtaState::Failed);
+    TEST_ASSERT_EQUAL_STRING("bad url", update->status().error);
+
+    server->serve("/fw.bin", image(20000, 8));
+    TEST_ASSERT_TRUE(update->start("http://updates.local/fw.bin"));
+    TEST_ASSERT_FALSE(update->start("http://updates.local/fw.bin"));
+
+    update->cancel();
+    TEST_ASSERT_TRUE(update->status().state == OtaState::Failed);
+    TEST_ASSERT_EQUAL_STRING("cancelled", update->status().error);
+    TEST_ASSERT_TRUE(update->start("http://updates.local/fw.bin"));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_downloads_and_installs_a_plain_image);
+    RUN_TEST(test_each_poll_reads_a_bounded_chunk);
+    RUN_TEST(test_dropped_connections_resume_with_a_range);
+    RUN_TEST(test_server_without_ranges_starts_over);
+    RUN_TEST(test_delta_image_over_http);
+    RUN_TEST(test_missing_image_fails_without_retrying);
+    RUN_TEST(test_unreachable_server_gives_up_and_discards_the_slot);
+    RUN_TEST(test_server_errors_are_retried);
+    RUN_TEST(test_start_rejects_bad_urls_and_a_second_update);
+    return UNITY_END();
+}
@@ -0,0 +1,272 @@
+/**
+ * Kaldor IIoT - Allocation audit of the per-sample path (native)
+ *
+ * Replaces the global allocator with a counting one and runs the code each
+ * 100 Hz sample goes through (rolling window, core hand-off ring, payload
+ * formatting, raw frames, offline buffering, backlog batches). After
+ * warm-up, the steady-state loop must not allocate at all.
+ *
+ * Run with: pio test -e native -f test_publish_path
+ */
+
+#include <unity.h>
+#include <new>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+#include "mqtt_topics.h"
+#include "payload_writer.h"
+#include "rolling_window.h"
+#include "spsc_ring.h"
+#include "telemetry_frame.h"
+#include "tiered_store.h"
+
+// ---- Counting allocator ----------------------------------------------------
+
+static volatile size_t allocations = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    void* p = ::malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void* operator new[](size_t size) { return ::operator new(size); }
+
+// Out of line, so GCC doesn't see free() inlined against operator new and
+// raise -Wmismatched-new-delete at every std::allocator call site
+__attribute__((noinline)) void operator delete(void* p) noexcept { ::free(p); }
+__attribute__((noinline)) void operator delete[](void* p) noexcept { ::free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { ::free(p); }
+__attribute__((noinline)) void operator delete[](void* p, size_t) noexcept { ::free(p); }
+
+// C allocations too (snprintf, stdio), where the libc allows interposing
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+extern "C" {
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+
+void* malloc(size_t size) {
+    allocations++;
+    return __libc_malloc(size);
+}
+void* calloc(size_t n, size_t size) {
+    allocations++;
+    return __libc_calloc(n, size);
+}
+void* realloc(void* p, size_t size) {
+    allocations++;
+    return __libc_realloc(p, size);
+}
+}
+#endif
+
+// ---- In-memory journal backend with fixed storage --------------------------
+
+class StaticStore : public JournalStore {
+public:
+    static const size_t SEGMENT_BYTES = 64 * JOURNAL_RECORD_SIZE;
+    uint8_t data[4][SEGMENT_BYTES];
+    size_t used[4];
+
+    StaticStore() { memset(used, 0, sizeof(used)); }
+
+    size_t size(uint8_t seg) override { return used[seg]; }
+    size_t read(uint8_t seg, size_t off, uint8_t* out, size_t n) override {
+        if (off >= used[seg]) return 0;
+        if (n > used[seg] - off) n = used[seg] - off;
+        memcpy(out, data[seg] + off, n);
+        return n;
+    }
+    bool append(uint8_t seg, const uint8_t* in, size_t n) override {
+        if (used[seg] + n > SEGMENT_BYTES) return false;
+        memcpy(data[seg] + used[seg], in, n);
+        used[seg] += n;
+        return true;
+    }
+    bool erase(uint8_t seg) override {
+        used[seg] = 0;
+        return true;
+    }
+};
+
+static SensorData sample(uint32_t i) {
+    SensorData d = {};
+    d.bbw = 120.0f + (float)(i % 50) * 0.13f;
+    d.quality = (uint8_t)(90 + i % 10);
+    d.timestamp = i * 10;
+    return d;
+}
+
+void setUp() {}
+void tearDown() {}
+
+// ---- Output format ---------------------------------------------------------
+
+void test_topics_are_built_once_per_loom() {
+    MqttTopics topics;
+    TEST_ASSERT_TRUE(topics.build("LOOM-001"));
+    TEST_ASSERT_EQUAL_STRING("kaldor/loom/LOOM-001/bbw/raw", topics.raw);
+    TEST_ASSERT_EQUAL_STRING("kaldor/loom/LOOM-001/backlog/ack", topics.backlogAck);
+    TEST_ASSERT_TRUE(MqttTopics::matches("kaldor/loom/LOOM-001/ota", topics.ota));
+    TEST_ASSERT_FALSE(MqttTopics::matches("kaldor/loom/LOOM-002/ota", topics.ota));
+
+    char longId[80];
+    memset(longId, 'x', sizeof(longId) - 1);
+    longId[sizeof(longId) - 1] = '\0';
+    TEST_ASSERT_FALSE(topics.build(longId));
+}
+
+void test_raw_sample_json() {
+    char buf[128];
+    PayloadWriter out(buf, sizeof(buf));
+    SensorData d = {};
+    d.bbw = 123.456f;
+    d.quality = 97;
+    d.timestamp = 4000000000u;
+    TEST_ASSERT_TRUE(writeRawSample(out, d, "BBW-1a2b"));
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"timestamp\":4000000000,\"device_id\":\"BBW-1a2b\",\"bbw\":123.46,\"quality\":97}",
+        out.c_str());
+    TEST_ASSERT_EQUAL(strlen(buf), out.length());
+
+    d.bbw_raw = 180.5f;                     // Replaced by the outlier filter
+    d.bbw_outlier = true;
+    TEST_ASSERT_TRUE(writeRawSample(out, d, "BBW-1a2b"));
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"timestamp\":4000000000,\"device_id\":\"BBW-1a2b\",\"bbw\":123.46,\"bbw_raw\":180.50,\"quality\":97}",
+        out.c_str());
+}
+
+void test_numbers_and_escaping() {
+    char buf[128];
+    PayloadWriter out(buf, sizeof(buf));
+    out.beginObject()
+       .add("neg", -0.004f, 2)
+       .add("small", -1.05f, 1)
+       .add("nan", NAN, 2)
+       .add("int", (int32_t)-42)
+       .add("s", "a\"b\\")
+       .beginArray("e").endArray()
+       .endObject();
+    TEST_ASSERT_TRUE(out.ok());
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"neg\":0.00,\"small\":-1.1,\"nan\":null,\"int\":-42,\"s\":\"a\\\"b\\\\\",\"e\":[]}",
+        out.c_str());
+}
+
+void test_overflow_is_reported() {
+    char buf[16];
+    PayloadWriter out(buf, sizeof(buf));
+    TEST_ASSERT_FALSE(writeRawSample(out, sample(1), "BBW-1a2b"));
+    TEST_ASSERT_LESS_THAN(sizeof(buf), strlen(buf));
+}
+
+void test_backlog_batch_json() {
+    char buf[256];
+    PayloadWriter out(buf, sizeof(buf));
+    SensorData records[2] = {sample(0), sample(1)};
+    uint32_t seqs[2] = {7, 8};
+    TEST_ASSERT_TRUE(writeBacklogBatch(out, "BBW-1", "LOOM-1", records, seqs, 2));
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"device_id\":\"BBW-1\",\"loom_id\":\"LOOM-1\",\"first_seq\":7,\"last_seq\":8,"
+        "\"samples\":[[7,0,120.00,90],[8,10,120.13,91]]}",
+        out.c_str());
+}
+
+// ---- Allocation audit ------------------------------------------------------
+
+static StaticStore flash;
+static SequencedSample hotStorage[64];
+static SequencedSample warmStorage[128];
+
+void test_steady_state_sample_path_does_not_allocate() {
+    MqttTopics topics;
+    topics.build("LOOM-001");
+    const char* deviceId = "BBW-00c0ffee";
+    uint32_t deviceHash = deviceIdHash(deviceId);
+
+    RollingWindow<float, 100> window;
+    SpscRing<SensorData, 256> ring;
+    char payloadBuffer[960];
+    PayloadWriter payload(payloadBuffer, sizeof(payloadBuffer));
+    uint8_t frameBuffer[960];
+    TelemetryFrameEncoder frame(frameBuffer, sizeof(frameBuffer));
+    uint16_t frameSeq = 0;
+
+    SampleJournal journal(flash, 4, 64, 10);
+    journal.begin();
+    TieredSampleStore store(journal);
+    store.begin(hotStorage, 64, warmStorage, 128);
+
+    SensorData batch[20];
+    uint32_t seqs[20];
+    size_t published = 0;
+
+    auto runSamples = [&](uint32_t from, uint32_t count) {
+        for (uint32_t i = from; i < from + count; i++) {
+            // Acquisition task
+            SensorData d = sample(i);
+            window.push(d.bbw);
+            d.bbw_stddev = window.stddev();
+            ring.push(d);
+
+            // Network task: live publish, offline buffer, raw frame
+            SensorData out;
+            while (ring.pop(out)) {
+                if (writeRawSample(payload, out, deviceId)) published += payload.length();
+                store.add(out);
+
+                if (frame.empty()) frame.begin(deviceHash, out.timestamp, frameSeq);
+                if (!frame.add(out.timestamp, out.bbw, out.quality) || frame.count() >= 100) {
+                    frameSeq++;
+                    frame.clear();
+                }
+            }
+
+            // Backlog batch every 5 samples (20 Hz)
+            if (i % 5 == 0) {
+                size_t n = 0;
+                store.read(store.oldestSequence(), 20, [&](uint32_t seq, const SensorData& s) {
+                    seqs[n] = seq;
+                    batch[n] = s;
+                    n++;
+                });
+                if (n > 0 && writeBacklogBatch(payload, deviceId, "LOOM-001", batch, seqs, n)) {
+                    published += payload.length();
+                    store.acknowledge(seqs[n - 1]);
+                }
+            }
+        }
+    };
+
+    // Warm-up: fill windows and tiers, rotate the journal at least once
+    runSamples(0, 2000);
+
+    size_t before = allocations;
+    runSamples(2000, 10000);
+    size_t during = allocations - before;
+
+    TEST_ASSERT_GREATER_THAN(0, published);
+    TEST_ASSERT_EQUAL_MESSAGE(0, during, "per-sample path allocated on the heap");
+}
+
+void test_counting_allocator_sees_allocations() {
+    size_t before = allocations;
+    std::vector<int> grows;
+    grows.push_back(1);
+    TEST_ASSERT_GREATER_THAN(before, allocations);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_topics_are_built_once_per_loom);
+    RUN_TEST(test_raw_sample_json);
+    RUN_TEST(test_numbers_and_escaping);
+    RUN_TEST(test_overflow_is_reported);
+    RUN_TEST(test_backlog_batch_json);
+    RUN_TEST(test_counting_allocator_sees_allocations);
+    RUN_TEST(test_steady_state_sample_path_does_not_allocate);
+    return UNITY_END();
+}
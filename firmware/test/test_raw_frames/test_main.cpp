@@ -0,0 +1,183 @@
+/**
+ * Kaldor IIoT - Binary raw frame publishing through an outage (native)
+ *
+ * SamplePublisher and DataBuffer built with RAW_BINARY_FRAMES 1: a frame
+ * that cannot be sent, because the broker is down or the live queue is
+ * full, must end up in the local buffer sample for sample, in order.
+ *
+ * Run with: pio test -e native -f test_raw_frames
+ */
+
+#define RAW_BINARY_FRAMES 1
+#undef JOURNAL_PATH_PREFIX                  // env:native sets the simulation's
+#define JOURNAL_PATH_PREFIX "/tmp/kaldor-test-raw-frames-"
+
+#include <unity.h>
+#include <vector>
+#include "hal_sim.h"
+#include "runtime_config_defaults.h"
+#include "../../src/data_buffer.cpp"
+#include "../../src/sample_publisher.cpp"
+
+void halLog(const char*, ...) {}
+
+/** Connected broker stand-in that can refuse publishes (a full queue). */
+class FrameBroker : public MqttTransport {
+public:
+    bool online = true;
+    bool accepting = true;
+    std::vector<uint16_t> frameCounts;
+    std::vector<uint16_t> frameSequences;
+
+    bool connected() override { return online; }
+
+    bool publish(const char*, const uint8_t* payload, size_t length, bool, uint8_t,
+                 MqttPriority) override {
+        if (!online || !accepting) return false;
+        TelemetryFrameDecoder frame;
+        bool valid = frame.begin(payload, length);
+        frameCounts.push_back(valid ? frame.header().count : 0);
+        frameSequences.push_back(frame.header().sequence);
+        return true;
+    }
+    using MqttTransport::publish;
+};
+
+struct Rig {
+    SimClock clock;
+    FrameBroker broker;
+    DataBuffer buffer;
+    Backfill backfill;
+    ReportFilter filter;
+    RuntimeConfig config;
+    MqttTopics topics;
+    char payloadBuffer[512];
+    PayloadWriter payload;
+    SamplePublisher publisher;
+    uint32_t next;
+
+    Rig()
+        : backfill(BACKFILL_INTERVAL_MS, BACKFILL_ACK_TIMEOUT_MS, BACKFILL_WINDOW),
+          filter(0, 0, 0), config(defaultRuntimeConfig(100)),
+          payload(payloadBuffer, sizeof(payloadBuffer)),
+          publisher(broker, clock, buffer, backfill, filter, config, topics, payload), next(0) {
+        buffer.begin(1000, 0);
+        buffer.clear();
+        topics.build("loom-001");
+        publisher.begin("BBW-a1b2c3d4", "loom-001", deviceIdHash("BBW-a1b2c3d4"));
+    }
+
+    /** n samples at 100 Hz, with the fields a frame does not carry set. */
+    void samples(uint32_t n) {
+        for (uint32_t i = 0; i < n; i++, next++) {
+            SensorData d = {};
+            d.timestamp = next * 10;
+            d.bbw = 120.0f + (float)(next % 7);
+            d.bbw_raw = d.bbw + 0.5f;
+            d.motor_current = (float)next;
+            d.quality = 95;
+            clock.advance(10000);
+            publisher.publish(d);
+            publisher.flush();
+        }
+    }
+
+    /** Timestamps of the buffered samples, checking the full records. */
+    void buffered(std::vector<uint32_t>& stamps) {
+        stamps.clear();
+        SensorData records[BACKFILL_BATCH_SIZE];
+        uint32_t seqs[BACKFILL_BATCH_SIZE];
+        uint32_t from = buffer.oldestSequence();
+        size_t n;
+        while ((n = buffer.readBacklog(from, records, seqs, BACKFILL_BATCH_SIZE)) > 0) {
+            for (size_t i = 0; i < n; i++) {
+                uint32_t k = (uint32_t)(records[i].timestamp / 10);
+                TEST_ASSERT_EQUAL_FLOAT((float)k, records[i].motor_current);
+                TEST_ASSERT_EQUAL_FLOAT(records[i].bbw + 0.5f, records[i].bbw_raw);
+                stamps.push_back((uint32_t)records[i].timestamp);
+            }
+            from = seqs[n - 1] + 1;
+        }
+    }
+};
+
+static void assertBuffered(Rig& rig, uint32_t first, uint32_t n) {
+    std::vector<uint32_t> stamps;
+    rig.buffered(stamps);
+    TEST_ASSERT_EQUAL(n, stamps.size());
+    for (uint32_t i = 0; i < n; i++) {
+        TEST_ASSERT_EQUAL_UINT32((first + i) * 10, stamps[i]);
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_frames_go_out_while_connected() {
+    static Rig rig;
+    rig.samples(250);
+    TEST_ASSERT_EQUAL(2, rig.broker.frameCounts.size());
+    TEST_ASSERT_EQUAL_UINT16(RAW_FRAME_MAX_SAMPLES, rig.broker.frameCounts[0]);
+    TEST_ASSERT_EQUAL_UINT16(1, rig.broker.frameSequences[1]);
+    TEST_ASSERT_EQUAL(0, rig.buffer.size());
+}
+
+void test_outage_buffers_the_open_frame_first() {
+    static Rig rig;
+    rig.samples(40);                        // Frame open, not yet due
+    rig.broker.online = false;
+    rig.samples(30);
+    TEST_ASSERT_EQUAL(0, rig.broker.frameCounts.size());
+    assertBuffered(rig, 0, 70);
+
+    // Back online: frames again, numbered on from the last one sent
+    rig.broker.online = true;
+    rig.samples(RAW_FRAME_MAX_SAMPLES);
+    TEST_ASSERT_EQUAL(1, rig.broker.frameCounts.size());
+    TEST_ASSERT_EQUAL_UINT16(0, rig.broker.frameSequences[0]);
+    TEST_ASSERT_EQUAL(70, rig.buffer.size());
+}
+
+void test_refused_frames_are_buffered() {
+    static Rig rig;
+    rig.broker.accepting = false;           // Connected, live queue full
+    rig.samples(RAW_FRAME_MAX_SAMPLES + 20);
+    TEST_ASSERT_EQUAL(0, rig.broker.frameCounts.size());
+    assertBuffered(rig, 0, RAW_FRAME_MAX_SAMPLES);
+
+    // The partial frame is refused when it is due, too
+    rig.clock.advance(RAW_FRAME_MAX_AGE_MS * 1000);
+    rig.publisher.flush();
+    assertBuffered(rig, 0, RAW_FRAME_MAX_SAMPLES + 20);
+
+    rig.broker.accepting = true;
+    rig.samples(RAW_FRAME_MAX_SAMPLES);
+    TEST_ASSERT_EQUAL(1, rig.broker.frameCounts.size());
+    TEST_ASSERT_EQUAL_UINT16(0, rig.broker.frameSequences[0]);
+}
+
+void test_persist_keeps_the_open_frame() {
+    static Rig rig;
+    rig.samples(RAW_FRAME_MAX_SAMPLES + 40);    // One frame sent, one open
+    TEST_ASSERT_TRUE(rig.publisher.persist());
+    TEST_ASSERT_EQUAL(1, rig.broker.frameCounts.size());
+    TEST_ASSERT_EQUAL(0, rig.buffer.ramSize());
+    TEST_ASSERT_EQUAL(40, rig.buffer.flashSize());
+
+    // The journal keeps fewer fields than RAM; the timestamps must match
+    SensorData records[40];
+    uint32_t seqs[40];
+    TEST_ASSERT_EQUAL(40, rig.buffer.readBacklog(rig.buffer.oldestSequence(), records, seqs, 40));
+    for (uint32_t i = 0; i < 40; i++) {
+        TEST_ASSERT_EQUAL_UINT32((RAW_FRAME_MAX_SAMPLES + i) * 10, (uint32_t)records[i].timestamp);
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_frames_go_out_while_connected);
+    RUN_TEST(test_outage_buffers_the_open_frame_first);
+    RUN_TEST(test_refused_frames_are_buffered);
+    RUN_TEST(test_persist_keeps_the_open_frame);
+    return UNITY_END();
+}
@@ -0,0 +1,141 @@
+/**
+ * Kaldor IIoT - ReportFilter and AdaptiveRate unit tests (native)
+ *
+ * Run with: pio test -e native -f test_report_filter
+ */
+
+#include <unity.h>
+#include <math.h>
+#include "report_filter.h"
+#include "adaptive_rate.h"
+
+static const AdaptiveRateConfig RATE = {
+    10,         // fast interval (ms)
+    100,        // idle interval (ms)
+    1.0f,       // active stddev (mm)
+    0.2f,       // idle stddev
+    0.05f,      // active vibration (g)
+    0.01f,      // idle vibration
+    30000,      // hold (ms)
+};
+
+static uint32_t lcg = 1;
+static float noise(float amplitude) {
+    lcg = lcg * 1664525u + 1013904223u;
+    return amplitude * (((float)(lcg >> 8) / 16777216.0f) * 2.0f - 1.0f);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_disabled_filter_reports_everything() {
+    ReportFilter filter(0, 0, 0);
+    for (uint32_t i = 0; i < 100; i++) {
+        TEST_ASSERT_TRUE(filter.shouldReport(120.0f, true, i * 10));
+    }
+    TEST_ASSERT_EQUAL(0, filter.suppressed());
+}
+
+void test_absolute_deadband_and_drift() {
+    ReportFilter filter(0.5f, 0, 0);
+    TEST_ASSERT_TRUE(filter.shouldReport(120.0f, true, 0));     // First sample
+    TEST_ASSERT_FALSE(filter.shouldReport(120.4f, true, 10));
+    TEST_ASSERT_FALSE(filter.shouldReport(119.6f, true, 20));
+
+    // Slow drift is reported once it adds up against the last report
+    TEST_ASSERT_FALSE(filter.shouldReport(120.3f, true, 30));
+    TEST_ASSERT_TRUE(filter.shouldReport(120.6f, true, 40));
+    TEST_ASSERT_FALSE(filter.shouldReport(121.0f, true, 50));
+}
+
+void test_percent_deadband_uses_larger_band() {
+    ReportFilter filter(0.1f, 1.0f, 0);         // 1 % of 200 mm = 2 mm
+    filter.shouldReport(200.0f, true, 0);
+    TEST_ASSERT_FALSE(filter.shouldReport(201.5f, true, 10));
+    TEST_ASSERT_TRUE(filter.shouldReport(202.5f, true, 20));
+}
+
+void test_heartbeat_validity_and_force() {
+    ReportFilter filter(1.0f, 0, 5000);
+    filter.shouldReport(120.0f, true, 0);
+    TEST_ASSERT_FALSE(filter.shouldReport(120.0f, true, 4990));
+    TEST_ASSERT_TRUE(filter.shouldReport(120.0f, true, 5000));  // Heartbeat
+
+    TEST_ASSERT_TRUE(filter.shouldReport(-1.0f, false, 5010));  // Became invalid
+    TEST_ASSERT_FALSE(filter.shouldReport(-1.0f, false, 5020));
+    TEST_ASSERT_TRUE(filter.shouldReport(120.0f, true, 5030));  // Valid again
+
+    TEST_ASSERT_TRUE(filter.shouldReport(120.0f, true, 5040, true));
+}
+
+void test_stable_loom_is_cut_tenfold_without_losing_excursions() {
+    // 10 minutes at 100 Hz: +-0.3 mm noise around 120 mm, with a 40 ms
+    // excursion to 126 mm every minute
+    ReportFilter filter(0.5f, 0, 5000);
+    uint32_t excursions = 0, excursionsReported = 0, total = 0;
+
+    for (uint32_t t = 0; t < 600000; t += 10) {
+        bool excursion = (t % 60000) >= 30000 && (t % 60000) < 30040;
+        float value = 120.0f + noise(0.3f) + (excursion ? 6.0f : 0.0f);
+        bool reported = filter.shouldReport(value, true, t);
+        total++;
+        if (excursion && (t % 60000) == 30000) {
+            excursions++;
+            if (reported) excursionsReported++;
+        }
+    }
+
+    TEST_ASSERT_EQUAL(10, excursions);
+    TEST_ASSERT_EQUAL(excursions, excursionsReported);
+    TEST_ASSERT_LESS_THAN(total / 10, filter.reported());
+}
+
+void test_rate_steps_up_at_once_and_down_after_hold() {
+    AdaptiveRate rate(RATE, 20, true);
+    TEST_ASSERT_EQUAL(20, rate.update(0.5f, 0.02f, 0));
+
+    // Vibration spike: fast immediately
+    TEST_ASSERT_EQUAL(10, rate.update(0.5f, 0.08f, 1000));
+    TEST_ASSERT_TRUE(rate.state() == RateState::Active);
+
+    // Calm again, but held until holdMs after the last activity
+    TEST_ASSERT_EQUAL(10, rate.update(0.5f, 0.02f, 30000));
+    TEST_ASSERT_EQUAL(20, rate.update(0.5f, 0.02f, 31000));
+
+    // Quiet loom: idle after another hold
+    TEST_ASSERT_EQUAL(20, rate.update(0.1f, 0.005f, 40000));
+    TEST_ASSERT_EQUAL(20, rate.update(0.1f, 0.005f, 60000));
+    TEST_ASSERT_EQUAL(100, rate.update(0.1f, 0.005f, 61000));
+
+    // Any movement leaves idle at once
+    TEST_ASSERT_EQUAL(20, rate.update(0.5f, 0.005f, 62000));
+    TEST_ASSERT_EQUAL(10, rate.update(2.0f, 0.005f, 63000));
+    TEST_ASSERT_EQUAL(5, rate.changes());
+}
+
+void test_rate_config() {
+    AdaptiveRate rate(RATE, 10, false);
+    rate.setRate(50);
+    TEST_ASSERT_EQUAL(20, rate.update(5.0f, 1.0f, 0));      // Not adaptive
+    rate.setRate(1000);
+    TEST_ASSERT_EQUAL(10, rate.baseInterval());             // Clamped to fast
+    rate.setRate(0);
+    TEST_ASSERT_EQUAL(1000, rate.baseInterval());
+
+    rate.setRate(20);
+    rate.setAdaptive(true);
+    TEST_ASSERT_EQUAL(50, rate.update(0.5f, 0.02f, 5000));
+    TEST_ASSERT_EQUAL(10, rate.update(2.0f, 0.02f, 5050));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_disabled_filter_reports_everything);
+    RUN_TEST(test_absolute_deadband_and_drift);
+    RUN_TEST(test_percent_deadband_uses_larger_band);
+    RUN_TEST(test_heartbeat_validity_and_force);
+    RUN_TEST(test_stable_loom_is_cut_tenfold_without_losing_excursions);
+    RUN_TEST(test_rate_steps_up_at_once_and_down_after_hold);
+    RUN_TEST(test_rate_config);
+    return UNITY_END();
+}
@@ -0,0 +1,111 @@
+/**
+ * Kaldor IIoT - RollingWindow unit tests (native)
+ *
+ * Run with: pio test -e native -f test_rolling_window
+ */
+
+#include <unity.h>
+#include <stdlib.h>
+#include "rolling_window.h"
+
+void setUp() {}
+void tearDown() {}
+
+// Reference implementation: full rescan of the last N samples, as
+// SensorManager::updateStatistics() used to do.
+struct Rescan {
+    float mean, stddev, minimum, maximum;
+    size_t invalid;
+};
+
+template <size_t N>
+static Rescan rescan(const float* history, const bool* valid, size_t count) {
+    Rescan r = {0, 0, 0, 0, 0};
+    size_t start = count > N ? count - N : 0;
+    double sum = 0, sumSq = 0;
+    size_t n = 0;
+    for (size_t i = start; i < count; i++) {
+        if (!valid[i]) { r.invalid++; continue; }
+        float v = history[i];
+        if (n == 0 || v < r.minimum) r.minimum = v;
+        if (n == 0 || v > r.maximum) r.maximum = v;
+        sum += v;
+        sumSq += (double)v * v;
+        n++;
+    }
+    if (n) {
+        double mean = sum / n;
+        double var = sumSq / n - mean * mean;
+        r.mean = (float)mean;
+        r.stddev = (float)sqrt(var > 0 ? var : 0);
+    }
+    return r;
+}
+
+void test_empty_window_reports_zero() {
+    RollingWindow<float, 8> w;
+    TEST_ASSERT_EQUAL(0, w.count());
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, w.mean());
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, w.minimum());
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, w.maximum());
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, w.stddev());
+}
+
+void test_min_max_follow_eviction() {
+    RollingWindow<float, 3> w;
+    w.push(5); w.push(1); w.push(9);
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, w.minimum());
+    TEST_ASSERT_EQUAL_FLOAT(9.0f, w.maximum());
+    w.push(4);  // evicts 5
+    w.push(6);  // evicts 1
+    TEST_ASSERT_EQUAL_FLOAT(4.0f, w.minimum());
+    w.push(2);  // evicts 9
+    TEST_ASSERT_EQUAL_FLOAT(6.0f, w.maximum());
+    TEST_ASSERT_EQUAL_FLOAT(2.0f, w.minimum());
+    TEST_ASSERT_EQUAL_FLOAT(4.0f, w.mean());
+}
+
+void test_invalid_samples_are_counted_not_averaged() {
+    RollingWindow<float, 4> w;
+    w.push(10); w.push(-1, false); w.push(20); w.push(-1, false);
+    TEST_ASSERT_EQUAL(4, w.count());
+    TEST_ASSERT_EQUAL(2, w.invalidCount());
+    TEST_ASSERT_EQUAL_FLOAT(15.0f, w.mean());
+    TEST_ASSERT_EQUAL_FLOAT(10.0f, w.minimum());
+    w.push(30); w.push(40); w.push(50);  // evicts 10, -1, 20
+    TEST_ASSERT_EQUAL(1, w.invalidCount());
+    TEST_ASSERT_EQUAL_FLOAT(30.0f, w.minimum());
+    TEST_ASSERT_EQUAL_FLOAT(50.0f, w.maximum());
+}
+
+void test_matches_rescan_on_random_stream() {
+    const size_t total = 20000;
+    static float history[total];
+    static bool valid[total];
+    RollingWindow<float, 100> w;
+    srand(42);
+
+    for (size_t i = 0; i < total; i++) {
+        valid[i] = (rand() % 20) != 0;
+        history[i] = valid[i] ? 100.0f + (rand() % 2000) / 100.0f : -1.0f;
+        w.push(history[i], valid[i]);
+
+        if (i % 97 == 0 || i == total - 1) {
+            Rescan r = rescan<100>(history, valid, i + 1);
+            TEST_ASSERT_EQUAL(r.invalid, w.invalidCount());
+            TEST_ASSERT_EQUAL_FLOAT(r.minimum, w.minimum());
+            TEST_ASSERT_EQUAL_FLOAT(r.maximum, w.maximum());
+            TEST_ASSERT_FLOAT_WITHIN(1e-3f, r.mean, w.mean());
+            TEST_ASSERT_FLOAT_WITHIN(1e-2f, r.stddev, w.stddev());
+        }
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_window_reports_zero);
+    RUN_TEST(test_min_max_follow_eviction);
+    RUN_TEST(test_invalid_samples_are_counted_not_averaged);
+    RUN_TEST(test_matches_rescan_on_random_stream);
+    return UNITY_END();
+}
@@ -0,0 +1,190 @@
+/**
+ * Kaldor IIoT - Rollup unit tests (native)
+ *
+ * Bucket alignment and closing order, merged statistics against a direct
+ * computation over the same samples, the payload, and RollupPublisher's
+ * level mask and offline holding.
+ *
+ * Run with: pio test -e native -f test_rollup
+ */
+
+#include <unity.h>
+#include <math.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "rollup.h"
+#include "hal_sim.h"
+
+static SensorData sample(uint32_t timestamp, float bbw) {
+    SensorData data = {};
+    data.timestamp = timestamp;
+    data.bbw = bbw;
+    data.quality = 90;
+    data.temperature = 24.0f;
+    data.vibration = 0.02f;
+    return data;
+}
+
+/** BBW around 120 mm: a slow swing plus a little noise, some invalid. */
+static float bbwAt(uint32_t i) {
+    if (i % 97 == 0) return -1.0f;
+    return 120.0f + 3.0f * (float)sin((double)i * 0.001) + (float)((i * 7919u) % 100) * 0.01f;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_buckets_close_finest_first_on_aligned_boundaries() {
+    Rollups rollups;
+    std::vector<RollupBucket> closed;
+    auto sink = [&](const RollupBucket& b) { closed.push_back(b); };
+
+    // 100 Hz from 250 ms: the first 1 s bucket starts at 0 and is partial
+    for (uint32_t t = 250; t < 60000; t += 10) rollups.add(sample(t, 120.0f), sink);
+    TEST_ASSERT_EQUAL_UINT32(59, closed.size());
+    TEST_ASSERT_EQUAL_UINT32(0, closed[0].start);
+    TEST_ASSERT_EQUAL_UINT32(75, closed[0].samples);
+    TEST_ASSERT_EQUAL_UINT32(58000, closed.back().start);
+
+    closed.clear();
+    TEST_ASSERT_EQUAL_UINT32(2, rollups.add(sample(60000, 120.0f), sink));
+    TEST_ASSERT_EQUAL_UINT8((uint8_t)RollupLevel::Second, closed[0].level);
+    TEST_ASSERT_EQUAL_UINT32(59000, closed[0].start);
+    TEST_ASSERT_EQUAL_UINT8((uint8_t)RollupLevel::Minute, closed[1].level);
+    TEST_ASSERT_EQUAL_UINT32(0, closed[1].start);
+    TEST_ASSERT_EQUAL_UINT32(60000, closed[1].durationMs());
+    TEST_ASSERT_EQUAL_UINT32(5975, closed[1].samples);
+
+    TEST_ASSERT_NOT_NULL(rollups.current(RollupLevel::Second));
+    TEST_ASSERT_NULL(rollups.current(RollupLevel::Minute));    // Opens when a second closes
+}
+
+void test_hour_matches_a_direct_computation() {
+    Rollups rollups;
+    std::vector<RollupBucket> hours;
+    size_t minutes = 0;
+    auto sink = [&](const RollupBucket& b) {
+        if (b.level == (uint8_t)RollupLevel::Hour) hours.push_back(b);
+        if (b.level == (uint8_t)RollupLevel::Minute) minutes++;
+    };
+
+    // 10 Hz for an hour and a bit; the direct statistics cover the first hour
+    double sum = 0, sumSquares = 0, lo = 1e9, hi = -1e9;
+    uint32_t valid = 0, samples = 0;
+    for (uint32_t i = 0; i <= 36000 + 10; i++) {
+        uint32_t t = i * 100;
+        float bbw = bbwAt(i);
+        rollups.add(sample(t, bbw), sink);
+        if (t >= 3600000) continue;
+        samples++;
+        if (bbw <= 0) continue;
+        valid++;
+        sum += (double)bbw;
+        sumSquares += (double)bbw * (double)bbw;
+        lo = fmin(lo, (double)bbw);
+        hi = fmax(hi, (double)bbw);
+    }
+    double mean = sum / valid;
+    double stddev = sqrt(sumSquares / valid - mean * mean);
+
+    TEST_ASSERT_EQUAL_UINT32(60, minutes);
+    TEST_ASSERT_EQUAL_UINT32(1, hours.size());
+    const RollupBucket& hour = hours[0];
+    TEST_ASSERT_EQUAL_UINT32(0, hour.start);
+    TEST_ASSERT_EQUAL_UINT32(samples, hour.samples);
+    TEST_ASSERT_EQUAL_UINT32(valid, hour.count);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, (float)mean, hour.mean);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, (float)stddev, hour.stddev());
+    TEST_ASSERT_EQUAL_FLOAT((float)lo, hour.minimum);
+    TEST_ASSERT_EQUAL_FLOAT((float)hi, hour.maximum);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 90.0f, hour.qualityMean);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 24.0f, hour.temperatureMean);
+}
+
+void test_payload_follows_the_view_columns() {
+    RollupBucket bucket;
+    bucket.clear((uint8_t)RollupLevel::Minute, 120000);
+    SensorData a = sample(120010, 120.0f);
+    SensorData b = sample(120020, 124.0f);
+    b.quality = 70;
+    b.bbw_outlier = true;
+    bucket.add(a);
+    bucket.add(b);
+    bucket.add(sample(120030, -1.0f));
+
+    char buf[512];
+    PayloadWriter out(buf, sizeof(buf));
+    TEST_ASSERT_TRUE(writeRollup(out, bucket, "BBW-1", "LOOM-1"));
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"device_id\":\"BBW-1\",\"loom_id\":\"LOOM-1\",\"resolution\":\"1m\","
+        "\"timestamp\":120000,\"duration_ms\":60000,\"sample_count\":3,\"valid_count\":2,"
+        "\"avg_bbw\":122.00,\"min_bbw\":120.00,\"max_bbw\":124.00,\"stddev_bbw\":2.000,"
+        "\"outliers\":1,\"avg_quality\":83.3,\"min_quality\":70,\"avg_temp\":24.0,"
+        "\"avg_vib\":0.0200,\"max_vib\":0.0200}",
+        out.c_str());
+
+    // No valid reading: the BBW columns are left out
+    bucket.clear((uint8_t)RollupLevel::Second, 0);
+    bucket.add(sample(10, -1.0f));
+    TEST_ASSERT_TRUE(writeRollup(out, bucket, "BBW-1", "LOOM-1"));
+    TEST_ASSERT_NULL(strstr(out.c_str(), "avg_bbw"));
+}
+
+void test_publisher_holds_coarse_levels_while_offline() {
+    SimBroker broker;
+    MqttTopics topics;
+    topics.build("L1");
+    char buf[512];
+    PayloadWriter payload(buf, sizeof(buf));
+    RollupPublisher publisher(broker, topics, payload);
+    publisher.begin("BBW-1", "L1");
+
+    std::vector<std::string> seen;
+    broker.onPublish([&](const char* topic, const uint8_t* data, size_t length) {
+        (void)data;
+        (void)length;
+        seen.push_back(topic);
+    });
+
+    RollupBucket second, minute, hour;
+    second.clear((uint8_t)RollupLevel::Second, 0);
+    minute.clear((uint8_t)RollupLevel::Minute, 0);
+    hour.clear((uint8_t)RollupLevel::Hour, 0);
+    second.add(sample(0, 120.0f));
+    minute.merge(second);
+    hour.merge(minute);
+
+    publisher.publish(second, 0x7);
+    publisher.publish(minute, 0x5);         // 1 min not enabled
+    TEST_ASSERT_EQUAL_UINT32(1, seen.size());
+    TEST_ASSERT_EQUAL_STRING("kaldor/loom/L1/bbw/rollup/1s", seen[0].c_str());
+
+    broker.setConnected(false);
+    publisher.publish(second, 0x7);         // Dropped: the raw backlog covers it
+    for (uint32_t i = 0; i < ROLLUP_PENDING + 2; i++) {
+        minute.start = i * 60000;
+        publisher.publish(minute, 0x7);
+    }
+    publisher.publish(hour, 0x7);
+    TEST_ASSERT_EQUAL_UINT32(ROLLUP_PENDING, publisher.pendingCount());
+    TEST_ASSERT_EQUAL_UINT32(1 + 3, publisher.dropped());     // Second, then the oldest minutes
+
+    broker.setConnected(true);
+    publisher.drain();
+    TEST_ASSERT_EQUAL_UINT32(0, publisher.pendingCount());
+    TEST_ASSERT_EQUAL_UINT32(1 + ROLLUP_PENDING, seen.size());
+    TEST_ASSERT_EQUAL_STRING("kaldor/loom/L1/bbw/rollup/1m", seen[1].c_str());
+    TEST_ASSERT_EQUAL_STRING("kaldor/loom/L1/bbw/rollup/1h", seen.back().c_str());
+    TEST_ASSERT_EQUAL_UINT32(ROLLUP_PENDING - 1, publisher.published(RollupLevel::Minute));
+    TEST_ASSERT_EQUAL_UINT32(1, publisher.published(RollupLevel::Hour));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_buckets_close_finest_first_on_aligned_boundaries);
+    RUN_TEST(test_hour_matches_a_direct_computation);
+    RUN_TEST(test_payload_follows_the_view_columns);
+    RUN_TEST(test_publisher_holds_coarse_levels_while_offline);
+    return UNITY_END();
+}
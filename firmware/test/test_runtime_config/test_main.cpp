@@ -0,0 +1,237 @@
+/**
+ * Kaldor IIoT - RuntimeConfig and ConfigSnapshot unit tests (native)
+ *
+ * Run with: pio test -e native -f test_runtime_config
+ */
+
+#include <unity.h>
+#include <math.h>
+#include <string.h>
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include "runtime_config.h"
+#include "config_snapshot.h"
+#include "runtime_config_store.h"
+
+static RuntimeConfig defaults() {
+    RuntimeConfig cfg;
+    cfg.layout = RUNTIME_CONFIG_LAYOUT;
+    cfg.version = 0;
+    cfg.bbwMin = 50;
+    cfg.bbwMax = 200;
+    cfg.temperatureMax = 80;
+    cfg.vibrationMax = 5;
+    cfg.calibrationOffset = 0;
+    cfg.calibrationScale = 1;
+    cfg.outlierThreshold = 3;
+    cfg.outlierMinSigmaMm = 0.3f;
+    cfg.sampleRateHz = 100;
+    cfg.adaptiveRate = false;
+    cfg.reportDeadbandMm = 0;
+    cfg.reportDeadbandPct = 0;
+    cfg.reportMaxSilenceMs = 5000;
+    cfg.publishRaw = true;
+    cfg.rollupLevels = 0x7;
+    return cfg;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_defaults_are_valid() {
+    TEST_ASSERT_NULL(validateRuntimeConfig(defaults()));
+}
+
+void test_rejects_bad_values() {
+    RuntimeConfig cfg = defaults();
+    cfg.bbwMin = 250;                       // Above bbwMax
+    TEST_ASSERT_NOT_NULL(validateRuntimeConfig(cfg));
+
+    cfg = defaults();
+    cfg.calibrationScale = NAN;
+    TEST_ASSERT_NOT_NULL(validateRuntimeConfig(cfg));
+
+    cfg = defaults();
+    cfg.calibrationScale = 0;
+    TEST_ASSERT_NOT_NULL(validateRuntimeConfig(cfg));
+
+    cfg = defaults();
+    cfg.sampleRateHz = 0;
+    TEST_ASSERT_NOT_NULL(validateRuntimeConfig(cfg));
+    cfg.sampleRateHz = 200;                 // Above the ultrasonic limit
+    TEST_ASSERT_NOT_NULL(validateRuntimeConfig(cfg));
+
+    cfg = defaults();
+    cfg.reportDeadbandPct = -1;
+    TEST_ASSERT_NOT_NULL(validateRuntimeConfig(cfg));
+
+    cfg = defaults();
+    cfg.outlierThreshold = 0.5f;            // Would reject most samples
+    TEST_ASSERT_NOT_NULL(validateRuntimeConfig(cfg));
+    cfg.outlierThreshold = 0;               // Off
+    TEST_ASSERT_NULL(validateRuntimeConfig(cfg));
+    cfg.outlierMinSigmaMm = -1;
+    TEST_ASSERT_NOT_NULL(validateRuntimeConfig(cfg));
+
+    cfg = defaults();
+    cfg.rollupLevels = 0x8;                 // No fourth level
+    TEST_ASSERT_NOT_NULL(validateRuntimeConfig(cfg));
+
+    cfg = defaults();
+    cfg.layout = RUNTIME_CONFIG_LAYOUT + 1; // Blob from another firmware
+    TEST_ASSERT_NOT_NULL(validateRuntimeConfig(cfg));
+}
+
+void test_changed_ignores_version() {
+    RuntimeConfig a = defaults();
+    RuntimeConfig b = a;
+    b.version = 7;
+    TEST_ASSERT_FALSE(runtimeConfigChanged(a, b));
+    b.vibrationMax = 4;
+    TEST_ASSERT_TRUE(runtimeConfigChanged(a, b));
+    b = a;
+    b.publishRaw = false;
+    TEST_ASSERT_TRUE(runtimeConfigChanged(a, b));
+}
+
+void test_snapshot_publish_and_generation() {
+    ConfigSnapshot<RuntimeConfig> snapshot(defaults());
+    RuntimeConfig out;
+    snapshot.read(out);
+    TEST_ASSERT_EQUAL_FLOAT(200, out.bbwMax);
+
+    uint32_t generation = snapshot.generation();
+    RuntimeConfig update = defaults();
+    update.version = 1;
+    update.bbwMax = 180;
+    snapshot.publish(update);
+    TEST_ASSERT_NOT_EQUAL(generation, snapshot.generation());
+
+    snapshot.read(out);
+    TEST_ASSERT_EQUAL_UINT32(1, out.version);
+    TEST_ASSERT_EQUAL_FLOAT(180, out.bbwMax);
+
+    // Both copies get reused
+    for (uint32_t v = 2; v < 6; v++) {
+        update.version = v;
+        snapshot.publish(update);
+        snapshot.read(out);
+        TEST_ASSERT_EQUAL_UINT32(v, out.version);
+    }
+}
+
+// Preferences' typed getters and putters over a map; NVS keys are at most
+// 15 characters
+struct FakePreferences {
+    std::map<std::string, float> floats;
+    std::map<std::string, uint32_t> uints;
+    std::map<std::string, bool> bools;
+    size_t longestKey = 0;
+
+    template <typename T>
+    static T get(const std::map<std::string, T>& m, const char* key, T fallback) {
+        auto it = m.find(key);
+        return it == m.end() ? fallback : it->second;
+    }
+    float getFloat(const char* key, float fallback) { return get(floats, key, fallback); }
+    uint32_t getUInt(const char* key, uint32_t fallback) { return get(uints, key, fallback); }
+    bool getBool(const char* key, bool fallback) { return get(bools, key, fallback); }
+
+    size_t note(const char* key) {
+        if (strlen(key) > longestKey) longestKey = strlen(key);
+        return 1;
+    }
+    size_t putFloat(const char* key, float v) { floats[key] = v; return note(key); }
+    size_t putUInt(const char* key, uint32_t v) { uints[key] = v; return note(key); }
+    size_t putBool(const char* key, bool v) { bools[key] = v; return note(key); }
+};
+
+void test_store_round_trip() {
+    RuntimeConfig saved = defaults();
+    saved.version = 9;
+    saved.bbwMax = 180;
+    saved.calibrationScale = 1.02f;
+    saved.sampleRateHz = 50;
+    saved.adaptiveRate = true;
+    saved.reportMaxSilenceMs = 60000;
+    saved.publishRaw = false;
+    saved.rollupLevels = 6;
+
+    FakePreferences store;
+    writeRuntimeConfig(store, saved);
+    TEST_ASSERT_TRUE(store.longestKey <= 15);
+
+    RuntimeConfig loaded = defaults();
+    readRuntimeConfig(store, loaded);
+    TEST_ASSERT_FALSE(runtimeConfigChanged(saved, loaded));
+    TEST_ASSERT_EQUAL_UINT32(9, loaded.version);
+    TEST_ASSERT_NULL(validateRuntimeConfig(loaded));
+}
+
+void test_store_missing_keys_keep_defaults() {
+    // Written by a firmware that had no report-by-exception settings yet
+    FakePreferences store;
+    store.putUInt("version", 4);
+    store.putFloat("bbw_min", 60);
+    store.putFloat("vib_max", 3);
+
+    RuntimeConfig loaded = defaults();
+    readRuntimeConfig(store, loaded);
+    TEST_ASSERT_EQUAL_UINT32(4, loaded.version);
+    TEST_ASSERT_EQUAL_FLOAT(60, loaded.bbwMin);
+    TEST_ASSERT_EQUAL_FLOAT(3, loaded.vibrationMax);
+    TEST_ASSERT_EQUAL_FLOAT(200, loaded.bbwMax);
+    TEST_ASSERT_EQUAL_UINT32(5000, loaded.reportMaxSilenceMs);
+    TEST_ASSERT_TRUE(loaded.publishRaw);
+    TEST_ASSERT_NULL(validateRuntimeConfig(loaded));
+}
+
+struct Pattern {
+    uint32_t words[16];     // All equal in a consistent copy
+};
+
+void test_readers_never_see_torn_copies() {
+    Pattern initial = {};
+    ConfigSnapshot<Pattern> snapshot(initial);
+    std::atomic<bool> done(false);
+    std::atomic<uint32_t> torn(0);
+
+    std::thread reader([&]() {
+        uint32_t last = 0;
+        Pattern p;
+        while (!done.load()) {
+            snapshot.read(p);
+            for (uint32_t w : p.words) {
+                if (w != p.words[0]) torn++;
+            }
+            if (p.words[0] < last) torn++;  // Never goes backwards
+            last = p.words[0];
+        }
+    });
+
+    Pattern p;
+    for (uint32_t v = 1; v <= 200000; v++) {
+        for (uint32_t& w : p.words) w = v;
+        snapshot.publish(p);
+    }
+    done = true;
+    reader.join();
+
+    TEST_ASSERT_EQUAL_UINT32(0, torn.load());
+    snapshot.read(p);
+    TEST_ASSERT_EQUAL_UINT32(200000, p.words[15]);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_defaults_are_valid);
+    RUN_TEST(test_rejects_bad_values);
+    RUN_TEST(test_changed_ignores_version);
+    RUN_TEST(test_snapshot_publish_and_generation);
+    RUN_TEST(test_store_round_trip);
+    RUN_TEST(test_store_missing_keys_keep_defaults);
+    RUN_TEST(test_readers_never_see_torn_copies);
+    return UNITY_END();
+}
@@ -0,0 +1,127 @@
+/**
+ * Kaldor IIoT - SampleBlocks unit tests (native)
+ *
+ * Run with: pio test -e native -f test_sample_blocks
+ */
+
+#include <unity.h>
+#include <thread>
+#include "sample_blocks.h"
+
+typedef SampleBlocks<int16_t, 3, 8> Blocks;
+
+static void produce(Blocks& blocks, int16_t first, size_t count, uint32_t nowMs = 0) {
+    for (size_t i = 0; i < count; i++) {
+        int16_t* slot = blocks.next();
+        slot[0] = (int16_t)(first + i);
+        slot[1] = 0;
+        slot[2] = -1;
+        blocks.commit(nowMs);
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_block_is_handed_over_when_full() {
+    Blocks blocks;
+    uint32_t ts = 0;
+    produce(blocks, 0, 7);
+    TEST_ASSERT_NULL(blocks.acquire(ts));
+
+    produce(blocks, 7, 1, 1234);
+    const int16_t* block = blocks.acquire(ts);
+    TEST_ASSERT_NOT_NULL(block);
+    TEST_ASSERT_EQUAL_UINT32(1234, ts);
+    for (int i = 0; i < 8; i++) TEST_ASSERT_EQUAL(i, block[i * 3]);
+    TEST_ASSERT_EQUAL(1, blocks.completed());
+}
+
+void test_producer_fills_other_block_while_consumer_holds_one() {
+    Blocks blocks;
+    uint32_t ts;
+    produce(blocks, 0, 8);
+    const int16_t* held = blocks.acquire(ts);
+
+    produce(blocks, 100, 4);
+    TEST_ASSERT_EQUAL(0, held[0]);          // Untouched while held
+    TEST_ASSERT_EQUAL(4, blocks.pending());
+
+    blocks.release();
+    produce(blocks, 104, 4);
+    const int16_t* next = blocks.acquire(ts);
+    TEST_ASSERT_NOT_NULL(next);
+    TEST_ASSERT_EQUAL(100, next[0]);
+    TEST_ASSERT_EQUAL(107, next[7 * 3]);
+}
+
+void test_busy_consumer_drops_whole_blocks() {
+    Blocks blocks;
+    uint32_t ts;
+    produce(blocks, 0, 8);
+    const int16_t* held = blocks.acquire(ts);
+
+    produce(blocks, 100, 16);               // Two blocks while busy
+    TEST_ASSERT_EQUAL(2, blocks.droppedBlocks());
+    TEST_ASSERT_EQUAL(16, blocks.droppedSamples());
+    TEST_ASSERT_EQUAL(0, held[0]);
+    TEST_ASSERT_EQUAL(1, blocks.completed());
+}
+
+void test_restart_discards_partial_block() {
+    Blocks blocks;
+    uint32_t ts;
+    produce(blocks, 0, 5);
+    blocks.restart();
+    TEST_ASSERT_EQUAL(5, blocks.droppedSamples());
+
+    produce(blocks, 50, 8);
+    const int16_t* block = blocks.acquire(ts);
+    TEST_ASSERT_NOT_NULL(block);
+    TEST_ASSERT_EQUAL(50, block[0]);        // No stale samples before the gap
+}
+
+void test_concurrent_blocks_are_never_torn() {
+    SampleBlocks<int16_t, 1, 64> blocks;
+    std::atomic<bool> done(false);
+    uint32_t checked = 0, torn = 0;
+
+    std::thread consumer([&] {
+        uint32_t ts;
+        while (!done.load()) {
+            const int16_t* block = blocks.acquire(ts);
+            if (!block) {
+                std::this_thread::yield();
+                continue;
+            }
+            // Each block holds 64 consecutive values
+            for (int i = 1; i < 64; i++) {
+                if ((int16_t)(block[i] - block[i - 1]) != 1) torn++;
+            }
+            checked++;
+            blocks.release();
+        }
+    });
+
+    int16_t value = 0;
+    for (int i = 0; i < 200000; i++) {
+        *blocks.next() = value++;
+        blocks.commit(0);
+        if ((i & 63) == 0) std::this_thread::yield();
+    }
+    done.store(true);
+    consumer.join();
+
+    TEST_ASSERT_GREATER_THAN(0, checked);
+    TEST_ASSERT_EQUAL(0, torn);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_block_is_handed_over_when_full);
+    RUN_TEST(test_producer_fills_other_block_while_consumer_holds_one);
+    RUN_TEST(test_busy_consumer_drops_whole_blocks);
+    RUN_TEST(test_restart_discards_partial_block);
+    RUN_TEST(test_concurrent_blocks_are_never_torn);
+    return UNITY_END();
+}
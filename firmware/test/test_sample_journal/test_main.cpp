@@ -0,0 +1,199 @@
+/**
+ * Kaldor IIoT - SampleJournal unit and fault-injection tests (native)
+ *
+ * Runs the journal against FileJournalStore in a temporary directory.
+ *
+ * Run with: pio test -e native -f test_sample_journal
+ */
+
+#include <unity.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "sample_journal.h"
+
+static char dir[40];
+static char prefix[56];
+
+// Simulates power loss during a write: after `budget` bytes, the rest of
+// the append is cut off and every later write fails.
+class TornStore : public JournalStore {
+public:
+    JournalStore& inner;
+    long budget;
+
+    TornStore(JournalStore& s, long bytes) : inner(s), budget(bytes) {}
+
+    size_t size(uint8_t seg) override { return inner.size(seg); }
+    size_t read(uint8_t seg, size_t off, uint8_t* d, size_t n) override { return inner.read(seg, off, d, n); }
+    bool erase(uint8_t seg) override { return budget > 0 ? inner.erase(seg) : false; }
+    bool append(uint8_t seg, const uint8_t* d, size_t n) override {
+        if (budget <= 0) return false;
+        if ((long)n > budget) {
+            inner.append(seg, d, (size_t)budget);
+            budget = 0;
+            return false;
+        }
+        budget -= (long)n;
+        return inner.append(seg, d, n);
+    }
+};
+
+static SensorData sample(uint32_t i) {
+    SensorData d = {};
+    d.bbw = 100.0f + (float)i * 0.5f;
+    d.bbw_min = 99.0f;
+    d.bbw_max = 130.0f;
+    d.bbw_stddev = 1.25f;
+    d.temperature = 24.5f;
+    d.vibration = 0.3f;
+    d.quality = (uint8_t)(i % 101);
+    d.timestamp = 1000 + i * 10;
+    return d;
+}
+
+static std::vector<uint32_t> replaySeqs(SampleJournal& j, std::vector<SensorData>* out = nullptr) {
+    std::vector<uint32_t> seqs;
+    j.replay([&](uint32_t seq, const SensorData& d) {
+        seqs.push_back(seq);
+        if (out) out->push_back(d);
+    });
+    return seqs;
+}
+
+void setUp() {
+    snprintf(dir, sizeof(dir), "/tmp/kaldor-journal-XXXXXX");
+    TEST_ASSERT_NOT_NULL(mkdtemp(dir));
+    snprintf(prefix, sizeof(prefix), "%s/journal-", dir);
+}
+
+void tearDown() {
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    (void)system(cmd);
+}
+
+void test_record_round_trip_and_crc() {
+    uint8_t rec[JOURNAL_RECORD_SIZE];
+    SensorData in = sample(7), out;
+    uint32_t seq = 0;
+    in.bbw_raw = 180.0f;                    // Not in the record
+    in.bbw_outlier = true;
+    in.motor_current = 12.5f;
+    memset(&out, 0xA5, sizeof(out));        // Whatever was on the stack
+    SampleJournal::encodeRecord(1234, in, rec);
+    TEST_ASSERT_TRUE(SampleJournal::decodeRecord(rec, seq, out));
+    TEST_ASSERT_EQUAL_UINT32(1234, seq);
+    TEST_ASSERT_EQUAL_FLOAT(in.bbw, out.bbw);
+    TEST_ASSERT_EQUAL_FLOAT(in.vibration, out.vibration);
+    TEST_ASSERT_EQUAL(in.quality, out.quality);
+    TEST_ASSERT_EQUAL_UINT32(in.timestamp, out.timestamp);
+    TEST_ASSERT_EQUAL_FLOAT(in.bbw, out.bbw_raw);
+    TEST_ASSERT_FALSE(out.bbw_outlier);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, out.motor_current);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, out.warp_tension);
+
+    rec[17] ^= 0x10;
+    TEST_ASSERT_FALSE(SampleJournal::decodeRecord(rec, seq, out));
+}
+
+void test_survives_restart() {
+    {
+        FileJournalStore store(prefix);
+        SampleJournal j(store, 4, 100, 10);
+        j.begin();
+        for (uint32_t i = 0; i < 55; i++) j.append(sample(i));
+        j.flush();
+    }
+    FileJournalStore store(prefix);
+    SampleJournal j(store, 4, 100, 10);
+    j.begin();
+    std::vector<SensorData> data;
+    std::vector<uint32_t> seqs = replaySeqs(j, &data);
+    TEST_ASSERT_EQUAL(55, seqs.size());
+    TEST_ASSERT_EQUAL_UINT32(0, seqs.front());
+    TEST_ASSERT_EQUAL_UINT32(54, seqs.back());
+    TEST_ASSERT_EQUAL_FLOAT(sample(54).bbw, data.back().bbw);
+    TEST_ASSERT_EQUAL_UINT32(55, j.nextSequence());
+}
+
+void test_rotation_drops_oldest_and_keeps_order() {
+    FileJournalStore store(prefix);
+    SampleJournal j(store, 3, 20, 5);
+    j.begin();
+    for (uint32_t i = 0; i < 130; i++) j.append(sample(i));
+    j.flush();
+
+    std::vector<uint32_t> seqs = replaySeqs(j);
+    TEST_ASSERT_LESS_OR_EQUAL(60, seqs.size());
+    TEST_ASSERT_GREATER_OR_EQUAL(40, seqs.size());
+    TEST_ASSERT_EQUAL_UINT32(129, seqs.back());
+    for (size_t i = 1; i < seqs.size(); i++) {
+        TEST_ASSERT_EQUAL_UINT32(seqs[i - 1] + 1, seqs[i]);
+    }
+    TEST_ASSERT_GREATER_THAN(0, j.droppedRecords());
+}
+
+void test_torn_write_is_recovered() {
+    {
+        FileJournalStore file(prefix);
+        // 3 blocks of 10 records, then power fails 15 bytes into the 4th
+        TornStore torn(file, 3 * 10 * JOURNAL_RECORD_SIZE + 15);
+        SampleJournal j(torn, 4, 100, 10);
+        j.begin();
+        for (uint32_t i = 0; i < 40; i++) j.append(sample(i));
+        TEST_ASSERT_EQUAL(1, j.writeErrors());
+    }
+
+    // Reboot: everything written before the tear replays
+    FileJournalStore store(prefix);
+    SampleJournal j(store, 4, 100, 10);
+    j.begin();
+    std::vector<uint32_t> seqs = replaySeqs(j);
+    TEST_ASSERT_EQUAL(30, seqs.size());
+    TEST_ASSERT_EQUAL_UINT32(29, seqs.back());
+
+    // New records land after the tear without misalignment
+    for (uint32_t i = 0; i < 10; i++) j.append(sample(100 + i));
+    j.flush();
+    seqs = replaySeqs(j);
+    TEST_ASSERT_EQUAL(40, seqs.size());
+    TEST_ASSERT_EQUAL_UINT32(39, seqs.back());
+    TEST_ASSERT_EQUAL(0, j.corruptRecords());
+}
+
+void test_corrupt_record_is_skipped() {
+    {
+        FileJournalStore store(prefix);
+        SampleJournal j(store, 2, 100, 10);
+        j.begin();
+        for (uint32_t i = 0; i < 20; i++) j.append(sample(i));
+    }
+
+    // Flip a byte inside record 5 of segment 0
+    char name[128];
+    snprintf(name, sizeof(name), "%s0.jnl", prefix);
+    FILE* f = fopen(name, "r+b");
+    TEST_ASSERT_NOT_NULL(f);
+    fseek(f, 5 * JOURNAL_RECORD_SIZE + 20, SEEK_SET);
+    fputc(0x5A, f);
+    fclose(f);
+
+    FileJournalStore store(prefix);
+    SampleJournal j(store, 2, 100, 10);
+    j.begin();
+    std::vector<uint32_t> seqs = replaySeqs(j);
+    TEST_ASSERT_EQUAL(19, seqs.size());
+    TEST_ASSERT_EQUAL(1, j.corruptRecords());
+    TEST_ASSERT_EQUAL_UINT32(6, seqs[5]);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_record_round_trip_and_crc);
+    RUN_TEST(test_survives_restart);
+    RUN_TEST(test_rotation_drops_oldest_and_keeps_order);
+    RUN_TEST(test_torn_write_is_recovered);
+    RUN_TEST(test_corrupt_record_is_skipped);
+    return UNITY_END();
+}
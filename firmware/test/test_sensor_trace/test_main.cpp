@@ -0,0 +1,408 @@
+/**
+ * Kaldor IIoT - Sensor trace unit tests (native)
+ *
+ * Every record type through TraceWriter and back through TraceReader,
+ * chunk continuation and flushing, lost and damaged chunks as TraceReplay
+ * sees them, the replay ports before a run, and a simulated SensorManager
+ * run recorded and replayed sample for sample.
+ *
+ * Run with: pio test -e native -f test_sensor_trace
+ */
+
+#include <unity.h>
+#include <math.h>
+#include <string.h>
+#include <memory>
+#include <vector>
+#include "hal_sim.h"
+#include "sensor_trace.h"
+#include "trace_replay.h"
+#include "../../src/sensors.cpp"
+
+void halLog(const char*, ...) {}
+
+static std::vector<uint8_t> drain(SensorTrace& trace) {
+    std::vector<uint8_t> bytes;
+    TraceChunk chunk;
+    while (trace.next(chunk)) bytes.insert(bytes.end(), chunk.data, chunk.data + chunk.length);
+    return bytes;
+}
+
+/** Closes both lanes' last chunks, as their producers' next ready() would. */
+static void stop(SensorTrace& trace, uint32_t nowMs, uint32_t nowUs) {
+    trace.stop();
+    trace.lane(TraceLane::Acquisition).ready(nowMs, nowUs);
+    trace.lane(TraceLane::Accel).ready(nowMs, nowUs);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_records_round_trip() {
+    static SensorTrace trace;
+    trace.start();
+    TraceWriter& acquisition = trace.lane(TraceLane::Acquisition);
+    TraceWriter& accel = trace.lane(TraceLane::Accel);
+
+    // 71 minutes in: micros() has wrapped once
+    const uint32_t ms = 4300000;
+    const uint32_t us = (uint32_t)(4300000ull * 1000);
+    TEST_ASSERT_TRUE(acquisition.ready(ms, us));
+    TEST_ASSERT_TRUE(acquisition.justStarted());
+    TEST_ASSERT_FALSE(acquisition.justStarted());
+    TraceState state = {1.5f, 1.01f, 3.0f, 0.5f, 24.5f, 0.031f, 4299500, true, us - 800};
+    acquisition.state(us, state);
+    acquisition.read(us);
+    acquisition.echo(us + 5, 450, 701);
+    acquisition.read(us + 10000);
+    acquisition.noEcho(us + 10003);
+    acquisition.temperature(us + 10010, 23.45f);
+    acquisition.temperature(us + 10020, NAN);
+    acquisition.temperature(us + 10030, -999.0f);
+
+    TEST_ASSERT_TRUE(accel.ready(ms, us));
+    accel.accelFill(us + 1, 300);
+    accel.accelOverrun(us + 2);
+    accel.beginAccel(us + 3);
+    for (int16_t i = 0; i < 40; i++) {     // Splits after TRACE_ACCEL_MAX
+        int16_t xyz[3] = {(int16_t)(i * 3), (int16_t)(-256 + i), (int16_t)(i % 2 ? 1000 : -1000)};
+        accel.accelSample(xyz);
+    }
+    accel.endAccel();
+    stop(trace, ms + 20, us + 20000);
+    std::vector<uint8_t> bytes = drain(trace);
+
+    TraceReader reader;
+    TraceItem item;
+    uint64_t t0 = traceTime(ms, us);
+    TEST_ASSERT_EQUAL_UINT64(4300000000ull, t0);
+    TEST_ASSERT_TRUE(reader.begin(bytes.data(), bytes.size()));
+    TEST_ASSERT_EQUAL_UINT8(0, reader.header().lane);
+    TEST_ASSERT_EQUAL_UINT8(TRACE_FIRST | TRACE_LAST, reader.header().flags);
+    TEST_ASSERT_EQUAL_UINT16(8, reader.header().records);
+
+    TEST_ASSERT_TRUE(reader.next(item));
+    TEST_ASSERT_TRUE(item.type == TraceRecord::State);
+    TEST_ASSERT_EQUAL_UINT64(t0, item.time);
+    TEST_ASSERT_EQUAL_FLOAT(1.5f, item.state.calibrationOffset);
+    TEST_ASSERT_EQUAL_FLOAT(1.01f, item.state.calibrationScale);
+    TEST_ASSERT_EQUAL_FLOAT(0.031f, item.state.vibrationRms);
+    TEST_ASSERT_EQUAL_UINT32(4299500, item.state.lastSlowRead);
+    TEST_ASSERT_TRUE(item.state.echoPending);
+    TEST_ASSERT_EQUAL_UINT32(us - 800, item.state.echoTriggerUs);
+    TEST_ASSERT_TRUE(reader.next(item));
+    TEST_ASSERT_TRUE(item.type == TraceRecord::Read);
+    TEST_ASSERT_TRUE(reader.next(item));
+    TEST_ASSERT_TRUE(item.type == TraceRecord::Echo);
+    TEST_ASSERT_EQUAL_UINT64(t0 + 5, item.time);
+    TEST_ASSERT_EQUAL_UINT32(450, item.riseUs);
+    TEST_ASSERT_EQUAL_UINT32(701, item.widthUs);
+    TEST_ASSERT_TRUE(reader.next(item));
+    TEST_ASSERT_EQUAL_UINT64(t0 + 10000, item.time);
+    TEST_ASSERT_TRUE(reader.next(item));
+    TEST_ASSERT_TRUE(item.type == TraceRecord::NoEcho);
+    TEST_ASSERT_TRUE(reader.next(item));
+    TEST_ASSERT_TRUE(item.type == TraceRecord::Temperature);
+    TEST_ASSERT_EQUAL_FLOAT(23.45f, item.celsius);
+    TEST_ASSERT_TRUE(reader.next(item));
+    TEST_ASSERT_TRUE(item.type == TraceRecord::TemperatureFailed);
+    TEST_ASSERT_TRUE(isnan(item.celsius));
+    TEST_ASSERT_TRUE(reader.next(item));
+    TEST_ASSERT_TRUE(item.type == TraceRecord::TemperatureFailed);
+    TEST_ASSERT_FALSE(reader.next(item));
+
+    size_t at = reader.size();
+    TEST_ASSERT_TRUE(reader.begin(bytes.data() + at, bytes.size() - at));
+    TEST_ASSERT_EQUAL_UINT8(1, reader.header().lane);
+    TEST_ASSERT_TRUE(reader.next(item));
+    TEST_ASSERT_TRUE(item.type == TraceRecord::AccelFill);
+    TEST_ASSERT_EQUAL_UINT32(300, item.blockFill);
+    TEST_ASSERT_TRUE(reader.next(item));
+    TEST_ASSERT_TRUE(item.type == TraceRecord::AccelOverrun);
+    int16_t expected = 0;
+    for (uint8_t count : {32, 8}) {
+        TEST_ASSERT_TRUE(reader.next(item));
+        TEST_ASSERT_TRUE(item.type == TraceRecord::Accel);
+        TEST_ASSERT_EQUAL_UINT64(t0 + 3, item.time);
+        TEST_ASSERT_EQUAL_UINT8(count, item.count);
+        for (uint8_t i = 0; i < item.count; i++, expected++) {
+            TEST_ASSERT_EQUAL_INT(expected * 3, item.xyz[i][0]);
+            TEST_ASSERT_EQUAL_INT(-256 + expected, item.xyz[i][1]);
+            TEST_ASSERT_EQUAL_INT(expected % 2 ? 1000 : -1000, item.xyz[i][2]);
+        }
+    }
+    TEST_ASSERT_FALSE(reader.next(item));
+    TEST_ASSERT_EQUAL(bytes.size(), at + reader.size());
+
+    // About 5 bytes per accelerometer sample
+    TEST_ASSERT_TRUE(reader.size() < 40 * 6 + 2 * SENSOR_TRACE_HEADER_SIZE);
+}
+
+void test_chunks_continue_and_flush() {
+    static SensorTrace trace;
+    TraceWriter& lane = trace.lane(TraceLane::Acquisition);
+    TEST_ASSERT_FALSE(lane.ready(0, 0));       // Not capturing
+    trace.start();
+
+    // Fill past one chunk; the writer continues in a new one
+    uint32_t us = 1000;
+    TEST_ASSERT_TRUE(lane.ready(1, us));
+    for (int i = 0; i < 60; i++) {
+        lane.read(us);
+        lane.echo(us + 3, 450, 700);
+        us += 1000;
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, lane.chunks());
+
+    // A chunk is closed once it is TRACE_FLUSH_MS old, full or not
+    TEST_ASSERT_TRUE(lane.ready(TRACE_FLUSH_MS, us));
+    TEST_ASSERT_EQUAL_UINT32(1, lane.chunks());
+    TEST_ASSERT_TRUE(lane.ready(TRACE_FLUSH_MS + 1, us));
+    TEST_ASSERT_EQUAL_UINT32(2, lane.chunks());
+    lane.read(us);
+    stop(trace, TRACE_FLUSH_MS + 2, us + 1000);
+    TEST_ASSERT_EQUAL_UINT32(3, lane.chunks());
+
+    std::vector<uint8_t> bytes = drain(trace);
+    TraceReader reader;
+    TraceItem item;
+    size_t at = 0;
+    uint32_t reads = 0;
+    uint64_t last = 0;
+    const uint8_t flags[3] = {TRACE_FIRST, 0, TRACE_LAST};
+    for (uint16_t sequence = 0; sequence < 3; sequence++) {
+        TEST_ASSERT_TRUE(reader.begin(bytes.data() + at, bytes.size() - at));
+        TEST_ASSERT_EQUAL_UINT16(sequence, reader.header().sequence);
+        TEST_ASSERT_EQUAL_UINT8(flags[sequence], reader.header().flags);
+        TEST_ASSERT_TRUE(reader.size() <= TRACE_CHUNK_BYTES);
+        while (reader.next(item)) {
+            TEST_ASSERT_TRUE(item.time >= last);   // Each chunk carries its base time
+            last = item.time;
+            if (item.type == TraceRecord::Read) reads++;
+        }
+        at += reader.size();
+    }
+    TEST_ASSERT_EQUAL(bytes.size(), at);
+    TEST_ASSERT_EQUAL_UINT32(61, reads);
+    TEST_ASSERT_EQUAL_UINT64(1000 + 60 * 1000, last);
+}
+
+void test_replay_counts_lost_and_damaged_chunks() {
+    static SensorTrace trace;
+    TraceWriter& lane = trace.lane(TraceLane::Acquisition);
+    trace.start();
+
+    // Nobody takes the chunks: the ring keeps the first ones, drops the rest
+    uint32_t ms = 0;
+    TEST_ASSERT_TRUE(lane.ready(ms, 0));
+    for (int chunk = 0; chunk < TRACE_RING_CHUNKS + 3; chunk++) {
+        ms += TRACE_FLUSH_MS;
+        lane.read(ms * 1000);
+        lane.ready(ms, ms * 1000);
+    }
+    TEST_ASSERT_EQUAL_UINT32(3, lane.dropped());
+    std::vector<uint8_t> bytes = drain(trace);
+
+    // Later chunks get through again, after a gap in the sequence
+    ms += TRACE_FLUSH_MS;
+    lane.read(ms * 1000);
+    stop(trace, ms, ms * 1000);
+    std::vector<uint8_t> rest = drain(trace);
+
+    // and a few bytes of noise in front of them
+    const uint8_t noise[5] = {'K', 'T', 0x7F, 0, 0};
+    bytes.insert(bytes.end(), noise, noise + sizeof(noise));
+    bytes.insert(bytes.end(), rest.begin(), rest.end());
+
+    static TraceReplay replay;
+    TEST_ASSERT_TRUE(replay.load(bytes.data(), bytes.size()));
+    const TraceReplay::Stats& stats = replay.stats();
+    TEST_ASSERT_EQUAL_UINT32(TRACE_RING_CHUNKS + 1, stats.chunks);
+    TEST_ASSERT_EQUAL_UINT32(3, stats.lostChunks);
+    TEST_ASSERT_EQUAL_UINT32(5, stats.damaged);
+    TEST_ASSERT_EQUAL_UINT32(TRACE_RING_CHUNKS + 1, stats.reads);
+
+    const uint8_t garbage[64] = {0};
+    TEST_ASSERT_FALSE(replay.load(garbage, sizeof(garbage)));
+}
+
+void test_replay_ports_before_the_run() {
+    static SensorTrace trace;
+    trace.start();
+    TraceWriter& lane = trace.lane(TraceLane::Acquisition);
+    lane.ready(5000, 5000000);
+    TraceState state = {0.0f, 1.0f, 3.0f, 0.5f, 31.0f, 0.0f, 4500, false, 0};
+    lane.state(5000000, state);
+    lane.read(5000000);
+    stop(trace, 5001, 5001000);
+    std::vector<uint8_t> bytes = drain(trace);
+
+    static TraceReplay replay;
+    TEST_ASSERT_TRUE(replay.load(bytes.data(), bytes.size()));
+    TEST_ASSERT_EQUAL_UINT32(1, replay.stats().states);
+
+    // SensorManager::begin(): the air temperature the capture started with,
+    // an immediate self-test echo, an accelerometer that passes
+    TEST_ASSERT_EQUAL_FLOAT(31.0f, replay.thermometer().readCelsius());
+    EchoCapture echo;
+    TEST_ASSERT_TRUE(replay.ultrasonic().begin(echo));
+    echo.trigger(replay.clock().micros());
+    replay.ultrasonic().trigger();
+    float distance = 0;
+    TEST_ASSERT_TRUE(echo.poll(replay.clock().micros(), distance) == EchoStatus::Ready);
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, 120.0f, distance);
+    TEST_ASSERT_EQUAL_UINT32(0, replay.clock().millis());
+    TEST_ASSERT_TRUE(replay.accel().begin(VIBRATION_SAMPLE_RATE_HZ, 16));
+    TEST_ASSERT_TRUE(replay.accel().selfTest());
+    TEST_ASSERT_EQUAL_UINT8(0, replay.accel().fifoEntries());
+}
+
+/**
+ * Ultrasonic sensor with everything the filters react to: echo widths that
+ * vary, spikes for the outlier filter, missing echoes and echoes that
+ * arrive after the next read.
+ */
+class AwkwardUltrasonic : public UltrasonicPort {
+private:
+    struct Edge {
+        uint32_t at;
+        bool rising;
+    };
+    HalClock& clock;
+    EchoCapture* capture;
+    uint32_t triggers;
+    std::vector<Edge> pending;
+
+    void schedule(uint32_t rise, uint32_t width) {
+        pending.push_back({rise, true});
+        pending.push_back({rise + width, false});
+    }
+
+public:
+    explicit AwkwardUltrasonic(HalClock& clk) : clock(clk), capture(nullptr), triggers(0) {}
+
+    bool begin(EchoCapture& echo) override {
+        capture = &echo;
+        return true;
+    }
+
+    void trigger() override {
+        uint32_t now = clock.micros();
+        triggers++;
+        if (triggers <= 2) {                        // Self-test: answer at once
+            capture->onEdge(true, now + 450);
+            capture->onEdge(false, now + 1150);
+            return;
+        }
+        if (triggers % 50 == 7) return;             // No echo
+        uint32_t width = 700 + (triggers * 37) % 60;
+        if (triggers % 97 == 5) width = 3000;       // Spike
+        schedule(now + (triggers % 40 == 3 ? 9500 : 450), width);   // Late or on time
+    }
+
+    /** Edges whose time has come, as the echo pin interrupt would see them. */
+    void deliver() {
+        uint32_t now = clock.micros();
+        size_t kept = 0;
+        for (const Edge& edge : pending) {
+            if ((int32_t)(now - edge.at) >= 0) {
+                capture->onEdge(edge.rising, edge.at);
+            } else {
+                pending[kept++] = edge;
+            }
+        }
+        pending.resize(kept);
+    }
+};
+
+class FlakyThermometer : public TemperaturePort {
+private:
+    uint32_t reads = 0;
+
+public:
+    bool begin() override { return true; }
+    float readCelsius() override {
+        reads++;
+        return reads % 13 == 0 ? NAN : 22.0f + 0.37f * (float)(reads % 7);
+    }
+};
+
+static bool sameSample(const SensorData& a, const SensorData& b) {
+    return a.timestamp == b.timestamp && a.bbw == b.bbw && a.bbw_raw == b.bbw_raw &&
+           a.bbw_outlier == b.bbw_outlier && a.bbw_min == b.bbw_min && a.bbw_max == b.bbw_max &&
+           a.bbw_stddev == b.bbw_stddev && a.temperature == b.temperature &&
+           a.vibration == b.vibration && a.quality == b.quality;
+}
+
+void test_replay_reproduces_a_recorded_run() {
+    SimClock clock;
+    AwkwardUltrasonic ultrasonic(clock);
+    FlakyThermometer thermometer;
+    SimAccel accel(clock, 0.2f, 25.0f);
+    static SensorManager sensors(clock, ultrasonic, thermometer, accel);
+    TEST_ASSERT_TRUE(sensors.begin());
+    static SensorTrace trace;
+    sensors.setTrace(&trace);
+
+    // A minute at 100 Hz with the accelerometer drained and analysed as the
+    // tasks do, and a calibration change halfway
+    const float edges[] = VIBRATION_BAND_EDGES_HZ;
+    static VibrationAnalyzer<VIBRATION_BLOCK_SIZE> analyzer(
+        VIBRATION_SAMPLE_RATE_HZ, edges, sizeof(edges) / sizeof(edges[0]));
+    std::vector<SensorData> recorded;
+    std::vector<uint8_t> bytes;
+    TraceChunk chunk;
+    trace.start();
+    for (int i = 0; i < 6000; i++) {
+        if (i == 3000) sensors.setCalibration(1.5f, 1.01f);
+        clock.advance(10000);
+        ultrasonic.deliver();
+        recorded.push_back(sensors.read());
+        sensors.drainAccelerometer();
+        uint32_t blockTime;
+        if (const int16_t* block = sensors.vibrationBlock(blockTime)) {
+            VibrationFeatures features;
+            analyzer.analyze(block, SensorManager::ACCEL_G_PER_COUNT, features);
+            sensors.releaseVibrationBlock();
+            sensors.setVibrationLevel(features.rms);
+        }
+        while (trace.next(chunk)) bytes.insert(bytes.end(), chunk.data, chunk.data + chunk.length);
+    }
+    stop(trace, clock.millis(), clock.micros());
+    while (trace.next(chunk)) bytes.insert(bytes.end(), chunk.data, chunk.data + chunk.length);
+    TEST_ASSERT_EQUAL_UINT32(0, trace.dropped());
+    TEST_ASSERT_TRUE(sensors.echoTimeouts() > 0);
+    TEST_ASSERT_TRUE(sensors.bbwOutliers() > 0);
+    TEST_ASSERT_TRUE(recorded.back().vibration > 0);
+
+    // Replayed twice into fresh SensorManagers: the same samples each time
+    for (int pass = 0; pass < 2; pass++) {
+        std::unique_ptr<TraceReplay> replay(new TraceReplay());
+        TEST_ASSERT_TRUE(replay->load(bytes.data(), bytes.size()));
+        TEST_ASSERT_EQUAL_UINT32(0, replay->stats().lostChunks);
+        TEST_ASSERT_EQUAL_UINT32(6000, replay->stats().reads);
+        std::unique_ptr<SensorManager> replayed(new SensorManager(
+            replay->clock(), replay->ultrasonic(), replay->thermometer(), replay->accel()));
+        TEST_ASSERT_TRUE(replayed->begin());
+
+        size_t index = 0, mismatches = 0;
+        replay->run(*replayed, [&](const SensorData& data) {
+            if (index >= recorded.size() || !sameSample(recorded[index], data)) mismatches++;
+            index++;
+        });
+        TEST_ASSERT_EQUAL(recorded.size(), index);
+        TEST_ASSERT_EQUAL(0, mismatches);
+        TEST_ASSERT_EQUAL_UINT32(sensors.echoTimeouts(), replayed->echoTimeouts());
+        TEST_ASSERT_EQUAL_UINT32(sensors.bbwOutliers(), replayed->bbwOutliers());
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_records_round_trip);
+    RUN_TEST(test_chunks_continue_and_flush);
+    RUN_TEST(test_replay_counts_lost_and_damaged_chunks);
+    RUN_TEST(test_replay_ports_before_the_run);
+    RUN_TEST(test_replay_reproduces_a_recorded_run);
+    return UNITY_END();
+}
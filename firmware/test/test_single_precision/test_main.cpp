@@ -0,0 +1,99 @@
+/**
+ * Kaldor IIoT - Single-precision acquisition path (native)
+ *
+ * The ESP32's FPU only does single precision; doubles are emulated in
+ * software. The headers on the path from the echo to the statistics and
+ * the change detector are compiled here with float-to-double promotion
+ * as an error, so an unsuffixed literal or a promoted argument fails this
+ * test's build (src/sensors.cpp does the same for itself). The tests then
+ * check that float loses nothing that matters against a double reference.
+ *
+ * Run with: pio test -e native -f test_single_precision
+ */
+
+#include <unity.h>
+#include <math.h>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic error "-Wdouble-promotion"
+#pragma GCC diagnostic error "-Wfloat-conversion"
+#include "config.h"
+#include "adaptive_rate.h"
+#include "change_detector.h"
+#include "echo_capture.h"
+#include "hampel_filter.h"
+#include "report_filter.h"
+#include "rolling_window.h"
+
+// Template bodies are only checked where explicitly instantiated
+template class RollingWindow<float, BBW_WINDOW_SIZE>;
+template class SlidingMedian<OUTLIER_WINDOW>;
+template class HampelFilter<OUTLIER_WINDOW>;
+#pragma GCC diagnostic pop
+
+void setUp() {}
+void tearDown() {}
+
+void test_speed_of_sound_model() {
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 0.3313f, speedOfSound(0.0f));
+    TEST_ASSERT_FLOAT_WITHIN(0.0002f, 0.3433f, speedOfSound(20.0f));
+    TEST_ASSERT_FLOAT_WITHIN(0.0002f, 0.3520f, speedOfSound(35.0f));
+    TEST_ASSERT_EQUAL_FLOAT(speedOfSound(20.0f), speedOfSound(NAN));
+    TEST_ASSERT_EQUAL_FLOAT(speedOfSound(-40.0f), speedOfSound(-60.0f));
+    TEST_ASSERT_EQUAL_FLOAT(speedOfSound(80.0f), speedOfSound(200.0f));
+}
+
+static float measure(EchoCapture& echo, uint32_t echoUs) {
+    float distance = 0;
+    echo.trigger(0);
+    echo.onEdge(true, 450);
+    echo.onEdge(false, 450 + echoUs);
+    echo.poll(460 + echoUs, distance);
+    return distance;
+}
+
+void test_compensation_removes_temperature_error() {
+    // 120 mm at 35 °C air: the fixed 20 °C constant reads 2.5 mm short
+    const float air = 35.0f;
+    uint32_t echoUs = (uint32_t)lroundf(2.0f * 120.0f / speedOfSound(air));
+
+    EchoCapture fixed;
+    EchoCapture compensated;
+    compensated.setSpeedOfSound(speedOfSound(air));
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 120.0f, measure(compensated, echoUs));
+    TEST_ASSERT_TRUE(120.0f - measure(fixed, echoUs) > 2.0f);
+}
+
+void test_float_statistics_match_double_reference() {
+    // Echo -> mm -> calibration -> rolling statistics, in float against the
+    // same arithmetic in double; 0.01 mm is well below the sensor's 0.3 mm
+    RollingWindow<float, BBW_WINDOW_SIZE> window;
+    const float mmPerUs = speedOfSound(24.5f) / 2.0f;
+    double values[BBW_WINDOW_SIZE] = {};
+    uint32_t state = 1;
+    for (uint32_t i = 0; i < 20000; i++) {
+        state = state * 1664525u + 1013904223u;
+        uint32_t echoUs = 600 + (state >> 20) % 200;
+        float mm = ((float)echoUs * mmPerUs + 1.5f) * 1.02f;
+        window.push(mm);
+        values[i % BBW_WINDOW_SIZE] = ((double)echoUs * (double)mmPerUs + 1.5) * 1.02;
+    }
+
+    double sum = 0;
+    for (double v : values) sum += v;
+    double mean = sum / BBW_WINDOW_SIZE;
+    double m2 = 0;
+    for (double v : values) m2 += (v - mean) * (v - mean);
+    double stddev = sqrt(m2 / BBW_WINDOW_SIZE);
+
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, (float)mean, window.mean());
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, (float)stddev, window.stddev());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_speed_of_sound_model);
+    RUN_TEST(test_compensation_removes_temperature_error);
+    RUN_TEST(test_float_statistics_match_double_reference);
+    return UNITY_END();
+}
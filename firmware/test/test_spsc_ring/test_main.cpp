@@ -0,0 +1,89 @@
+/**
+ * Kaldor IIoT - SpscRing unit tests (native)
+ *
+ * Run with: pio test -e native -f test_spsc_ring
+ */
+
+#include <unity.h>
+#include <thread>
+#include "spsc_ring.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_fifo_order_and_empty() {
+    SpscRing<int, 4> ring;
+    int v = 0;
+    TEST_ASSERT_FALSE(ring.pop(v));
+    TEST_ASSERT_TRUE(ring.push(1));
+    TEST_ASSERT_TRUE(ring.push(2));
+    TEST_ASSERT_TRUE(ring.pop(v));
+    TEST_ASSERT_EQUAL(1, v);
+    TEST_ASSERT_TRUE(ring.pop(v));
+    TEST_ASSERT_EQUAL(2, v);
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+void test_full_ring_drops_and_counts() {
+    SpscRing<int, 4> ring;
+    for (int i = 0; i < 4; i++) TEST_ASSERT_TRUE(ring.push(i));
+    TEST_ASSERT_FALSE(ring.push(99));
+    TEST_ASSERT_FALSE(ring.push(100));
+    TEST_ASSERT_EQUAL(2, ring.dropped());
+    TEST_ASSERT_EQUAL(4, ring.highWaterMark());
+
+    int v = -1;
+    TEST_ASSERT_TRUE(ring.pop(v));
+    TEST_ASSERT_EQUAL(0, v);  // oldest item survives, newest was dropped
+    TEST_ASSERT_TRUE(ring.push(4));
+    TEST_ASSERT_EQUAL(4, ring.size());
+}
+
+void test_indices_wrap() {
+    SpscRing<uint32_t, 8> ring;
+    uint32_t v = 0;
+    for (uint32_t i = 0; i < 100000; i++) {
+        TEST_ASSERT_TRUE(ring.push(i));
+        TEST_ASSERT_TRUE(ring.pop(v));
+        TEST_ASSERT_EQUAL(i, v);
+    }
+}
+
+void test_two_threads_preserve_sequence() {
+    static SpscRing<uint32_t, 256> ring;
+    const uint32_t total = 2000000;
+    uint32_t pushed = 0;
+
+    std::thread producer([&]() {
+        for (uint32_t i = 0; i < total; i++) {
+            while (!ring.push(i)) {
+                std::this_thread::yield();
+            }
+            pushed++;
+        }
+    });
+
+    uint32_t expected = 0;
+    bool ordered = true;
+    while (expected < total) {
+        uint32_t v;
+        if (ring.pop(v)) {
+            if (v != expected) ordered = false;
+            expected++;
+        }
+    }
+    producer.join();
+
+    TEST_ASSERT_TRUE(ordered);
+    TEST_ASSERT_EQUAL(total, pushed);
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_fifo_order_and_empty);
+    RUN_TEST(test_full_ring_drops_and_counts);
+    RUN_TEST(test_indices_wrap);
+    RUN_TEST(test_two_threads_preserve_sequence);
+    return UNITY_END();
+}
@@ -0,0 +1,173 @@
+/**
+ * Kaldor IIoT - Stage timing unit tests (native)
+ *
+ * Histogram bucketing and percentiles, interval summaries, the jitter and
+ * missed-deadline accounting, and the timing report format.
+ *
+ * Run with: pio test -e native -f test_stage_timing
+ */
+
+#include <unity.h>
+#include <string.h>
+#include "stage_timing.h"
+#include "hal_sim.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_bucket_edges() {
+    TEST_ASSERT_EQUAL_INT(0, LatencyHistogram::bucketFor(0));
+    TEST_ASSERT_EQUAL_INT(0, LatencyHistogram::bucketFor(4));
+    TEST_ASSERT_EQUAL_INT(1, LatencyHistogram::bucketFor(5));
+    TEST_ASSERT_EQUAL_INT(7, LatencyHistogram::bucketFor(999));
+    TEST_ASSERT_EQUAL_INT(8, LatencyHistogram::bucketFor(1000));
+    TEST_ASSERT_EQUAL_INT(TIMING_BUCKETS - 1, LatencyHistogram::bucketFor(500000));
+    TEST_ASSERT_EQUAL_INT(TIMING_BUCKETS - 1, LatencyHistogram::bucketFor(0xFFFFFFFF));
+}
+
+void test_percentiles_report_bucket_upper_edge() {
+    LatencyHistogram h;
+    for (int i = 0; i < 98; i++) h.record(30);     // 20..50 bucket
+    h.record(700);                                  // 500..1000
+    h.record(750);
+
+    HistogramSnapshot s;
+    h.snapshot(s);
+    TEST_ASSERT_EQUAL_UINT32(100, s.total);
+    TEST_ASSERT_EQUAL_UINT32(750, s.maxUs);
+    TEST_ASSERT_EQUAL_UINT32(50, s.percentile(0.5f));
+    TEST_ASSERT_EQUAL_UINT32(750, s.percentile(0.99f));    // Capped at the max
+}
+
+void test_empty_histogram_percentile_is_zero() {
+    HistogramSnapshot s = {};
+    TEST_ASSERT_EQUAL_UINT32(0, s.percentile(0.5f));
+}
+
+void test_summary_covers_only_the_interval() {
+    LatencyHistogram h;
+    HistogramSnapshot previous = {};
+    for (int i = 0; i < 10; i++) h.record(3000);
+
+    TimingSummary first = summarizeSince(h, previous);
+    TEST_ASSERT_EQUAL_UINT32(10, first.count);
+    TEST_ASSERT_EQUAL_UINT32(3000, first.maxUs);
+    TEST_ASSERT_EQUAL_UINT32(3000, first.p50);
+
+    for (int i = 0; i < 4; i++) h.record(8);
+    TimingSummary second = summarizeSince(h, previous);
+    TEST_ASSERT_EQUAL_UINT32(4, second.count);
+    TEST_ASSERT_EQUAL_UINT32(8, second.maxUs);     // Window max, not since boot
+    TEST_ASSERT_EQUAL_UINT32(8, second.p99);
+    TEST_ASSERT_EQUAL_UINT32(3000, h.maximum());
+
+    TimingSummary idle = summarizeSince(h, previous);
+    TEST_ASSERT_EQUAL_UINT32(0, idle.count);
+    TEST_ASSERT_EQUAL_UINT32(0, idle.maxUs);
+}
+
+void test_stage_timers_use_clock_cycles() {
+    SimClock clock;
+    StageTimers timers(clock);
+
+    uint32_t started = timers.start();
+    clock.advance(120);
+    timers.stop(Stage::Serialise, started);
+
+    TEST_ASSERT_EQUAL_UINT32(1, timers[Stage::Serialise].count());
+    TEST_ASSERT_EQUAL_UINT32(120, timers[Stage::Serialise].maximum());
+    TEST_ASSERT_EQUAL_UINT32(0, timers[Stage::Publish].count());
+}
+
+void test_steady_cycle_has_no_jitter_or_misses() {
+    CycleMonitor monitor;
+    for (uint32_t i = 0; i < 100; i++) {
+        monitor.wake(i * 10000, 10000);
+        monitor.done(i * 10000 + 300);
+    }
+    TEST_ASSERT_EQUAL_UINT32(99, monitor.jitter().count());
+    TEST_ASSERT_EQUAL_UINT32(0, monitor.jitter().maximum());
+    TEST_ASSERT_EQUAL_UINT32(0, monitor.missed());
+    TEST_ASSERT_EQUAL_UINT32(0, monitor.overruns());
+}
+
+void test_late_wake_is_jitter_and_stall_is_missed() {
+    CycleMonitor monitor;
+    monitor.wake(0, 10000);
+    monitor.wake(11000, 10000);     // 1 ms late: jitter only
+    TEST_ASSERT_EQUAL_UINT32(1000, monitor.jitter().maximum());
+    TEST_ASSERT_EQUAL_UINT32(0, monitor.missed());
+
+    // A 25 ms stall, then vTaskDelayUntil catches up on the original grid
+    monitor.done(11000 + 25000);
+    TEST_ASSERT_EQUAL_UINT32(1, monitor.overruns());
+    monitor.wake(36000, 10000);     // Due at 20000
+    monitor.wake(36100, 10000);     // Due at 30000
+    monitor.wake(40000, 10000);     // Due at 40000, back on time
+    TEST_ASSERT_EQUAL_UINT32(2, monitor.missed());
+}
+
+void test_period_change_restarts_grid() {
+    CycleMonitor monitor;
+    monitor.wake(0, 10000);
+    monitor.wake(10000, 10000);
+    monitor.wake(20000, 50000);     // Slower rate from here
+    monitor.wake(70000, 50000);
+    TEST_ASSERT_EQUAL_UINT32(0, monitor.missed());
+    TEST_ASSERT_EQUAL_UINT32(50000, monitor.period());
+    TEST_ASSERT_EQUAL_UINT32(2, monitor.jitter().count());
+}
+
+void test_timing_report_format() {
+    SimClock clock;
+    StageTimers timers(clock);
+    CycleMonitor monitor;
+    timers[Stage::SensorRead].record(40);
+    timers[Stage::SensorRead].record(60);
+    monitor.wake(0, 10000);
+    monitor.wake(10200, 10000);
+
+    static char buf[2048];
+    PayloadWriter out(buf, sizeof(buf));
+    TEST_ASSERT_TRUE(writeTimingReport(out, "BBW-1", 42, timers, monitor));
+
+    TEST_ASSERT_NOT_NULL(strstr(buf, "{\"device_id\":\"BBW-1\",\"uptime\":42,"
+                                     "\"bucket_edges_us\":[5,10,20,50,100,"));
+    TEST_ASSERT_NOT_NULL(strstr(buf, "\"stages\":{\"sensor_read\":{\"count\":2,\"max\":60,"
+                                     "\"buckets\":[0,0,0,1,1]},"));
+    TEST_ASSERT_NOT_NULL(strstr(buf, "\"ota\":{\"count\":0,\"max\":0,\"buckets\":[0]}}"));
+    TEST_ASSERT_NOT_NULL(strstr(buf, "\"sample_jitter\":{\"count\":1,\"max\":200,"
+                                     "\"buckets\":[0,0,0,0,0,0,1]}"));
+    TEST_ASSERT_NOT_NULL(strstr(buf, "\"sample_period_us\":10000,\"missed_deadlines\":0,"
+                                     "\"sample_overruns\":0}"));
+}
+
+void test_timing_report_fits_with_every_bucket_used() {
+    SimClock clock;
+    StageTimers timers(clock);
+    CycleMonitor monitor;
+    // Every bucket of every stage in use: the longest bucket arrays
+    for (uint8_t s = 0; s < (uint8_t)Stage::Count; s++) {
+        for (uint32_t edge : TIMING_BUCKET_EDGES_US) timers[(Stage)s].record(edge - 1);
+        timers[(Stage)s].record(600000);
+    }
+
+    static char buf[2048 - 64];                 // The firmware payload buffer
+    PayloadWriter out(buf, sizeof(buf));
+    TEST_ASSERT_TRUE(writeTimingReport(out, "BBW-a1b2c3d4", 4000000, timers, monitor));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_bucket_edges);
+    RUN_TEST(test_percentiles_report_bucket_upper_edge);
+    RUN_TEST(test_empty_histogram_percentile_is_zero);
+    RUN_TEST(test_summary_covers_only_the_interval);
+    RUN_TEST(test_stage_timers_use_clock_cycles);
+    RUN_TEST(test_steady_cycle_has_no_jitter_or_misses);
+    RUN_TEST(test_late_wake_is_jitter_and_stall_is_missed);
+    RUN_TEST(test_period_change_restarts_grid);
+    RUN_TEST(test_timing_report_format);
+    RUN_TEST(test_timing_report_fits_with_every_bucket_used);
+    return UNITY_END();
+}
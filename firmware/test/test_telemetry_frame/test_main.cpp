@@ -0,0 +1,115 @@
+/**
+ * Kaldor IIoT - Binary telemetry frame unit tests (native)
+ *
+ * Run with: pio test -e native -f test_telemetry_frame
+ */
+
+#include <unity.h>
+#include "telemetry_frame.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_round_trip() {
+    uint8_t buf[1024];
+    TelemetryFrameEncoder enc(buf, sizeof(buf));
+    uint32_t hash = deviceIdHash("BBW-a1b2c3d4");
+    enc.begin(hash, 5000, 42);
+
+    const float bbw[] = {125.43f, 125.51f, -1.0f, 124.98f, 399.99f, 0.01f};
+    for (int i = 0; i < 6; i++) {
+        TEST_ASSERT_TRUE(enc.add(5000 + i * 10 + (i == 3 ? 7 : 0), bbw[i], (uint8_t)(90 + i)));
+    }
+
+    TelemetryFrameDecoder dec;
+    TEST_ASSERT_TRUE(dec.begin(enc.data(), enc.size()));
+    TEST_ASSERT_EQUAL(TELEMETRY_FRAME_VERSION, dec.header().version);
+    TEST_ASSERT_EQUAL(6, dec.header().count);
+    TEST_ASSERT_EQUAL(42, dec.header().sequence);
+    TEST_ASSERT_EQUAL_UINT32(hash, dec.header().deviceHash);
+    TEST_ASSERT_EQUAL_UINT32(5000, dec.header().baseTimestamp);
+
+    FrameSample s;
+    for (int i = 0; i < 6; i++) {
+        TEST_ASSERT_TRUE(dec.next(s));
+        TEST_ASSERT_EQUAL_UINT32(5000 + i * 10 + (i == 3 ? 7 : 0), s.timestamp);
+        TEST_ASSERT_FLOAT_WITHIN(0.005f, bbw[i], s.bbw);
+        TEST_ASSERT_EQUAL(90 + i, s.quality);
+    }
+    TEST_ASSERT_FALSE(dec.next(s));
+    TEST_ASSERT_FALSE(dec.error());
+}
+
+void test_steady_stream_is_compact() {
+    uint8_t buf[1024];
+    TelemetryFrameEncoder enc(buf, sizeof(buf));
+    enc.begin(1, 0, 0);
+    for (uint32_t i = 0; i < 100; i++) {
+        TEST_ASSERT_TRUE(enc.add(i * 10, 125.0f + (float)(i % 7) * 0.1f, 95));
+    }
+    // 1-byte time delta, <= 2-byte BBW delta, 1-byte quality
+    TEST_ASSERT_LESS_OR_EQUAL(TELEMETRY_FRAME_HEADER_SIZE + 100 * 4 + 2, enc.size());
+}
+
+void test_full_frame_rejects_samples() {
+    uint8_t buf[TELEMETRY_FRAME_HEADER_SIZE + 3 * TELEMETRY_FRAME_MAX_SAMPLE_SIZE];
+    TelemetryFrameEncoder enc(buf, sizeof(buf));
+    enc.begin(1, 0, 0);
+    int added = 0;
+    while (enc.add(added * 10, 100.0f, 100)) added++;
+    // Room is reserved for a worst-case sample, so at least 3 always fit
+    TEST_ASSERT_GREATER_OR_EQUAL(3, added);
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(buf), enc.size());
+    TEST_ASSERT_EQUAL(added, enc.count());
+}
+
+void test_timestamp_wraps() {
+    uint8_t buf[64];
+    TelemetryFrameEncoder enc(buf, sizeof(buf));
+    enc.begin(1, 0xFFFFFFF0u, 0);
+    enc.add(0xFFFFFFF0u, 100.0f, 100);
+    enc.add(0x00000004u, 100.0f, 100);
+
+    TelemetryFrameDecoder dec;
+    FrameSample s;
+    TEST_ASSERT_TRUE(dec.begin(enc.data(), enc.size()));
+    TEST_ASSERT_TRUE(dec.next(s));
+    TEST_ASSERT_TRUE(dec.next(s));
+    TEST_ASSERT_EQUAL_UINT32(4, s.timestamp);
+}
+
+void test_rejects_bad_input() {
+    uint8_t buf[128];
+    TelemetryFrameEncoder enc(buf, sizeof(buf));
+    enc.begin(1, 0, 0);
+    for (int i = 0; i < 5; i++) enc.add(i * 10, 200.0f + i, 100);
+
+    TelemetryFrameDecoder dec;
+    FrameSample s;
+
+    // Truncated: header promises 5 samples
+    TEST_ASSERT_TRUE(dec.begin(enc.data(), enc.size() - 3));
+    int decoded = 0;
+    while (dec.next(s)) decoded++;
+    TEST_ASSERT_LESS_THAN(5, decoded);
+    TEST_ASSERT_TRUE(dec.error());
+
+    // Wrong magic / version / too short
+    buf[2] = TELEMETRY_FRAME_VERSION + 1;
+    TEST_ASSERT_FALSE(dec.begin(buf, enc.size()));
+    buf[2] = TELEMETRY_FRAME_VERSION;
+    buf[0] = '{';
+    TEST_ASSERT_FALSE(dec.begin(buf, enc.size()));
+    TEST_ASSERT_FALSE(dec.begin(buf, 4));
+    TEST_ASSERT_FALSE(dec.next(s));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_steady_stream_is_compact);
+    RUN_TEST(test_full_frame_rejects_samples);
+    RUN_TEST(test_timestamp_wraps);
+    RUN_TEST(test_rejects_bad_input);
+    return UNITY_END();
+}
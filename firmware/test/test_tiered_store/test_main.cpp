@@ -0,0 +1,204 @@
+/**
+ * Kaldor IIoT - SampleRing and TieredSampleStore unit tests (native)
+ *
+ * The cold tier is a SampleJournal on FileJournalStore in a temporary
+ * directory.
+ *
+ * Run with: pio test -e native -f test_tiered_store
+ */
+
+#include <unity.h>
+#include <stdlib.h>
+#include <vector>
+#include "tiered_store.h"
+
+static char dir[40];
+static char prefix[56];
+
+static SensorData sample(uint32_t i) {
+    SensorData d = {};
+    d.bbw = 100.0f + (float)i;
+    d.quality = 90;
+    d.timestamp = i * 10;
+    return d;
+}
+
+static std::vector<uint32_t> readSeqs(TieredSampleStore& s, uint32_t from, size_t max,
+                                      std::vector<SensorData>* out = nullptr) {
+    std::vector<uint32_t> seqs;
+    s.read(from, max, [&](uint32_t seq, const SensorData& d) {
+        seqs.push_back(seq);
+        if (out) out->push_back(d);
+    });
+    return seqs;
+}
+
+static void assertConsecutive(const std::vector<uint32_t>& seqs, uint32_t first) {
+    for (size_t i = 0; i < seqs.size(); i++) {
+        TEST_ASSERT_EQUAL_UINT32(first + i, seqs[i]);
+    }
+}
+
+void setUp() {
+    snprintf(dir, sizeof(dir), "/tmp/kaldor-tiers-XXXXXX");
+    TEST_ASSERT_NOT_NULL(mkdtemp(dir));
+    snprintf(prefix, sizeof(prefix), "%s/journal-", dir);
+}
+
+void tearDown() {
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    (void)system(cmd);
+}
+
+void test_ring_evicts_oldest_and_views_wrap() {
+    SequencedSample storage[4];
+    SampleRing ring;
+    ring.attach(storage, 4);
+
+    SequencedSample evicted;
+    for (uint32_t i = 0; i < 4; i++) {
+        TEST_ASSERT_FALSE(ring.push({i, sample(i)}, evicted));
+    }
+    TEST_ASSERT_TRUE(ring.full());
+    TEST_ASSERT_TRUE(ring.push({4, sample(4)}, evicted));
+    TEST_ASSERT_EQUAL_UINT32(0, evicted.seq);
+    TEST_ASSERT_EQUAL_UINT32(1, ring.front().seq);
+    TEST_ASSERT_EQUAL_UINT32(4, ring.at(3).seq);
+
+    // Contents 1..4 wrap around the end of storage: two runs
+    const SequencedSample* run;
+    size_t n = ring.view(0, run);
+    TEST_ASSERT_EQUAL(3, n);
+    TEST_ASSERT_EQUAL_UINT32(1, run[0].seq);
+    TEST_ASSERT_EQUAL(1, ring.view(n, run));
+    TEST_ASSERT_EQUAL_UINT32(4, run[0].seq);
+    TEST_ASSERT_EQUAL(0, ring.view(4, run));
+
+    ring.dropFront(2);
+    TEST_ASSERT_EQUAL(2, ring.size());
+    TEST_ASSERT_EQUAL_UINT32(3, ring.front().seq);
+}
+
+void test_zero_capacity_ring_passes_through() {
+    SampleRing ring;
+    ring.attach(nullptr, 100);
+    SequencedSample evicted;
+    TEST_ASSERT_EQUAL(0, ring.capacity());
+    TEST_ASSERT_TRUE(ring.push({9, sample(9)}, evicted));
+    TEST_ASSERT_EQUAL_UINT32(9, evicted.seq);
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+void test_samples_cascade_through_tiers_in_order() {
+    FileJournalStore file(prefix);
+    SampleJournal journal(file, 4, 100, 5);
+    journal.begin();
+    SequencedSample hot[8], warm[16];
+    TieredSampleStore store(journal);
+    store.begin(hot, 8, warm, 16);
+
+    for (uint32_t i = 0; i < 50; i++) store.add(sample(i));
+
+    TEST_ASSERT_EQUAL(8, store.hotSize());
+    TEST_ASSERT_EQUAL(16, store.warmSize());
+    TEST_ASSERT_EQUAL(26, store.coldSize());
+    TEST_ASSERT_EQUAL(50, store.size());
+    TEST_ASSERT_EQUAL_UINT32(0, store.oldestSequence());
+    TEST_ASSERT_EQUAL_UINT32(50, store.nextSequence());
+
+    std::vector<SensorData> data;
+    std::vector<uint32_t> seqs = readSeqs(store, 0, 100, &data);
+    TEST_ASSERT_EQUAL(50, seqs.size());
+    assertConsecutive(seqs, 0);
+    TEST_ASSERT_EQUAL_FLOAT(sample(49).bbw, data.back().bbw);
+}
+
+void test_read_from_the_middle_of_each_tier() {
+    FileJournalStore file(prefix);
+    SampleJournal journal(file, 4, 100, 5);
+    journal.begin();
+    SequencedSample hot[8], warm[16];
+    TieredSampleStore store(journal);
+    store.begin(hot, 8, warm, 16);
+    for (uint32_t i = 0; i < 50; i++) store.add(sample(i));
+
+    // Flash 0..25, PSRAM 26..41, RAM 42..49
+    std::vector<uint32_t> seqs = readSeqs(store, 20, 10);
+    TEST_ASSERT_EQUAL(10, seqs.size());
+    assertConsecutive(seqs, 20);
+
+    seqs = readSeqs(store, 30, 15);
+    TEST_ASSERT_EQUAL(15, seqs.size());
+    assertConsecutive(seqs, 30);
+
+    seqs = readSeqs(store, 45, 100);
+    TEST_ASSERT_EQUAL(5, seqs.size());
+    assertConsecutive(seqs, 45);
+
+    TEST_ASSERT_EQUAL(0, readSeqs(store, 50, 100).size());
+}
+
+void test_acknowledge_trims_every_tier() {
+    FileJournalStore file(prefix);
+    SampleJournal journal(file, 4, 10, 5);
+    journal.begin();
+    SequencedSample hot[8], warm[16];
+    TieredSampleStore store(journal);
+    store.begin(hot, 8, warm, 16);
+    for (uint32_t i = 0; i < 50; i++) store.add(sample(i));
+
+    // Flash is trimmed a whole segment at a time, the rings exactly
+    store.acknowledge(33);
+    TEST_ASSERT_EQUAL_UINT32(20, store.oldestSequence());
+    TEST_ASSERT_EQUAL_UINT32(34, readSeqs(store, 34, 100).front());
+    TEST_ASSERT_EQUAL(8, store.warmSize());
+    TEST_ASSERT_EQUAL(8, store.hotSize());
+
+    store.acknowledge(49);
+    TEST_ASSERT_EQUAL(0, store.size());
+    TEST_ASSERT_EQUAL_UINT32(50, store.oldestSequence());
+
+    // Numbering continues after a full drain
+    store.add(sample(50));
+    TEST_ASSERT_EQUAL_UINT32(50, readSeqs(store, 0, 10).front());
+}
+
+void test_persist_survives_restart() {
+    {
+        FileJournalStore file(prefix);
+        SampleJournal journal(file, 4, 100, 5);
+        journal.begin();
+        SequencedSample hot[8], warm[16];
+        TieredSampleStore store(journal);
+        store.begin(hot, 8, warm, 16);
+        for (uint32_t i = 0; i < 30; i++) store.add(sample(i));
+        TEST_ASSERT_TRUE(store.persist());
+        TEST_ASSERT_EQUAL(0, store.hotSize());
+        TEST_ASSERT_EQUAL(30, store.coldSize());
+    }
+
+    FileJournalStore file(prefix);
+    SampleJournal journal(file, 4, 100, 5);
+    journal.begin();
+    SequencedSample hot[8];
+    TieredSampleStore store(journal);
+    store.begin(hot, 8, nullptr, 0);
+    TEST_ASSERT_EQUAL_UINT32(30, store.nextSequence());
+
+    store.add(sample(30));
+    std::vector<uint32_t> seqs = readSeqs(store, 0, 100);
+    TEST_ASSERT_EQUAL(31, seqs.size());
+    assertConsecutive(seqs, 0);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_ring_evicts_oldest_and_views_wrap);
+    RUN_TEST(test_zero_capacity_ring_passes_through);
+    RUN_TEST(test_samples_cascade_through_tiers_in_order);
+    RUN_TEST(test_read_from_the_middle_of_each_tier);
+    RUN_TEST(test_acknowledge_trims_every_tier);
+    RUN_TEST(test_persist_survives_restart);
+    return UNITY_END();
+}
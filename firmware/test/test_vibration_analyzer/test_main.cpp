@@ -0,0 +1,155 @@
+/**
+ * Kaldor IIoT - RealFft and VibrationAnalyzer golden-signal tests (native)
+ *
+ * Run with: pio test -e native -f test_vibration_analyzer
+ */
+
+#include <unity.h>
+#include <math.h>
+#include <stdint.h>
+#include "real_fft.h"
+#include "vibration_analyzer.h"
+
+static const size_t N = 1024;
+static const float RATE_HZ = 800.0f;
+static const float SCALE = 0.004f;       // g per count (ADXL345 full resolution)
+static const float PI_F = 3.14159265359f;
+
+static const float EDGES[] = {1, 10, 50, 150, 400};
+
+static int16_t block[N * VIBRATION_AXES];
+static VibrationAnalyzer<N> analyzer(RATE_HZ, EDGES, 5);
+
+// Amplitudes in g; the x axis carries the signal, y is silent, z is +1 g
+typedef float (*Signal)(size_t i);
+
+static void fill(Signal x) {
+    for (size_t i = 0; i < N; i++) {
+        block[i * 3 + 0] = (int16_t)lroundf(x(i) / SCALE);
+        block[i * 3 + 1] = 0;
+        block[i * 3 + 2] = (int16_t)lroundf(1.0f / SCALE);
+    }
+}
+
+// 0.5 g at 100 Hz (exactly 128 cycles per block)
+static float sine100(size_t i) { return 0.5f * sinf(2 * PI_F * 100.0f * (float)i / RATE_HZ); }
+
+static float square25(size_t i) { return ((i / 16) % 2) ? 0.3f : -0.3f; }
+
+// One 2 g spike every 64 samples
+static float impulses(size_t i) { return (i % 64) == 0 ? 2.0f : 0.0f; }
+
+static uint32_t lcg = 12345;
+static float uniform() {
+    lcg = lcg * 1664525u + 1013904223u;
+    return ((float)(lcg >> 8) + 0.5f) / 16777216.0f;
+}
+static float gaussian(size_t) {
+    return 0.2f * sqrtf(-2.0f * logf(uniform())) * cosf(2 * PI_F * uniform());
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_fft_matches_direct_dft() {
+    const size_t n = 64;
+    RealFft<n> fft;
+    float x[n], spectrum[n];
+    for (size_t i = 0; i < n; i++) {
+        x[i] = sinf(0.37f * (float)i) + 0.25f * cosf(1.9f * (float)i) + (float)(i % 5) * 0.1f;
+        spectrum[i] = x[i];
+    }
+    fft.forward(spectrum);
+
+    for (size_t k = 0; k <= n / 2; k++) {
+        float re = 0, im = 0;
+        for (size_t i = 0; i < n; i++) {
+            float a = -2 * PI_F * (float)(k * i) / (float)n;
+            re += x[i] * cosf(a);
+            im += x[i] * sinf(a);
+        }
+        float gotRe = k == 0 ? spectrum[0] : (k == n / 2 ? spectrum[1] : spectrum[2 * k]);
+        float gotIm = (k == 0 || k == n / 2) ? 0 : spectrum[2 * k + 1];
+        TEST_ASSERT_FLOAT_WITHIN(1e-3f, re, gotRe);
+        TEST_ASSERT_FLOAT_WITHIN(1e-3f, im, gotIm);
+    }
+}
+
+void test_sine_features() {
+    fill(sine100);
+    VibrationFeatures f;
+    analyzer.analyze(block, SCALE, f);
+
+    TEST_ASSERT_FLOAT_WITHIN(0.005f, 0.5f / sqrtf(2.0f), f.axis[0].rms);
+    TEST_ASSERT_FLOAT_WITHIN(0.005f, 0.5f, f.axis[0].peak);
+    TEST_ASSERT_FLOAT_WITHIN(0.02f, sqrtf(2.0f), f.axis[0].crest);
+    TEST_ASSERT_FLOAT_WITHIN(0.02f, 1.5f, f.axis[0].kurtosis);
+
+    // Gravity and silent axes contribute nothing
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0, f.axis[1].rms);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0, f.axis[2].rms);
+    TEST_ASSERT_FLOAT_WITHIN(0.005f, f.axis[0].rms, f.rms);
+
+    // All energy in the 50-150 Hz band, and it equals the mean square
+    TEST_ASSERT_EQUAL(4, f.bandCount);
+    float ms = f.axis[0].rms * f.axis[0].rms;
+    TEST_ASSERT_FLOAT_WITHIN(0.01f * ms, ms, f.bandEnergy[2]);
+    TEST_ASSERT_LESS_THAN(0.001f * ms, f.bandEnergy[0] + f.bandEnergy[1] + f.bandEnergy[3]);
+}
+
+void test_square_wave_has_unit_crest_and_kurtosis() {
+    fill(square25);
+    VibrationFeatures f;
+    analyzer.analyze(block, SCALE, f);
+    TEST_ASSERT_FLOAT_WITHIN(0.005f, 0.3f, f.axis[0].rms);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 1.0f, f.axis[0].crest);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 1.0f, f.axis[0].kurtosis);
+
+    // 25 Hz fundamental carries 8/pi^2 of the power
+    float ms = 0.09f;
+    TEST_ASSERT_FLOAT_WITHIN(0.03f * ms, ms * 8.0f / (PI_F * PI_F), f.bandEnergy[1]);
+}
+
+void test_impulses_raise_kurtosis_and_crest() {
+    fill(impulses);
+    VibrationFeatures f;
+    analyzer.analyze(block, SCALE, f);
+    TEST_ASSERT_GREATER_THAN(50.0f, f.axis[0].kurtosis);
+    TEST_ASSERT_GREATER_THAN(7.0f, f.axis[0].crest);
+}
+
+void test_gaussian_noise_kurtosis_near_three_and_bands_sum_to_variance() {
+    fill(gaussian);
+    VibrationFeatures f;
+    analyzer.analyze(block, SCALE, f);
+    TEST_ASSERT_FLOAT_WITHIN(0.4f, 3.0f, f.axis[0].kurtosis);
+    TEST_ASSERT_FLOAT_WITHIN(0.02f, 0.2f, f.axis[0].rms);
+
+    float total = 0;
+    for (uint8_t b = 0; b < f.bandCount; b++) total += f.bandEnergy[b];
+    float ms = f.axis[0].rms * f.axis[0].rms;
+    // Bands cover 1 Hz..Nyquist, so they hold nearly all the power (the
+    // windowed estimate from one noise block scatters by a few percent)
+    TEST_ASSERT_FLOAT_WITHIN(0.15f * ms, ms, total);
+}
+
+void test_flat_block_is_all_zero() {
+    for (size_t i = 0; i < N * VIBRATION_AXES; i++) block[i] = 250;
+    VibrationFeatures f;
+    analyzer.analyze(block, SCALE, f);
+    TEST_ASSERT_EQUAL_FLOAT(0, f.rms);
+    TEST_ASSERT_EQUAL_FLOAT(0, f.axis[0].crest);
+    TEST_ASSERT_EQUAL_FLOAT(0, f.axis[0].kurtosis);
+    TEST_ASSERT_EQUAL_FLOAT(0, f.bandEnergy[0]);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_fft_matches_direct_dft);
+    RUN_TEST(test_sine_features);
+    RUN_TEST(test_square_wave_has_unit_crest_and_kurtosis);
+    RUN_TEST(test_impulses_raise_kurtosis_and_crest);
+    RUN_TEST(test_gaussian_noise_kurtosis_near_three_and_bands_sum_to_variance);
+    RUN_TEST(test_flat_block_is_all_zero);
+    return UNITY_END();
+}
@@ -0,0 +1,89 @@
+/**
+ * Kaldor IIoT - OTA image packer (host tool)
+ *
+ * Turns a firmware binary into a packed image for a download over the ota
+ * topic: compressed, or with --base a delta against the firmware the
+ * devices are running now. A device refuses a delta whose base does not
+ * match its running image, before writing anything.
+ *
+ *   g++ -std=gnu++17 -O2 -Iinclude tools/ota_pack.cpp -o ota_pack
+ *   ./ota_pack .pio/build/esp32dev/firmware.bin kaldor.kota [--base running.bin]
+ *
+ * The image is decoded again before it is written out, so a packer bug
+ * never reaches a device.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "hal_sim.h"
+#include "ota_image.h"
+
+static bool readFile(const char* path, std::vector<uint8_t>& data) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    uint8_t block[65536];
+    size_t n;
+    while ((n = fread(block, 1, sizeof(block), f)) > 0) data.insert(data.end(), block, block + n);
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+static bool writeFile(const char* path, const std::vector<uint8_t>& data) {
+    FILE* f = fopen(path, "wb");
+    if (!f) return false;
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    return fclose(f) == 0 && ok;
+}
+
+int main(int argc, char** argv) {
+    const char* basePath = nullptr;
+    const char* paths[2] = {nullptr, nullptr};
+    int count = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--base") == 0 && i + 1 < argc) {
+            basePath = argv[++i];
+        } else if (count < 2 && argv[i][0] != '-') {
+            paths[count++] = argv[i];
+        } else {
+            count = -1;
+            break;
+        }
+    }
+    if (count != 2) {
+        fprintf(stderr, "usage: %s firmware.bin out.kota [--base running.bin]\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<uint8_t> firmware, base;
+    if (!readFile(paths[0], firmware) || firmware.empty()) {
+        fprintf(stderr, "cannot read %s\n", paths[0]);
+        return 1;
+    }
+    if (basePath && (!readFile(basePath, base) || base.empty())) {
+        fprintf(stderr, "cannot read %s\n", basePath);
+        return 1;
+    }
+
+    std::vector<uint8_t> image = otaImagePack(firmware.data(), firmware.size(),
+                                              basePath ? base.data() : nullptr, base.size());
+
+    static uint8_t window[OTA_WINDOW_BYTES];
+    SimFirmware check(base);
+    OtaImageDecoder decoder(check, window, sizeof(window));
+    decoder.begin((uint32_t)image.size());
+    if (!decoder.feed(image.data(), image.size()) || !decoder.finish() ||
+        check.written() != firmware) {
+        fprintf(stderr, "packed image does not decode (%s)\n", otaImageError(decoder.result()));
+        return 1;
+    }
+
+    if (!writeFile(paths[1], image)) {
+        fprintf(stderr, "cannot write %s\n", paths[1]);
+        return 1;
+    }
+    printf("%s: %zu -> %zu bytes (%.1f%%)%s\n", paths[1], firmware.size(), image.size(),
+           100.0 * image.size() / firmware.size(), basePath ? ", delta" : "");
+    return 0;
+}